@@ -0,0 +1,693 @@
+/**
+ * \file BtBaud.c
+ * \brief Implements bluetooth baud rate negotiation
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-01-27
+ *
+ * Link frame: type, operation, rate 32 bit little endian. A proposal is
+ * answered by an accept or reject for the same rate, a probe by a probe ack.
+ * The saved rate is a record of a magic word and the rate at EEPROM_ADDR.
+ */
+
+#include "BtBaud.h"
+
+#include <string.h>
+#include <stdbool.h>
+#include <xdc/runtime/Error.h>
+#include <ti/sysbios/BIOS.h>
+#include <ti/sysbios/knl/Clock.h>
+#include <ti/sysbios/knl/Semaphore.h>
+#include <ti/sysbios/knl/Task.h>
+#include <ti/sysbios/hal/Hwi.h>
+#include <driverlib/sysctl.h>
+#include <driverlib/eeprom.h>
+
+#include "BtStack.h"
+
+#define DEFAULT_PRIORITY 5				//! Default priority of the negotiation task
+#define DEFAULT_STACK 1024				//! Default stack size of the negotiation task
+#define DEFAULT_MAX_BAUD 921600			//! Default fastest rate agreed to
+#define DEFAULT_PREFIX "AT+UART="		//! Default text before the rate in the module command
+#define DEFAULT_SUFFIX ",0,0\r\n"		//! Default text after the rate in the module command
+#define DEFAULT_SETTLE 50				//! Default ms the module needs to apply its command
+#define DEFAULT_INTERVAL 1000			//! Default ms between error rate checks
+#define DEFAULT_ERROR_PERCENT 5			//! Default corrupt frames per hundred which trigger a step down
+#define MIN_CHECK_FRAMES 20				//! Fewest frames in an interval for the error rate to count
+#define RAISE_ATTEMPTS 3				//! Intervals in which the rate is raised before giving up
+#define SILENT_INTERVALS 5				//! Intervals without a good frame before the default rate is tried
+#define REPLY_TIMEOUT 100				//! ms an answer to a proposal or probe is waited for
+#define PROBE_TRIES 3					//! No. of probes sent at a new rate before it is abandoned
+#define COMMAND_SIZE 32					//! Most characters in a module command, terminator included
+#define LINK_SIZE 6						//! No. of bytes in a link frame
+#define EEPROM_ADDR 0					//! Byte address of the saved rate record, word aligned
+#define EEPROM_MAGIC 0x42415544			//! First word of a valid saved rate record
+
+typedef enum
+{
+	OP_PROPOSE = 1,
+	OP_ACCEPT,
+	OP_REJECT,
+	OP_PROBE,
+	OP_PROBE_ACK
+} BtBaud_Op;
+
+static const uint32_t rates[BTBAUD_RATE_COUNT] = {115200, 230400, 460800, 921600};
+
+static Bool hasStart = FALSE;
+static uint32_t maxBaud = DEFAULT_MAX_BAUD;		//! Fastest rate agreed to
+static const char* cmdPrefix = DEFAULT_PREFIX;	//! Text before the rate, NULL for no command
+static const char* cmdSuffix = DEFAULT_SUFFIX;	//! Text after the rate
+static uint16_t settleMs = DEFAULT_SETTLE;		//! ms the module needs to apply its command
+static uint16_t intervalMs = DEFAULT_INTERVAL;	//! ms between error rate checks
+static uint8_t errorPercent = DEFAULT_ERROR_PERCENT;	//! Corrupt frames per hundred which trigger a step down
+
+static Task_Handle task = NULL;				//! Answers proposals and checks the error rate
+static Semaphore_Handle lockSem = NULL;		//! Held while the rate is being changed
+static Semaphore_Handle replySem = NULL;	//! Posted when the awaited answer arrives
+static Semaphore_Handle workSem = NULL;		//! Wakes the task for an accepted proposal
+
+static volatile Bool negotiating;			//! This end is changing the rate, proposals are rejected
+static volatile uint32_t awaitBaud;			//! Rate of the answer being waited for
+static volatile uint8_t replyOp;			//! Operation of the answer which arrived, 0 for none
+static volatile uint32_t proposed;			//! Rate accepted from the peer, 0 for none
+
+static Bool eepromReady = FALSE;			//! EEPROM initialised, the rate can be saved
+static uint32_t savedBaud = 0;				//! Rate in the EEPROM record, 0 for none
+static uint32_t lastFrames;					//! Frames received at the last error rate check
+static uint32_t lastErrors;					//! Reception errors at the last error rate check
+static uint8_t silentCount;					//! Error rate checks in a row without a good frame
+
+static BtBaud_Stats stats;
+
+/**
+ * \brief Function executed by the negotiation task
+ */
+static void taskFxn(UArg unused0, UArg unused1);
+
+/**
+ * \brief Runs in the reception task with baud link frames
+ */
+static void linkFxn(const uint8_t* frame, uint16_t size);
+
+/**
+ * \brief Changes the rate with the peer, lockSem held
+ */
+static int8_t propose(uint32_t baud);
+
+/**
+ * \brief Switches to a rate the peer proposed and waits for its probe, lockSem held
+ */
+static void respond(uint32_t baud);
+
+/**
+ * \brief Sends a link frame and waits for its answer
+ *
+ * \return Operation of the answer, 0 if none arrived
+ */
+static uint8_t await(uint8_t op, uint32_t baud);
+
+/**
+ * \brief Sends a link frame on the control lane
+ */
+static void sendOp(uint8_t op, uint32_t baud);
+
+/**
+ * \brief Reconfigures the module and the UART
+ */
+static int8_t switchTo(uint32_t baud);
+
+/**
+ * \brief Steps down one rate if the reception error rate climbed, falls back if the link went silent
+ *
+ * \return Flag indicating whether the link fell back to the default rate
+ */
+static Bool checkErrors(void);
+
+/**
+ * \brief Probes the current rate and switches to the default rate if nothing answers
+ *
+ * \return Flag indicating whether the rate was switched
+ */
+static Bool fallBack(void);
+
+/**
+ * \brief Takes the reception counters as the start of the next check
+ */
+static void resetErrors(void);
+
+/**
+ * \brief Returns the index of a rate in rates, -1 if not negotiable
+ */
+static int8_t rateIndex(uint32_t baud);
+
+/**
+ * \brief Reads the saved rate, 0 if there is none
+ */
+static uint32_t load(void);
+
+/**
+ * \brief Saves the rate unless it is saved already
+ */
+static void save(uint32_t baud);
+
+int8_t BtBaud_setMaxBaud(uint32_t baud)
+{
+	if (hasStart)
+	{
+		return -1;
+	}
+
+	if (rateIndex(baud) < 0)
+	{
+		return -2;
+	}
+
+	maxBaud = baud;
+	return 0;
+}
+
+int8_t BtBaud_setCommand(const char* prefix, const char* suffix, uint16_t settle)
+{
+	if (hasStart)
+	{
+		return -1;
+	}
+
+	if (suffix == NULL)
+	{
+		suffix = "";
+	}
+
+	// up to 7 digits of rate and the terminator
+	if ((prefix != NULL) && (strlen(prefix) + strlen(suffix) + 8 > COMMAND_SIZE))
+	{
+		return -2;
+	}
+
+	cmdPrefix = prefix;
+	cmdSuffix = suffix;
+	settleMs = settle;
+	return 0;
+}
+
+int8_t BtBaud_setFallback(uint16_t ms, uint8_t percent)
+{
+	if (hasStart)
+	{
+		return -1;
+	}
+
+	if ((ms == 0) || (percent > 100))
+	{
+		return -2;
+	}
+
+	intervalMs = ms;
+	errorPercent = percent;
+	return 0;
+}
+
+int8_t BtBaud_start(void)
+{
+	if (hasStart || BtStack_hasStarted())
+	{
+		return -1;
+	}
+
+	memset(&stats, 0, sizeof(stats));
+	negotiating = FALSE;
+	replyOp = 0;
+	proposed = 0;
+	silentCount = 0;
+
+	// the UART opens at the last rate which carried a probe
+	savedBaud = load();
+	if (savedBaud != 0)
+	{
+		BtStack_setBaud(savedBaud, NULL, 0);
+	}
+
+	Error_Block eb;
+	Error_init(&eb);
+
+	Semaphore_Params semParams;
+	Semaphore_Params_init(&semParams);
+	semParams.mode = Semaphore_Mode_BINARY;
+	lockSem = Semaphore_create(1, &semParams, &eb);
+	replySem = Semaphore_create(0, &semParams, &eb);
+	workSem = Semaphore_create(0, &semParams, &eb);
+	if ((lockSem == NULL) || (replySem == NULL) || (workSem == NULL))
+	{
+		BtBaud_stop();
+		return -2;
+	}
+
+	Task_Params params;
+	Task_Params_init(&params);
+	params.instance->name = "btBaud";
+	params.priority = DEFAULT_PRIORITY;
+	params.stackSize = DEFAULT_STACK;
+	task = Task_create((Task_FuncPtr) taskFxn, &params, &eb);
+	if (task == NULL)
+	{
+		BtBaud_stop();
+		return -2;
+	}
+
+	BtStack_link(KFP_LINK_BAUD, linkFxn);
+
+	hasStart = TRUE;
+	return 0;
+}
+
+int8_t BtBaud_stop(void)
+{
+	if (!hasStart && (lockSem == NULL))
+	{
+		return -1;
+	}
+
+	if (task != NULL)
+	{
+		Task_delete(&task);
+	}
+	if (workSem != NULL)
+	{
+		Semaphore_delete(&workSem);
+	}
+	if (replySem != NULL)
+	{
+		Semaphore_delete(&replySem);
+	}
+	if (lockSem != NULL)
+	{
+		Semaphore_delete(&lockSem);
+	}
+
+	hasStart = FALSE;
+	return 0;
+}
+
+int8_t BtBaud_negotiate(uint32_t baud)
+{
+	if (!hasStart)
+	{
+		return -1;
+	}
+
+	if ((rateIndex(baud) < 0) || (baud > maxBaud))
+	{
+		return -2;
+	}
+
+	Semaphore_pend(lockSem, BIOS_WAIT_FOREVER);
+	negotiating = TRUE;
+	int8_t ret = propose(baud);
+	negotiating = FALSE;
+	Semaphore_post(lockSem);
+
+	return ret;
+}
+
+uint32_t BtBaud_raise(void)
+{
+	if (!hasStart)
+	{
+		return 0;
+	}
+
+	// fastest first, a peer with a lower limit rejects straight away
+	int8_t i;
+	for (i = BTBAUD_RATE_COUNT-1; (i >= 0) && (rates[i] > BtStack_getBaud()); i--)
+	{
+		if ((rates[i] <= maxBaud) && (BtBaud_negotiate(rates[i]) == 0))
+		{
+			break;
+		}
+	}
+
+	return BtStack_getBaud();
+}
+
+void BtBaud_getStats(BtBaud_Stats* out)
+{
+	UInt key = Hwi_disable();
+	*out = stats;
+	Hwi_restore(key);
+	out->baud = BtStack_getBaud();
+}
+
+static void taskFxn(UArg param0, UArg param1)
+{
+	uint8_t raiseAttempts = 0;
+	UInt interval = ((uint32_t)intervalMs * 1000) / Clock_tickPeriod;
+	if (interval == 0)
+	{
+		interval = 1;
+	}
+
+	resetErrors();
+	while (TRUE)
+	{
+		if (Semaphore_pend(workSem, interval))
+		{
+			Semaphore_pend(lockSem, BIOS_WAIT_FOREVER);
+			respond(proposed);
+			proposed = 0;
+			Semaphore_post(lockSem);
+			continue;
+		}
+
+		// a peer found again at the default rate is raised from scratch
+		if (checkErrors())
+		{
+			raiseAttempts = 0;
+		}
+
+		// a rejected raise is tried again, the peer may have been busy
+		if (raiseAttempts < RAISE_ATTEMPTS)
+		{
+			uint32_t before = BtStack_getBaud();
+			raiseAttempts = (BtBaud_raise() != before) ? RAISE_ATTEMPTS : raiseAttempts + 1;
+		}
+	}
+}
+
+static void linkFxn(const uint8_t* frame, uint16_t size)
+{
+	if (size != LINK_SIZE)
+	{
+		return;
+	}
+
+	uint8_t op = frame[1];
+	uint32_t baud = frame[2] | ((uint32_t)frame[3] << 8) | ((uint32_t)frame[4] << 16) | ((uint32_t)frame[5] << 24);
+
+	switch (op)
+	{
+	case OP_PROPOSE:
+		// one change at a time, a busy end refuses
+		if ((rateIndex(baud) < 0) || (baud > maxBaud) || negotiating || (proposed != 0))
+		{
+			sendOp(OP_REJECT, baud);
+		}
+		else
+		{
+			// the task switches once the accept has left
+			sendOp(OP_ACCEPT, baud);
+			proposed = baud;
+			Semaphore_post(workSem);
+		}
+		break;
+
+	case OP_PROBE:
+		sendOp(OP_PROBE_ACK, baud);
+		if ((proposed != 0) && (baud == awaitBaud))
+		{
+			replyOp = op;
+			Semaphore_post(replySem);
+		}
+		break;
+
+	case OP_ACCEPT:
+	case OP_REJECT:
+	case OP_PROBE_ACK:
+		if (negotiating && (baud == awaitBaud))
+		{
+			replyOp = op;
+			Semaphore_post(replySem);
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+static int8_t propose(uint32_t baud)
+{
+	uint32_t old = BtStack_getBaud();
+	if (baud == old)
+	{
+		return 0;
+	}
+
+	stats.proposals++;
+	if (await(OP_PROPOSE, baud) != OP_ACCEPT)
+	{
+		stats.rejected++;
+		return -3;
+	}
+
+	// both ends switch, the probe shows they meet at the new rate
+	if (switchTo(baud) != 0)
+	{
+		stats.probeFailures++;
+		return -4;
+	}
+	uint8_t i;
+	for (i = 0; i < PROBE_TRIES; i++)
+	{
+		if (await(OP_PROBE, baud) == OP_PROBE_ACK)
+		{
+			stats.switches++;
+			save(baud);
+			return 0;
+		}
+	}
+
+	stats.probeFailures++;
+	switchTo(old);
+	return -4;
+}
+
+static void respond(uint32_t baud)
+{
+	uint32_t old = BtStack_getBaud();
+
+	awaitBaud = baud;
+	replyOp = 0;
+	Semaphore_reset(replySem, 0);
+	if (switchTo(baud) != 0)
+	{
+		stats.probeFailures++;
+		return;
+	}
+
+	// the initiator switches about when this end does, then probes
+	UInt wait = (((uint32_t)(PROBE_TRIES+1) * REPLY_TIMEOUT + settleMs) * 1000) / Clock_tickPeriod;
+	if (Semaphore_pend(replySem, wait) && (replyOp == OP_PROBE))
+	{
+		stats.switches++;
+		save(baud);
+		return;
+	}
+
+	stats.probeFailures++;
+	switchTo(old);
+}
+
+static uint8_t await(uint8_t op, uint32_t baud)
+{
+	awaitBaud = baud;
+	replyOp = 0;
+	Semaphore_reset(replySem, 0);
+
+	sendOp(op, baud);
+	Semaphore_pend(replySem, ((uint32_t)REPLY_TIMEOUT * 1000) / Clock_tickPeriod);
+	return replyOp;
+}
+
+static void sendOp(uint8_t op, uint32_t baud)
+{
+	uint8_t frame[LINK_SIZE];
+	frame[0] = KFP_LINK_BAUD;
+	frame[1] = op;
+	frame[2] = baud & 0xFF;
+	frame[3] = (baud >> 8) & 0xFF;
+	frame[4] = (baud >> 16) & 0xFF;
+	frame[5] = baud >> 24;
+	BtStack_pushRaw(frame, LINK_SIZE, BTSTACK_LANE_CONTROL);
+}
+
+static int8_t switchTo(uint32_t baud)
+{
+	char command[COMMAND_SIZE];
+	const char* text = NULL;
+
+	if (cmdPrefix != NULL)
+	{
+		// prefix, rate in decimal, suffix
+		char digits[8];
+		uint8_t n = 0;
+		uint32_t rest = baud;
+		do
+		{
+			digits[n++] = '0' + (rest % 10);
+			rest /= 10;
+		} while ((rest > 0) && (n < sizeof(digits)));
+
+		strcpy(command, cmdPrefix);
+		char* p = command + strlen(command);
+		while (n > 0)
+		{
+			*p++ = digits[--n];
+		}
+		strcpy(p, cmdSuffix);
+		text = command;
+	}
+
+	uint32_t old = BtStack_getBaud();
+	int8_t ret = BtStack_setBaud(baud, text, settleMs);
+	if (ret != 0)
+	{
+		// the UART may have been left closed, restart btStack at the old rate rather than run without one
+		stats.uartFailures++;
+		if (BtStack_stop() == 0)
+		{
+			BtStack_setBaud(old, NULL, 0);
+			BtStack_start();
+		}
+		ret = -2;
+	}
+
+	// errors at the old rate do not count against the new one
+	resetErrors();
+	return ret;
+}
+
+static Bool checkErrors(void)
+{
+	BtStack_RxStats rx;
+	BtStack_getRxStats(&rx);
+	uint32_t good = rx.frames - lastFrames;
+	uint32_t bad = (rx.corruptFrames + rx.hwOverruns) - lastErrors;
+	lastFrames = rx.frames;
+	lastErrors = rx.corruptFrames + rx.hwOverruns;
+
+	// a peer restarted at the default rate decodes as silence or noise, too little for the error rate
+	silentCount = (good == 0) ? silentCount + 1 : 0;
+	if (silentCount >= SILENT_INTERVALS)
+	{
+		silentCount = 0;
+		return fallBack();
+	}
+
+	if ((errorPercent == 0) || (good + bad < MIN_CHECK_FRAMES) || (bad * 100 < (good + bad) * errorPercent))
+	{
+		return FALSE;
+	}
+
+	int8_t index = rateIndex(BtStack_getBaud());
+	if (index <= 0)
+	{
+		return FALSE;
+	}
+
+	// only an accepted step down is taken, an unanswered one is left to the silence fallback
+	stats.fallbacks++;
+	Semaphore_pend(lockSem, BIOS_WAIT_FOREVER);
+	negotiating = TRUE;
+	propose(rates[index-1]);
+	negotiating = FALSE;
+	Semaphore_post(lockSem);
+	return FALSE;
+}
+
+static Bool fallBack(void)
+{
+	uint32_t baud = BtStack_getBaud();
+	if (baud == rates[0])
+	{
+		return FALSE;
+	}
+
+	Semaphore_pend(lockSem, BIOS_WAIT_FOREVER);
+	negotiating = TRUE;
+
+	// a peer which is only idle still answers at this rate
+	uint8_t i;
+	for (i = 0; i < PROBE_TRIES; i++)
+	{
+		if (await(OP_PROBE, baud) == OP_PROBE_ACK)
+		{
+			negotiating = FALSE;
+			Semaphore_post(lockSem);
+			return FALSE;
+		}
+	}
+
+	stats.silentFallbacks++;
+	if (switchTo(rates[0]) == 0)
+	{
+		for (i = 0; i < PROBE_TRIES; i++)
+		{
+			if (await(OP_PROBE, rates[0]) == OP_PROBE_ACK)
+			{
+				save(rates[0]);
+				break;
+			}
+		}
+	}
+
+	negotiating = FALSE;
+	Semaphore_post(lockSem);
+	return TRUE;
+}
+
+static void resetErrors(void)
+{
+	BtStack_RxStats rx;
+	BtStack_getRxStats(&rx);
+	lastFrames = rx.frames;
+	lastErrors = rx.corruptFrames + rx.hwOverruns;
+}
+
+static int8_t rateIndex(uint32_t baud)
+{
+	int8_t i;
+	for (i = 0; i < BTBAUD_RATE_COUNT; i++)
+	{
+		if (rates[i] == baud)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+static uint32_t load(void)
+{
+	SysCtlPeripheralEnable(SYSCTL_PERIPH_EEPROM0);
+	eepromReady = (EEPROMInit() == EEPROM_INIT_OK);
+	if (!eepromReady)
+	{
+		return 0;
+	}
+
+	uint32_t record[2];
+	EEPROMRead(record, EEPROM_ADDR, sizeof(record));
+	if ((record[0] != EEPROM_MAGIC) || (rateIndex(record[1]) < 0) || (record[1] > maxBaud))
+	{
+		return 0;
+	}
+
+	return record[1];
+}
+
+static void save(uint32_t baud)
+{
+	// spare the EEPROM rewriting what it holds
+	if (!eepromReady || (baud == savedBaud))
+	{
+		return;
+	}
+
+	uint32_t record[2] = {EEPROM_MAGIC, baud};
+	if (EEPROMProgram(record, EEPROM_ADDR, sizeof(record)) == 0)
+	{
+		savedBaud = baud;
+	}
+}
@@ -10,27 +10,207 @@
 
 #include <xdc/runtime/Error.h>
 #include <ti/sysbios/knl/Task.h>
+#include <ti/sysbios/knl/Clock.h>
+#include <ti/sysbios/knl/Semaphore.h>
+#include <ti/sysbios/BIOS.h>
+#include <ti/sysbios/hal/Hwi.h>
 #include <xdc/runtime/System.h>
+#include <xdc/runtime/Timestamp.h>
+#include <xdc/runtime/Types.h>
 #include <string.h>
 #include "Board.h"
+#include "ByteRing.h"
+#include "BtUart.h"
+#include "Crc16.h"
 
 #define DEFAULT_RX_PRIORITY 10			//! Default priority of reception task
 #define DEFAULT_RX_STACK 2048			//! Default stack size of reception task
 #define DEFAULT_UART_BAUD 115200		//! Default baud rate for UART
+#define DEFAULT_UART_DMA FALSE			//! Default reception through uDMA rather than the UART driver
+#define DEFAULT_CRC FALSE				//! Default CRC trailer on every frame
+#define DEFAULT_FLOW BTSTACK_FLOW_NONE	//! Default flow control of the reception ring
+#define RX_RING_SIZE 512				//! Size of the ring between UART Hwi and reception task, power of two
+#define RX_RING_WATERMARK 128			//! Fill level at which the reception task is woken again
+#define RX_FLOW_HIGH 384				//! Fill level at which the peer is paused
+#define RX_FLOW_LOW 128					//! Fill level at which a paused peer is resumed
+#define FLOW_PAUSE_MAX 200				//! Longest ms a pause by the peer lasts without a resume
+#define FLOW_SIZE 2						//! No. of bytes in a flow link frame after the marker: type, FLOW_XOFF or FLOW_XON
+#define FLOW_XOFF 0						//! Flow link frame asking the peer to pause
+#define FLOW_XON 1						//! Flow link frame asking the peer to resume
+#define DEFAULT_DISPATCH_PRIORITY 8		//! Default priority of dispatch tasks
+#define DEFAULT_DISPATCH_STACK 1536		//! Default stack size of dispatch tasks
+#define DEFAULT_DISPATCH_WORKERS 1		//! Default no. of dispatch tasks
+#define DEFAULT_DISPATCH_DEPTH 16		//! Default no. of frames queued for dispatch
+#define DEFAULT_DISPATCH_POLICY FRAMEQUEUE_DROP_OLDEST	//! Default behaviour when dispatch falls behind
+#define MAX_DISPATCH_WORKERS 4			//! Most dispatch tasks which can be configured
+#define MAX_DISPATCH_DEPTH 32			//! Most frames which can be queued for dispatch
+#define DISPATCH_POLL 10				//! ms a dispatch task waits for a frame before checking for a pause
+#define STOP_TIMEOUT 1000				//! ms BtStack_stop waits for frame callbacks to return
+#define MAX_STATE_IDS 8					//! Most IDs which can be coalesced
+#define MAX_LINKS 8						//! Most link frame types which can be handled
+#define DEFAULT_TX_PRIORITY 9			//! Default priority of transmission task
+#define DEFAULT_TX_STACK 1024			//! Default stack size of transmission task
+#define TX_CONTROL_RING_SIZE 256		//! Size of the ring of encoded control frames waiting to be sent, power of two
+#define TX_BULK_RING_SIZE 512			//! Size of the ring of encoded bulk frames waiting to be sent, power of two
+#define TX_BULK_QUANTUM 64				//! Most bulk bytes per write unless a single frame is longer
+#define DEFAULT_CONTROL_DEPTH 8			//! Default no. of frames which can wait in the control lane
+#define DEFAULT_BULK_DEPTH 16			//! Default no. of frames which can wait in the bulk lane
+#define MAX_LANE_DEPTH 16				//! Most frames which can wait in a lane
+#define SET_BAUD_DRAIN_MS 100			//! Longest wait for queued frames to leave before the baud rate changes
 
 static Bool hasStart = FALSE;					//! Task started status
 static Task_Handle rxTask = NULL;				//! Handle to the reception task
 static int8_t rxPriority = DEFAULT_RX_PRIORITY;	//! Priority of reception task
 static uint16_t rxStackSize = DEFAULT_RX_STACK;	//! Stack size of reception task
-static BtStack_Callback rxCallback = NULL;		//! Function to call on receive event
+static FrameRouter router;						//! Routes received frames to subscribers, starts empty
+
+static int8_t dispatchPriority = DEFAULT_DISPATCH_PRIORITY;		//! Priority of dispatch tasks
+static uint16_t dispatchStackSize = DEFAULT_DISPATCH_STACK;		//! Stack size of dispatch tasks
+static uint8_t dispatchWorkers = DEFAULT_DISPATCH_WORKERS;		//! No. of dispatch tasks
+static uint16_t dispatchDepth = DEFAULT_DISPATCH_DEPTH;			//! No. of frames queued for dispatch
+static FrameQueue_Policy dispatchPolicy = DEFAULT_DISPATCH_POLICY;	//! Behaviour when dispatch falls behind
+static uint32_t stateIds[MAX_STATE_IDS];		//! IDs of frames coalesced while waiting for dispatch
+static uint8_t stateCount = 0;					//! No. of entries in stateIds
+static uint8_t linkTypes[MAX_LINKS];			//! Type bytes of handled link frames
+static BtStack_LinkFxn linkFxns[MAX_LINKS];		//! Handler of each entry in linkTypes
+static uint8_t linkCount = 0;					//! No. of entries in linkTypes
+
+static Task_Handle txTask = NULL;				//! Handle to the transmission task
+static int8_t txPriority = DEFAULT_TX_PRIORITY;	//! Priority of transmission task
+static uint16_t txStackSize = DEFAULT_TX_STACK;	//! Stack size of transmission task
+static uint8_t laneDepth[BTSTACK_LANE_COUNT] = {DEFAULT_CONTROL_DEPTH, DEFAULT_BULK_DEPTH};	//! Frames which can wait per lane
+
+/**
+ * \struct BtStack_TxLane
+ * \brief Frames of one priority waiting to be sent
+ */
+typedef struct
+{
+	ByteRing ring;						//! Encoded frames waiting to be sent
+	uint16_t frameLen[MAX_LANE_DEPTH];	//! Encoded size of each waiting frame, oldest at frameHead
+	uint32_t frameTime[MAX_LANE_DEPTH];	//! Timestamp each waiting frame was pushed at
+	uint8_t frameHead;					//! Index of the oldest waiting frame
+	uint8_t frameCount;					//! No. of waiting frames
+	uint8_t inFlight;					//! No. of frames at the front being written
+
+	uint32_t frames;					//! No. of frames queued
+	uint32_t queueFull;					//! No. of frames refused because the lane was full
+	uint32_t sent;						//! No. of frames written
+	uint32_t latencyTotal;				//! Sum of push to written times, timestamp ticks
+	uint32_t latencyMax;				//! Longest push to written time, timestamp ticks
+} BtStack_TxLane;
 
 static uint32_t uartBaud = DEFAULT_UART_BAUD;	//! Baud rate to initiate UART peripheral to
+static Bool uartDma = DEFAULT_UART_DMA;			//! Receive through uDMA ping-pong blocks
+static Bool crcEnabled = DEFAULT_CRC;			//! Frames carry a CRC-16 trailer both ways
+static BtStack_Flow flowMode = DEFAULT_FLOW;	//! How the peer is held off while the reception ring is nearly full
+static uint32_t urgentId;						//! ID handled at interrupt level
+static BtStack_UrgentFxn urgentFxn = NULL;		//! Called in Hwi context with frames of urgentId, NULL for none
+
+/**
+ * \struct BtStack_Session
+ * \brief Resources owned by the service between BtStack_start and BtStack_stop
+ */
+typedef struct
+{
+	Bool uartOpen;						//! Bluetooth UART, opened once for the lifetime of the service
+	ByteRing rxRing;					//! Bytes received in Hwi context, waiting to be decoded
+	uint8_t rxRingBuf[RX_RING_SIZE];	//! Storage of rxRing
+	Semaphore_Handle rxSem;				//! Wakes the reception task
+	Slip_Decoder decoder;				//! Decodes the contents of rxRing
+	uint32_t rxBadSize;					//! No. of frames dropped for wrong size
+	uint32_t rxBadCrc;					//! No. of frames dropped for CRC mismatch
+	Slip_Decoder urgentDecoder;			//! Decodes received bytes in Hwi context, looking for urgentId
+	uint32_t rxUrgent;					//! No. of frames handed to urgentFxn
+
+	FrameQueue dispatchQueue;						//! Frames waiting for a dispatch task
+	BtStack_Frame dispatchSlots[MAX_DISPATCH_DEPTH];	//! Storage of dispatchQueue
+	Bool dispatchQueueCreated;						//! dispatchQueue needs deleting
+	Task_Handle dispatchTask[MAX_DISPATCH_WORKERS];	//! Tasks running frame callbacks
+	volatile Bool dispatchPaused;					//! Dispatch tasks take no more frames
+	volatile uint8_t dispatchBusy;					//! No. of dispatch tasks taking or handling a frame
+
+	BtStack_TxLane txLane[BTSTACK_LANE_COUNT];		//! Frames waiting to be sent, by priority
+	uint8_t txControlBuf[TX_CONTROL_RING_SIZE];		//! Storage of the control lane ring
+	uint8_t txBulkBuf[TX_BULK_RING_SIZE];			//! Storage of the bulk lane ring
+	Semaphore_Handle txSem;				//! Wakes the transmission task
+	volatile Bool txBusy;				//! Frames at the front of txLane[txBusyLane] are being written
+	uint8_t txBusyLane;					//! Lane being written, BTSTACK_LANE_COUNT for a flow frame
+	BtStack_TxStats txStats;			//! Transmission counters
+
+	volatile int8_t flowSend;			//! Flow frame waiting to be sent, FLOW_XOFF or FLOW_XON, -1 for none
+	uint8_t flowFrame[2][SLIP_WORST_SIZE(1 + FLOW_SIZE + CRC16_SIZE)];	//! Encoded flow frames, by FLOW_XOFF and FLOW_XON
+	uint16_t flowLen[2];				//! Encoded size of each flow frame
+	volatile Bool rxThrottled;			//! The peer has been asked to pause
+	uint32_t rxThrottleStart;			//! Timestamp the peer was asked to pause at
+	volatile Bool txPaused;				//! The peer asked this end to pause
+	uint32_t txPauseStart;				//! Timestamp the peer asked this end to pause at
+	uint32_t ticksPerUs;				//! Timestamp ticks per microsecond
+	BtStack_FlowStats flowStats;		//! Flow control counters
+} BtStack_Session;
+
+static BtStack_Session session;			//! Session of the running service
 
 /**
  * \brief Function executed by the reception task
  */
 void rxFxn(UArg unused0, UArg unused1);
 
+/**
+ * \brief Function executed by the transmission task
+ */
+static void txFxn(UArg unused0, UArg unused1);
+
+/**
+ * \brief Called once a transmission has been taken by the UART, frees its bytes in the ring
+ */
+static void txDoneFxn(uint16_t len);
+
+/**
+ * \brief Function executed by the dispatch tasks
+ */
+static void dispatchFxn(UArg unused0, UArg unused1);
+
+/**
+ * \brief Runs in Hwi context after bytes were added to the reception ring
+ */
+static void rxNotifyFxn(uint16_t before, uint16_t added);
+
+/**
+ * \brief Called by the SLIP decoder for every complete frame
+ */
+static void rxFrameFxn(const uint8_t* frame, uint16_t size, void* arg);
+
+/**
+ * \brief Runs in Hwi context with received bytes before they reach the reception ring
+ */
+static void rxScanFxn(const uint8_t* data, uint16_t len);
+
+/**
+ * \brief Called by the interrupt level SLIP decoder for every complete frame
+ */
+static void urgentFrameFxn(const uint8_t* frame, uint16_t size, void* arg);
+
+/**
+ * \brief Pauses or resumes the peer, from Hwi or task context
+ */
+static void rxThrottle(Bool on);
+
+/**
+ * \brief Pauses or resumes transmission at the peer's request
+ */
+static void txPause(Bool on);
+
+/**
+ * \brief Encodes a frame into a lane, with a CRC trailer if enabled
+ */
+static int16_t pushFrame(const uint8_t* frame, uint16_t size, BtStack_Lane lane);
+
+/**
+ * \brief Releases everything held by the session
+ */
+static void sessionClose(void);
+
 int8_t BtStack_start(void)
 {
 	if (rxTask != NULL)
@@ -39,135 +219,738 @@ int8_t BtStack_start(void)
 		return -1;
 	}
 
-	// creating the task
+	Error_Block eb;
+	Error_init(&eb);
+
+	// subscriptions are fixed from here until the service stops
+	FrameRouter_build(&router);
+
+	// reception ring and the semaphore which signals it
+	ByteRing_init(&session.rxRing, session.rxRingBuf, RX_RING_SIZE);
+	Slip_decoderInit(&session.decoder, rxFrameFxn, NULL);
+	session.rxBadSize = 0;
+	session.rxBadCrc = 0;
+	Slip_decoderInit(&session.urgentDecoder, urgentFrameFxn, NULL);
+	session.rxUrgent = 0;
+
+	Semaphore_Params semParams;
+	Semaphore_Params_init(&semParams);
+	semParams.mode = Semaphore_Mode_BINARY;
+	session.rxSem = Semaphore_create(0, &semParams, &eb);
+	if (session.rxSem == NULL)
+	{
+		return -2;
+	}
+
+	// transmission ring and the semaphore which signals it
+	memset(session.txLane, 0, sizeof(session.txLane));
+	ByteRing_init(&session.txLane[BTSTACK_LANE_CONTROL].ring, session.txControlBuf, TX_CONTROL_RING_SIZE);
+	ByteRing_init(&session.txLane[BTSTACK_LANE_BULK].ring, session.txBulkBuf, TX_BULK_RING_SIZE);
+	session.txBusy = FALSE;
+	memset(&session.txStats, 0, sizeof(session.txStats));
+
+	// flow frames are encoded once, they are sent ahead of both lanes
+	uint8_t state;
+	for (state = FLOW_XOFF; state <= FLOW_XON; state++)
+	{
+		uint8_t raw[1 + FLOW_SIZE + CRC16_SIZE] = {KFP_LINK_MARKER, KFP_LINK_FLOW, state};
+		uint16_t rawSize = 1 + FLOW_SIZE;
+		if (crcEnabled)
+		{
+			uint16_t crc = Crc16_compute(raw, rawSize);
+			raw[rawSize] = crc >> 8;
+			raw[rawSize+1] = crc & 0xFF;
+			rawSize += CRC16_SIZE;
+		}
+		session.flowLen[state] = Slip_encode(session.flowFrame[state], raw, rawSize);
+	}
+	session.flowSend = -1;
+	session.rxThrottled = FALSE;
+	session.txPaused = FALSE;
+	memset(&session.flowStats, 0, sizeof(session.flowStats));
+
+	Types_FreqHz freq;
+	Timestamp_getFreq(&freq);
+	session.ticksPerUs = freq.lo / 1000000;
+	if (session.ticksPerUs == 0)
+	{
+		session.ticksPerUs = 1;
+	}
+
+	session.txSem = Semaphore_create(0, &semParams, &eb);
+	if (session.txSem == NULL)
+	{
+		sessionClose();
+		return -2;
+	}
+
+	// creating the task before reception starts, it owns the decoder
+
 	Task_Params params;
 	Task_Params_init(&params);
 	params.instance->name = "btStack::rx";
 	params.priority = rxPriority;
 	params.stackSize = rxStackSize;
 
-	Error_Block eb;
-	Error_init(&eb);
-
 	rxTask = Task_create((Task_FuncPtr) rxFxn, &params, &eb);
 	if (rxTask == NULL)
 	{
+		sessionClose();
 		return -2;
 	}
-	else
+
+	// frames are handed over to dispatch tasks so callbacks never hold up reception
+	if (FrameQueue_create(&session.dispatchQueue, session.dispatchSlots, dispatchDepth, dispatchPolicy) != 0)
 	{
-		hasStart = TRUE;
-		return 0;
+		sessionClose();
+		return -2;
+	}
+	session.dispatchQueueCreated = TRUE;
+	FrameQueue_setStateIds(&session.dispatchQueue, stateIds, stateCount);
+	FrameQueue_setKeptIds(&session.dispatchQueue, &urgentId, (urgentFxn != NULL) ? 1 : 0);
+
+	session.dispatchPaused = FALSE;
+	session.dispatchBusy = 0;
+
+	Task_Params_init(&params);
+	params.instance->name = "btStack::dispatch";
+	params.priority = dispatchPriority;
+	params.stackSize = dispatchStackSize;
+
+	uint8_t i;
+	for (i=0; i<dispatchWorkers; i++)
+	{
+		session.dispatchTask[i] = Task_create((Task_FuncPtr) dispatchFxn, &params, &eb);
+		if (session.dispatchTask[i] == NULL)
+		{
+			sessionClose();
+			return -2;
+		}
+	}
+
+	// transmission task writes pending frames in batches
+	Task_Params_init(&params);
+	params.instance->name = "btStack::tx";
+	params.priority = txPriority;
+	params.stackSize = txStackSize;
+
+	txTask = Task_create((Task_FuncPtr) txFxn, &params, &eb);
+	if (txTask == NULL)
+	{
+		sessionClose();
+		return -2;
 	}
+
+	// open the bluetooth UART once, it is shared by reception and transmission
+	BtUart_Params uartParams;
+	uartParams.baud = uartBaud;
+	uartParams.useDma = uartDma;
+	uartParams.flowPins = (flowMode == BTSTACK_FLOW_RTSCTS);
+	uartParams.rxRing = &session.rxRing;
+	uartParams.rxFxn = rxNotifyFxn;
+	uartParams.scanFxn = (urgentFxn != NULL) ? rxScanFxn : NULL;
+	uartParams.txDoneFxn = txDoneFxn;
+	if (BtUart_open(&uartParams) != 0)
+	{
+		sessionClose();
+		return -3;
+	}
+	session.uartOpen = TRUE;
+
+	hasStart = TRUE;
+	return 0;
 }
 
 int8_t BtStack_stop(void)
 {
-	Task_delete(&rxTask);
+	if (!hasStart)
+	{
+		// service not running
+		return -1;
+	}
+
+	// a callback stopping the service would wait for itself
+	Task_Handle self = Task_self();
+	uint8_t i;
+	for (i=0; i<MAX_DISPATCH_WORKERS; i++)
+	{
+		if ((session.dispatchTask[i] != NULL) && (session.dispatchTask[i] == self))
+		{
+			return -3;
+		}
+	}
+
+	// callbacks may be waiting on their own stack, e.g. for a bus transfer, let them return first
+	session.dispatchPaused = TRUE;
+	uint32_t stopTicks = ((uint32_t)STOP_TIMEOUT * 1000) / Clock_tickPeriod;
+	uint32_t waited = 0;
+	while (session.dispatchBusy > 0)
+	{
+		if (waited++ >= stopTicks)
+		{
+			// a callback is stuck, deleting its task would free a stack still in use
+			session.dispatchPaused = FALSE;
+			return -2;
+		}
+		Task_sleep(1);
+	}
+
+	sessionClose();
 	hasStart = FALSE;
 
 	return 0;
 }
 
+void BtStack_getRxStats(BtStack_RxStats* stats)
+{
+	BtUart_Stats uartStats;
+	BtUart_getStats(&uartStats);
+
+	stats->frames = session.decoder.frames - session.rxBadSize - session.rxBadCrc;
+	stats->ringOverruns = session.rxRing.overruns;
+	stats->hwOverruns = uartStats.hwOverruns;
+	stats->crcErrors = session.rxBadCrc;
+	stats->urgentFrames = session.rxUrgent;
+	stats->corruptFrames = session.decoder.escErrors + session.decoder.overruns + session.rxBadSize + session.rxBadCrc;
+}
+
+int8_t BtStack_setCrc(Bool enable)
+{
+	if (hasStart)
+	{
+		return -1;
+	}
+
+	crcEnabled = enable;
+	return 0;
+}
+
+int8_t BtStack_setUrgent(uint32_t id, BtStack_UrgentFxn fxn)
+{
+	if (hasStart)
+	{
+		return -1;
+	}
+
+	urgentId = id;
+	urgentFxn = fxn;
+	return 0;
+}
+
+int8_t BtStack_setFlow(BtStack_Flow flow)
+{
+	if (hasStart)
+	{
+		return -1;
+	}
+
+	if (flow > BTSTACK_FLOW_INBAND)
+	{
+		return -2;
+	}
+
+	flowMode = flow;
+	return 0;
+}
+
+void BtStack_getFlowStats(BtStack_FlowStats* stats)
+{
+	UInt key = Hwi_disable();
+	*stats = session.flowStats;
+	uint32_t now = Timestamp_get32();
+	if (session.rxThrottled)
+	{
+		stats->rxThrottledUs += (now - session.rxThrottleStart) / session.ticksPerUs;
+	}
+	if (session.txPaused)
+	{
+		stats->txPausedUs += (now - session.txPauseStart) / session.ticksPerUs;
+	}
+	Hwi_restore(key);
+}
+
+int8_t BtStack_setDispatch(uint8_t workers, uint16_t depth, FrameQueue_Policy policy)
+{
+	if (hasStart)
+	{
+		return -1;
+	}
+
+	if ((workers == 0) || (workers > MAX_DISPATCH_WORKERS) || (depth == 0) || (depth > MAX_DISPATCH_DEPTH))
+	{
+		return -2;
+	}
+
+	dispatchWorkers = workers;
+	dispatchDepth = depth;
+	dispatchPolicy = policy;
+	return 0;
+}
+
+int8_t BtStack_coalesce(uint32_t id)
+{
+	if (hasStart)
+	{
+		return -1;
+	}
+
+	if (stateCount == MAX_STATE_IDS)
+	{
+		return -2;
+	}
+
+	stateIds[stateCount] = id;
+	stateCount++;
+	return 0;
+}
+
+void BtStack_getDispatchStats(FrameQueue_Stats* stats)
+{
+	FrameQueue_getStats(&session.dispatchQueue, stats);
+}
+
 Bool BtStack_hasStarted(void)
 {
 	return hasStart;
 }
 
-Bool BtStack_hasCallback(void)
+int8_t BtStack_subscribe(uint32_t id, uint32_t mask, BtStack_Callback callback)
 {
-	if (rxCallback == NULL)
+	if (hasStart)
 	{
-		return FALSE;
+		return -1;
 	}
-	else
+
+	if (callback == NULL)
 	{
-		return TRUE;
+		return -3;
 	}
+
+	return FrameRouter_add(&router, id, mask, callback) == 0 ? 0 : -2;
 }
 
-int8_t BtStack_attachCallback(BtStack_Callback callback)
+int8_t BtStack_clearSubscriptions(void)
 {
-	if (BtStack_hasCallback())
+	if (hasStart)
 	{
 		return -1;
 	}
-	else
+
+	FrameRouter_init(&router);
+	return 0;
+}
+
+int8_t BtStack_push(const BtStack_Frame* frame)
+{
+	return BtStack_pushLane(frame, BTSTACK_LANE_CONTROL);
+}
+
+int8_t BtStack_pushLane(const BtStack_Frame* frame, BtStack_Lane lane)
+{
+	if (frame->b8[0] == KFP_LINK_MARKER)
 	{
-		rxCallback = callback;
-		return 0;
+		// would be taken for a link frame
+		return -3;
 	}
+
+	return (int8_t)pushFrame(frame->b8, KFP_FRAME_SIZE-2, lane);
 }
 
-int8_t BtStack_removeCallback(void)
+int16_t BtStack_pushRaw(const uint8_t* frame, uint16_t size, BtStack_Lane lane)
 {
-	if (BtStack_hasCallback())
+	if ((size == 0) || (size > BTSTACK_MAX_RAW))
+	{
+		return -3;
+	}
+
+	uint8_t link[SLIP_MAX_FRAME];
+	link[0] = KFP_LINK_MARKER;
+	memcpy(&link[1], frame, size);
+	return pushFrame(link, size + 1, lane);
+}
+
+static int16_t pushFrame(const uint8_t* frame, uint16_t size, BtStack_Lane lane)
+{
+	if (!hasStart)
+	{
+		// no session to write to
+		return -1;
+	}
+
+	if (lane >= BTSTACK_LANE_COUNT)
+	{
+		return -3;
+	}
+
+	// frame and its trailer contiguous for the encoder
+	const uint8_t* raw = frame;
+	uint16_t rawSize = size;
+	uint8_t withCrc[SLIP_MAX_FRAME];
+	if (crcEnabled)
+	{
+		uint16_t crc = Crc16_compute(frame, size);
+		memcpy(withCrc, frame, size);
+		withCrc[size] = crc >> 8;
+		withCrc[size+1] = crc & 0xFF;
+		raw = withCrc;
+		rawSize += CRC16_SIZE;
+	}
+
+	// encoded before the lock, interrupts are only held off for the copy
+	uint8_t sendStream[SLIP_WORST_SIZE(SLIP_MAX_FRAME)];
+	uint16_t sentChar = Slip_encode(sendStream, raw, rawSize);
+	uint16_t capacity = (lane == BTSTACK_LANE_CONTROL) ? TX_CONTROL_RING_SIZE : TX_BULK_RING_SIZE;
+	if (sentChar > capacity)
+	{
+		// would never fit, however long the caller waits
+		return -4;
+	}
+
+	BtStack_TxLane* txLane = &session.txLane[lane];
+	UInt key = Hwi_disable();
+
+	if ((txLane->frameCount >= laneDepth[lane]) || (ByteRing_space(&txLane->ring) < sentChar))
 	{
-		rxCallback = NULL;
+		txLane->queueFull++;
+		session.txStats.queueFull++;
+		Hwi_restore(key);
+		return -2;
+	}
+	ByteRing_write(&txLane->ring, sendStream, sentChar);
+
+	uint8_t slot = (txLane->frameHead + txLane->frameCount) % MAX_LANE_DEPTH;
+	txLane->frameLen[slot] = sentChar;
+	txLane->frameTime[slot] = Timestamp_get32();
+	txLane->frameCount++;
+	txLane->frames++;
+	session.txStats.frames++;
+	Hwi_restore(key);
+
+	Semaphore_post(session.txSem);
+	return sentChar;
+}
+
+int8_t BtStack_setBaud(uint32_t baud, const char* command, uint16_t settleMs)
+{
+	if (!hasStart)
+	{
+		// taken when the UART is next opened
+		uartBaud = baud;
 		return 0;
 	}
+
+	// let queued frames leave at the old rate, then hold the transmission task off the UART
+	uint32_t drainTicks = ((uint32_t)SET_BAUD_DRAIN_MS * 1000) / Clock_tickPeriod;
+	uint32_t waited = 0;
+	while (TRUE)
+	{
+		UInt key = Hwi_disable();
+		Bool drained = (session.txLane[BTSTACK_LANE_CONTROL].frameCount == 0) &&
+				(session.txLane[BTSTACK_LANE_BULK].frameCount == 0);
+		if (!session.txBusy && (drained || (waited >= drainTicks)))
+		{
+			session.txBusy = TRUE;
+			Hwi_restore(key);
+			break;
+		}
+		Hwi_restore(key);
+
+		Task_sleep(1);
+		waited++;
+	}
+
+	if (command != NULL)
+	{
+		BtUart_write((const uint8_t*) command, strlen(command));
+	}
+
+	// the module applies its new rate once it has answered the command
+	if (settleMs > 0)
+	{
+		Task_sleep(((uint32_t)settleMs * 1000) / Clock_tickPeriod + 1);
+	}
+
+	int8_t ret = 0;
+	int8_t status = BtUart_setBaud(baud);
+	if (status == 0)
+	{
+		uartBaud = baud;
+	}
 	else
 	{
-		return -1;
+		// a UART which failed to reopen was left closed
+		if (status == -2)
+		{
+			session.uartOpen = FALSE;
+		}
+		ret = -2;
 	}
+
+	// frames queued meanwhile go out at the new rate
+	session.txBusy = FALSE;
+	Semaphore_post(session.txSem);
+	return ret;
 }
 
-int8_t BtStack_push(const BtStack_Frame* frame)
+uint32_t BtStack_getBaud(void)
 {
-	// special character declarations
-	const char escapedEnd[] = {SLIP_ESC, SLIP_ESC_END};	// escaped 0xC0
-	const char escapedEsc[] = {SLIP_ESC, SLIP_ESC_ESC};	// escaped 0xDB
+	return uartBaud;
+}
 
-	char sendStream[KFP_WORST_SIZE];
-	uint8_t sentChar = 0;
+int8_t BtStack_link(uint8_t type, BtStack_LinkFxn fxn)
+{
+	if (hasStart)
+	{
+		return -1;
+	}
 
-	// append start character
-	sendStream[0] = SLIP_END;
-	sentChar++;
+	if (fxn == NULL)
+	{
+		return -3;
+	}
 
-	// iterate through frame adding ESC characters where necessary
 	uint8_t i;
-	for (i=0; i<KFP_FRAME_SIZE-2; i++)
+	for (i=0; i<linkCount; i++)
 	{
-		switch(frame->b8[i])
+		if (linkTypes[i] == type)
 		{
-		case(SLIP_END):
-				// escape END character
-				strncat(sendStream, escapedEnd, 2);
-				sentChar+=2;
-				break;
-		case(SLIP_ESC):
-				// escape ESC character
-				strncat(sendStream, escapedEsc, 2);
-				sentChar+=2;
-				break;
-		default:
-				sendStream[sentChar] = frame->b8[i];
-				sentChar++;
+			linkFxns[i] = fxn;
+			return 0;
 		}
 	}
 
-	// append end character
-	sendStream[sentChar] = SLIP_END;
-	sentChar++;
+	if (linkCount == MAX_LINKS)
+	{
+		return -2;
+	}
 
-	// prepare UART socket
-	UART_Handle s;
-	UART_Params params;
-	UART_Params_init(&params);
-	params.baudRate = uartBaud;
-	params.writeMode = UART_MODE_BLOCKING;
-	params.writeDataMode = UART_DATA_BINARY;
-	params.readDataMode = UART_DATA_BINARY;
-	params.readReturnMode = UART_RETURN_FULL;
-	params.readEcho = UART_ECHO_OFF;
-	s = UART_open(Board_BT1, &params);
+	linkTypes[linkCount] = type;
+	linkFxns[linkCount] = fxn;
+	linkCount++;
+	return 0;
+}
 
-	// write to socket and close once complete
-	int8_t ret = UART_write(s, sendStream, sentChar);
-	UART_close(s);
+int8_t BtStack_deliver(const BtStack_Frame* frame)
+{
+	if (!hasStart)
+	{
+		return -1;
+	}
 
-	return ret;
+	return (FrameQueue_put(&session.dispatchQueue, frame) == 0) ? 0 : -2;
+}
+
+int8_t BtStack_setLaneDepth(BtStack_Lane lane, uint8_t depth)
+{
+	if (hasStart)
+	{
+		return -1;
+	}
+
+	if ((lane >= BTSTACK_LANE_COUNT) || (depth == 0) || (depth > MAX_LANE_DEPTH))
+	{
+		return -2;
+	}
+
+	laneDepth[lane] = depth;
+	return 0;
+}
+
+void BtStack_getTxStats(BtStack_TxStats* stats)
+{
+	UInt key = Hwi_disable();
+	*stats = session.txStats;
+	Hwi_restore(key);
+}
+
+void BtStack_getLaneStats(BtStack_Lane lane, BtStack_LaneStats* stats)
+{
+	if (lane >= BTSTACK_LANE_COUNT)
+	{
+		memset(stats, 0, sizeof(BtStack_LaneStats));
+		return;
+	}
+
+	const BtStack_TxLane* txLane = &session.txLane[lane];
+
+	UInt key = Hwi_disable();
+	stats->frames = txLane->frames;
+	stats->queueFull = txLane->queueFull;
+	stats->sent = txLane->sent;
+	uint32_t total = txLane->latencyTotal;
+	uint32_t max = txLane->latencyMax;
+	Hwi_restore(key);
+
+	// ticksPerUs is only known once the service has been started
+	uint32_t ticksPerUs = (session.ticksPerUs > 0) ? session.ticksPerUs : 1;
+	stats->maxLatencyUs = max / ticksPerUs;
+	stats->meanLatencyUs = (stats->sent > 0) ? (total / stats->sent) / ticksPerUs : 0;
+}
+
+static void txFxn(UArg param0, UArg param1)
+{
+	UInt pauseTicks = ((uint32_t)FLOW_PAUSE_MAX * 1000) / Clock_tickPeriod + 1;
+
+	while(TRUE)
+	{
+		// a pause which is never resumed must not stop transmission for good
+		Semaphore_pend(session.txSem, session.txPaused ? pauseTicks : BIOS_WAIT_FOREVER);
+
+		// strict priority, control frames all go at once, bulk frames in quanta of whole frames,
+		// a SLIP frame cannot be split since a control frame written between its parts would end it
+		BtStack_TxLane* txLane;
+		uint16_t bytes = 0;
+
+		UInt key = Hwi_disable();
+
+		// txDoneFxn or BtStack_setBaud wakes this task again once the UART is free
+		if (session.txBusy)
+		{
+			Hwi_restore(key);
+			continue;
+		}
+
+		// flow frames overtake both lanes and go out while paused
+		if (session.flowSend >= 0)
+		{
+			BtUart_Span span;
+			span.data = session.flowFrame[session.flowSend];
+			span.len = session.flowLen[session.flowSend];
+			session.flowSend = -1;
+			session.txBusy = TRUE;
+			session.txBusyLane = BTSTACK_LANE_COUNT;
+			Hwi_restore(key);
+
+			if (BtUart_writeSpans(&span, 1) != 0)
+			{
+				session.txBusy = FALSE;
+			}
+			continue;
+		}
+
+		if (session.txPaused)
+		{
+			Bool expired = (Timestamp_get32() - session.txPauseStart) / session.ticksPerUs >= (uint32_t)FLOW_PAUSE_MAX * 1000;
+			if (expired)
+			{
+				session.flowStats.pauseTimeouts++;
+			}
+			Hwi_restore(key);
+			if (expired)
+			{
+				txPause(FALSE);
+			}
+			continue;
+		}
+
+		BtStack_TxLane* control = &session.txLane[BTSTACK_LANE_CONTROL];
+		BtStack_TxLane* bulk = &session.txLane[BTSTACK_LANE_BULK];
+		if (control->frameCount > 0)
+		{
+			session.txBusyLane = BTSTACK_LANE_CONTROL;
+			txLane = control;
+			while (txLane->inFlight < txLane->frameCount)
+			{
+				bytes += txLane->frameLen[(txLane->frameHead + txLane->inFlight) % MAX_LANE_DEPTH];
+				txLane->inFlight++;
+			}
+		}
+		else
+		{
+			session.txBusyLane = BTSTACK_LANE_BULK;
+			txLane = bulk;
+			while (txLane->inFlight < txLane->frameCount)
+			{
+				uint16_t len = txLane->frameLen[(txLane->frameHead + txLane->inFlight) % MAX_LANE_DEPTH];
+				if ((txLane->inFlight > 0) && (bytes + len > TX_BULK_QUANTUM))
+				{
+					break;
+				}
+				bytes += len;
+				txLane->inFlight++;
+			}
+		}
+		session.txBusy = (bytes > 0);
+		Hwi_restore(key);
+
+		if (bytes == 0)
+		{
+			continue;
+		}
+
+		// whole frames gathered across the ring's wrap point
+		BtUart_Span spans[2];
+		uint8_t count = 0;
+		uint16_t offset = 0;
+		while ((count < 2) && (offset < bytes))
+		{
+			spans[count].len = ByteRing_peekAt(&txLane->ring, offset, &spans[count].data);
+			if (spans[count].len > bytes - offset)
+			{
+				spans[count].len = bytes - offset;
+			}
+			offset += spans[count].len;
+			count++;
+		}
+
+		if (BtUart_writeSpans(spans, count) != 0)
+		{
+			txLane->inFlight = 0;
+			session.txBusy = FALSE;
+		}
+	}
+}
+
+static void txDoneFxn(uint16_t len)
+{
+	UInt key;
+	if (session.txBusyLane == BTSTACK_LANE_COUNT)
+	{
+		// flow frames do not come from a lane
+		key = Hwi_disable();
+		session.txStats.bytes += len;
+		session.txStats.writes++;
+		Hwi_restore(key);
+
+		session.txBusy = FALSE;
+		Semaphore_post(session.txSem);
+		return;
+	}
+
+	BtStack_TxLane* txLane = &session.txLane[session.txBusyLane];
+	ByteRing_consume(&txLane->ring, len);
+
+	key = Hwi_disable();
+	session.txStats.bytes += len;
+	session.txStats.writes++;
+
+	// every frame in the write has left, account for how long each waited
+	uint32_t now = Timestamp_get32();
+	while (txLane->inFlight > 0)
+	{
+		uint32_t latency = now - txLane->frameTime[txLane->frameHead];
+		txLane->latencyTotal += latency;
+		if (latency > txLane->latencyMax)
+		{
+			txLane->latencyMax = latency;
+		}
+		txLane->sent++;
+
+		txLane->frameHead = (txLane->frameHead + 1) % MAX_LANE_DEPTH;
+		txLane->frameCount--;
+		txLane->inFlight--;
+	}
+
+	Bool pending = (session.txLane[BTSTACK_LANE_CONTROL].frameCount > 0) ||
+			(session.txLane[BTSTACK_LANE_BULK].frameCount > 0) || (session.flowSend >= 0);
+	Hwi_restore(key);
+
+	// frames queued during the write go out next
+	session.txBusy = FALSE;
+	if (pending)
+	{
+		Semaphore_post(session.txSem);
+	}
 }
 
 void BtStack_framePrint(const BtStack_Frame* frame, KfpPrintFormat format)
@@ -196,87 +979,273 @@ void BtStack_framePrint(const BtStack_Frame* frame, KfpPrintFormat format)
 
 void rxFxn(UArg param0, UArg param1)
 {
-	// Declare state variables
-	Bool inFrame = FALSE;
-	uint8_t frIndex = 0;
+	while(TRUE)
+	{
+		Semaphore_pend(session.rxSem, BIOS_WAIT_FOREVER);
+
+		// decode everything received so far, at most two blocks if the ring wrapped
+		const uint8_t* data;
+		uint16_t len;
+		while ((len = ByteRing_peek(&session.rxRing, &data)) > 0)
+		{
+			Slip_decode(&session.decoder, data, len);
+			ByteRing_consume(&session.rxRing, len);
+		}
+
+		// the peer may send again once the ring has drained
+		if (session.rxThrottled && (ByteRing_count(&session.rxRing) <= RX_FLOW_LOW))
+		{
+			rxThrottle(FALSE);
+		}
+	}
+}
+
+static void rxNotifyFxn(uint16_t before, uint16_t added)
+{
+	// only wake the task when it may be waiting or is falling behind
+	if ((before == 0) || ((before < RX_RING_WATERMARK) && (before + added >= RX_RING_WATERMARK)))
+	{
+		Semaphore_post(session.rxSem);
+	}
 
-	// Buffers
-	char tempRx[1];
-	BtStack_Frame tempFr;
+	// hold the peer off before the ring overruns
+	if ((flowMode != BTSTACK_FLOW_NONE) && (before + added >= RX_FLOW_HIGH))
+	{
+		rxThrottle(TRUE);
+	}
+}
+
+static void rxScanFxn(const uint8_t* data, uint16_t len)
+{
+	Slip_decode(&session.urgentDecoder, data, len);
+}
+
+static void urgentFrameFxn(const uint8_t* frame, uint16_t size, void* arg)
+{
+	uint32_t stamp = Timestamp_get32();
+
+	// only whole KFP frames of the urgent ID, the reception task handles the rest
+	uint16_t trailer = crcEnabled ? CRC16_SIZE : 0;
+	const BtStack_Frame* kfp = (const BtStack_Frame*) frame;
+	if ((size != (KFP_FRAME_SIZE-2) + trailer) || (kfp->id.b32 != urgentId))
+	{
+		return;
+	}
+
+	if (crcEnabled && (Crc16_compute(frame, size) != 0))
+	{
+		return;
+	}
+
+	session.rxUrgent++;
+	urgentFxn(kfp, stamp);
+}
+
+static void rxThrottle(Bool on)
+{
+	UInt key = Hwi_disable();
+	if (session.rxThrottled == on)
+	{
+		Hwi_restore(key);
+		return;
+	}
+
+	session.rxThrottled = on;
+	uint32_t now = Timestamp_get32();
+	if (on)
+	{
+		session.flowStats.rxThrottles++;
+		session.rxThrottleStart = now;
+	}
+	else
+	{
+		session.flowStats.rxThrottledUs += (now - session.rxThrottleStart) / session.ticksPerUs;
+	}
+
+	// pin and request stay in the order the ring crossed its marks
+	Bool inBand = (flowMode == BTSTACK_FLOW_INBAND);
+	if (inBand)
+	{
+		session.flowSend = on ? FLOW_XOFF : FLOW_XON;
+	}
+	else
+	{
+		BtUart_setRts(!on);
+	}
+	Hwi_restore(key);
+
+	if (inBand)
+	{
+		Semaphore_post(session.txSem);
+	}
+}
+
+static void txPause(Bool on)
+{
+	UInt key = Hwi_disable();
+	if (session.txPaused == on)
+	{
+		Hwi_restore(key);
+		return;
+	}
+
+	session.txPaused = on;
+	uint32_t now = Timestamp_get32();
+	if (on)
+	{
+		session.flowStats.txPauses++;
+		session.txPauseStart = now;
+	}
+	else
+	{
+		session.flowStats.txPausedUs += (now - session.txPauseStart) / session.ticksPerUs;
+	}
+	Hwi_restore(key);
+
+	// resumed frames go out, a pause arms the timeout
+	Semaphore_post(session.txSem);
+}
+
+static void rxFrameFxn(const uint8_t* frame, uint16_t size, void* arg)
+{
+	// ignore corrupt frames
+	uint16_t trailer = crcEnabled ? CRC16_SIZE : 0;
+	if (size <= trailer)
+	{
+		session.rxBadSize++;
+		return;
+	}
+
+	// CRC over the frame and its trailer is 0 when intact
+	if (crcEnabled && (Crc16_compute(frame, size) != 0))
+	{
+		session.rxBadCrc++;
+		return;
+	}
+	size -= trailer;
+
+	if (frame[0] != KFP_LINK_MARKER)
+	{
+		if (size == (KFP_FRAME_SIZE-2))
+		{
+			// a dispatch task calls the subscribers to interpret it
+			FrameQueue_put(&session.dispatchQueue, (const BtStack_Frame*) frame);
+		}
+		else
+		{
+			session.rxBadSize++;
+		}
+		return;
+	}
+
+	// link frames are handled without the marker, their first byte is the type
+	frame++;
+	size--;
+	if (size == 0)
+	{
+		session.rxBadSize++;
+		return;
+	}
+
+	if ((frame[0] == KFP_LINK_FLOW) && (size == FLOW_SIZE))
+	{
+		txPause(frame[1] == FLOW_XOFF);
+		return;
+	}
+
+	uint8_t i;
+	for (i=0; i<linkCount; i++)
+	{
+		if (linkTypes[i] == frame[0])
+		{
+			linkFxns[i](frame, size);
+			return;
+		}
+	}
+
+	session.rxBadSize++;
+}
+
+static void dispatchFxn(UArg param0, UArg param1)
+{
+	BtStack_Frame frame;
+	UInt poll = ((uint32_t)DISPATCH_POLL * 1000) / Clock_tickPeriod;
+	if (poll == 0)
+	{
+		poll = 1;
+	}
 
 	while(TRUE)
 	{
-		// open socket
-		UART_Handle s;
-		UART_Params params;
-		UART_Params_init(&params);
-		params.baudRate = uartBaud;
-		params.writeDataMode = UART_DATA_BINARY;
-		params.readMode = UART_MODE_BLOCKING;
-		params.readDataMode = UART_DATA_BINARY;
-		params.readReturnMode = UART_RETURN_FULL;
-		params.readEcho = UART_ECHO_OFF;
-		s = UART_open(Board_BT1, &params);
-
-		// read UART buffer and decode
-		UART_read(s, tempRx, 1);
-		switch(tempRx[0])
+		// counted busy before taking a frame, so BtStack_stop never sees a frame between queue and callback
+		UInt key = Hwi_disable();
+		Bool paused = session.dispatchPaused;
+		if (!paused)
 		{
-		case(SLIP_END):
-				if (inFrame)
-				{
-					if (frIndex == (KFP_FRAME_SIZE-2))
-					{
-						// end of frame, call callback to interpret it
-						if (rxCallback != NULL)
-						{
-							rxCallback(&tempFr);
-						}
-					}
-
-					// ignore corrupt frames
-					frIndex = 0;
-					inFrame = FALSE;
+			session.dispatchBusy++;
+		}
+		Hwi_restore(key);
 
-					break;
-				}
-				else
-				{
-					inFrame = TRUE;		// start new frame
-					frIndex = 0;
-					break;
-				}
-		case(SLIP_ESC):
-				if (inFrame)
-				{
-					UART_read(s, tempRx, 1);
-					switch(tempRx[0])
-					{
-					case(SLIP_ESC_END):
-							tempFr.b8[frIndex] = SLIP_END;
-							frIndex++;
-							break;
-					case(SLIP_ESC_ESC):
-							tempFr.b8[frIndex] = SLIP_ESC;
-							frIndex++;
-							break;
-					default:
-						break;	// invalid post ESC character
-					}
-					break;
-				}
-				else
-				{
-					break;		// ignore corrupt frames
-				}
-		default:
-			if (inFrame)
-			{
-				// standard character store
-				tempFr.b8[frIndex] = tempRx[0];
-				frIndex++;
-				break;
-			}
+		if (paused)
+		{
+			Task_sleep(poll);
+			continue;
 		}
+
+		if (FrameQueue_get(&session.dispatchQueue, &frame, poll))
+		{
+			FrameRouter_route(&router, &frame);
+		}
+
+		key = Hwi_disable();
+		session.dispatchBusy--;
+		Hwi_restore(key);
+	}
+}
+
+static void sessionClose(void)
+{
+	// transmission task may be inside a write, it goes before the UART
+	if (txTask != NULL)
+	{
+		Task_delete(&txTask);
+	}
+
+	if (session.uartOpen)
+	{
+		BtUart_close();
+		session.uartOpen = FALSE;
+	}
+
+	// reception has stopped, nothing can post the semaphore now
+	if (rxTask != NULL)
+	{
+		Task_delete(&rxTask);
+	}
+
+	// dispatch tasks are paused outside their callbacks, or never took a frame
+	uint8_t i;
+	for (i=0; i<MAX_DISPATCH_WORKERS; i++)
+	{
+		if (session.dispatchTask[i] != NULL)
+		{
+			Task_delete(&session.dispatchTask[i]);
+		}
+	}
+
+	if (session.dispatchQueueCreated)
+	{
+		FrameQueue_delete(&session.dispatchQueue);
+		session.dispatchQueueCreated = FALSE;
+	}
+
+	if (session.rxSem != NULL)
+	{
+		Semaphore_delete(&session.rxSem);
+	}
+
+	if (session.txSem != NULL)
+	{
+		Semaphore_delete(&session.txSem);
 	}
 }
@@ -0,0 +1,503 @@
+/**
+ * \file BtUart.c
+ * \brief Implements bluetooth UART transport used by btStack
+ * \author George Xian
+ * \version 0.1
+ * \date 2014-12-27
+ */
+
+#include "BtUart.h"
+
+#include <stdbool.h>
+#include <inc/hw_memmap.h>
+#include <inc/hw_types.h>
+#include <inc/hw_ints.h>
+#include <inc/hw_uart.h>
+#include <driverlib/sysctl.h>
+#include <driverlib/gpio.h>
+#include <driverlib/pin_map.h>
+#include <driverlib/uart.h>
+#include <driverlib/udma.h>
+
+#include <xdc/runtime/Error.h>
+#include <ti/sysbios/hal/Hwi.h>
+#include <ti/sysbios/knl/Clock.h>
+#include <ti/drivers/UART.h>
+#include "Board.h"
+
+#define BT_UART_BASE UART1_BASE				//! Peripheral behind Board_BT1
+#define BT_UART_INT INT_UART1				//! Interrupt of Board_BT1
+#define BT_DMA_RX UDMA_CHANNEL_UART1RX		//! uDMA channel receiving from Board_BT1
+#define BT_DMA_TX UDMA_CHANNEL_UART1TX		//! uDMA channel transmitting to Board_BT1
+#define BT_FLOW_PORT GPIO_PORTC_BASE		//! Port of the Board_BT1 flow control pins
+#define BT_FLOW_RTS GPIO_PIN_4				//! RTS of Board_BT1, driven as GPIO, low when ready to receive
+#define BT_FLOW_CTS GPIO_PIN_5				//! CTS of Board_BT1, the UART holds transmission while high
+
+/**
+ * \struct BtUart_Object
+ * \brief State of the open bluetooth UART
+ */
+typedef struct
+{
+	Bool isOpen;						//! UART open status
+	Bool useDma;						//! uDMA in use instead of the UART driver
+	Bool flowPins;						//! RTS and CTS pins in use
+	ByteRing* rxRing;					//! Ring received bytes are placed in
+	BtUart_RxFxn rxFxn;					//! Called after bytes are placed in rxRing
+	BtUart_ScanFxn scanFxn;				//! Called before bytes are placed in rxRing, may be NULL
+	BtUart_TxDoneFxn txDoneFxn;			//! Called when an asynchronous write completes
+	BtUart_Stats stats;					//! Transport counters
+
+	// UART driver reception
+	UART_Handle handle;					//! TI-RTOS UART driver handle
+	uint8_t rxByte;						//! Target of the outstanding callback mode read
+
+	// uDMA reception
+	Hwi_Handle hwi;						//! Hwi serving Board_BT1
+	Clock_Handle poll;					//! Hands over bytes no receive timeout will flush
+	uint8_t active;						//! Block the uDMA fills next, 0 primary, 1 alternate
+	uint8_t handed[2];					//! No. of bytes of each block already handed to rxRing
+	uint8_t block[2][BTUART_DMA_BLOCK];	//! Ping-pong blocks
+
+	// uDMA transmission
+	volatile Bool txBusy;				//! Asynchronous write in progress
+	uint16_t txLen;						//! No. of bytes in the write in progress
+	tDMAControlTable txTasks[BTUART_MAX_SPANS];	//! Scatter-gather task list, one per buffer
+} BtUart_Object;
+
+static BtUart_Object obj;				//! The bluetooth UART
+
+/**
+ * \brief Runs in Hwi context for every byte the UART driver receives
+ */
+static void driverRxFxn(UART_Handle handle, void* buf, int count);
+
+/**
+ * \brief Hwi of Board_BT1 while uDMA is in use
+ */
+static void dmaIsrFxn(UArg arg);
+
+/**
+ * \brief Runs every tick while uDMA is in use, hands over the part of the active block not yet handed
+ */
+static void dmaPollFxn(UArg arg);
+
+/**
+ * \brief Opens Board_BT1 through the TI-RTOS UART driver
+ */
+static int8_t driverOpen(uint32_t baud);
+
+/**
+ * \brief Programs Board_BT1 and the uDMA directly
+ */
+static int8_t dmaOpen(uint32_t baud);
+
+/**
+ * \brief Enables CTS and releases RTS after the UART has been (re)opened
+ */
+static void flowOpen(void);
+
+/**
+ * \brief Points a ping-pong block back at the receive FIFO
+ */
+static void dmaRearm(uint8_t sel);
+
+/**
+ * \brief Moves the newly received part of a block into the reception ring
+ */
+static void dmaHandOff(uint8_t sel, uint8_t upto);
+
+int8_t BtUart_open(const BtUart_Params* params)
+{
+	if (obj.isOpen)
+	{
+		return -1;
+	}
+
+	obj.useDma = params->useDma;
+	obj.flowPins = params->flowPins;
+	obj.rxRing = params->rxRing;
+	obj.rxFxn = params->rxFxn;
+	obj.scanFxn = params->scanFxn;
+	obj.txDoneFxn = params->txDoneFxn;
+	obj.txBusy = FALSE;
+	obj.stats.hwOverruns = 0;
+	obj.stats.rxBlocks = 0;
+
+	int8_t ret = obj.useDma ? dmaOpen(params->baud) : driverOpen(params->baud);
+	if (ret == 0)
+	{
+		flowOpen();
+		obj.isOpen = TRUE;
+	}
+
+	return ret;
+}
+
+int8_t BtUart_close(void)
+{
+	if (!obj.isOpen)
+	{
+		return -1;
+	}
+
+	if (obj.flowPins)
+	{
+		UARTFlowControlSet(BT_UART_BASE, UART_FLOWCONTROL_NONE);
+	}
+
+	if (obj.useDma)
+	{
+		UARTIntDisable(BT_UART_BASE, UART_INT_RT | UART_INT_OE);
+		UARTDMADisable(BT_UART_BASE, UART_DMA_RX | UART_DMA_TX);
+		uDMAChannelDisable(BT_DMA_RX);
+		uDMAChannelDisable(BT_DMA_TX);
+		Clock_delete(&obj.poll);
+		Hwi_delete(&obj.hwi);
+		UARTDisable(BT_UART_BASE);
+	}
+	else
+	{
+		UART_close(obj.handle);
+		obj.handle = NULL;
+	}
+
+	obj.isOpen = FALSE;
+	return 0;
+}
+
+int BtUart_write(const uint8_t* data, uint16_t len)
+{
+	if (!obj.isOpen)
+	{
+		return -1;
+	}
+
+	if (!obj.useDma)
+	{
+		return UART_write(obj.handle, data, len);
+	}
+
+	// driver is not in use, feed the FIFO directly
+	uint16_t i;
+	for (i=0; i<len; i++)
+	{
+		UARTCharPut(BT_UART_BASE, data[i]);
+	}
+	return len;
+}
+
+int8_t BtUart_writeSpans(const BtUart_Span* spans, uint8_t count)
+{
+	if (!obj.isOpen || obj.txBusy)
+	{
+		return -1;
+	}
+
+	if ((count == 0) || (count > BTUART_MAX_SPANS))
+	{
+		return -2;
+	}
+
+	uint16_t total = 0;
+	uint8_t i;
+	for (i=0; i<count; i++)
+	{
+		total += spans[i].len;
+	}
+
+	if (!obj.useDma)
+	{
+		// driver writes block, the buffers are free once they return
+		for (i=0; i<count; i++)
+		{
+			UART_write(obj.handle, spans[i].data, spans[i].len);
+		}
+		obj.txDoneFxn(total);
+		return 0;
+	}
+
+	// one scatter-gather task per buffer, given its start, the last one ends the transfer
+	for (i=0; i<count; i++)
+	{
+		tDMAControlTable task = uDMATaskStructEntry(spans[i].len, UDMA_SIZE_8,
+				UDMA_SRC_INC_8, spans[i].data, UDMA_DST_INC_NONE, (void*) (BT_UART_BASE + UART_O_DR),
+				UDMA_ARB_4, (i == count-1) ? UDMA_MODE_BASIC : UDMA_MODE_PER_SCATTER_GATHER);
+		obj.txTasks[i] = task;
+	}
+
+	// busy only once the channel runs, else the interrupt would see it idle and finish early
+	UInt key = Hwi_disable();
+	obj.txLen = total;
+	uDMAChannelScatterGatherSet(BT_DMA_TX, count, obj.txTasks, 1);
+	uDMAChannelEnable(BT_DMA_TX);
+	obj.txBusy = TRUE;
+	Hwi_restore(key);
+
+	return 0;
+}
+
+int8_t BtUart_setBaud(uint32_t baud)
+{
+	if (!obj.isOpen || obj.txBusy)
+	{
+		return -1;
+	}
+
+	if (!obj.useDma)
+	{
+		// the driver only takes a baud rate when opened
+		UART_close(obj.handle);
+		obj.handle = NULL;
+		if (driverOpen(baud) != 0)
+		{
+			obj.isOpen = FALSE;
+			return -2;
+		}
+		flowOpen();
+		return 0;
+	}
+
+	// let the last byte leave at the old rate, uDMA and FIFO levels survive reprogramming
+	while (UARTBusy(BT_UART_BASE))
+	{
+	}
+	UARTConfigSetExpClk(BT_UART_BASE, SysCtlClockGet(), baud,
+			UART_CONFIG_WLEN_8 | UART_CONFIG_STOP_ONE | UART_CONFIG_PAR_NONE);
+	return 0;
+}
+
+void BtUart_setRts(Bool ready)
+{
+	if (obj.flowPins)
+	{
+		GPIOPinWrite(BT_FLOW_PORT, BT_FLOW_RTS, ready ? 0 : BT_FLOW_RTS);
+	}
+}
+
+void BtUart_getStats(BtUart_Stats* stats)
+{
+	*stats = obj.stats;
+}
+
+static void flowOpen(void)
+{
+	if (!obj.flowPins)
+	{
+		return;
+	}
+
+	// RTS follows the reception ring rather than the FIFO, so it stays a GPIO
+	SysCtlPeripheralEnable(SYSCTL_PERIPH_GPIOC);
+	GPIOPinTypeGPIOOutput(BT_FLOW_PORT, BT_FLOW_RTS);
+	GPIOPinWrite(BT_FLOW_PORT, BT_FLOW_RTS, 0);
+
+	GPIOPinConfigure(GPIO_PC5_U1CTS);
+	GPIOPinTypeUART(BT_FLOW_PORT, BT_FLOW_CTS);
+	UARTFlowControlSet(BT_UART_BASE, UART_FLOWCONTROL_TX);
+}
+
+static int8_t driverOpen(uint32_t baud)
+{
+	UART_Params params;
+	UART_Params_init(&params);
+	params.baudRate = baud;
+	params.readMode = UART_MODE_CALLBACK;
+	params.readCallback = driverRxFxn;
+	params.writeMode = UART_MODE_BLOCKING;
+	params.readDataMode = UART_DATA_BINARY;
+	params.writeDataMode = UART_DATA_BINARY;
+	params.readReturnMode = UART_RETURN_FULL;
+	params.readEcho = UART_ECHO_OFF;
+	obj.handle = UART_open(Board_BT1, &params);
+	if (obj.handle == NULL)
+	{
+		return -2;
+	}
+
+	// first read, driverRxFxn rearms it from then on
+	UART_read(obj.handle, &obj.rxByte, 1);
+	return 0;
+}
+
+static void driverRxFxn(UART_Handle handle, void* buf, int count)
+{
+	if (count > 0)
+	{
+		if (obj.scanFxn != NULL)
+		{
+			obj.scanFxn(&obj.rxByte, 1);
+		}
+
+		uint16_t before = ByteRing_count(obj.rxRing);
+		ByteRing_put(obj.rxRing, obj.rxByte);
+		obj.rxFxn(before, 1);
+	}
+
+	UART_read(handle, &obj.rxByte, 1);
+}
+
+static int8_t dmaOpen(uint32_t baud)
+{
+	Error_Block eb;
+	Error_init(&eb);
+
+	Board_initDMA();
+
+	Hwi_Params hwiParams;
+	Hwi_Params_init(&hwiParams);
+	obj.hwi = Hwi_create(BT_UART_INT, dmaIsrFxn, &hwiParams, &eb);
+	if (obj.hwi == NULL)
+	{
+		return -2;
+	}
+
+	// the receive timeout needs bytes in the FIFO, a burst which empties it leaves its bytes in the block
+	Clock_Params clockParams;
+	Clock_Params_init(&clockParams);
+	clockParams.period = 1;
+	obj.poll = Clock_create((Clock_FuncPtr) dmaPollFxn, 1, &clockParams, &eb);
+	if (obj.poll == NULL)
+	{
+		Hwi_delete(&obj.hwi);
+		return -2;
+	}
+
+	// 8N1, uDMA bursts 8 bytes at a time from a half full FIFO
+	UARTConfigSetExpClk(BT_UART_BASE, SysCtlClockGet(), baud,
+			UART_CONFIG_WLEN_8 | UART_CONFIG_STOP_ONE | UART_CONFIG_PAR_NONE);
+	UARTFIFOLevelSet(BT_UART_BASE, UART_FIFO_TX4_8, UART_FIFO_RX4_8);
+	UARTFIFOEnable(BT_UART_BASE);
+
+	uDMAChannelAssign(UDMA_CH22_UART1RX);
+	uDMAChannelAttributeDisable(BT_DMA_RX, UDMA_ATTR_ALL);
+	uDMAChannelAttributeEnable(BT_DMA_RX, UDMA_ATTR_USEBURST);
+	uDMAChannelControlSet(BT_DMA_RX | UDMA_PRI_SELECT,
+			UDMA_SIZE_8 | UDMA_SRC_INC_NONE | UDMA_DST_INC_8 | UDMA_ARB_8);
+	uDMAChannelControlSet(BT_DMA_RX | UDMA_ALT_SELECT,
+			UDMA_SIZE_8 | UDMA_SRC_INC_NONE | UDMA_DST_INC_8 | UDMA_ARB_8);
+
+	// transmission requests a byte at a time as FIFO space frees up
+	uDMAChannelAssign(UDMA_CH23_UART1TX);
+	uDMAChannelAttributeDisable(BT_DMA_TX, UDMA_ATTR_ALL);
+
+	obj.active = 0;
+	dmaRearm(0);
+	dmaRearm(1);
+	uDMAChannelEnable(BT_DMA_RX);
+
+	// a receive timeout flushes whatever is left below the burst level
+	UARTDMAEnable(BT_UART_BASE, UART_DMA_RX | UART_DMA_TX);
+	UARTIntClear(BT_UART_BASE, UARTIntStatus(BT_UART_BASE, false));
+	UARTIntEnable(BT_UART_BASE, UART_INT_RT | UART_INT_OE);
+	UARTEnable(BT_UART_BASE);
+	Clock_start(obj.poll);
+
+	return 0;
+}
+
+static void dmaRearm(uint8_t sel)
+{
+	obj.handed[sel] = 0;
+	uDMAChannelTransferSet(BT_DMA_RX | (sel ? UDMA_ALT_SELECT : UDMA_PRI_SELECT),
+			UDMA_MODE_PINGPONG, (void*) (BT_UART_BASE + UART_O_DR),
+			obj.block[sel], BTUART_DMA_BLOCK);
+}
+
+static void dmaHandOff(uint8_t sel, uint8_t upto)
+{
+	uint8_t from = obj.handed[sel];
+	if (upto > from)
+	{
+		if (obj.scanFxn != NULL)
+		{
+			obj.scanFxn(&obj.block[sel][from], upto - from);
+		}
+
+		uint16_t before = ByteRing_count(obj.rxRing);
+		ByteRing_write(obj.rxRing, &obj.block[sel][from], upto - from);
+		obj.handed[sel] = upto;
+		obj.stats.rxBlocks++;
+		obj.rxFxn(before, upto - from);
+	}
+}
+
+static void dmaIsrFxn(UArg arg)
+{
+	uint32_t status = UARTIntStatus(BT_UART_BASE, true);
+	UARTIntClear(BT_UART_BASE, status);
+
+	if (status & UART_INT_OE)
+	{
+		obj.stats.hwOverruns++;
+	}
+
+	// transmission done, the uDMA disables the channel after the last task
+	if (obj.txBusy && !uDMAChannelIsEnabled(BT_DMA_TX))
+	{
+		obj.txBusy = FALSE;
+		obj.txDoneFxn(obj.txLen);
+	}
+
+	// completed blocks, in the order the uDMA filled them
+	uint32_t sel = obj.active ? UDMA_ALT_SELECT : UDMA_PRI_SELECT;
+	while (uDMAChannelModeGet(BT_DMA_RX | sel) == UDMA_MODE_STOP)
+	{
+		dmaHandOff(obj.active, BTUART_DMA_BLOCK);
+		dmaRearm(obj.active);
+
+		obj.active ^= 1;
+		sel = obj.active ? UDMA_ALT_SELECT : UDMA_PRI_SELECT;
+	}
+
+	// both blocks filled before this ran, the channel stopped
+	if (!uDMAChannelIsEnabled(BT_DMA_RX))
+	{
+		uDMAChannelEnable(BT_DMA_RX);
+	}
+
+	if (status & UART_INT_RT)
+	{
+		// hold off the uDMA so bytes reach the ring in order
+		UARTDMADisable(BT_UART_BASE, UART_DMA_RX);
+
+		uint8_t filled = BTUART_DMA_BLOCK - uDMAChannelSizeGet(BT_DMA_RX | sel);
+		dmaHandOff(obj.active, filled);
+
+		// bytes left in the FIFO below the burst level
+		uint8_t tail[16];
+		uint16_t count = 0;
+		while (UARTCharsAvail(BT_UART_BASE) && (count < sizeof(tail)))
+		{
+			tail[count] = UARTCharGetNonBlocking(BT_UART_BASE);
+			count++;
+		}
+		if (count > 0)
+		{
+			if (obj.scanFxn != NULL)
+			{
+				obj.scanFxn(tail, count);
+			}
+
+			uint16_t before = ByteRing_count(obj.rxRing);
+			ByteRing_write(obj.rxRing, tail, count);
+			obj.rxFxn(before, count);
+		}
+
+		UARTDMAEnable(BT_UART_BASE, UART_DMA_RX);
+	}
+}
+
+static void dmaPollFxn(UArg arg)
+{
+	UInt key = Hwi_disable();
+
+	// a filled block is left to the interrupt, which takes blocks in order
+	uint32_t sel = obj.active ? UDMA_ALT_SELECT : UDMA_PRI_SELECT;
+	if (uDMAChannelModeGet(BT_DMA_RX | sel) != UDMA_MODE_STOP)
+	{
+		dmaHandOff(obj.active, BTUART_DMA_BLOCK - uDMAChannelSizeGet(BT_DMA_RX | sel));
+	}
+
+	Hwi_restore(key);
+}
@@ -0,0 +1,137 @@
+/**
+ * \file ByteRing.c
+ * \brief Implements single producer, single consumer lock-free byte ring
+ * \author George Xian
+ * \version 0.1
+ * \date 2014-12-20
+ */
+
+#include "ByteRing.h"
+
+#include <string.h>
+
+/**
+ * \brief Stops the compiler moving buffer accesses across an index update
+ *
+ * Producer and consumer run on the same core so no hardware barrier is needed.
+ */
+#if defined(__GNUC__)
+#define RING_BARRIER() __asm volatile ("" ::: "memory")
+#else
+#define RING_BARRIER() __asm(" ")
+#endif
+
+void ByteRing_init(ByteRing* ring, uint8_t* buf, uint16_t size)
+{
+	ring->buf = buf;
+	ring->mask = size - 1;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->overruns = 0;
+}
+
+uint16_t ByteRing_count(const ByteRing* ring)
+{
+	return (uint16_t) (ring->head - ring->tail);
+}
+
+uint16_t ByteRing_space(const ByteRing* ring)
+{
+	return (uint16_t) (ring->mask + 1 - ByteRing_count(ring));
+}
+
+uint16_t ByteRing_write(ByteRing* ring, const uint8_t* data, uint16_t len)
+{
+	uint16_t head = ring->head;
+	uint16_t space = ByteRing_space(ring);
+	if (len > space)
+	{
+		ring->overruns += len - space;
+		len = space;
+	}
+
+	// copy up to the end of storage then wrap to the start
+	uint16_t offset = head & ring->mask;
+	uint16_t first = ring->mask + 1 - offset;
+	if (first > len)
+	{
+		first = len;
+	}
+	memcpy(&ring->buf[offset], data, first);
+	memcpy(ring->buf, &data[first], len - first);
+
+	// publish only once the bytes are in place
+	RING_BARRIER();
+	ring->head = head + len;
+
+	return len;
+}
+
+int8_t ByteRing_put(ByteRing* ring, uint8_t value)
+{
+	uint16_t head = ring->head;
+	if ((uint16_t) (head - ring->tail) > ring->mask)
+	{
+		ring->overruns++;
+		return -1;
+	}
+
+	ring->buf[head & ring->mask] = value;
+
+	RING_BARRIER();
+	ring->head = head + 1;
+
+	return 0;
+}
+
+uint16_t ByteRing_reserve(ByteRing* ring, uint8_t** data)
+{
+	uint16_t head = ring->head;
+	uint16_t space = ByteRing_space(ring);
+
+	// stop at the end of storage
+	uint16_t offset = head & ring->mask;
+	uint16_t contiguous = ring->mask + 1 - offset;
+
+	*data = &ring->buf[offset];
+	return (space < contiguous) ? space : contiguous;
+}
+
+void ByteRing_commit(ByteRing* ring, uint16_t len)
+{
+	// publish only once the bytes are in place
+	RING_BARRIER();
+	ring->head += len;
+}
+
+uint16_t ByteRing_peek(const ByteRing* ring, const uint8_t** data)
+{
+	return ByteRing_peekAt(ring, 0, data);
+}
+
+uint16_t ByteRing_peekAt(const ByteRing* ring, uint16_t offset, const uint8_t** data)
+{
+	uint16_t tail = ring->tail + offset;
+	uint16_t count = ring->head - tail;
+	if (count > ring->mask + 1)
+	{
+		// offset is past the unread bytes
+		count = 0;
+	}
+
+	RING_BARRIER();
+
+	// stop at the end of storage
+	uint16_t position = tail & ring->mask;
+	uint16_t contiguous = ring->mask + 1 - position;
+
+	*data = &ring->buf[position];
+	return (count < contiguous) ? count : contiguous;
+}
+
+void ByteRing_consume(ByteRing* ring, uint16_t len)
+{
+	// bytes must be finished with before the producer may reuse them
+	RING_BARRIER();
+	ring->tail += len;
+}
@@ -0,0 +1,391 @@
+/**
+ * \file DriveCtrl.c
+ * \brief Implements drive control application
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-01-10
+ */
+
+#include "DriveCtrl.h"
+
+#include <string.h>
+#include <xdc/runtime/Error.h>
+#include <xdc/runtime/Timestamp.h>
+#include <xdc/runtime/Types.h>
+#include <ti/sysbios/BIOS.h>
+#include <ti/sysbios/knl/Clock.h>
+#include <ti/sysbios/knl/Semaphore.h>
+#include <ti/sysbios/knl/Task.h>
+#include <ti/sysbios/hal/Hwi.h>
+
+#include "BtStack.h"
+#include "PwrMgmt.h"
+
+#define DEFAULT_CTRL_PRIORITY 11		//! Default priority of control task, above btStack so ticks are not delayed
+#define DEFAULT_CTRL_STACK 1024			//! Default stack size of control task
+#define DEFAULT_RATE 100				//! Default updates per second
+#define DEFAULT_SLEW 400				//! Default largest change in magnitude per second
+#define MIN_RATE 10						//! Slowest control loop rate
+#define MAX_RATE 500					//! Fastest control loop rate
+
+static Bool hasStart = FALSE;
+static Task_Handle ctrlTask = NULL;		//! Handle to the control task
+static Clock_Handle ctrlClock = NULL;	//! Wakes the control task every period
+static Semaphore_Handle tickSem = NULL;	//! Posted by ctrlClock
+static Semaphore_Struct doneSem;		//! Posted when an update leaves the bus, kept across stops for late completions
+static Bool doneSemBuilt = FALSE;		//! doneSem has been constructed
+static int8_t ctrlPriority = DEFAULT_CTRL_PRIORITY;
+static uint16_t ctrlStackSize = DEFAULT_CTRL_STACK;
+static uint16_t rate = DEFAULT_RATE;	//! Updates per second
+static uint16_t slew = DEFAULT_SLEW;	//! Largest change in magnitude per second, 0 for none
+
+/**
+ * \union DriveCtrl_Target
+ * \brief Commanded power and yaw, stored together so a tick never sees half a command
+ */
+typedef union
+{
+	struct
+	{
+		int8_t power;
+		int8_t yaw;
+	};
+	uint16_t b16;
+} DriveCtrl_Target;
+
+static volatile uint16_t target;		//! Latest DriveCtrl_Target
+static volatile Bool busy;				//! Control task is handling a tick
+static volatile Bool halted;			//! Output drops to zero at the next tick, without slewing
+static volatile Bool latched;			//! Commands are ignored until DriveCtrl_release
+static volatile int8_t doneStatus;		//! Status of the last update sent
+static DriveCtrl_Stats stats;
+static uint32_t jitterTotal;			//! Sum of period deviations, timestamp ticks
+static uint32_t jitterMax;				//! Largest period deviation, timestamp ticks
+static uint32_t jitterCount;			//! No. of periods measured
+
+/**
+ * \brief Function executed by the control task
+ */
+static void ctrlFxn(UArg unused0, UArg unused1);
+
+/**
+ * \brief Runs in Swi context every control period
+ */
+static void clockFxn(UArg unused);
+
+/**
+ * \brief Subscribed to drive command frames
+ */
+static void frameFxn(const BtStack_Frame* frame);
+
+/**
+ * \brief Called from the I2C driver's interrupt context when an update completes
+ */
+static void doneFxn(PwrMgmt_Token token, int8_t status, const uint8_t* read, void* arg);
+
+/**
+ * \brief Moves value towards goal by at most step, all in Q8
+ */
+static int16_t slewTowards(int16_t value, int16_t goal, int16_t step);
+
+int8_t DriveCtrl_init(uint32_t id)
+{
+	if (BtStack_hasStarted())
+	{
+		return -1;
+	}
+
+	BtStack_subscribe(id, FRAMEROUTER_EXACT, frameFxn);
+	BtStack_coalesce(id);
+	return 0;
+}
+
+int8_t DriveCtrl_setRate(uint16_t hz)
+{
+	if (hasStart)
+	{
+		return -1;
+	}
+
+	if ((hz < MIN_RATE) || (hz > MAX_RATE))
+	{
+		return -2;
+	}
+
+	rate = hz;
+	return 0;
+}
+
+int8_t DriveCtrl_setSlew(uint16_t perSecond)
+{
+	if (hasStart)
+	{
+		return -1;
+	}
+
+	slew = perSecond;
+	return 0;
+}
+
+int8_t DriveCtrl_start(void)
+{
+	if (hasStart)
+	{
+		return -1;
+	}
+
+	Error_Block eb;
+	Error_init(&eb);
+
+	memset(&stats, 0, sizeof(stats));
+	jitterTotal = 0;
+	jitterMax = 0;
+	jitterCount = 0;
+	busy = FALSE;
+	halted = FALSE;
+	latched = FALSE;
+
+	Semaphore_Params semParams;
+	Semaphore_Params_init(&semParams);
+	semParams.mode = Semaphore_Mode_BINARY;
+	if (doneSemBuilt)
+	{
+		Semaphore_reset(Semaphore_handle(&doneSem), 0);
+	}
+	else
+	{
+		Semaphore_construct(&doneSem, 0, &semParams);
+		doneSemBuilt = TRUE;
+	}
+
+	tickSem = Semaphore_create(0, &semParams, &eb);
+	if (tickSem == NULL)
+	{
+		return -2;
+	}
+
+	Task_Params params;
+	Task_Params_init(&params);
+	params.instance->name = "driveCtrl";
+	params.priority = ctrlPriority;
+	params.stackSize = ctrlStackSize;
+	ctrlTask = Task_create((Task_FuncPtr) ctrlFxn, &params, &eb);
+	if (ctrlTask == NULL)
+	{
+		Semaphore_delete(&tickSem);
+		return -2;
+	}
+
+	// period rounded to whole ticks, at least one
+	UInt period = 1000000 / ((uint32_t)rate * Clock_tickPeriod);
+	if (period == 0)
+	{
+		period = 1;
+	}
+
+	Clock_Params clockParams;
+	Clock_Params_init(&clockParams);
+	clockParams.period = period;
+	clockParams.startFlag = TRUE;
+	ctrlClock = Clock_create((Clock_FuncPtr) clockFxn, period, &clockParams, &eb);
+	if (ctrlClock == NULL)
+	{
+		Task_delete(&ctrlTask);
+		Semaphore_delete(&tickSem);
+		return -2;
+	}
+
+	hasStart = TRUE;
+	return 0;
+}
+
+int8_t DriveCtrl_stop(void)
+{
+	if (!hasStart)
+	{
+		return -1;
+	}
+
+	Clock_stop(ctrlClock);
+	Clock_delete(&ctrlClock);
+	Task_delete(&ctrlTask);
+	Semaphore_delete(&tickSem);
+	hasStart = FALSE;
+	return 0;
+}
+
+void DriveCtrl_command(int8_t power, int8_t yaw)
+{
+	DriveCtrl_Target t;
+	t.power = power;
+	t.yaw = yaw;
+
+	UInt key = Hwi_disable();
+	if (latched)
+	{
+		stats.ignored++;
+	}
+	else
+	{
+		target = t.b16;
+	}
+	Hwi_restore(key);
+}
+
+void DriveCtrl_halt(void)
+{
+	UInt key = Hwi_disable();
+	target = 0;
+	halted = TRUE;
+	latched = TRUE;
+	Hwi_restore(key);
+}
+
+void DriveCtrl_release(void)
+{
+	latched = FALSE;
+}
+
+void DriveCtrl_getStats(DriveCtrl_Stats* out)
+{
+	UInt key = Hwi_disable();
+	*out = stats;
+	uint32_t total = jitterTotal;
+	uint32_t max = jitterMax;
+	uint32_t count = jitterCount;
+	Hwi_restore(key);
+
+	// timestamp ticks to microseconds
+	Types_FreqHz freq;
+	Timestamp_getFreq(&freq);
+	uint32_t ticksPerUs = freq.lo / 1000000;
+	if (ticksPerUs == 0)
+	{
+		ticksPerUs = 1;
+	}
+
+	out->maxJitterUs = max / ticksPerUs;
+	out->meanJitterUs = (count > 0) ? (total / count) / ticksPerUs : 0;
+}
+
+static void clockFxn(UArg unused)
+{
+	if (busy)
+	{
+		// previous update still on the bus, this tick is lost
+		stats.overruns++;
+		return;
+	}
+
+	busy = TRUE;
+	Semaphore_post(tickSem);
+}
+
+static void ctrlFxn(UArg unused0, UArg unused1)
+{
+	// expected period in timestamp ticks
+	Types_FreqHz freq;
+	Timestamp_getFreq(&freq);
+	UInt clockPeriod = 1000000 / ((uint32_t)rate * Clock_tickPeriod);
+	if (clockPeriod == 0)
+	{
+		clockPeriod = 1;
+	}
+	uint32_t expected = (uint32_t)(((uint64_t)freq.lo * clockPeriod * Clock_tickPeriod) / 1000000);
+
+	// slew per tick in Q8, at least one LSB so the output always converges
+	int16_t step = INT16_MAX;
+	if (slew > 0)
+	{
+		uint32_t q8 = ((uint32_t)slew << 8) / rate;
+		step = (q8 == 0) ? 1 : (q8 > INT16_MAX) ? INT16_MAX : (int16_t)q8;
+	}
+
+	int16_t power = 0;		//! Output power, Q8
+	int16_t yaw = 0;		//! Output yaw, Q8
+	uint32_t last = 0;
+	Bool measured = FALSE;
+
+	while(TRUE)
+	{
+		Semaphore_pend(tickSem, BIOS_WAIT_FOREVER);
+
+		// deviation of this period from the configured one
+		uint32_t now = Timestamp_get32();
+		if (measured)
+		{
+			uint32_t period = now - last;
+			uint32_t jitter = (period > expected) ? period - expected : expected - period;
+			UInt key = Hwi_disable();
+			jitterTotal += jitter;
+			jitterCount++;
+			if (jitter > jitterMax)
+			{
+				jitterMax = jitter;
+			}
+			Hwi_restore(key);
+		}
+		last = now;
+		measured = TRUE;
+
+		// read the command and queue the update in one step, a halt either comes
+		// first and is seen here or comes after and cancels the queued update
+		UInt key = Hwi_disable();
+		if (halted)
+		{
+			// the motors were already stopped, ramping down would restart them
+			halted = FALSE;
+			power = 0;
+			yaw = 0;
+		}
+
+		DriveCtrl_Target t;
+		t.b16 = target;
+		power = slewTowards(power, (int16_t)t.power << 8, step);
+		yaw = slewTowards(yaw, (int16_t)t.yaw << 8, step);
+		int32_t token = PwrMgmt_driveAsync(power >> 8, yaw >> 8, doneFxn, NULL);
+		Hwi_restore(key);
+
+		if (token < 0)
+		{
+			stats.errors++;
+		}
+		else
+		{
+			Semaphore_pend(Semaphore_handle(&doneSem), BIOS_WAIT_FOREVER);
+
+			// an update cancelled by an urgent stop is not an error
+			if ((doneStatus != 0) && !halted)
+			{
+				stats.errors++;
+			}
+		}
+		stats.ticks++;
+		busy = FALSE;
+	}
+}
+
+static void frameFxn(const BtStack_Frame* frame)
+{
+	DriveCtrl_command((int8_t)frame->payload.b8[0], (int8_t)frame->payload.b8[1]);
+}
+
+static void doneFxn(PwrMgmt_Token token, int8_t status, const uint8_t* read, void* arg)
+{
+	doneStatus = status;
+	Semaphore_post(Semaphore_handle(&doneSem));
+}
+
+static int16_t slewTowards(int16_t value, int16_t goal, int16_t step)
+{
+	int32_t diff = (int32_t)goal - value;
+	if (diff > step)
+	{
+		return value + step;
+	}
+	if (diff < -step)
+	{
+		return value - step;
+	}
+	return goal;
+}
@@ -0,0 +1,77 @@
+/**
+ * \file EStop.c
+ * \brief Implements emergency stop application
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-02
+ */
+
+#include "EStop.h"
+
+#include <ti/sysbios/hal/Hwi.h>
+
+#include "BtStack.h"
+#include "InterBus.h"
+#include "PwrMgmt.h"
+#include "DriveCtrl.h"
+
+static uint32_t triggers;				//! No. of emergency stop frames received
+static uint32_t refused;				//! No. of stops which could not be queued
+
+/**
+ * \brief Runs in the UART's Hwi with each emergency stop frame
+ */
+static void stopFxn(const BtStack_Frame* frame, uint32_t stamp);
+
+/**
+ * \brief Subscribed to emergency stop frames, runs once the frame is dispatched
+ */
+static void releaseFxn(const BtStack_Frame* frame);
+
+int8_t EStop_init(uint32_t id)
+{
+	if (BtStack_hasStarted())
+	{
+		return -1;
+	}
+
+	triggers = 0;
+	refused = 0;
+	BtStack_setUrgent(id, stopFxn);
+	BtStack_subscribe(id, FRAMEROUTER_EXACT, releaseFxn);
+	return 0;
+}
+
+void EStop_getStats(EStop_Stats* stats)
+{
+	UInt key = Hwi_disable();
+	stats->triggers = triggers;
+	stats->refused = refused;
+	Hwi_restore(key);
+
+	// the stop write is the only urgent transaction on the bus
+	InterBus_BusStats busStats;
+	InterBus_getBusStats(&busStats);
+	stats->lastLatencyUs = busStats.lastUrgentUs;
+	stats->maxLatencyUs = busStats.maxUrgentUs;
+}
+
+static void stopFxn(const BtStack_Frame* frame, uint32_t stamp)
+{
+	triggers++;
+
+	// the control task must not ramp the motors back up from where they were
+	DriveCtrl_halt();
+
+	// a stop already waiting for the bus does the same job
+	if (PwrMgmt_stopNow(stamp) == -1)
+	{
+		refused++;
+	}
+}
+
+static void releaseFxn(const BtStack_Frame* frame)
+{
+	// drive frames received ahead of the stop have been dispatched and ignored
+	DriveCtrl_release();
+}
@@ -0,0 +1,260 @@
+/**
+ * \file FrameQueue.c
+ * \brief Implements bounded KFP frame queue
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-01-03
+ */
+
+#include "FrameQueue.h"
+
+#include <xdc/runtime/Error.h>
+#include <ti/sysbios/BIOS.h>
+#include <ti/sysbios/hal/Hwi.h>
+
+int8_t FrameQueue_create(FrameQueue* queue, BtStack_Frame* slots, uint16_t depth, FrameQueue_Policy policy)
+{
+	queue->slots = slots;
+	queue->depth = depth;
+	queue->head = 0;
+	queue->count = 0;
+	queue->policy = policy;
+	queue->space = NULL;
+	queue->stateIds = NULL;
+	queue->stateCount = 0;
+	queue->keptIds = NULL;
+	queue->keptCount = 0;
+
+	queue->stats.puts = 0;
+	queue->stats.drops = 0;
+	queue->stats.coalesced = 0;
+	queue->stats.highWater = 0;
+
+	Error_Block eb;
+	Error_init(&eb);
+
+	Semaphore_Params params;
+	Semaphore_Params_init(&params);
+	queue->items = Semaphore_create(0, &params, &eb);
+	if (queue->items == NULL)
+	{
+		return -1;
+	}
+
+	if (policy == FRAMEQUEUE_BLOCK)
+	{
+		queue->space = Semaphore_create(depth, &params, &eb);
+		if (queue->space == NULL)
+		{
+			Semaphore_delete(&queue->items);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+void FrameQueue_setStateIds(FrameQueue* queue, const uint32_t* ids, uint8_t count)
+{
+	queue->stateIds = ids;
+	queue->stateCount = count;
+}
+
+void FrameQueue_setKeptIds(FrameQueue* queue, const uint32_t* ids, uint8_t count)
+{
+	queue->keptIds = ids;
+	queue->keptCount = count;
+}
+
+void FrameQueue_delete(FrameQueue* queue)
+{
+	Semaphore_delete(&queue->items);
+	if (queue->space != NULL)
+	{
+		Semaphore_delete(&queue->space);
+	}
+}
+
+/**
+ * \brief Returns whether frames of this ID are coalesced
+ */
+static Bool isState(const FrameQueue* queue, uint32_t id)
+{
+	uint8_t i;
+	for (i=0; i<queue->stateCount; i++)
+	{
+		if (queue->stateIds[i] == id)
+		{
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/**
+ * \brief Returns whether frames of this ID are spared by the drop policy
+ */
+static Bool isKept(const FrameQueue* queue, uint32_t id)
+{
+	uint8_t i;
+	for (i=0; i<queue->keptCount; i++)
+	{
+		if (queue->keptIds[i] == id)
+		{
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/**
+ * \brief Discards the oldest frame which is not kept, call with interrupts disabled
+ *
+ * \return Returns TRUE if a frame was discarded, FALSE if every queued frame is kept
+ */
+static Bool evict(FrameQueue* queue)
+{
+	uint16_t i;
+	for (i=0; i<queue->count; i++)
+	{
+		if (!isKept(queue, queue->slots[(queue->head + i) % queue->depth].id.b32))
+		{
+			break;
+		}
+	}
+
+	if (i == queue->count)
+	{
+		return FALSE;
+	}
+
+	if (i == 0)
+	{
+		queue->head = (queue->head + 1) % queue->depth;
+		queue->count--;
+		return TRUE;
+	}
+
+	// later frames close the gap, keeping their order
+	for (; i+1 < queue->count; i++)
+	{
+		queue->slots[(queue->head + i) % queue->depth] = queue->slots[(queue->head + i + 1) % queue->depth];
+	}
+	queue->count--;
+	return TRUE;
+}
+
+/**
+ * \brief Replaces a queued frame of the same ID, call with interrupts disabled
+ *
+ * \return Returns TRUE if a queued frame was replaced
+ */
+static Bool coalesce(FrameQueue* queue, const BtStack_Frame* frame)
+{
+	uint16_t i;
+	for (i=0; i<queue->count; i++)
+	{
+		BtStack_Frame* queued = &queue->slots[(queue->head + i) % queue->depth];
+		if (queued->id.b32 == frame->id.b32)
+		{
+			// keeps the older frame's place, so the newest state goes out soonest
+			*queued = *frame;
+			queue->stats.coalesced++;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+int8_t FrameQueue_put(FrameQueue* queue, const BtStack_Frame* frame)
+{
+	Bool state = isState(queue, frame->id.b32);
+	if (state)
+	{
+		UInt key = Hwi_disable();
+		Bool replaced = coalesce(queue, frame);
+		if (replaced)
+		{
+			queue->stats.puts++;
+		}
+		Hwi_restore(key);
+
+		if (replaced)
+		{
+			return 0;
+		}
+	}
+
+	if (queue->policy == FRAMEQUEUE_BLOCK)
+	{
+		Semaphore_pend(queue->space, BIOS_WAIT_FOREVER);
+	}
+
+	UInt key = Hwi_disable();
+	queue->stats.puts++;
+
+	// another putter may have queued this ID while this one waited for space
+	if (state && (queue->policy == FRAMEQUEUE_BLOCK) && coalesce(queue, frame))
+	{
+		Hwi_restore(key);
+		Semaphore_post(queue->space);
+		return 0;
+	}
+
+	if (queue->count == queue->depth)
+	{
+		// a kept frame makes way for itself whatever the policy, unless only kept frames are queued
+		Bool kept = isKept(queue, frame->id.b32);
+		queue->stats.drops++;
+		if (((queue->policy == FRAMEQUEUE_DROP_NEWEST) && !kept) || !evict(queue))
+		{
+			Hwi_restore(key);
+			return -1;
+		}
+
+		// takes the place of the discarded frame, no. of queued frames is unchanged
+		queue->slots[(queue->head + queue->count) % queue->depth] = *frame;
+		queue->count++;
+		Hwi_restore(key);
+		return 0;
+	}
+
+	queue->slots[(queue->head + queue->count) % queue->depth] = *frame;
+	queue->count++;
+	if (queue->count > queue->stats.highWater)
+	{
+		queue->stats.highWater = queue->count;
+	}
+	Hwi_restore(key);
+
+	Semaphore_post(queue->items);
+	return 0;
+}
+
+Bool FrameQueue_get(FrameQueue* queue, BtStack_Frame* frame, UInt timeout)
+{
+	if (!Semaphore_pend(queue->items, timeout))
+	{
+		return FALSE;
+	}
+
+	UInt key = Hwi_disable();
+	*frame = queue->slots[queue->head];
+	queue->head = (queue->head + 1) % queue->depth;
+	queue->count--;
+	Hwi_restore(key);
+
+	if (queue->space != NULL)
+	{
+		Semaphore_post(queue->space);
+	}
+
+	return TRUE;
+}
+
+void FrameQueue_getStats(FrameQueue* queue, FrameQueue_Stats* stats)
+{
+	UInt key = Hwi_disable();
+	*stats = queue->stats;
+	Hwi_restore(key);
+}
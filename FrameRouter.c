@@ -0,0 +1,134 @@
+/**
+ * \file FrameRouter.c
+ * \brief Implements ID keyed KFP frame routing table
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-01-05
+ */
+
+#include "FrameRouter.h"
+
+/**
+ * \brief Multiplicative hash of an ID to a slot
+ */
+static uint8_t hashId(uint32_t id)
+{
+	return (uint8_t) ((id * 2654435761u) >> 26) & (FRAMEROUTER_HASH_SIZE - 1);
+}
+
+void FrameRouter_init(FrameRouter* router)
+{
+	router->count = 0;
+	router->exactCount = 0;
+	router->built = 0;
+}
+
+int8_t FrameRouter_add(FrameRouter* router, uint32_t id, uint32_t mask, FrameRouter_Fxn fxn)
+{
+	if (router->count == FRAMEROUTER_MAX_ROUTES)
+	{
+		return -1;
+	}
+
+	FrameRouter_Route* route = &router->routes[router->count];
+	route->id = id & mask;
+	route->mask = mask;
+	route->fxn = fxn;
+	router->count++;
+	router->built = 0;
+
+	return 0;
+}
+
+void FrameRouter_build(FrameRouter* router)
+{
+	uint8_t i, j;
+
+	// insertion sort, exact routes first in ID order, masked routes keep their order
+	for (i=1; i<router->count; i++)
+	{
+		FrameRouter_Route route = router->routes[i];
+		uint8_t exact = (route.mask == FRAMEROUTER_EXACT);
+
+		j = i;
+		while (j > 0)
+		{
+			const FrameRouter_Route* prev = &router->routes[j-1];
+			uint8_t prevExact = (prev->mask == FRAMEROUTER_EXACT);
+			if (!exact || (prevExact && (prev->id <= route.id)))
+			{
+				break;
+			}
+			router->routes[j] = *prev;
+			j--;
+		}
+		router->routes[j] = route;
+	}
+
+	router->exactCount = 0;
+	while ((router->exactCount < router->count) &&
+			(router->routes[router->exactCount].mask == FRAMEROUTER_EXACT))
+	{
+		router->exactCount++;
+	}
+
+	// hash the first route of each distinct exact ID
+	for (i=0; i<FRAMEROUTER_HASH_SIZE; i++)
+	{
+		router->hash[i] = 0;
+	}
+
+	for (i=0; i<router->exactCount; i++)
+	{
+		if ((i > 0) && (router->routes[i-1].id == router->routes[i].id))
+		{
+			continue;
+		}
+
+		uint8_t slot = hashId(router->routes[i].id);
+		while (router->hash[slot] != 0)
+		{
+			slot = (slot + 1) & (FRAMEROUTER_HASH_SIZE - 1);
+		}
+		router->hash[slot] = i + 1;
+	}
+
+	router->built = 1;
+}
+
+uint8_t FrameRouter_route(const FrameRouter* router, const BtStack_Frame* frame)
+{
+	uint32_t id = frame->id.b32;
+	uint8_t called = 0;
+	uint8_t i;
+
+	// exact routes, probe until the ID or an empty slot is found
+	uint8_t slot = hashId(id);
+	while (router->hash[slot] != 0)
+	{
+		i = router->hash[slot] - 1;
+		if (router->routes[i].id == id)
+		{
+			while ((i < router->exactCount) && (router->routes[i].id == id))
+			{
+				router->routes[i].fxn(frame);
+				called++;
+				i++;
+			}
+			break;
+		}
+		slot = (slot + 1) & (FRAMEROUTER_HASH_SIZE - 1);
+	}
+
+	// masked routes
+	for (i=router->exactCount; i<router->count; i++)
+	{
+		if ((id & router->routes[i].mask) == router->routes[i].id)
+		{
+			router->routes[i].fxn(frame);
+			called++;
+		}
+	}
+
+	return called;
+}
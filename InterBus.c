@@ -0,0 +1,950 @@
+/**
+ * \file InterBus.c
+ * \brief Implements inter board bus service
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-01-12
+ *
+ * Transactions wait in a fixed pool, linked into one FIFO per slave and
+ * priority. Only one is handed to the I2C driver at a time so the scheduler
+ * chooses what goes next, from the driver callback as each one completes.
+ *
+ * A failed transaction is retried after a growing backoff. Once its retries
+ * are used up it fails and the recovery task clears the bus and reopens the
+ * driver, queued transactions wait meanwhile.
+ *
+ * One extra slot past the pool is reserved for an urgent transaction, so it
+ * is never refused for lack of room and goes ahead of every queue.
+ */
+
+#include "InterBus.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include <inc/hw_memmap.h>
+#include <inc/hw_types.h>
+#include <driverlib/gpio.h>
+#include <driverlib/pin_map.h>
+#include <driverlib/sysctl.h>
+#include <xdc/runtime/Error.h>
+#include <xdc/runtime/Timestamp.h>
+#include <xdc/runtime/Types.h>
+#include <ti/sysbios/BIOS.h>
+#include <ti/sysbios/knl/Clock.h>
+#include <ti/sysbios/knl/Semaphore.h>
+#include <ti/sysbios/knl/Task.h>
+#include <ti/sysbios/hal/Hwi.h>
+#include <ti/drivers/I2C.h>
+
+#include "Board.h"
+
+#define NO_SLOT -1		//! End of a queue, or no transaction on the bus
+#define URGENT_SLOT INTERBUS_POOL_SIZE	//! Pool entry reserved for InterBus_urgent
+#define MAX_RETRIES 3					//! Retries of a failed transaction before the bus is recovered
+#define RETRY_BACKOFF 1					//! Clock ticks before the first retry, doubled for each further one
+#define DEFAULT_RECOVERY_PRIORITY 12	//! Default priority of recovery task, above the users of the bus
+#define DEFAULT_RECOVERY_STACK 768		//! Default stack size of recovery task
+#define RECOVERY_INTERVAL 10			//! Clock ticks between attempts while the bus stays stuck
+#define RECOVERY_ATTEMPTS 20			//! Attempts to reopen the driver before the bus is given up
+#define CLEAR_PULSES 9					//! SCL pulses which release a slave stuck mid byte
+#define STOP_TIMEOUT 1000				//! Longest ms InterBus_stop waits for queued transactions
+#define INTER_PORT GPIO_PORTB_BASE		//! Port of the Board_INTER pins
+#define INTER_SCL GPIO_PIN_2			//! SCL of Board_INTER
+#define INTER_SDA GPIO_PIN_3			//! SDA of Board_INTER
+
+/**
+ * \struct InterBus_Slot
+ * \brief A queued transaction and the buffers it refers to
+ */
+typedef struct
+{
+	I2C_Transaction transaction;			//! Transaction handed to the driver
+	UChar writeBuf[INTERBUS_MAX_WRITE];		//! Bytes written
+	UChar readBuf[INTERBUS_MAX_READ];		//! Bytes read
+	InterBus_DoneFxn doneFxn;				//! Called on completion, may be NULL
+	void* arg;								//! Passed to doneFxn
+	InterBus_Token token;					//! Token returned on submission
+	uint32_t queued;						//! Timestamp the transaction was queued at
+	int8_t slave;							//! Slave the transaction is for
+	int8_t next;							//! Next slot in the same queue
+	Bool inUse;								//! Slot holds a queued transaction
+	Bool supersedable;						//! Cancelled by an urgent write to the same slave
+} InterBus_Slot;
+
+/**
+ * \struct InterBus_Slave
+ * \brief Queues and counters of a registered slave
+ */
+typedef struct
+{
+	Bool used;									//! Entry holds a registered slave
+	uint8_t address;							//! 7 bit slave address
+	int8_t head[INTERBUS_PRIORITY_COUNT];		//! Oldest slot of each queue
+	int8_t tail[INTERBUS_PRIORITY_COUNT];		//! Newest slot of each queue
+	uint8_t pending;							//! No. of transactions queued or on the bus
+
+	InterBus_SlaveStats stats;					//! Counters, latencies are kept below
+	uint32_t latencyTotal;						//! Sum of queueing times, timestamp ticks
+	uint32_t latencyMax;						//! Longest queueing time, timestamp ticks
+	uint32_t started;							//! No. of transactions put on the bus
+} InterBus_Slave;
+
+/**
+ * \struct InterBus_Sync
+ * \brief Completion of a blocking caller, lives on the caller's stack
+ */
+typedef struct
+{
+	Semaphore_Struct sem;		//! Posted on completion
+	int8_t status;				//! Status of the transaction
+	uint8_t* read;				//! Where the bytes read are copied to
+	uint8_t readCount;			//! No. of bytes to copy
+} InterBus_Sync;
+
+static Bool hasStart = FALSE;
+static I2C_Handle bus;							//! Inter board I2C bus, open while the service runs
+static InterBus_Slot pool[INTERBUS_POOL_SIZE+1];	//! Storage of every queued transaction, URGENT_SLOT last
+static InterBus_Slave slaves[INTERBUS_MAX_SLAVES];
+static uint8_t rrNext[INTERBUS_PRIORITY_COUNT];	//! Slave looked at first for each priority
+static volatile int8_t active = NO_SLOT;		//! Slot on the bus
+static volatile uint8_t queuedCount;			//! No. of slots in use
+static volatile Bool urgentQueued;				//! URGENT_SLOT is waiting for the bus
+static InterBus_Token nextToken;				//! Token of the next submission, 1 to INT32_MAX
+
+static uint8_t retries;							//! Retries of the active slot so far
+static Clock_Handle retryClock = NULL;			//! One shot, retries the active slot after a backoff
+static Task_Handle recoveryTask = NULL;			//! Clears the bus and reopens the driver
+static Semaphore_Handle recoverySem = NULL;		//! Wakes the recovery task
+static int8_t recoveryPriority = DEFAULT_RECOVERY_PRIORITY;
+static uint16_t recoveryStackSize = DEFAULT_RECOVERY_STACK;
+static volatile Bool recovering;				//! Bus is being recovered, nothing is started
+static volatile Bool lost;						//! Recovery gave up, transactions are refused until a restart
+static Bool outage;								//! Transactions have failed since the last success
+static uint32_t outageStart;					//! Timestamp of the first failure of the outage
+static InterBus_BusStats busStats;				//! Counters, times are kept in timestamp ticks
+
+/**
+ * \brief Puts the next transaction on the bus if it is free, called with Hwi disabled
+ */
+static void startNext(void);
+
+/**
+ * \brief Called by the I2C driver when the transaction on the bus completes
+ */
+static void i2cDoneFxn(I2C_Handle handle, I2C_Transaction* transaction, Bool success);
+
+/**
+ * \brief Retries the active slot later, or fails it and recovers the bus, called with Hwi disabled
+ */
+static void transferFailed(void);
+
+/**
+ * \brief Runs in Swi context once the backoff of a retry has passed
+ */
+static void retryClockFxn(UArg unused);
+
+/**
+ * \brief Function executed by the recovery task
+ */
+static void recoveryFxn(UArg unused0, UArg unused1);
+
+/**
+ * \brief Releases a slave holding SDA low by clocking SCL, then issues a STOP
+ *
+ * \return Flag indicating whether SDA was released
+ */
+static Bool clearBus(void);
+
+/**
+ * \brief Opens Board_INTER in callback mode
+ */
+static I2C_Handle openBus(void);
+
+/**
+ * \brief Fills a slot with a transaction and counts it against its slave, called with Hwi disabled
+ */
+static void prepare(int8_t index, int8_t slave, const uint8_t* write, uint8_t writeCount,
+		uint8_t readCount, InterBus_DoneFxn doneFxn, void* arg);
+
+/**
+ * \brief Returns a slot to the pool, called with Hwi disabled
+ */
+static void release(int8_t index);
+
+/**
+ * \brief Queues a transaction, shared by the submission functions
+ */
+static int32_t enqueue(int8_t slave, InterBus_Priority priority, const uint8_t* write, uint8_t writeCount,
+		uint8_t readCount, InterBus_DoneFxn doneFxn, void* arg, Bool supersedable);
+
+/**
+ * \brief Fails every queued transaction, called with Hwi disabled and nothing on the bus
+ */
+static void failQueued(void);
+
+/**
+ * \brief Returns whether an index names a registered slave
+ */
+static Bool isSlave(int8_t slave);
+
+/**
+ * \brief Completion of the transaction of a blocking caller
+ */
+static void syncDoneFxn(InterBus_Token token, int8_t status, const uint8_t* read, void* arg);
+
+int8_t InterBus_start(void)
+{
+	if (hasStart)
+	{
+		return -1;
+	}
+
+	memset(pool, 0, sizeof(pool));
+	memset(rrNext, 0, sizeof(rrNext));
+	active = NO_SLOT;
+	queuedCount = 0;
+	urgentQueued = FALSE;
+	nextToken = 1;
+	retries = 0;
+	recovering = FALSE;
+	lost = FALSE;
+	outage = FALSE;
+	memset(&busStats, 0, sizeof(busStats));
+
+	Error_Block eb;
+	Error_init(&eb);
+
+	Clock_Params clockParams;
+	Clock_Params_init(&clockParams);
+	clockParams.period = 0;
+	clockParams.startFlag = FALSE;
+	retryClock = Clock_create((Clock_FuncPtr) retryClockFxn, RETRY_BACKOFF, &clockParams, &eb);
+
+	Semaphore_Params semParams;
+	Semaphore_Params_init(&semParams);
+	semParams.mode = Semaphore_Mode_BINARY;
+	recoverySem = Semaphore_create(0, &semParams, &eb);
+
+	Task_Params params;
+	Task_Params_init(&params);
+	params.instance->name = "interBus::recovery";
+	params.priority = recoveryPriority;
+	params.stackSize = recoveryStackSize;
+	recoveryTask = (recoverySem != NULL) ? Task_create((Task_FuncPtr) recoveryFxn, &params, &eb) : NULL;
+
+	bus = ((retryClock != NULL) && (recoveryTask != NULL)) ? openBus() : NULL;
+	if (!bus)
+	{
+		if (recoveryTask != NULL)
+		{
+			Task_delete(&recoveryTask);
+		}
+		if (recoverySem != NULL)
+		{
+			Semaphore_delete(&recoverySem);
+		}
+		if (retryClock != NULL)
+		{
+			Clock_delete(&retryClock);
+		}
+		return -2;
+	}
+
+	hasStart = TRUE;
+	return 0;
+}
+
+int8_t InterBus_stop(void)
+{
+	if (!hasStart)
+	{
+		return -1;
+	}
+
+	// refuse new transactions, then let the queued ones and any recovery finish
+	hasStart = FALSE;
+	uint32_t stopTicks = ((uint32_t)STOP_TIMEOUT * 1000) / Clock_tickPeriod;
+	uint32_t waited = 0;
+	while ((queuedCount > 0) || recovering)
+	{
+		if (waited++ >= stopTicks)
+		{
+			// the bus never recovered, keep serving what is queued
+			hasStart = TRUE;
+			return -2;
+		}
+		Task_sleep(1);
+	}
+
+	Task_delete(&recoveryTask);
+	Semaphore_delete(&recoverySem);
+	Clock_delete(&retryClock);
+	if (bus)
+	{
+		I2C_close(bus);
+		bus = NULL;
+	}
+	return 0;
+}
+
+Bool InterBus_hasStarted(void)
+{
+	return hasStart;
+}
+
+int8_t InterBus_addSlave(uint8_t address)
+{
+	UInt key = Hwi_disable();
+
+	int8_t i;
+	for (i = 0; i < INTERBUS_MAX_SLAVES; i++)
+	{
+		if (!slaves[i].used)
+		{
+			memset(&slaves[i], 0, sizeof(slaves[i]));
+			memset(slaves[i].head, NO_SLOT, sizeof(slaves[i].head));
+			memset(slaves[i].tail, NO_SLOT, sizeof(slaves[i].tail));
+			slaves[i].address = address;
+			slaves[i].used = TRUE;
+			Hwi_restore(key);
+			return i;
+		}
+	}
+
+	Hwi_restore(key);
+	return -1;
+}
+
+int8_t InterBus_removeSlave(int8_t slave)
+{
+	UInt key = Hwi_disable();
+	if (!isSlave(slave))
+	{
+		Hwi_restore(key);
+		return -2;
+	}
+
+	if (slaves[slave].pending > 0)
+	{
+		Hwi_restore(key);
+		return -1;
+	}
+
+	slaves[slave].used = FALSE;
+	Hwi_restore(key);
+	return 0;
+}
+
+int32_t InterBus_submit(int8_t slave, InterBus_Priority priority, const uint8_t* write,
+		uint8_t writeCount, uint8_t readCount, InterBus_DoneFxn doneFxn, void* arg)
+{
+	return enqueue(slave, priority, write, writeCount, readCount, doneFxn, arg, FALSE);
+}
+
+int32_t InterBus_supersedable(int8_t slave, const uint8_t* write, uint8_t writeCount,
+		InterBus_DoneFxn doneFxn, void* arg)
+{
+	return enqueue(slave, INTERBUS_PRIORITY_COMMAND, write, writeCount, 0, doneFxn, arg, TRUE);
+}
+
+static int32_t enqueue(int8_t slave, InterBus_Priority priority, const uint8_t* write, uint8_t writeCount,
+		uint8_t readCount, InterBus_DoneFxn doneFxn, void* arg, Bool supersedable)
+{
+	if ((writeCount > INTERBUS_MAX_WRITE) || (readCount > INTERBUS_MAX_READ) ||
+			((writeCount == 0) && (readCount == 0)) || (priority >= INTERBUS_PRIORITY_COUNT))
+	{
+		return -3;
+	}
+
+	UInt key = Hwi_disable();
+
+	if (!isSlave(slave))
+	{
+		Hwi_restore(key);
+		return -3;
+	}
+
+	if (lost)
+	{
+		Hwi_restore(key);
+		return -2;
+	}
+
+	if (!hasStart)
+	{
+		Hwi_restore(key);
+		return -1;
+	}
+
+	InterBus_Slave* s = &slaves[slave];
+	if ((s->pending >= INTERBUS_SLAVE_DEPTH) || (queuedCount >= INTERBUS_POOL_SIZE))
+	{
+		s->stats.queueFull++;
+		Hwi_restore(key);
+		return -2;
+	}
+
+	int8_t index = 0;
+	while (pool[index].inUse)
+	{
+		index++;
+	}
+
+	prepare(index, slave, write, writeCount, readCount, doneFxn, arg);
+	pool[index].queued = Timestamp_get32();
+	pool[index].supersedable = supersedable;
+
+	// append to the slave's queue of this priority
+	if (s->tail[priority] == NO_SLOT)
+	{
+		s->head[priority] = index;
+	}
+	else
+	{
+		pool[s->tail[priority]].next = index;
+	}
+	s->tail[priority] = index;
+
+	InterBus_Token token = pool[index].token;
+	startNext();
+	Hwi_restore(key);
+	return token;
+}
+
+int32_t InterBus_urgent(int8_t slave, const uint8_t* write, uint8_t writeCount, uint32_t since)
+{
+	if ((writeCount == 0) || (writeCount > INTERBUS_MAX_WRITE))
+	{
+		return -3;
+	}
+
+	UInt key = Hwi_disable();
+
+	if (!hasStart)
+	{
+		Hwi_restore(key);
+		return -1;
+	}
+
+	if (!isSlave(slave))
+	{
+		Hwi_restore(key);
+		return -3;
+	}
+
+	if (lost)
+	{
+		Hwi_restore(key);
+		return -2;
+	}
+
+	if (pool[URGENT_SLOT].inUse)
+	{
+		Hwi_restore(key);
+		return -2;
+	}
+
+	prepare(URGENT_SLOT, slave, write, writeCount, 0, NULL, NULL);
+	pool[URGENT_SLOT].queued = since;
+
+	// writes still waiting which the urgent one replaces would undo it, drop them
+	InterBus_Slave* s = &slaves[slave];
+	int8_t prev = NO_SLOT;
+	int8_t index = s->head[INTERBUS_PRIORITY_COMMAND];
+	while (index != NO_SLOT)
+	{
+		InterBus_Slot* slot = &pool[index];
+		int8_t next = slot->next;
+		if (!slot->supersedable)
+		{
+			prev = index;
+			index = next;
+			continue;
+		}
+
+		// unlink, the rest of the queue keeps its order
+		if (prev == NO_SLOT)
+		{
+			s->head[INTERBUS_PRIORITY_COMMAND] = next;
+		}
+		else
+		{
+			pool[prev].next = next;
+		}
+		if (s->tail[INTERBUS_PRIORITY_COMMAND] == index)
+		{
+			s->tail[INTERBUS_PRIORITY_COMMAND] = prev;
+		}
+
+		busStats.cancelled++;
+		if (slot->doneFxn != NULL)
+		{
+			slot->doneFxn(slot->token, -2, slot->readBuf, slot->arg);
+		}
+		release(index);
+		index = next;
+	}
+
+	// starts now unless a transaction is already on the bus
+	InterBus_Token token = pool[URGENT_SLOT].token;
+	urgentQueued = TRUE;
+	startNext();
+	Hwi_restore(key);
+	return token;
+}
+
+int8_t InterBus_transfer(int8_t slave, InterBus_Priority priority, const uint8_t* write,
+		uint8_t writeCount, uint8_t* read, uint8_t readCount)
+{
+	InterBus_Sync sync;
+	Semaphore_Params semParams;
+	Semaphore_Params_init(&semParams);
+	semParams.mode = Semaphore_Mode_BINARY;
+	Semaphore_construct(&sync.sem, 0, &semParams);
+	sync.read = read;
+	sync.readCount = readCount;
+
+	int32_t token = InterBus_submit(slave, priority, write, writeCount, readCount, syncDoneFxn, &sync);
+	if (token >= 0)
+	{
+		Semaphore_pend(Semaphore_handle(&sync.sem), BIOS_WAIT_FOREVER);
+	}
+	Semaphore_destruct(&sync.sem);
+
+	return (token >= 0) ? sync.status : (int8_t)token;
+}
+
+Bool InterBus_isDone(InterBus_Token token)
+{
+	UInt key = Hwi_disable();
+	uint8_t i;
+	for (i = 0; i <= URGENT_SLOT; i++)
+	{
+		if (pool[i].inUse && (pool[i].token == token))
+		{
+			Hwi_restore(key);
+			return FALSE;
+		}
+	}
+	Hwi_restore(key);
+	return TRUE;
+}
+
+uint8_t InterBus_pending(int8_t slave)
+{
+	return isSlave(slave) ? slaves[slave].pending : 0;
+}
+
+Bool InterBus_isIdle(void)
+{
+	return queuedCount == 0;
+}
+
+void InterBus_getBusStats(InterBus_BusStats* stats)
+{
+	UInt key = Hwi_disable();
+	*stats = busStats;
+	Hwi_restore(key);
+
+	// timestamp ticks to microseconds
+	Types_FreqHz freq;
+	Timestamp_getFreq(&freq);
+	uint32_t ticksPerUs = freq.lo / 1000000;
+	if (ticksPerUs == 0)
+	{
+		ticksPerUs = 1;
+	}
+
+	stats->maxRecoveryUs /= ticksPerUs;
+	stats->lastOutageUs /= ticksPerUs;
+	stats->maxOutageUs /= ticksPerUs;
+	stats->lastUrgentUs /= ticksPerUs;
+	stats->maxUrgentUs /= ticksPerUs;
+}
+
+void InterBus_getSlaveStats(int8_t slave, InterBus_SlaveStats* stats)
+{
+	if (!isSlave(slave))
+	{
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	const InterBus_Slave* s = &slaves[slave];
+
+	UInt key = Hwi_disable();
+	*stats = s->stats;
+	uint32_t total = s->latencyTotal;
+	uint32_t max = s->latencyMax;
+	uint32_t started = s->started;
+	Hwi_restore(key);
+
+	// timestamp ticks to microseconds
+	Types_FreqHz freq;
+	Timestamp_getFreq(&freq);
+	uint32_t ticksPerUs = freq.lo / 1000000;
+	if (ticksPerUs == 0)
+	{
+		ticksPerUs = 1;
+	}
+
+	stats->maxLatencyUs = max / ticksPerUs;
+	stats->meanLatencyUs = (started > 0) ? (total / started) / ticksPerUs : 0;
+}
+
+static void startNext(void)
+{
+	while ((active == NO_SLOT) && !recovering)
+	{
+		// an urgent transaction first, then the highest priority with work,
+		// round-robin between its slaves
+		int8_t index = NO_SLOT;
+		if (urgentQueued)
+		{
+			index = URGENT_SLOT;
+			urgentQueued = FALSE;
+		}
+
+		uint8_t p;
+		for (p = 0; (p < INTERBUS_PRIORITY_COUNT) && (index == NO_SLOT); p++)
+		{
+			uint8_t k;
+			for (k = 0; k < INTERBUS_MAX_SLAVES; k++)
+			{
+				uint8_t i = (rrNext[p] + k) % INTERBUS_MAX_SLAVES;
+				InterBus_Slave* s = &slaves[i];
+				if (s->used && (s->head[p] != NO_SLOT))
+				{
+					index = s->head[p];
+					s->head[p] = pool[index].next;
+					if (s->head[p] == NO_SLOT)
+					{
+						s->tail[p] = NO_SLOT;
+					}
+					rrNext[p] = (i + 1) % INTERBUS_MAX_SLAVES;
+					break;
+				}
+			}
+		}
+
+		if (index == NO_SLOT)
+		{
+			// nothing queued
+			return;
+		}
+
+		InterBus_Slot* slot = &pool[index];
+		InterBus_Slave* s = &slaves[slot->slave];
+		uint32_t latency = Timestamp_get32() - slot->queued;
+		s->latencyTotal += latency;
+		if (latency > s->latencyMax)
+		{
+			s->latencyMax = latency;
+		}
+		s->started++;
+
+		if (index == URGENT_SLOT)
+		{
+			busStats.urgent++;
+			busStats.lastUrgentUs = latency;
+			if (latency > busStats.maxUrgentUs)
+			{
+				busStats.maxUrgentUs = latency;
+			}
+		}
+
+		active = index;
+		retries = 0;
+		if (!I2C_transfer(bus, &slot->transaction))
+		{
+			transferFailed();
+		}
+	}
+}
+
+static void i2cDoneFxn(I2C_Handle handle, I2C_Transaction* transaction, Bool success)
+{
+	int8_t index = (int8_t)transaction->arg;
+	InterBus_Slot* slot = &pool[index];
+	InterBus_Slave* s = &slaves[slot->slave];
+
+	if (!success)
+	{
+		UInt key = Hwi_disable();
+		transferFailed();
+		Hwi_restore(key);
+		return;
+	}
+
+	s->stats.completed++;
+	s->stats.bytes += transaction->writeCount + transaction->readCount;
+	if (outage)
+	{
+		// control is back, account for how long it was lost
+		outage = FALSE;
+		busStats.lastOutageUs = Timestamp_get32() - outageStart;
+		if (busStats.lastOutageUs > busStats.maxOutageUs)
+		{
+			busStats.maxOutageUs = busStats.lastOutageUs;
+		}
+	}
+
+	// slot stays in use until the callback returns, its read buffer is handed over
+	if (slot->doneFxn != NULL)
+	{
+		slot->doneFxn(slot->token, 0, slot->readBuf, slot->arg);
+	}
+
+	UInt key = Hwi_disable();
+	release(index);
+	active = NO_SLOT;
+	startNext();
+	Hwi_restore(key);
+}
+
+static void transferFailed(void)
+{
+	int8_t index = active;
+	InterBus_Slot* slot = &pool[index];
+
+	if (!outage)
+	{
+		outage = TRUE;
+		outageStart = Timestamp_get32();
+		busStats.outages++;
+	}
+
+	if (retries < MAX_RETRIES)
+	{
+		// slot stays on the bus until the retry
+		Clock_setTimeout(retryClock, RETRY_BACKOFF << retries);
+		Clock_start(retryClock);
+		retries++;
+		busStats.retries++;
+		return;
+	}
+
+	// give up on it and recover the bus before starting anything else
+	slaves[slot->slave].stats.errors++;
+	busStats.failures++;
+	if (slot->doneFxn != NULL)
+	{
+		slot->doneFxn(slot->token, -2, slot->readBuf, slot->arg);
+	}
+	release(index);
+	active = NO_SLOT;
+	retries = 0;
+
+	recovering = TRUE;
+	Semaphore_post(recoverySem);
+}
+
+static void retryClockFxn(UArg unused)
+{
+	UInt key = Hwi_disable();
+	if ((active != NO_SLOT) && !recovering)
+	{
+		if (!I2C_transfer(bus, &pool[active].transaction))
+		{
+			transferFailed();
+		}
+	}
+	Hwi_restore(key);
+}
+
+static void recoveryFxn(UArg unused0, UArg unused1)
+{
+	uint8_t attempts = 0;		//! Failed attempts to reopen the driver in a row
+
+	while(TRUE)
+	{
+		Semaphore_pend(recoverySem, BIOS_WAIT_FOREVER);
+
+		uint32_t began = Timestamp_get32();
+		if (bus)
+		{
+			I2C_close(bus);
+			bus = NULL;
+		}
+
+		if (!clearBus())
+		{
+			busStats.stuckBus++;
+		}
+
+		bus = openBus();
+		if (!bus)
+		{
+			busStats.recoveryFailures++;
+			if (++attempts < RECOVERY_ATTEMPTS)
+			{
+				// try again shortly, queued transactions keep waiting
+				Task_sleep(RECOVERY_INTERVAL);
+				Semaphore_post(recoverySem);
+				continue;
+			}
+
+			// nothing will reach the slaves, let the callers waiting on them go
+			UInt key = Hwi_disable();
+			lost = TRUE;
+			failQueued();
+			recovering = FALSE;
+			Hwi_restore(key);
+			attempts = 0;
+			continue;
+		}
+		attempts = 0;
+
+		UInt key = Hwi_disable();
+		busStats.recoveries++;
+		uint32_t took = Timestamp_get32() - began;
+		if (took > busStats.maxRecoveryUs)
+		{
+			busStats.maxRecoveryUs = took;
+		}
+		recovering = FALSE;
+		startNext();
+		Hwi_restore(key);
+	}
+}
+
+static Bool clearBus(void)
+{
+	// half a 100 kHz bit, SysCtlDelay takes 3 cycles per loop
+	uint32_t halfBit = SysCtlClockGet() / (3 * 200000);
+
+	// take both lines as open drain GPIO, released high
+	GPIOPinTypeGPIOOutputOD(INTER_PORT, INTER_SCL | INTER_SDA);
+	GPIOPinWrite(INTER_PORT, INTER_SCL | INTER_SDA, INTER_SCL | INTER_SDA);
+	SysCtlDelay(halfBit);
+
+	// clock out whatever the slave is still sending until it lets go of SDA
+	uint8_t i;
+	for (i = 0; (i < CLEAR_PULSES) && !GPIOPinRead(INTER_PORT, INTER_SDA); i++)
+	{
+		GPIOPinWrite(INTER_PORT, INTER_SCL, 0);
+		SysCtlDelay(halfBit);
+		GPIOPinWrite(INTER_PORT, INTER_SCL, INTER_SCL);
+		SysCtlDelay(halfBit);
+	}
+	Bool released = GPIOPinRead(INTER_PORT, INTER_SDA) ? TRUE : FALSE;
+
+	// STOP, SDA rises while SCL is high
+	GPIOPinWrite(INTER_PORT, INTER_SDA, 0);
+	SysCtlDelay(halfBit);
+	GPIOPinWrite(INTER_PORT, INTER_SDA, INTER_SDA);
+	SysCtlDelay(halfBit);
+
+	// hand the pins back to the I2C peripheral
+	GPIOPinConfigure(GPIO_PB2_I2C0SCL);
+	GPIOPinConfigure(GPIO_PB3_I2C0SDA);
+	GPIOPinTypeI2CSCL(INTER_PORT, INTER_SCL);
+	GPIOPinTypeI2C(INTER_PORT, INTER_SDA);
+
+	return released;
+}
+
+static I2C_Handle openBus(void)
+{
+	I2C_Params params;
+	I2C_Params_init(&params);
+	params.transferMode = I2C_MODE_CALLBACK;
+	params.transferCallbackFxn = i2cDoneFxn;
+	return I2C_open(Board_INTER, &params);
+}
+
+static void prepare(int8_t index, int8_t slave, const uint8_t* write, uint8_t writeCount,
+		uint8_t readCount, InterBus_DoneFxn doneFxn, void* arg)
+{
+	InterBus_Slave* s = &slaves[slave];
+	InterBus_Slot* slot = &pool[index];
+	slot->inUse = TRUE;
+	slot->slave = slave;
+	slot->next = NO_SLOT;
+	slot->supersedable = FALSE;
+	slot->doneFxn = doneFxn;
+	slot->arg = arg;
+	slot->token = nextToken;
+
+	// tokens are returned as int32_t, where negative values are errors
+	nextToken = (nextToken >= INT32_MAX) ? 1 : nextToken + 1;
+	memcpy(slot->writeBuf, write, writeCount);
+
+	slot->transaction.writeBuf = slot->writeBuf;
+	slot->transaction.writeCount = writeCount;
+	slot->transaction.readBuf = slot->readBuf;
+	slot->transaction.readCount = readCount;
+	slot->transaction.slaveAddress = s->address;
+	slot->transaction.arg = (UArg)index;
+
+	queuedCount++;
+	s->pending++;
+	s->stats.submitted++;
+	if (s->pending > s->stats.highWater)
+	{
+		s->stats.highWater = s->pending;
+	}
+}
+
+static void release(int8_t index)
+{
+	slaves[pool[index].slave].pending--;
+	pool[index].inUse = FALSE;
+	queuedCount--;
+}
+
+static void failQueued(void)
+{
+	if (urgentQueued)
+	{
+		InterBus_Slot* slot = &pool[URGENT_SLOT];
+		urgentQueued = FALSE;
+		slaves[slot->slave].stats.errors++;
+		busStats.failures++;
+		if (slot->doneFxn != NULL)
+		{
+			slot->doneFxn(slot->token, -2, slot->readBuf, slot->arg);
+		}
+		release(URGENT_SLOT);
+	}
+
+	uint8_t i;
+	uint8_t p;
+	for (i = 0; i < INTERBUS_MAX_SLAVES; i++)
+	{
+		InterBus_Slave* s = &slaves[i];
+		for (p = 0; p < INTERBUS_PRIORITY_COUNT; p++)
+		{
+			while (s->head[p] != NO_SLOT)
+			{
+				int8_t index = s->head[p];
+				InterBus_Slot* slot = &pool[index];
+				s->head[p] = slot->next;
+				s->stats.errors++;
+				busStats.failures++;
+				if (slot->doneFxn != NULL)
+				{
+					slot->doneFxn(slot->token, -2, slot->readBuf, slot->arg);
+				}
+				release(index);
+			}
+			s->tail[p] = NO_SLOT;
+		}
+	}
+}
+
+static Bool isSlave(int8_t slave)
+{
+	return (slave >= 0) && (slave < INTERBUS_MAX_SLAVES) && slaves[slave].used;
+}
+
+static void syncDoneFxn(InterBus_Token token, int8_t status, const uint8_t* read, void* arg)
+{
+	InterBus_Sync* sync = (InterBus_Sync*)arg;
+	sync->status = status;
+	if ((status == 0) && (sync->readCount > 0))
+	{
+		memcpy(sync->read, read, sync->readCount);
+	}
+	Semaphore_post(Semaphore_handle(&sync->sem));
+}
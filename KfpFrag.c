@@ -0,0 +1,299 @@
+/**
+ * \file KfpFrag.c
+ * \brief Implements variable length KFP frames and fragmentation of long messages
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-01-24
+ *
+ * Fragment link frame: type, length of data, message number, fragment index,
+ * fragment count, offset of data in the message (2 bytes, little endian),
+ * ID (4 bytes), data.
+ */
+
+#include "KfpFrag.h"
+
+#include <string.h>
+#include <ti/sysbios/knl/Clock.h>
+#include <ti/sysbios/knl/Task.h>
+#include <ti/sysbios/hal/Hwi.h>
+
+#define DEFAULT_MTU (BTSTACK_MAX_RAW - 1)	//! Default bytes per link frame, fits the control lane escaped throughout
+#define DEFAULT_TIMEOUT 500				//! Default ms a partly received message is kept
+#define MAX_SEND_WAIT 1000				//! Longest ms to wait for room for a fragment
+
+/**
+ * \struct KfpFrag_Slot
+ * \brief A message being reassembled
+ */
+typedef struct
+{
+	Bool inUse;									//! Slot holds a partly received message
+	uint8_t message;							//! Message number of the sender
+	uint32_t id;								//! ID of the message
+	uint8_t count;								//! No. of fragments of the message
+	uint8_t received;							//! No. of distinct fragments received
+	uint8_t seen[KFPFRAG_MAX_FRAGMENTS/8];		//! Bit per fragment received
+	uint16_t len;								//! End of the furthest data received
+	uint32_t tick;								//! Clock tick the last fragment arrived at
+	uint8_t data[KFPFRAG_MAX_MESSAGE];			//! Message
+} KfpFrag_Slot;
+
+static Bool hasStart = FALSE;
+static uint8_t mtu = DEFAULT_MTU;				//! Bytes per link frame
+static uint16_t timeoutMs = DEFAULT_TIMEOUT;	//! ms a partly received message is kept
+static uint32_t timeoutTicks;					//! timeoutMs in Clock ticks
+static KfpFrag_Fxn messageFxn;					//! Called with each complete message
+static uint8_t nextMessage;						//! Message number of the next message sent
+static KfpFrag_Slot slots[KFPFRAG_SLOTS];		//! Reassembly slots, only used by the reception task
+static KfpFrag_Stats stats;
+
+/**
+ * \brief Runs in the reception task with fragment link frames
+ */
+static void fragFxn(const uint8_t* frame, uint16_t size);
+
+/**
+ * \brief Finds the slot of a message, or frees one for it
+ */
+static KfpFrag_Slot* slotFor(uint8_t message, uint32_t id, uint8_t count);
+
+int8_t KfpFrag_setMtu(uint8_t size)
+{
+	if (hasStart)
+	{
+		return -1;
+	}
+
+	if ((size <= KFPFRAG_HEADER_SIZE) || (size > BTSTACK_MAX_RAW))
+	{
+		return -2;
+	}
+
+	mtu = size;
+	return 0;
+}
+
+int8_t KfpFrag_setTimeout(uint16_t ms)
+{
+	if (hasStart)
+	{
+		return -1;
+	}
+
+	timeoutMs = ms;
+	return 0;
+}
+
+int8_t KfpFrag_start(KfpFrag_Fxn fxn)
+{
+	if (hasStart || BtStack_hasStarted())
+	{
+		return -1;
+	}
+
+	if (fxn == NULL)
+	{
+		return -3;
+	}
+
+	memset(slots, 0, sizeof(slots));
+	memset(&stats, 0, sizeof(stats));
+	messageFxn = fxn;
+	nextMessage = 0;
+	timeoutTicks = ((uint32_t)timeoutMs * 1000) / Clock_tickPeriod;
+
+	BtStack_link(KFP_LINK_FRAG, fragFxn);
+
+	hasStart = TRUE;
+	return 0;
+}
+
+int8_t KfpFrag_stop(void)
+{
+	if (!hasStart)
+	{
+		return -1;
+	}
+
+	hasStart = FALSE;
+	return 0;
+}
+
+int8_t KfpFrag_send(uint32_t id, const uint8_t* data, uint16_t len, BtStack_Lane lane, UInt timeout)
+{
+	if (!hasStart)
+	{
+		return -1;
+	}
+
+	// a stalled link must not hold the caller forever
+	UInt maxWait = ((uint32_t)MAX_SEND_WAIT * 1000) / Clock_tickPeriod;
+	if (timeout > maxWait)
+	{
+		timeout = maxWait;
+	}
+
+	uint8_t chunk = mtu - KFPFRAG_HEADER_SIZE;
+	uint16_t count = (len + chunk - 1) / chunk;
+	if ((len == 0) || (len > KFPFRAG_MAX_MESSAGE) || (count > KFPFRAG_MAX_FRAGMENTS))
+	{
+		return -3;
+	}
+
+	UInt key = Hwi_disable();
+	uint8_t message = nextMessage++;
+	Hwi_restore(key);
+
+	uint8_t frame[BTSTACK_MAX_RAW];
+	frame[0] = KFP_LINK_FRAG;
+	frame[2] = message;
+	frame[4] = count;
+	memcpy(&frame[7], &id, 4);
+
+	uint16_t offset = 0;
+	uint8_t index;
+	for (index = 0; index < count; index++)
+	{
+		uint8_t part = (len - offset > chunk) ? chunk : len - offset;
+		frame[1] = part;
+		frame[3] = index;
+		frame[5] = offset & 0xFF;
+		frame[6] = offset >> 8;
+		memcpy(&frame[KFPFRAG_HEADER_SIZE], &data[offset], part);
+
+		// lane drains as the transmission task writes, wait for it
+		UInt waited = 0;
+		int16_t status;
+		while ((status = BtStack_pushRaw(frame, KFPFRAG_HEADER_SIZE + part, lane)) == -2)
+		{
+			if (waited++ >= timeout)
+			{
+				return -2;
+			}
+			Task_sleep(1);
+		}
+
+		if (status < 0)
+		{
+			// stopped, or the fragment is too large for the lane
+			return -4;
+		}
+
+		offset += part;
+		stats.fragmentsSent++;
+	}
+
+	stats.messagesSent++;
+	stats.bytesSent += len;
+	return 0;
+}
+
+void KfpFrag_getStats(KfpFrag_Stats* out)
+{
+	UInt key = Hwi_disable();
+	*out = stats;
+	Hwi_restore(key);
+}
+
+static void fragFxn(const uint8_t* frame, uint16_t size)
+{
+	stats.fragmentsReceived++;
+
+	// check the header against the frame before trusting it
+	if (size < KFPFRAG_HEADER_SIZE)
+	{
+		stats.dropped++;
+		return;
+	}
+
+	uint8_t part = frame[1];
+	uint8_t index = frame[3];
+	uint8_t count = frame[4];
+	uint16_t offset = frame[5] | (frame[6] << 8);
+	uint32_t id;
+	memcpy(&id, &frame[7], 4);
+	if ((size != KFPFRAG_HEADER_SIZE + part) || (count == 0) ||
+			(count > KFPFRAG_MAX_FRAGMENTS) || (index >= count) || (offset + part > KFPFRAG_MAX_MESSAGE))
+	{
+		stats.dropped++;
+		return;
+	}
+
+	// a message in one frame needs no reassembly
+	if (count == 1)
+	{
+		messageFxn(id, &frame[KFPFRAG_HEADER_SIZE], part);
+		stats.messagesReceived++;
+		return;
+	}
+
+	KfpFrag_Slot* slot = slotFor(frame[2], id, count);
+	if (slot == NULL)
+	{
+		stats.dropped++;
+		return;
+	}
+
+	slot->tick = Clock_getTicks();
+	uint8_t bit = 1 << (index % 8);
+	if (slot->seen[index / 8] & bit)
+	{
+		// repeated fragment
+		return;
+	}
+
+	slot->seen[index / 8] |= bit;
+	slot->received++;
+	memcpy(&slot->data[offset], &frame[KFPFRAG_HEADER_SIZE], part);
+	if (offset + part > slot->len)
+	{
+		slot->len = offset + part;
+	}
+
+	if (slot->received == slot->count)
+	{
+		messageFxn(slot->id, slot->data, slot->len);
+		stats.messagesReceived++;
+		slot->inUse = FALSE;
+	}
+}
+
+static KfpFrag_Slot* slotFor(uint8_t message, uint32_t id, uint8_t count)
+{
+	uint32_t now = Clock_getTicks();
+	KfpFrag_Slot* free = NULL;
+
+	uint8_t i;
+	for (i = 0; i < KFPFRAG_SLOTS; i++)
+	{
+		KfpFrag_Slot* slot = &slots[i];
+		if (slot->inUse && (slot->message == message) && (slot->id == id) && (slot->count == count))
+		{
+			return slot;
+		}
+
+		// abandon messages which stopped arriving
+		if (slot->inUse && ((now - slot->tick) > timeoutTicks))
+		{
+			slot->inUse = FALSE;
+			stats.timeouts++;
+		}
+
+		if (!slot->inUse && (free == NULL))
+		{
+			free = slot;
+		}
+	}
+
+	if (free != NULL)
+	{
+		free->inUse = TRUE;
+		free->message = message;
+		free->id = id;
+		free->count = count;
+		free->received = 0;
+		free->len = 0;
+		memset(free->seen, 0, sizeof(free->seen));
+	}
+	return free;
+}
@@ -0,0 +1,540 @@
+/**
+ * \file KfpRel.c
+ * \brief Implements reliable KFP channel
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-01-20
+ *
+ * Data link frame: type, session of the sender (2 bytes, little endian),
+ * sequence number, 12 byte KFP frame.
+ * Ack link frame: type, session of the acknowledging end, session of the
+ * data frames acknowledged, next sequence number expected, bitmap where bit i
+ * means the frame i+1 after the expected one has arrived.
+ *
+ * Each end picks a session at random when it first sends. A data frame from a
+ * new session restarts reception at sequence number 0. An ack from a new
+ * session means the peer restarted, unacknowledged frames are numbered again
+ * from 0 and sent at once.
+ */
+
+#include "KfpRel.h"
+
+#include <string.h>
+#include <xdc/runtime/Error.h>
+#include <xdc/runtime/Timestamp.h>
+#include <ti/sysbios/BIOS.h>
+#include <ti/sysbios/knl/Clock.h>
+#include <ti/sysbios/knl/Semaphore.h>
+#include <ti/sysbios/knl/Task.h>
+#include <ti/sysbios/hal/Hwi.h>
+
+#include "BtStack.h"
+
+#define DEFAULT_WINDOW 4				//! Default no. of frames unacknowledged at once
+#define DEFAULT_TIMEOUT 60				//! Default ms before an unacknowledged frame is sent again
+#define CHECK_INTERVAL 5				//! ms between checks for frames to send again
+#define DEFAULT_RETRY_PRIORITY 9		//! Default priority of retransmission task, alongside btStack transmission
+#define DEFAULT_RETRY_STACK 1024		//! Default stack size of retransmission task, holds a frame being encoded
+#define MAX_SEND_WAIT 1000				//! Longest ms to wait for room in the window
+#define DATA_SIZE (4 + KFP_FRAME_SIZE-2)	//! No. of bytes in a data link frame
+#define ACK_SIZE 7						//! No. of bytes in an ack link frame
+
+/**
+ * \struct KfpRel_TxSlot
+ * \brief A sent frame waiting for acknowledgement
+ */
+typedef struct
+{
+	BtStack_Frame frame;		//! Frame sent
+	uint32_t sentTick;			//! Clock tick it was last sent at
+	Bool acked;					//! Selectively acknowledged, not sent again
+} KfpRel_TxSlot;
+
+static Bool hasStart = FALSE;
+static uint8_t window = DEFAULT_WINDOW;		//! Frames unacknowledged at once
+static uint16_t timeoutMs = DEFAULT_TIMEOUT;	//! ms before a frame is sent again
+static uint32_t timeoutTicks;				//! timeoutMs in Clock ticks
+
+static Semaphore_Handle windowSem = NULL;	//! Counts free places in the window
+static Clock_Handle checkClock = NULL;		//! Wakes the retransmission task
+static Semaphore_Handle checkSem = NULL;	//! Posted by checkClock
+static Task_Handle retryTask = NULL;		//! Sends again frames which timed out
+static int8_t retryPriority = DEFAULT_RETRY_PRIORITY;
+static uint16_t retryStackSize = DEFAULT_RETRY_STACK;
+
+static KfpRel_TxSlot txSlots[KFPREL_MAX_WINDOW];	//! Unacknowledged frames, indexed by sequence number
+static uint8_t sendBase;					//! Oldest unacknowledged sequence number
+static uint8_t sendNext;					//! Sequence number of the next frame sent
+static uint16_t epoch;						//! Session of this end, 0 until the first frame is sent
+static uint16_t txPeerEpoch;				//! Session of the end acknowledging sent frames, 0 before the first ack
+
+static BtStack_Frame rxSlots[KFPREL_MAX_WINDOW];	//! Frames which arrived early, indexed by sequence number
+static uint8_t rxValid;						//! Bit per entry of rxSlots holding a frame
+static uint8_t recvNext;					//! Sequence number expected next
+static uint16_t rxEpoch;					//! Session of the received data frames, 0 before the first
+
+static KfpRel_Stats stats;
+
+/**
+ * \brief Session of this end, picked on first use, call with interrupts disabled
+ */
+static uint16_t currentEpoch(void);
+
+/**
+ * \brief Numbers unacknowledged frames again from 0 for a restarted peer, call with interrupts disabled
+ */
+static void renumber(void);
+
+/**
+ * \brief Sends the data link frame of a sequence number
+ */
+static int16_t transmit(uint8_t seq);
+
+/**
+ * \brief Acknowledges everything received so far
+ */
+static void sendAck(void);
+
+/**
+ * \brief Runs in the reception task with data link frames
+ */
+static void dataFxn(const uint8_t* frame, uint16_t size);
+
+/**
+ * \brief Runs in the reception task with ack link frames
+ */
+static void ackFxn(const uint8_t* frame, uint16_t size);
+
+/**
+ * \brief Runs in Swi context, wakes the retransmission task
+ */
+static void checkFxn(UArg unused);
+
+/**
+ * \brief Function executed by the retransmission task, sends again frames which timed out
+ *
+ * Encoding a frame takes several hundred bytes of stack, too much for the
+ * system stack Swis share with Hwis.
+ */
+static void retryFxn(UArg unused0, UArg unused1);
+
+int8_t KfpRel_setWindow(uint8_t size)
+{
+	if (hasStart)
+	{
+		return -1;
+	}
+
+	if ((size == 0) || (size > KFPREL_MAX_WINDOW))
+	{
+		return -2;
+	}
+
+	window = size;
+	return 0;
+}
+
+int8_t KfpRel_setTimeout(uint16_t ms)
+{
+	if (hasStart)
+	{
+		return -1;
+	}
+
+	if (ms == 0)
+	{
+		return -2;
+	}
+
+	timeoutMs = ms;
+	return 0;
+}
+
+int8_t KfpRel_start(void)
+{
+	if (hasStart || BtStack_hasStarted())
+	{
+		return -1;
+	}
+
+	memset(txSlots, 0, sizeof(txSlots));
+	memset(&stats, 0, sizeof(stats));
+	sendBase = 0;
+	sendNext = 0;
+	epoch = 0;
+	txPeerEpoch = 0;
+	rxValid = 0;
+	recvNext = 0;
+	rxEpoch = 0;
+	timeoutTicks = ((uint32_t)timeoutMs * 1000) / Clock_tickPeriod;
+
+	Error_Block eb;
+	Error_init(&eb);
+
+	Semaphore_Params semParams;
+	Semaphore_Params_init(&semParams);
+	semParams.mode = Semaphore_Mode_COUNTING;
+	windowSem = Semaphore_create(window, &semParams, &eb);
+	if (windowSem == NULL)
+	{
+		return -2;
+	}
+
+	semParams.mode = Semaphore_Mode_BINARY;
+	checkSem = Semaphore_create(0, &semParams, &eb);
+	if (checkSem == NULL)
+	{
+		Semaphore_delete(&windowSem);
+		return -2;
+	}
+
+	Task_Params taskParams;
+	Task_Params_init(&taskParams);
+	taskParams.instance->name = "kfpRel::retry";
+	taskParams.priority = retryPriority;
+	taskParams.stackSize = retryStackSize;
+	retryTask = Task_create((Task_FuncPtr) retryFxn, &taskParams, &eb);
+	if (retryTask == NULL)
+	{
+		Semaphore_delete(&checkSem);
+		Semaphore_delete(&windowSem);
+		return -2;
+	}
+
+	UInt period = (CHECK_INTERVAL * 1000) / Clock_tickPeriod;
+	if (period == 0)
+	{
+		period = 1;
+	}
+
+	Clock_Params clockParams;
+	Clock_Params_init(&clockParams);
+	clockParams.period = period;
+	clockParams.startFlag = TRUE;
+	checkClock = Clock_create((Clock_FuncPtr) checkFxn, period, &clockParams, &eb);
+	if (checkClock == NULL)
+	{
+		Task_delete(&retryTask);
+		Semaphore_delete(&checkSem);
+		Semaphore_delete(&windowSem);
+		return -2;
+	}
+
+	BtStack_link(KFP_LINK_REL_DATA, dataFxn);
+	BtStack_link(KFP_LINK_REL_ACK, ackFxn);
+
+	hasStart = TRUE;
+	return 0;
+}
+
+int8_t KfpRel_stop(void)
+{
+	if (!hasStart)
+	{
+		return -1;
+	}
+
+	Clock_stop(checkClock);
+	Clock_delete(&checkClock);
+	Task_delete(&retryTask);
+	Semaphore_delete(&checkSem);
+	Semaphore_delete(&windowSem);
+	hasStart = FALSE;
+	return 0;
+}
+
+int8_t KfpRel_send(const BtStack_Frame* frame, UInt timeout)
+{
+	if (!hasStart)
+	{
+		return -1;
+	}
+
+	// a peer which stopped acknowledging must not hold the caller forever
+	UInt maxWait = ((uint32_t)MAX_SEND_WAIT * 1000) / Clock_tickPeriod;
+	if (timeout > maxWait)
+	{
+		timeout = maxWait;
+	}
+
+	if (!Semaphore_pend(windowSem, timeout))
+	{
+		return -2;
+	}
+
+	UInt key = Hwi_disable();
+	uint8_t seq = sendNext++;
+	KfpRel_TxSlot* slot = &txSlots[seq % KFPREL_MAX_WINDOW];
+	slot->frame = *frame;
+	slot->sentTick = Clock_getTicks();
+	slot->acked = FALSE;
+	stats.sent++;
+	Hwi_restore(key);
+
+	// a frame the lanes refuse stays in the window and is sent again once it times out
+	if (transmit(seq) < 0)
+	{
+		return -3;
+	}
+	return 0;
+}
+
+void KfpRel_getStats(KfpRel_Stats* out)
+{
+	UInt key = Hwi_disable();
+	*out = stats;
+	Hwi_restore(key);
+}
+
+static uint16_t currentEpoch(void)
+{
+	if (epoch == 0)
+	{
+		// the time of the first frame differs from one start to the next
+		uint32_t now = Timestamp_get32();
+		epoch = (uint16_t)(now ^ (now >> 16));
+		if (epoch == 0)
+		{
+			epoch = 1;
+		}
+	}
+	return epoch;
+}
+
+static void renumber(void)
+{
+	uint8_t count = sendNext - sendBase;
+	KfpRel_TxSlot moved[KFPREL_MAX_WINDOW];
+	uint8_t i;
+	for (i = 0; i < count; i++)
+	{
+		moved[i] = txSlots[(uint8_t)(sendBase + i) % KFPREL_MAX_WINDOW];
+	}
+
+	// frames the old session held out of order are lost with it, all go again
+	uint32_t now = Clock_getTicks();
+	for (i = 0; i < count; i++)
+	{
+		txSlots[i] = moved[i];
+		txSlots[i].sentTick = now - timeoutTicks;
+		txSlots[i].acked = FALSE;
+	}
+	sendBase = 0;
+	sendNext = count;
+	stats.resyncs++;
+}
+
+static int16_t transmit(uint8_t seq)
+{
+	uint8_t data[DATA_SIZE];
+
+	UInt key = Hwi_disable();
+	if ((uint8_t)(seq - sendBase) >= (uint8_t)(sendNext - sendBase))
+	{
+		// numbered again since, the frame goes under its new number
+		Hwi_restore(key);
+		return 0;
+	}
+	uint16_t session = currentEpoch();
+	data[0] = KFP_LINK_REL_DATA;
+	data[1] = session & 0xFF;
+	data[2] = session >> 8;
+	data[3] = seq;
+	memcpy(&data[4], txSlots[seq % KFPREL_MAX_WINDOW].frame.b8, KFP_FRAME_SIZE-2);
+	Hwi_restore(key);
+
+	return BtStack_pushRaw(data, DATA_SIZE, BTSTACK_LANE_CONTROL);
+}
+
+static void sendAck(void)
+{
+	UInt key = Hwi_disable();
+	uint16_t session = currentEpoch();
+	Hwi_restore(key);
+
+	uint8_t ack[ACK_SIZE];
+	ack[0] = KFP_LINK_REL_ACK;
+	ack[1] = session & 0xFF;
+	ack[2] = session >> 8;
+	ack[3] = rxEpoch & 0xFF;
+	ack[4] = rxEpoch >> 8;
+	ack[5] = recvNext;
+	ack[6] = 0;
+
+	uint8_t i;
+	for (i = 0; i < KFPREL_MAX_WINDOW; i++)
+	{
+		if (rxValid & (1 << ((uint8_t)(recvNext + 1 + i) % KFPREL_MAX_WINDOW)))
+		{
+			ack[6] |= 1 << i;
+		}
+	}
+
+	BtStack_pushRaw(ack, ACK_SIZE, BTSTACK_LANE_CONTROL);
+}
+
+static void dataFxn(const uint8_t* frame, uint16_t size)
+{
+	if (size != DATA_SIZE)
+	{
+		return;
+	}
+
+	uint16_t session = frame[1] | (frame[2] << 8);
+	if (session != rxEpoch)
+	{
+		// the peer restarted, its numbering starts over
+		if (rxEpoch != 0)
+		{
+			stats.resyncs++;
+		}
+		rxEpoch = session;
+		rxValid = 0;
+		recvNext = 0;
+	}
+
+	uint8_t seq = frame[3];
+	uint8_t ahead = seq - recvNext;
+	uint8_t bit = 1 << (seq % KFPREL_MAX_WINDOW);
+
+	if (ahead >= KFPREL_MAX_WINDOW)
+	{
+		// already delivered, its ack was lost
+		stats.duplicates++;
+	}
+	else if (rxValid & bit)
+	{
+		stats.duplicates++;
+	}
+	else
+	{
+		memcpy(rxSlots[seq % KFPREL_MAX_WINDOW].b8, &frame[4], KFP_FRAME_SIZE-2);
+		rxValid |= bit;
+		if (ahead > 0)
+		{
+			stats.outOfOrder++;
+		}
+
+		// hand over every frame now in order
+		while (rxValid & (1 << (recvNext % KFPREL_MAX_WINDOW)))
+		{
+			BtStack_deliver(&rxSlots[recvNext % KFPREL_MAX_WINDOW]);
+			rxValid &= ~(1 << (recvNext % KFPREL_MAX_WINDOW));
+			recvNext++;
+			stats.delivered++;
+		}
+	}
+
+	sendAck();
+}
+
+static void ackFxn(const uint8_t* frame, uint16_t size)
+{
+	if (size != ACK_SIZE)
+	{
+		return;
+	}
+
+	uint16_t peer = frame[1] | (frame[2] << 8);
+	uint16_t acked = frame[3] | (frame[4] << 8);
+	uint8_t cumulative = frame[5];
+	uint8_t freed = 0;
+
+	UInt key = Hwi_disable();
+
+	if (acked != epoch)
+	{
+		// acknowledges frames sent before this end restarted
+		Hwi_restore(key);
+		return;
+	}
+
+	if (peer != txPeerEpoch)
+	{
+		Bool restarted = (txPeerEpoch != 0);
+		txPeerEpoch = peer;
+		if (restarted)
+		{
+			// the peer lost everything it held, the ack is about old numbers
+			renumber();
+			Hwi_restore(key);
+			return;
+		}
+	}
+
+	// ignore acks for sequence numbers not sent yet
+	if ((uint8_t)(cumulative - sendBase) <= (uint8_t)(sendNext - sendBase))
+	{
+		while (sendBase != cumulative)
+		{
+			if (!txSlots[sendBase % KFPREL_MAX_WINDOW].acked)
+			{
+				stats.acked++;
+			}
+			sendBase++;
+			freed++;
+		}
+
+		// frames after a gap which arrived are not sent again
+		uint8_t i;
+		for (i = 0; i < KFPREL_MAX_WINDOW; i++)
+		{
+			uint8_t seq = cumulative + 1 + i;
+			if ((frame[6] & (1 << i)) && ((uint8_t)(seq - sendBase) < (uint8_t)(sendNext - sendBase)))
+			{
+				KfpRel_TxSlot* slot = &txSlots[seq % KFPREL_MAX_WINDOW];
+				if (!slot->acked)
+				{
+					slot->acked = TRUE;
+					stats.acked++;
+				}
+			}
+		}
+	}
+	Hwi_restore(key);
+
+	while (freed > 0)
+	{
+		Semaphore_post(windowSem);
+		freed--;
+	}
+}
+
+static void checkFxn(UArg unused)
+{
+	Semaphore_post(checkSem);
+}
+
+static void retryFxn(UArg unused0, UArg unused1)
+{
+	while(TRUE)
+	{
+		Semaphore_pend(checkSem, BIOS_WAIT_FOREVER);
+
+		uint32_t now = Clock_getTicks();
+		uint8_t i;
+		for (i = 0; i < KFPREL_MAX_WINDOW; i++)
+		{
+			// acks move the window while frames are pushed, look at it afresh each time
+			UInt key = Hwi_disable();
+			uint8_t seq = sendBase + i;
+			Bool due = FALSE;
+			if (i < (uint8_t)(sendNext - sendBase))
+			{
+				KfpRel_TxSlot* slot = &txSlots[seq % KFPREL_MAX_WINDOW];
+				if (!slot->acked && ((now - slot->sentTick) >= timeoutTicks))
+				{
+					slot->sentTick = now;
+					stats.retransmits++;
+					due = TRUE;
+				}
+			}
+			Hwi_restore(key);
+
+			if (due)
+			{
+				transmit(seq);
+			}
+		}
+	}
+}
@@ -4,142 +4,423 @@
  * \author George Xian
  * \version 0.1
  * \date 2014-12-06
+ *
+ * The power board is a slave of the inter board bus service. Commands are
+ * queued at command priority, battery polls at telemetry priority.
  */
 
-#include "pwrMgmt.h"
+#include "PwrMgmt.h"
 
+#include <string.h>
+#include <xdc/std.h>
 #include <xdc/runtime/Error.h>
 #include <xdc/runtime/System.h>
-#include <ti/drivers/I2C.h>
-
-#include "Board.h"
+#include <ti/sysbios/knl/Clock.h>
+#include <ti/sysbios/knl/Task.h>
 
 #define DEFAULT_PWRBOARD_ADDR 0x02
 #define BATTERY_REQUEST_CODE 131
+#define REGISTER_READ_CODE 132		//! Followed by the start register, the board answers with the block
+#define DEFAULT_BATTERY_INTERVAL 1000	//! Default ms between battery polls
+#define STOP_TIMEOUT 1000				//! Longest ms PwrMgmt_stop waits for queued transactions
 typedef enum {DRV_PWR = 101, DRV_YAW = 102} DrvComponent;
 
+/**
+ * \brief Stops the compiler moving snapshot accesses across a sequence update
+ *
+ * Writer and readers run on the same core so no hardware barrier is needed.
+ */
+#if defined(__GNUC__)
+#define SEQ_BARRIER() __asm volatile ("" ::: "memory")
+#else
+#define SEQ_BARRIER() __asm(" ")
+#endif
+
 static uint8_t pwrBoardAddr = DEFAULT_PWRBOARD_ADDR;
 
-typedef union
+static Bool hasStart = FALSE;
+static int8_t slave;				//! Power board on the inter board bus
+
+static uint16_t batteryInterval = DEFAULT_BATTERY_INTERVAL;	//! ms between battery polls, 0 for none
+static Clock_Handle batteryClock = NULL;	//! Starts a battery poll every interval
+
+/**
+ * \struct PwrMgmt_BatteryCache
+ * \brief Latest battery reading, published by a sequence lock
+ *
+ * seq is odd while the poll completion writes the other fields, readers retry
+ * when seq is odd or changed while they read.
+ */
+typedef struct
 {
-	struct
-	{
-		int8_t component;
-		int8_t magnitude;
-	};
-	UChar b8[2];
-} PwrMgmt_Message;
+	volatile uint32_t seq;		//! Sequence, even when the fields are consistent
+	int8_t percent;				//! Percentage of battery remaining, -1 before the first reading
+	uint32_t tick;				//! Clock tick the reading completed at
+	uint32_t polls;				//! No. of polls completed successfully
+	uint32_t failures;			//! No. of polls which failed
+	uint32_t deferred;			//! No. of polls skipped because the bus was busy
+} PwrMgmt_BatteryCache;
 
-int8_t PwrMgmt_drive(int8_t power, int8_t yaw)
+static PwrMgmt_BatteryCache battery;
+
+static void batteryClockFxn(UArg unused);
+static void batteryDoneFxn(PwrMgmt_Token token, int8_t status, const uint8_t* read, void* arg);
+
+int8_t PwrMgmt_start(void)
 {
-	// Generate transaction messages
-	PwrMgmt_Message pwrMsg;
-	pwrMsg.component = DRV_PWR;
-	pwrMsg.magnitude = power;
+	if (hasStart)
+	{
+		return -1;
+	}
 
-	PwrMgmt_Message yawMsg;
-	pwrMsg.component = DRV_YAW;
-	pwrMsg.magnitude = yaw;
+	if (!InterBus_hasStarted())
+	{
+		return -3;
+	}
 
-	// Opening I2C socket
-	I2C_Handle s;
-	I2C_Params params;
-	I2C_Params_init(&params);
-	params.transferMode = I2C_MODE_BLOCKING;
-	s = I2C_open(Board_INTER, &params);
-	if (!s)
+	slave = InterBus_addSlave(pwrBoardAddr);
+	if (slave < 0)
+	{
+		return -3;
+	}
+
+	memset(&battery, 0, sizeof(battery));
+	battery.percent = -1;
+	hasStart = TRUE;
+
+	// battery is polled in the background, the first poll is immediate
+	if (batteryInterval > 0)
+	{
+		Error_Block eb;
+		Error_init(&eb);
+
+		UInt period = ((uint32_t)batteryInterval * 1000) / Clock_tickPeriod;
+		if (period == 0)
+		{
+			period = 1;
+		}
+
+		Clock_Params clockParams;
+		Clock_Params_init(&clockParams);
+		clockParams.period = period;
+		clockParams.startFlag = TRUE;
+		batteryClock = Clock_create((Clock_FuncPtr) batteryClockFxn, 1, &clockParams, &eb);
+		if (batteryClock == NULL)
+		{
+			PwrMgmt_stop();
+			return -2;
+		}
+	}
+
+	return 0;
+}
+
+int8_t PwrMgmt_stop(void)
+{
+	if (!hasStart)
 	{
 		return -1;
 	}
 
-	// Transferring data
-	I2C_Transaction pwrTransaction;
-	pwrTransaction.writeBuf = pwrMsg.b8;
-	pwrTransaction.writeCount = 2;
-	pwrTransaction.readCount = 0;
-	pwrTransaction.slaveAddress = pwrBoardAddr;
-	if (!I2C_transfer(s, &pwrTransaction))
+	if (batteryClock != NULL)
 	{
-		I2C_close(s);
-		return -2;
+		Clock_stop(batteryClock);
 	}
 
-	I2C_Transaction yawTransaction;
-	yawTransaction.writeBuf = yawMsg.b8;
-	yawTransaction.writeCount = 2;
-	yawTransaction.readCount = 0;
-	yawTransaction.slaveAddress = pwrBoardAddr;
-	if (!I2C_transfer(s, &yawTransaction))
+	// refuse new transactions, then let the queued ones finish
+	hasStart = FALSE;
+	uint32_t stopTicks = ((uint32_t)STOP_TIMEOUT * 1000) / Clock_tickPeriod;
+	uint32_t waited = 0;
+	while (InterBus_removeSlave(slave) == -1)
 	{
-		I2C_close(s);
-		return  -2;
+		if (waited++ >= stopTicks)
+		{
+			// the bus is wedged, keep the service running
+			hasStart = TRUE;
+			if (batteryClock != NULL)
+			{
+				Clock_start(batteryClock);
+			}
+			return -2;
+		}
+		Task_sleep(1);
 	}
 
+	if (batteryClock != NULL)
+	{
+		Clock_delete(&batteryClock);
+	}
 	return 0;
 }
 
+Bool PwrMgmt_hasStarted(void)
+{
+	return hasStart;
+}
+
+int8_t PwrMgmt_drive(int8_t power, int8_t yaw)
+{
+	// power and yaw applied together by the power board
+	PwrMgmt_Command commands[2];
+	commands[0].component = DRV_PWR;
+	commands[0].magnitude = power;
+	commands[1].component = DRV_YAW;
+	commands[1].magnitude = yaw;
+
+	return PwrMgmt_batch(commands, 2);
+}
+
+int8_t PwrMgmt_batch(const PwrMgmt_Command* commands, uint8_t count)
+{
+	if ((count == 0) || (count > PWRMGMT_MAX_BATCH))
+	{
+		return -3;
+	}
+
+	// Generate transaction message, pairs back to back
+	UChar batchMsg[2*PWRMGMT_MAX_BATCH];
+	uint8_t i;
+	for (i = 0; i < count; i++)
+	{
+		batchMsg[2*i] = commands[i].component;
+		batchMsg[2*i+1] = commands[i].magnitude;
+	}
+
+	if (!hasStart)
+	{
+		return -1;
+	}
+	return InterBus_transfer(slave, INTERBUS_PRIORITY_COMMAND, batchMsg, 2*count, NULL, 0);
+}
+
 int8_t PwrMgmt_weapon(PwrMgmt_Weapon weapon, uint8_t state)
 {
-	// Generate transaction messages
-	PwrMgmt_Message weaponMsg;
-	weaponMsg.component = weapon;
-	weaponMsg.magnitude = state;
+	// Generate transaction message
+	UChar weaponMsg[2];
+	weaponMsg[0] = weapon;
+	weaponMsg[1] = state;
+
+	if (!hasStart)
+	{
+		return -1;
+	}
+	return InterBus_transfer(slave, INTERBUS_PRIORITY_COMMAND, weaponMsg, 2, NULL, 0);
+}
+
+int8_t PwrMgmt_batteryRemaining(void)
+{
+	// Generate transaction message
+	UChar batteryMsg = BATTERY_REQUEST_CODE;
+
+	if (!hasStart)
+	{
+		return -1;
+	}
+
+	uint8_t batteryRemaining;
+	int8_t status = InterBus_transfer(slave, INTERBUS_PRIORITY_TELEMETRY, &batteryMsg, 1, &batteryRemaining, 1);
+	if (status != 0)
+	{
+		return status;
+	}
+	return batteryRemaining;
+}
+
+int32_t PwrMgmt_batchAsync(const PwrMgmt_Command* commands, uint8_t count,
+		PwrMgmt_DoneFxn doneFxn, void* arg)
+{
+	if ((count == 0) || (count > PWRMGMT_MAX_BATCH))
+	{
+		return -3;
+	}
+
+	UChar batchMsg[2*PWRMGMT_MAX_BATCH];
+	uint8_t i;
+	for (i = 0; i < count; i++)
+	{
+		batchMsg[2*i] = commands[i].component;
+		batchMsg[2*i+1] = commands[i].magnitude;
+	}
+
+	if (!hasStart)
+	{
+		return -1;
+	}
+	return InterBus_submit(slave, INTERBUS_PRIORITY_COMMAND, batchMsg, 2*count, 0, doneFxn, arg);
+}
+
+int32_t PwrMgmt_driveAsync(int8_t power, int8_t yaw, PwrMgmt_DoneFxn doneFxn, void* arg)
+{
+	// an emergency stop makes a waiting drive command obsolete
+	UChar driveMsg[4] = {DRV_PWR, (UChar)power, DRV_YAW, (UChar)yaw};
 
-	// Opening I2C sockets
-	I2C_Handle s;
-	I2C_Params params;
-	I2C_Params_init(&params);
-	params.transferMode = I2C_MODE_BLOCKING;
-	s = I2C_open(Board_INTER, &params);
-	if (!s)
+	if (!hasStart)
 	{
 		return -1;
 	}
+	return InterBus_supersedable(slave, driveMsg, 4, doneFxn, arg);
+}
+
+int32_t PwrMgmt_batteryAsync(PwrMgmt_DoneFxn doneFxn, void* arg)
+{
+	UChar batteryMsg = BATTERY_REQUEST_CODE;
+
+	if (!hasStart)
+	{
+		return -1;
+	}
+	return InterBus_submit(slave, INTERBUS_PRIORITY_TELEMETRY, &batteryMsg, 1, 1, doneFxn, arg);
+}
+
+int32_t PwrMgmt_stopNow(uint32_t since)
+{
+	// preformatted, nothing to build at interrupt level
+	static const UChar stopMsg[4] = {DRV_PWR, 0, DRV_YAW, 0};
+
+	if (!hasStart)
+	{
+		return -1;
+	}
+	return InterBus_urgent(slave, stopMsg, sizeof(stopMsg), since);
+}
+
+Bool PwrMgmt_isDone(PwrMgmt_Token token)
+{
+	return InterBus_isDone(token);
+}
+
+int8_t PwrMgmt_readRegisters(uint8_t start, uint8_t* buf, uint8_t count)
+{
+	if ((count == 0) || (count > INTERBUS_MAX_READ))
+	{
+		return -3;
+	}
+
+	if (!hasStart)
+	{
+		return -1;
+	}
+
+	UChar readMsg[2];
+	readMsg[0] = REGISTER_READ_CODE;
+	readMsg[1] = start;
+	return InterBus_transfer(slave, INTERBUS_PRIORITY_TELEMETRY, readMsg, 2, buf, count);
+}
 
-	// Transferring data
-	I2C_Transaction weaponTransaction;
-	weaponTransaction.writeBuf = weaponMsg.b8;
-	weaponTransaction.writeCount = 2;
-	weaponTransaction.readCount = 0;
-	weaponTransaction.slaveAddress = pwrBoardAddr;
-	if (!I2C_transfer(s, &weaponTransaction))
+int8_t PwrMgmt_telemetry(PwrMgmt_Telemetry* telemetry)
+{
+	uint8_t regs[PWRMGMT_TELEMETRY_SIZE];
+	int8_t status = PwrMgmt_readRegisters(PWRMGMT_REG_BATTERY, regs, PWRMGMT_TELEMETRY_SIZE);
+	if (status != 0)
 	{
-		I2C_close(s);
-		return -2;
+		return status;
 	}
+
+	PwrMgmt_decodeTelemetry(regs, telemetry);
 	return 0;
 }
 
-int8_t PwrMgmt_batteryRemaining(void)
+int32_t PwrMgmt_telemetryAsync(PwrMgmt_DoneFxn doneFxn, void* arg)
 {
-	// Generate transaction messages
-	PwrMgmt_Message batteryMsg;
-	batteryMsg.component = BATTERY_REQUEST_CODE;
+	if (!hasStart)
+	{
+		return -1;
+	}
+
+	UChar readMsg[2];
+	readMsg[0] = REGISTER_READ_CODE;
+	readMsg[1] = PWRMGMT_REG_BATTERY;
+	return InterBus_submit(slave, INTERBUS_PRIORITY_TELEMETRY, readMsg, 2, PWRMGMT_TELEMETRY_SIZE, doneFxn, arg);
+}
 
-	// Opening I2C sockets
-	I2C_Handle s;
-	I2C_Params params;
-	I2C_Params_init(&params);
-	params.transferMode = I2C_MODE_BLOCKING;
-	s = I2C_open(Board_INTER, &params);
-	if (!s)
+void PwrMgmt_decodeTelemetry(const uint8_t* regs, PwrMgmt_Telemetry* telemetry)
+{
+	telemetry->battery = regs[PWRMGMT_REG_BATTERY];
+	telemetry->faults = regs[PWRMGMT_REG_FAULTS];
+	telemetry->current[0] = (int16_t)(regs[PWRMGMT_REG_CURRENT] | (regs[PWRMGMT_REG_CURRENT+1] << 8));
+	telemetry->current[1] = (int16_t)(regs[PWRMGMT_REG_CURRENT+2] | (regs[PWRMGMT_REG_CURRENT+3] << 8));
+	telemetry->temperature[0] = (int8_t)regs[PWRMGMT_REG_TEMPERATURE];
+	telemetry->temperature[1] = (int8_t)regs[PWRMGMT_REG_TEMPERATURE+1];
+}
+
+int8_t PwrMgmt_setBatteryInterval(uint16_t ms)
+{
+	if (hasStart)
 	{
 		return -1;
 	}
 
-	// Transferring data
-	UChar batteryRemaining;
+	batteryInterval = ms;
+	return 0;
+}
 
-	I2C_Transaction batteryTransaction;
-	batteryTransaction.writeBuf = batteryMsg.b8;
-	batteryTransaction.writeCount = 1;
-	batteryTransaction.readBuf = &batteryRemaining;
-	batteryTransaction.readCount = 1;
-	batteryTransaction.slaveAddress = pwrBoardAddr;
-	if (!I2C_transfer(s, &batteryTransaction))
+int8_t PwrMgmt_getBattery(PwrMgmt_Battery* out)
+{
+	uint32_t seq;
+	uint32_t tick;
+	do
 	{
-		I2C_close(s);
-		return -2;
+		seq = battery.seq;
+		SEQ_BARRIER();
+		out->percent = battery.percent;
+		out->polls = battery.polls;
+		out->failures = battery.failures;
+		out->deferred = battery.deferred;
+		tick = battery.tick;
+		SEQ_BARRIER();
+	} while ((seq & 1) || (seq != battery.seq));
+
+	// widened, ticks times the period overflows 32 bits after about 71 minutes
+	out->ageMs = (uint32_t)(((uint64_t)(Clock_getTicks() - tick) * Clock_tickPeriod) / 1000);
+	return (out->percent < 0) ? -1 : 0;
+}
+
+void PwrMgmt_getStats(PwrMgmt_Stats* out)
+{
+	InterBus_getSlaveStats(slave, out);
+}
+
+/**
+ * \brief Runs in Swi context every battery interval, polls only while the bus is idle
+ */
+static void batteryClockFxn(UArg unused)
+{
+	if (!InterBus_isIdle())
+	{
+		// other commands take priority, try again next interval
+		battery.seq++;
+		SEQ_BARRIER();
+		battery.deferred++;
+		SEQ_BARRIER();
+		battery.seq++;
 	}
-	return batteryRemaining;
+	else if (PwrMgmt_batteryAsync(batteryDoneFxn, NULL) < 0)
+	{
+		battery.seq++;
+		SEQ_BARRIER();
+		battery.failures++;
+		SEQ_BARRIER();
+		battery.seq++;
+	}
+}
+
+/**
+ * \brief Publishes the result of a battery poll
+ */
+static void batteryDoneFxn(PwrMgmt_Token token, int8_t status, const uint8_t* read, void* arg)
+{
+	battery.seq++;
+	SEQ_BARRIER();
+	if (status < 0)
+	{
+		battery.failures++;
+	}
+	else
+	{
+		battery.percent = read[0];
+		battery.tick = Clock_getTicks();
+		battery.polls++;
+	}
+	SEQ_BARRIER();
+	battery.seq++;
 }
@@ -0,0 +1,260 @@
+/**
+ * \file Slip.c
+ * \brief Implements word at a time SLIP encoder and table driven SLIP stream decoder
+ * \author George Xian
+ * \version 0.1
+ * \date 2014-12-14
+ */
+
+#include "Slip.h"
+
+#include <string.h>
+
+/**
+ * \brief Byte classes, literal classes are ordered below CLASS_END
+ */
+enum {CLASS_LIT, CLASS_ESC_END, CLASS_ESC_ESC, CLASS_END, CLASS_ESC, CLASS_COUNT};
+
+/**
+ * \brief Decoder states
+ */
+enum {STATE_HUNT, STATE_FRAME, STATE_ESCAPE, STATE_DISCARD, STATE_COUNT};
+
+/**
+ * \brief Operations performed on a transition
+ */
+enum {OP_NONE, OP_STORE, OP_STORE_END, OP_STORE_ESC, OP_EMIT, OP_RESET, OP_ESC_ERROR};
+
+/**
+ * \struct Slip_Transition
+ * \brief Entry of the state transition table
+ */
+typedef struct
+{
+	uint8_t next;		//! State to move to
+	uint8_t op;			//! Operation to perform
+} Slip_Transition;
+
+#define L CLASS_LIT
+#define E CLASS_END
+#define S CLASS_ESC
+#define X CLASS_ESC_END
+#define Y CLASS_ESC_ESC
+
+//! Class of every byte value
+static const uint8_t slipClass[256] = {
+	L, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L,	/* 0x00 */
+	L, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L,	/* 0x10 */
+	L, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L,	/* 0x20 */
+	L, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L,	/* 0x30 */
+	L, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L,	/* 0x40 */
+	L, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L,	/* 0x50 */
+	L, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L,	/* 0x60 */
+	L, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L,	/* 0x70 */
+	L, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L,	/* 0x80 */
+	L, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L,	/* 0x90 */
+	L, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L,	/* 0xA0 */
+	L, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L,	/* 0xB0 */
+	E, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L,	/* 0xC0 */
+	L, L, L, L, L, L, L, L, L, L, L, S, X, Y, L, L,	/* 0xD0 */
+	L, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L,	/* 0xE0 */
+	L, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L	/* 0xF0 */
+};
+
+#undef L
+#undef E
+#undef S
+#undef X
+#undef Y
+
+//! Transition for every state and byte class
+static const Slip_Transition slipTable[STATE_COUNT][CLASS_COUNT] = {
+	// STATE_HUNT, wait for the first END before buffering anything
+	{{STATE_HUNT, OP_NONE}, {STATE_HUNT, OP_NONE}, {STATE_HUNT, OP_NONE},
+			{STATE_FRAME, OP_RESET}, {STATE_HUNT, OP_NONE}},
+	// STATE_FRAME, END delimits frames, empty frames are ignored
+	{{STATE_FRAME, OP_STORE}, {STATE_FRAME, OP_STORE}, {STATE_FRAME, OP_STORE},
+			{STATE_FRAME, OP_EMIT}, {STATE_ESCAPE, OP_NONE}},
+	// STATE_ESCAPE, only ESC_END and ESC_ESC may follow ESC
+	{{STATE_DISCARD, OP_ESC_ERROR}, {STATE_FRAME, OP_STORE_END}, {STATE_FRAME, OP_STORE_ESC},
+			{STATE_FRAME, OP_ESC_ERROR}, {STATE_DISCARD, OP_ESC_ERROR}},
+	// STATE_DISCARD, drop the rest of a corrupt frame
+	{{STATE_DISCARD, OP_NONE}, {STATE_DISCARD, OP_NONE}, {STATE_DISCARD, OP_NONE},
+			{STATE_FRAME, OP_RESET}, {STATE_DISCARD, OP_NONE}}
+};
+
+#define ONES 0x01010101u				//! 0x01 in every byte lane
+#define HIGHS 0x80808080u				//! 0x80 in every byte lane
+
+/**
+ * \brief Non zero if any byte lane of the word is zero
+ */
+#define HAS_ZERO(v) (((v) - ONES) & ~(v) & HIGHS)
+
+/**
+ * \brief Non zero if any byte lane of the word equals b
+ */
+#define HAS_BYTE(v, b) HAS_ZERO((v) ^ (ONES * (b)))
+
+/**
+ * \brief Writes a byte, escaping it if it is special
+ */
+static uint8_t* encodeByte(uint8_t* out, uint8_t value)
+{
+	if (value == SLIP_END)
+	{
+		out[0] = SLIP_ESC;
+		out[1] = SLIP_ESC_END;
+		return out + 2;
+	}
+	else if (value == SLIP_ESC)
+	{
+		out[0] = SLIP_ESC;
+		out[1] = SLIP_ESC_ESC;
+		return out + 2;
+	}
+
+	out[0] = value;
+	return out + 1;
+}
+
+uint16_t Slip_encode(uint8_t* out, const uint8_t* frame, uint16_t size)
+{
+	uint8_t* start = out;
+	const uint8_t* end = frame + size;
+
+	*out = SLIP_END;
+	out++;
+
+	// whole words, copied as is unless a lane holds END or ESC
+	while (end - frame >= 4)
+	{
+		uint32_t word;
+		memcpy(&word, frame, 4);
+		if (HAS_BYTE(word, SLIP_END) | HAS_BYTE(word, SLIP_ESC))
+		{
+			out = encodeByte(out, frame[0]);
+			out = encodeByte(out, frame[1]);
+			out = encodeByte(out, frame[2]);
+			out = encodeByte(out, frame[3]);
+		}
+		else
+		{
+			memcpy(out, &word, 4);
+			out += 4;
+		}
+		frame += 4;
+	}
+
+	// trailing bytes
+	while (frame < end)
+	{
+		out = encodeByte(out, *frame);
+		frame++;
+	}
+
+	*out = SLIP_END;
+	out++;
+
+	return out - start;
+}
+
+void Slip_decoderInit(Slip_Decoder* dec, Slip_FrameFxn frameFxn, void* arg)
+{
+	dec->state = STATE_HUNT;
+	dec->size = 0;
+	dec->frameFxn = frameFxn;
+	dec->arg = arg;
+
+	dec->frames = 0;
+	dec->escErrors = 0;
+	dec->overruns = 0;
+}
+
+void Slip_decode(Slip_Decoder* dec, const uint8_t* data, uint16_t len)
+{
+	const uint8_t* end = data + len;
+	uint8_t state = dec->state;
+	uint16_t size = dec->size;
+
+	while (data < end)
+	{
+		if (state == STATE_FRAME)
+		{
+			// copy the run of literal bytes in one go
+			const uint8_t* run = data;
+			while ((data < end) && (slipClass[*data] < CLASS_END))
+			{
+				data++;
+			}
+
+			uint16_t runLen = data - run;
+			if (runLen > 0)
+			{
+				if (size + runLen > SLIP_MAX_FRAME)
+				{
+					dec->overruns++;
+					state = STATE_DISCARD;
+					continue;
+				}
+				memcpy(&dec->buf.b8[size], run, runLen);
+				size += runLen;
+			}
+
+			if (data == end)
+			{
+				break;
+			}
+		}
+
+		const Slip_Transition* t = &slipTable[state][slipClass[*data]];
+		uint8_t value = *data;
+		data++;
+		state = t->next;
+
+		switch (t->op)
+		{
+		case(OP_STORE_END):
+				value = SLIP_END;
+				break;
+		case(OP_STORE_ESC):
+				value = SLIP_ESC;
+				break;
+		case(OP_EMIT):
+				if (size > 0)
+				{
+					dec->frames++;
+					dec->frameFxn(dec->buf.b8, size, dec->arg);
+				}
+				size = 0;
+				continue;
+		case(OP_RESET):
+				size = 0;
+				continue;
+		case(OP_ESC_ERROR):
+				dec->escErrors++;
+				size = 0;
+				continue;
+		default:
+				break;
+		}
+
+		if (t->op != OP_NONE)
+		{
+			// store decoded byte
+			if (size == SLIP_MAX_FRAME)
+			{
+				dec->overruns++;
+				state = STATE_DISCARD;
+			}
+			else
+			{
+				dec->buf.b8[size] = value;
+				size++;
+			}
+		}
+	}
+
+	dec->state = state;
+	dec->size = size;
+}
@@ -0,0 +1,123 @@
+/**
+ * \file BtBaud.h
+ * \brief Declares bluetooth baud rate negotiation functions
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-01-27
+ *
+ * Both ends agree a faster UART rate with KFP_LINK_BAUD link frames. The
+ * initiator proposes a rate, the peer accepts or rejects it. On acceptance
+ * both ends reconfigure their bluetooth module and UART, then the initiator
+ * probes the link at the new rate. A rate which does not carry the probe is
+ * abandoned for the previous one. The last rate which carried a probe is kept
+ * in EEPROM and used from the next start on.
+ *
+ * While running, the reception error rate is checked every interval and the
+ * link proposes a step down one rate when it climbs past a threshold. The
+ * rate only changes when the peer accepts. When no good frame arrives for
+ * five intervals, as when the peer restarted at the default rate, the current
+ * rate is probed and, if nothing answers, the link falls back to 115200.
+ *
+ * If the UART fails to switch, btStack is restarted at the old rate.
+ */
+
+#ifndef BT_BAUD
+#define BT_BAUD
+
+#include <xdc/std.h>
+#include <stdint.h>
+#include "Kfp.h"
+
+#define BTBAUD_RATE_COUNT 4			//! No. of rates which can be negotiated
+
+/**
+ * \struct BtBaud_Stats
+ * \brief Negotiation counters since the service was started
+ */
+typedef struct
+{
+	uint32_t baud;				//! Rate the UART runs at
+	uint32_t proposals;			//! No. of rates proposed by this end
+	uint32_t rejected;			//! No. of proposals rejected or unanswered
+	uint32_t switches;			//! No. of rate changes which carried a probe, either end initiating
+	uint32_t probeFailures;		//! No. of rate changes abandoned because the probe was lost
+	uint32_t fallbacks;			//! No. of steps down proposed because of reception errors
+	uint32_t silentFallbacks;	//! No. of falls back to the default rate because the link went silent
+	uint32_t uartFailures;		//! No. of rate changes the UART failed, btStack restarted at the old rate
+} BtBaud_Stats;
+
+/**
+ * \brief Sets the fastest rate this end agrees to, only while the service is stopped
+ *
+ * \param baud One of 115200, 230400, 460800 or 921600
+ * \return Returns 0 for success, -1 if already started and -2 if the rate is not negotiable
+ */
+int8_t BtBaud_setMaxBaud(uint32_t baud);
+
+/**
+ * \brief Sets the command which reconfigures the bluetooth module, only while the service is stopped
+ *
+ * The command is prefix, the rate in decimal, then suffix. It is written at the
+ * old rate, the UART switches settleMs later.
+ *
+ * \param prefix Text before the rate, NULL if the module follows the UART by itself
+ * \param suffix Text after the rate
+ * \param settleMs Milliseconds the module needs to apply the command
+ * \return Returns 0 for success, -1 if already started and -2 if the command is too long
+ */
+int8_t BtBaud_setCommand(const char* prefix, const char* suffix, uint16_t settleMs);
+
+/**
+ * \brief Sets when the link steps down, only while the service is stopped
+ *
+ * \param intervalMs Milliseconds between checks of the reception counters
+ * \param percent Corrupt frames per hundred received in an interval which trigger a step down, 0 to never step down
+ * \return Returns 0 for success, -1 if already started and -2 if out of range
+ */
+int8_t BtBaud_setFallback(uint16_t intervalMs, uint8_t percent);
+
+/**
+ * \brief Starts the service, must be called before BtStack_start
+ *
+ * Sets btStack to the saved rate, if any, and raises the rate to the fastest
+ * both ends agree on one fallback interval later. Proposals which cross are
+ * both rejected, so the peer should leave raising to this end.
+ *
+ * \return Returns 0 for success, -1 if already started or btStack started, -2 if resources failed to create
+ */
+int8_t BtBaud_start(void);
+
+/**
+ * \brief Stops the service, the UART keeps its rate
+ *
+ * \return Returns 0 for success, -1 if not started
+ */
+int8_t BtBaud_stop(void);
+
+/**
+ * \brief Agrees a rate with the peer and switches to it, from task context only
+ *
+ * Waits for the peer's answer and the probe at the new rate.
+ *
+ * \param baud Rate to propose
+ * \return Returns 0 for success, -1 if not started, -2 if the rate is not negotiable,
+ * -3 if the peer rejected or did not answer and -4 if the probe was lost and the old rate restored
+ */
+int8_t BtBaud_negotiate(uint32_t baud);
+
+/**
+ * \brief Tries rates from the fastest allowed down to the current one, from task context only
+ *
+ * \return Rate the UART runs at afterwards, 0 if not started
+ */
+uint32_t BtBaud_raise(void);
+
+/**
+ * \brief Reads negotiation counters
+ *
+ * \param stats Filled with the counters
+ */
+void BtBaud_getStats(BtBaud_Stats* stats);
+
+
+#endif
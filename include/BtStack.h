@@ -10,74 +10,240 @@
 #define BT_STACK
 
 #include <ti/drivers/UART.h>
+#include "Slip.h"
+#include "Kfp.h"
+#include "FrameQueue.h"
+#include "FrameRouter.h"
+#include "Crc16.h"
 
-#define KFP_FRAME_SIZE 14	//! No. of data bytes in Killalot frame protocol
-#define KFP_WORST_SIZE 26	//! Maximum frame size if escape characters are used
+#define BTSTACK_MAX_RAW (SLIP_MAX_FRAME - CRC16_SIZE - 1)	//! Largest frame BtStack_pushRaw accepts, after the marker
 
-#define SLIP_END 0xC0		//! SLIP END character
-#define SLIP_ESC 0xDB		//! SLIP ESC character
-#define SLIP_ESC_END 0xDC	//! Used to send 0xC0 when preceded by ESC character
-#define SLIP_ESC_ESC 0xDD	//! Used to send 0xDB when preceded by ESC character
+/**
+ * \struct BtStack_RxStats
+ * \brief Reception counters since the service was started
+ */
+typedef struct
+{
+	uint32_t frames;			//! No. of well formed frames received
+	uint32_t corruptFrames;		//! No. of frames dropped by the decoder, for wrong size or CRC mismatch
+	uint32_t crcErrors;			//! No. of correctly sized frames dropped for CRC mismatch
+	uint32_t ringOverruns;		//! No. of bytes dropped because the reception task fell behind
+	uint32_t hwOverruns;		//! No. of UART FIFO overruns
+	uint32_t urgentFrames;		//! No. of frames of the urgent ID handled at interrupt level
+} BtStack_RxStats;
 
-typedef enum {KFPPRINTFORMAT_ASCII, KFPPRINTFORMAT_HEX} KfpPrintFormat;
+/**
+ * \struct BtStack_TxStats
+ * \brief Transmission counters since the service was started
+ */
+typedef struct
+{
+	uint32_t frames;			//! No. of frames queued
+	uint32_t bytes;				//! No. of encoded bytes written to the UART
+	uint32_t writes;			//! No. of UART writes, each carries one or more frames
+	uint32_t queueFull;			//! No. of frames refused because the queue was full
+} BtStack_TxStats;
 
 /**
- * \struct BtStack_Id
- * \brief Allows ID field of KFP to be accessed bytewise or wordwise of Thumb or ARM
+ * \enum BtStack_Lane
+ * \brief Transmission priorities, control frames always go before bulk frames
  */
-typedef union
+typedef enum
 {
-	uint8_t b8[4];			//! bytewise
-	uint16_t b16[2];		//! thumb wordwise
-	uint32_t b32;			//! ARM wordwise
-} BtStack_Id;
+	BTSTACK_LANE_CONTROL,		//! Replies and acknowledgements which must not wait
+	BTSTACK_LANE_BULK,			//! Telemetry, images and other bulk data
+	BTSTACK_LANE_COUNT
+} BtStack_Lane;
 
 /**
- * \struct BtStack_Data
- * \brief Allows payload field of KFP to be accessed bytewise or wordwise of Thumb or ARM
+ * \struct BtStack_LaneStats
+ * \brief Transmission counters of one lane since the service was started
  */
-typedef union
+typedef struct
 {
-	uint8_t b8[4];			//! bytewise
-	uint16_t b16[2];		//! thumb wordwise
-	uint32_t b32;			//! ARM wordwise
-} BtStack_Data;
+	uint32_t frames;			//! No. of frames queued
+	uint32_t queueFull;			//! No. of frames refused because the lane was full
+	uint32_t sent;				//! No. of frames written
+	uint32_t meanLatencyUs;		//! Mean time from push until the frame is handed to the UART
+	uint32_t maxLatencyUs;		//! Longest time from push until the frame is handed to the UART
+} BtStack_LaneStats;
 
 /**
- * \struct BtStack_Frame
- * \brief Represents KFP, allows access as structure or bytestream
+ * \enum BtStack_Flow
+ * \brief How the peer is held off while the reception ring is nearly full
  */
-typedef union
+typedef enum
 {
-	struct
-	{
-		BtStack_Id id;				//! 4 bytes ID
-		BtStack_Data payload;		//! 8 bytes payload
-	};
-	uint8_t b8[KFP_FRAME_SIZE-2];		//! bytestream access
-} BtStack_Frame;
+	BTSTACK_FLOW_NONE,			//! Bytes which do not fit the ring are lost
+	BTSTACK_FLOW_RTSCTS,		//! RTS and CTS pins of the bluetooth UART
+	BTSTACK_FLOW_INBAND			//! KFP_LINK_FLOW link frames, for modules without flow control pins
+} BtStack_Flow;
+
+/**
+ * \struct BtStack_FlowStats
+ * \brief Flow control counters since the service was started
+ */
+typedef struct
+{
+	uint32_t rxThrottles;		//! No. of times the peer was asked to pause
+	uint32_t rxThrottledUs;		//! Time the peer was asked to pause for
+	uint32_t txPauses;			//! No. of times the peer asked this end to pause, in band only
+	uint32_t txPausedUs;		//! Time this end paused for, in band only
+	uint32_t pauseTimeouts;		//! No. of pauses ended because no resume arrived
+} BtStack_FlowStats;
 
 /**
  * \typedef BtStack_callback
  * \brief Bluetooth stack service callback type
  */
-typedef void (*BtStack_Callback)(const BtStack_Frame*);
+typedef FrameRouter_Fxn BtStack_Callback;
 
+/**
+ * \typedef BtStack_LinkFxn
+ * \brief Called in the reception task with a link frame, the frame is only valid during the call
+ *
+ * \param frame Received frame, marker and CRC trailer removed, frame[0] is its type
+ * \param size No. of bytes in frame
+ */
+typedef void (*BtStack_LinkFxn)(const uint8_t* frame, uint16_t size);
+
+
+/**
+ * \typedef BtStack_UrgentFxn
+ * \brief Called in Hwi context with a frame of the urgent ID as soon as its END byte is decoded
+ *
+ * \param frame Received frame, only valid during the call
+ * \param stamp Timestamp the END byte was decoded at
+ */
+typedef void (*BtStack_UrgentFxn)(const BtStack_Frame* frame, uint32_t stamp);
 
 /**
  * \brief Starts bluetooth stack service
  *
- * \return Returns 0 for success, -1 if service already started and -2 for reception thread start failure
+ * Opens the bluetooth UART, which stays open until BtStack_stop is called.
+ *
+ * \return Returns 0 for success, -1 if service already started, -2 for reception thread start failure
+ * and -3 if the UART failed to open
  */
 int8_t BtStack_start(void);
 
 /**
- * \brief Stops bluetooth stack service
+ * \brief Stops bluetooth stack service and closes the bluetooth UART
  *
- * \return Returns 0 for success, -1 for failure
+ * Waits up to a second for frame callbacks to return. If one is still
+ * running then, the service keeps running. Must not be called from a frame
+ * callback.
+ *
+ * \return Returns 0 for success, -1 if service was not started, -2 if a frame callback did not return
+ * and -3 if called from a frame callback
  */
 int8_t BtStack_stop(void);
 
+/**
+ * \brief Reads reception counters
+ *
+ * \param stats Filled with the counters
+ */
+void BtStack_getRxStats(BtStack_RxStats* stats);
+
+/**
+ * \brief Adds a CRC-16 trailer to every frame, only while the service is stopped
+ *
+ * Sent frames get the CRC of their 12 bytes appended most significant byte first,
+ * received frames without a matching trailer are dropped. Both ends must agree.
+ *
+ * \param enable Flag to carry the trailer
+ * \return Returns 0 for success, -1 if service already started
+ */
+int8_t BtStack_setCrc(Bool enable);
+
+/**
+ * \brief Changes the baud rate of the bluetooth UART
+ *
+ * While stopped the rate is kept for BtStack_start. While started, frames already
+ * queued are sent first, then command is written to the module at the old rate and
+ * the UART is switched after settleMs. Frames pushed meanwhile wait and go out at
+ * the new rate. Call from one task at a time.
+ *
+ * \param baud New baud rate
+ * \param command Text written to the module before switching, NULL for none
+ * \param settleMs Milliseconds the module needs to apply the command
+ * \return Returns 0 for success, -2 if the UART could not be switched
+ */
+int8_t BtStack_setBaud(uint32_t baud, const char* command, uint16_t settleMs);
+
+/**
+ * \brief Returns the baud rate the bluetooth UART runs at, or will be opened at
+ *
+ * \return Baud rate
+ */
+uint32_t BtStack_getBaud(void);
+
+/**
+ * \brief Sets how the peer is held off while the reception ring is nearly full, only while the service is stopped
+ *
+ * The peer is paused once the ring is three quarters full and resumed once it
+ * has drained to a quarter. In band, the pause and resume frames overtake every
+ * queued frame, and a pause which is not resumed within 200 ms ends by itself.
+ * Pause requests from the peer are always honoured.
+ *
+ * \param flow Flow control in use
+ * \return Returns 0 for success, -1 if service already started and -2 if out of range
+ */
+int8_t BtStack_setFlow(BtStack_Flow flow);
+
+/**
+ * \brief Reads flow control counters
+ *
+ * \param stats Filled with the counters, pauses in progress included
+ */
+void BtStack_getFlowStats(BtStack_FlowStats* stats);
+
+/**
+ * \brief Handles one reserved ID at interrupt level, only while the service is stopped
+ *
+ * Received bytes are also decoded in the UART's Hwi, ahead of the reception ring,
+ * so frames of the ID are seen even when the ring is full or the reception task
+ * is held off. In uDMA mode bytes reach the Hwi a block or a receive timeout
+ * after they arrive. The frame is still dispatched to subscribers as usual,
+ * and the dispatch queue's drop policy never discards it in favour of other frames.
+ *
+ * \param id ID compared as BtStack_Id.b32
+ * \param fxn Called with each frame of the ID, NULL to stop decoding at interrupt level
+ * \return Returns 0 for success, -1 if service already started
+ */
+int8_t BtStack_setUrgent(uint32_t id, BtStack_UrgentFxn fxn);
+
+/**
+ * \brief Configures the tasks which run the reception callbacks, only while the service is stopped
+ *
+ * Received frames are queued for dispatch tasks so a slow callback does not hold up reception.
+ *
+ * \param workers No. of dispatch tasks, 1 to 4
+ * \param depth No. of frames which can be queued, 1 to 32
+ * \param policy Behaviour when the queue is full
+ * \return Returns 0 for success, -1 if service already started and -2 if out of range
+ */
+int8_t BtStack_setDispatch(uint8_t workers, uint16_t depth, FrameQueue_Policy policy);
+
+/**
+ * \brief Marks an ID as carrying state, only while the service is stopped
+ *
+ * A newer frame of a state ID replaces one still waiting for dispatch, so handlers
+ * only see the latest value. Frames of other IDs are events and are never coalesced.
+ *
+ * \param id ID compared as BtStack_Id.b32
+ * \return Returns 0 for success, -1 if service already started and -2 if 8 IDs are already marked
+ */
+int8_t BtStack_coalesce(uint32_t id);
+
+/**
+ * \brief Reads counters of the dispatch queue
+ *
+ * \param stats Filled with the counters
+ */
+void BtStack_getDispatchStats(FrameQueue_Stats* stats);
+
 /**
  * \brief Returns whether service has started
  *
@@ -86,34 +252,111 @@ int8_t BtStack_stop(void);
 Bool BtStack_hasStarted(void);
 
 /**
- * \brief Checks whether this service has callback attached
+ * \brief Subscribes a callback to received frames, only while the service is stopped
  *
- * \return Flag indicating whether callback is attached to this service
+ * Every callback whose subscription matches a frame ID is called with the frame.
+ * Exact IDs are looked up in constant time, masked subscriptions are checked in turn.
+ *
+ * \param id ID to match, compared as BtStack_Id.b32
+ * \param mask Bits of the ID which must match, FRAMEROUTER_EXACT for a single ID and 0 for every frame
+ * \param callback Callback to execute on matching frames
+ * \return Returns 0 for success, -1 if service already started, -2 if the table is full and -3 if callback was NULL
  */
-Bool BtStack_hasCallback(void);
+int8_t BtStack_subscribe(uint32_t id, uint32_t mask, BtStack_Callback callback);
 
 /**
- * \brief Attach callback for reception event
+ * \brief Removes every subscription, only while the service is stopped
  *
- * \param callback Callback to execute on reception event
- * \return Returns 0 if callback was NULL, -1 if a callback was already attached
+ * \return Returns 0 for success, -1 if service already started
  */
-int8_t BtStack_attachCallback(BtStack_Callback callback);
+int8_t BtStack_clearSubscriptions(void);
 
 /**
- * \brief Removes reception event callback
+ * \brief Pushes a frame to the back of the control lane
+ *
+ * Returns immediately, the frame is written by the transmission task together
+ * with any other frames queued by then.
  *
- * \return Returns 0 for success, -1 if existing callback was NULL
+ * \param frame Frame to send
+ * \returns Number of encoded bytes queued, -1 if service not started and -2 if the queue is full
  */
-int8_t BtStack_removeCallback(void);
+int8_t BtStack_push(const BtStack_Frame* frame);
 
 /**
- * \brief Pushes a frame to the back of the send queue
+ * \brief Pushes a frame to the back of a lane
+ *
+ * Control frames are written before any waiting bulk frame. Bulk frames are
+ * written a few at a time, up to 64 encoded bytes per write, so a control
+ * frame never waits behind a long burst. Frames are not split, so a single
+ * bulk frame longer than that goes in one write and a control frame may wait
+ * behind up to SLIP_WORST_SIZE(SLIP_MAX_FRAME) bytes.
  *
  * \param frame Frame to send
- * \returns Number of bytes written
+ * \param lane Lane to queue the frame in
+ * \returns Number of encoded bytes queued, -1 if service not started, -2 if the lane is full
+ * and -3 if the lane is invalid or the first byte of the ID is KFP_LINK_MARKER
  */
-int8_t BtStack_push(const BtStack_Frame* frame);
+int8_t BtStack_pushLane(const BtStack_Frame* frame, BtStack_Lane lane);
+
+/**
+ * \brief Sets how many frames may wait in a lane, only while the service is stopped
+ *
+ * \param lane Lane to configure
+ * \param depth No. of frames, 1 to 16
+ * \return Returns 0 for success, -1 if service already started and -2 if out of range
+ */
+int8_t BtStack_setLaneDepth(BtStack_Lane lane, uint8_t depth);
+
+/**
+ * \brief Pushes a link frame to the back of a lane
+ *
+ * The frame is sent after a KFP_LINK_MARKER byte, which tells receivers it
+ * is not a KFP frame, with a CRC trailer if enabled. Its first byte is the type.
+ *
+ * \param frame Bytes of the frame
+ * \param size No. of bytes, 1 to BTSTACK_MAX_RAW
+ * \param lane Lane to queue the frame in
+ * \returns Number of encoded bytes queued, -1 if service not started, -2 if the lane is full,
+ * -3 if size is out of range or the lane is invalid and -4 if the encoded frame is larger than the lane
+ */
+int16_t BtStack_pushRaw(const uint8_t* frame, uint16_t size, BtStack_Lane lane);
+
+/**
+ * \brief Handles received link frames of a type, only while the service is stopped
+ *
+ * Received frames which start with KFP_LINK_MARKER are link frames, handed
+ * to the function registered for the byte after the marker.
+ *
+ * \param type First byte of the frames, see KFP_LINK_*
+ * \param fxn Function called with each frame, replaces an earlier one of the same type
+ * \return Returns 0 for success, -1 if service already started, -2 if the table is full and -3 if fxn was NULL
+ */
+int8_t BtStack_link(uint8_t type, BtStack_LinkFxn fxn);
+
+/**
+ * \brief Queues a frame for the subscribers as if it had been received
+ *
+ * Lets link layers hand over the frames they carry.
+ *
+ * \param frame Frame to dispatch
+ * \return Returns 0 for success, -1 if service not started, -2 if the dispatch queue discarded it
+ */
+int8_t BtStack_deliver(const BtStack_Frame* frame);
+
+/**
+ * \brief Reads transmission counters
+ *
+ * \param stats Filled with the counters
+ */
+void BtStack_getTxStats(BtStack_TxStats* stats);
+
+/**
+ * \brief Reads transmission counters of one lane
+ *
+ * \param lane Lane to read
+ * \param stats Filled with the counters, zeroed if the lane is invalid
+ */
+void BtStack_getLaneStats(BtStack_Lane lane, BtStack_LaneStats* stats);
 
 /**
  * \brief Prints KFP frames to the console
@@ -0,0 +1,162 @@
+/**
+ * \file BtUart.h
+ * \brief Declares bluetooth UART transport used by btStack
+ * \author George Xian
+ * \version 0.1
+ * \date 2014-12-27
+ *
+ * Owns Board_BT1. Received bytes are placed in a ByteRing supplied by the
+ * caller. Reception is either driven by the TI-RTOS UART driver or, as a
+ * substitute for it, by uDMA ping-pong blocks so the CPU is interrupted
+ * per block rather than per byte. Bytes a burst moved without a receive
+ * timeout following, as when it emptied the FIFO, are handed over on the
+ * next tick. In uDMA mode transmission is also done by the uDMA, gathering
+ * several buffers into one transfer.
+ *
+ * Optionally CTS on PC5 holds transmission in hardware and RTS on PC4 is
+ * driven by the owner of the reception ring through BtUart_setRts.
+ */
+
+#ifndef BT_UART
+#define BT_UART
+
+#include <xdc/std.h>
+#include <stdint.h>
+#include "ByteRing.h"
+
+#define BTUART_DMA_BLOCK 64		//! Size of each uDMA ping-pong block, multiple of the 8 byte burst
+#define BTUART_MAX_SPANS 4		//! Most buffers gathered into one asynchronous write
+
+/**
+ * \typedef BtUart_RxFxn
+ * \brief Called in Hwi context, or with Hwi disabled from a Clock, after bytes were added to the reception ring
+ *
+ * \param before No. of bytes in the ring before the new bytes were added
+ * \param added No. of bytes added
+ */
+typedef void (*BtUart_RxFxn)(uint16_t before, uint16_t added);
+
+/**
+ * \typedef BtUart_ScanFxn
+ * \brief Called in Hwi context, or with Hwi disabled from a Clock, with received bytes before they are placed in the reception ring
+ *
+ * Sees every byte, including those the ring has no room for.
+ *
+ * \param data Bytes received
+ * \param len No. of bytes in data
+ */
+typedef void (*BtUart_ScanFxn)(const uint8_t* data, uint16_t len);
+
+/**
+ * \typedef BtUart_TxDoneFxn
+ * \brief Called when every buffer of an asynchronous write has been taken by the UART
+ *
+ * Runs in Hwi context in uDMA mode, the buffers may be reused from this call on.
+ *
+ * \param len Total no. of bytes written
+ */
+typedef void (*BtUart_TxDoneFxn)(uint16_t len);
+
+/**
+ * \struct BtUart_Span
+ * \brief One buffer of an asynchronous write
+ */
+typedef struct
+{
+	const uint8_t* data;		//! First byte
+	uint16_t len;				//! No. of bytes, at most 1024
+} BtUart_Span;
+
+/**
+ * \struct BtUart_Params
+ * \brief Parameters used to open the bluetooth UART
+ */
+typedef struct
+{
+	uint32_t baud;				//! Baud rate
+	Bool useDma;				//! Drive the UART through uDMA instead of the UART driver
+	Bool flowPins;				//! Use the RTS and CTS pins of Board_BT1
+	ByteRing* rxRing;			//! Ring received bytes are placed in
+	BtUart_RxFxn rxFxn;			//! Called after bytes are placed in rxRing
+	BtUart_ScanFxn scanFxn;		//! Called before bytes are placed in rxRing, may be NULL
+	BtUart_TxDoneFxn txDoneFxn;	//! Called when an asynchronous write completes
+} BtUart_Params;
+
+/**
+ * \struct BtUart_Stats
+ * \brief Transport counters since the UART was opened
+ */
+typedef struct
+{
+	uint32_t hwOverruns;		//! No. of UART FIFO overrun errors
+	uint32_t rxBlocks;			//! No. of blocks handed to the ring (uDMA mode only)
+} BtUart_Stats;
+
+/**
+ * \brief Opens the bluetooth UART and starts reception
+ *
+ * \param params Parameters to open with
+ * \return Returns 0 for success, -1 if already open and -2 if the UART failed to open
+ */
+int8_t BtUart_open(const BtUart_Params* params);
+
+/**
+ * \brief Stops reception and closes the bluetooth UART
+ *
+ * \return Returns 0 for success, -1 if not open
+ */
+int8_t BtUart_close(void);
+
+/**
+ * \brief Writes bytes to the bluetooth UART, blocks until they are sent
+ *
+ * Must not be used while an asynchronous write is in progress.
+ *
+ * \param data Bytes to write
+ * \param len No. of bytes in data
+ * \return No. of bytes written, negative for failure
+ */
+int BtUart_write(const uint8_t* data, uint16_t len);
+
+/**
+ * \brief Starts writing several buffers as one transfer
+ *
+ * In uDMA mode this returns once the transfer is started, otherwise once the
+ * bytes are written. txDoneFxn is called when the buffers may be reused.
+ *
+ * \param spans Buffers to write in order
+ * \param count No. of buffers, 1 to BTUART_MAX_SPANS
+ * \return Returns 0 for success, -1 if not open or a write is in progress and -2 if count is out of range
+ */
+int8_t BtUart_writeSpans(const BtUart_Span* spans, uint8_t count);
+
+/**
+ * \brief Changes the baud rate of the open UART
+ *
+ * Waits for bytes still in the FIFO to be sent at the old rate. Bytes arriving
+ * while the rate changes may be lost.
+ *
+ * \param baud New baud rate
+ * \return Returns 0 for success, -1 if not open or a write is in progress and -2 if the UART
+ * failed to reopen, in which case it is left closed
+ */
+int8_t BtUart_setBaud(uint32_t baud);
+
+/**
+ * \brief Drives RTS, does nothing unless flowPins was set
+ *
+ * May be called from Hwi context.
+ *
+ * \param ready Flag to let the module send, RTS low
+ */
+void BtUart_setRts(Bool ready);
+
+/**
+ * \brief Reads transport counters
+ *
+ * \param stats Filled with the counters
+ */
+void BtUart_getStats(BtUart_Stats* stats);
+
+
+#endif
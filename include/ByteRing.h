@@ -0,0 +1,117 @@
+/**
+ * \file ByteRing.h
+ * \brief Declares single producer, single consumer lock-free byte ring
+ * \author George Xian
+ * \version 0.1
+ * \date 2014-12-20
+ *
+ * One context may write and one context may read without any locking,
+ * e.g. a Hwi producing and a task consuming. Indices run freely and are
+ * masked on access, so the ring size must be a power of two.
+ */
+
+#ifndef BYTE_RING
+#define BYTE_RING
+
+#include <stdint.h>
+
+/**
+ * \struct ByteRing
+ * \brief Ring state, head is only written by the producer and tail only by the consumer
+ */
+typedef struct
+{
+	uint8_t* buf;					//! Storage, size is a power of two
+	uint16_t mask;					//! Size of storage less one
+	volatile uint16_t head;			//! Free running write index
+	volatile uint16_t tail;			//! Free running read index
+	volatile uint32_t overruns;		//! No. of bytes dropped because the ring was full
+} ByteRing;
+
+/**
+ * \brief Initialises an empty ring over caller supplied storage
+ *
+ * \param ring Ring to initialise
+ * \param buf Storage for the ring
+ * \param size Size of buf, must be a power of two no larger than 32768
+ */
+void ByteRing_init(ByteRing* ring, uint8_t* buf, uint16_t size);
+
+/**
+ * \brief Returns no. of bytes waiting to be read
+ */
+uint16_t ByteRing_count(const ByteRing* ring);
+
+/**
+ * \brief Returns no. of bytes which can be written before the ring is full
+ */
+uint16_t ByteRing_space(const ByteRing* ring);
+
+/**
+ * \brief Writes bytes to the ring, producer only
+ *
+ * \param ring Ring to write to
+ * \param data Bytes to write
+ * \param len No. of bytes in data
+ * \return No. of bytes written, the rest are dropped and counted as overruns
+ */
+uint16_t ByteRing_write(ByteRing* ring, const uint8_t* data, uint16_t len);
+
+/**
+ * \brief Writes a single byte to the ring, producer only
+ *
+ * \return Returns 0 for success, -1 if the ring was full and the byte was dropped
+ */
+int8_t ByteRing_put(ByteRing* ring, uint8_t value);
+
+/**
+ * \brief Finds the contiguous block of free space at the head, producer only
+ *
+ * Lets the producer build data in place, ByteRing_commit publishes it.
+ *
+ * \param ring Ring to write to
+ * \param data Set to the first free byte
+ * \return No. of contiguous free bytes at data
+ */
+uint16_t ByteRing_reserve(ByteRing* ring, uint8_t** data);
+
+/**
+ * \brief Publishes bytes written into space returned by ByteRing_reserve, producer only
+ *
+ * \param ring Ring written to
+ * \param len No. of bytes to publish
+ */
+void ByteRing_commit(ByteRing* ring, uint16_t len);
+
+/**
+ * \brief Finds the contiguous block of unread bytes at the tail, consumer only
+ *
+ * Bytes stay in the ring until ByteRing_consume is called, call again after
+ * consuming to get the block that wrapped around to the start of storage.
+ *
+ * \param ring Ring to read from
+ * \param data Set to the first unread byte
+ * \return No. of contiguous bytes at data
+ */
+uint16_t ByteRing_peek(const ByteRing* ring, const uint8_t** data);
+
+/**
+ * \brief Finds the contiguous block of unread bytes starting past the tail, consumer only
+ *
+ * \param ring Ring to read from
+ * \param offset No. of unread bytes to skip
+ * \param data Set to the first byte after the skipped ones
+ * \return No. of contiguous bytes at data
+ */
+uint16_t ByteRing_peekAt(const ByteRing* ring, uint16_t offset, const uint8_t** data);
+
+/**
+ * \brief Releases bytes previously returned by ByteRing_peek, consumer only
+ *
+ * \param ring Ring to release bytes from
+ * \param len No. of bytes to release
+ */
+void ByteRing_consume(ByteRing* ring, uint16_t len);
+
+
+#endif
@@ -0,0 +1,43 @@
+/**
+ * \file Crc16.h
+ * \brief Declares CRC-16/CCITT used to check KFP frames
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-01-18
+ *
+ * Polynomial 0x1021, initial value 0xFFFF, no reflection and no final XOR.
+ * Appending the CRC most significant byte first makes the CRC of the whole
+ * frame 0, which is how receivers check it.
+ */
+
+#ifndef CRC16
+#define CRC16
+
+#include <stdint.h>
+
+#define CRC16_INIT 0xFFFF		//! Initial value of a CRC
+#define CRC16_SIZE 2			//! No. of bytes of an appended CRC
+
+/**
+ * \brief Continues a CRC over more bytes
+ *
+ * Four bytes are folded in per step through slice-by-4 tables held in flash.
+ *
+ * \param crc CRC so far, CRC16_INIT for the first bytes
+ * \param data Bytes to add
+ * \param len No. of bytes in data
+ * \return Updated CRC
+ */
+uint16_t Crc16_update(uint16_t crc, const uint8_t* data, uint16_t len);
+
+/**
+ * \brief Computes the CRC of a buffer
+ *
+ * \param data Bytes to check
+ * \param len No. of bytes in data
+ * \return CRC of data
+ */
+uint16_t Crc16_compute(const uint8_t* data, uint16_t len);
+
+
+#endif
@@ -0,0 +1,109 @@
+/**
+ * \file DriveCtrl.h
+ * \brief Declares drive control application functions
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-01-10
+ *
+ * Drive commands received over bluetooth only set a target. A control task
+ * woken by a Clock at a fixed rate moves the output towards the target,
+ * limited to a maximum slew, and sends one update to the power board per tick.
+ */
+
+#ifndef DRIVE_CTRL
+#define DRIVE_CTRL
+
+#include <xdc/std.h>
+#include <stdint.h>
+
+#define DRIVECTRL_DEFAULT_ID 0x00565244		//! Frame ID of drive commands, "DRV" bytewise
+
+/**
+ * \struct DriveCtrl_Stats
+ * \brief Control loop counters since the application was started
+ */
+typedef struct
+{
+	uint32_t ticks;				//! No. of updates sent to the power board
+	uint32_t overruns;			//! No. of ticks skipped because the previous update had not finished
+	uint32_t errors;			//! No. of updates the power board did not accept
+	uint32_t ignored;			//! No. of commands ignored while halted
+	uint32_t maxJitterUs;		//! Largest deviation of a measured period from the configured period
+	uint32_t meanJitterUs;		//! Mean deviation of measured periods from the configured period
+} DriveCtrl_Stats;
+
+/**
+ * \brief Subscribes to drive command frames, must be called before BtStack_start
+ *
+ * Drive frames carry power in payload byte 0 and yaw in payload byte 1. The
+ * frame ID is marked as state so only the latest command waits for dispatch.
+ *
+ * \param id Frame ID of drive commands, compared as BtStack_Id.b32
+ * \return Returns 0 for success, -1 if btStack already started
+ */
+int8_t DriveCtrl_init(uint32_t id);
+
+/**
+ * \brief Sets the control loop rate, only while the application is stopped
+ *
+ * The period is rounded to whole Clock ticks.
+ *
+ * \param hz Updates per second, 10 to 500
+ * \return Returns 0 for success, -1 if already started, -2 if out of range
+ */
+int8_t DriveCtrl_setRate(uint16_t hz);
+
+/**
+ * \brief Sets how fast power and yaw may change, only while the application is stopped
+ *
+ * \param perSecond Largest change in magnitude per second, 0 for no limit
+ * \return Returns 0 for success, -1 if already started
+ */
+int8_t DriveCtrl_setSlew(uint16_t perSecond);
+
+/**
+ * \brief Starts the control loop, power management must have started
+ *
+ * \return Returns 0 for success, -1 if already started, -2 if the task or clock failed to start
+ */
+int8_t DriveCtrl_start(void);
+
+/**
+ * \brief Stops the control loop, the last update sent stays applied
+ *
+ * \return Returns 0 for success, -1 if not started
+ */
+int8_t DriveCtrl_stop(void);
+
+/**
+ * \brief Sets the commanded power and yaw, applied from the next tick
+ *
+ * Ignored between DriveCtrl_halt and DriveCtrl_release.
+ *
+ * \param power Forward power
+ * \param yaw Yaw rate
+ */
+void DriveCtrl_command(int8_t power, int8_t yaw);
+
+/**
+ * \brief Commands zero power and yaw and drops the output to zero without slewing
+ *
+ * For use after the motors were stopped directly, may be called from Hwi context.
+ * Commands are ignored from then on until DriveCtrl_release.
+ */
+void DriveCtrl_halt(void);
+
+/**
+ * \brief Accepts commands again after DriveCtrl_halt
+ */
+void DriveCtrl_release(void);
+
+/**
+ * \brief Reads control loop counters
+ *
+ * \param stats Filled with the counters
+ */
+void DriveCtrl_getStats(DriveCtrl_Stats* stats);
+
+
+#endif
@@ -0,0 +1,59 @@
+/**
+ * \file EStop.h
+ * \brief Declares emergency stop application functions
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-02
+ *
+ * Emergency stop frames are recognised by btStack as their bytes are decoded
+ * in the UART's Hwi. The motors are stopped straight from there by an urgent
+ * power board write which goes ahead of everything queued for the inter board
+ * bus, without waiting for any task to run.
+ */
+
+#ifndef E_STOP
+#define E_STOP
+
+#include <xdc/std.h>
+#include <stdint.h>
+
+/**
+ * \struct EStop_Stats
+ * \brief Emergency stop counters since btStack was started
+ */
+typedef struct
+{
+	uint32_t triggers;			//! No. of emergency stop frames received
+	uint32_t refused;			//! No. of stops the power management service could not queue
+	uint32_t lastLatencyUs;		//! Time from the END byte of the last stop until its write was put on the bus
+	uint32_t maxLatencyUs;		//! Longest time from the END byte of a stop until its write was put on the bus
+} EStop_Stats;
+
+/**
+ * \brief Handles emergency stop frames at interrupt level, must be called before BtStack_start
+ *
+ * The payload of the frame is ignored. Drive control output drops to zero
+ * and drive commands are ignored until the stop frame itself is dispatched,
+ * so drive frames received ahead of the stop cannot restart the motors. A
+ * later drive command moves the vehicle again. Ordering relies on a single
+ * dispatch worker, see BtStack_setDispatch.
+ *
+ * The dispatch queue never drops the stop frame to make room, whatever its
+ * policy, so the release is only lost when the reception ring overruns and
+ * the stop frame's bytes never reach the reception task. Drive commands then
+ * stay ignored until the next stop frame, which the operator sends to resume.
+ *
+ * \param id Reserved frame ID of the emergency stop, see KFP_ESTOP_ID
+ * \return Returns 0 for success, -1 if btStack already started
+ */
+int8_t EStop_init(uint32_t id);
+
+/**
+ * \brief Reads emergency stop counters
+ *
+ * \param stats Filled with the counters
+ */
+void EStop_getStats(EStop_Stats* stats);
+
+
+#endif
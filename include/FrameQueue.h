@@ -0,0 +1,131 @@
+/**
+ * \file FrameQueue.h
+ * \brief Declares bounded KFP frame queue
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-01-03
+ *
+ * Frames are copied into caller supplied slots. Any number of tasks may
+ * put and get, the slots are guarded by briefly disabling interrupts.
+ *
+ * Frames with a state ID are coalesced, a newer frame replaces a queued
+ * frame of the same ID in place rather than queueing behind it. Frames of
+ * any other ID are events and are always queued.
+ *
+ * Frames with a kept ID are never discarded by the drop policy while the
+ * queue holds any other frame, the oldest other frame makes way instead.
+ */
+
+#ifndef FRAME_QUEUE
+#define FRAME_QUEUE
+
+#include <xdc/std.h>
+#include <ti/sysbios/knl/Semaphore.h>
+#include "Kfp.h"
+
+/**
+ * \enum FrameQueue_Policy
+ * \brief What a put does when the queue is full
+ */
+typedef enum
+{
+	FRAMEQUEUE_DROP_OLDEST,		//! Replace the oldest queued frame
+	FRAMEQUEUE_DROP_NEWEST,		//! Discard the frame being put
+	FRAMEQUEUE_BLOCK			//! Wait for a slot to free up
+} FrameQueue_Policy;
+
+/**
+ * \struct FrameQueue_Stats
+ * \brief Queue counters since creation
+ */
+typedef struct
+{
+	uint32_t puts;				//! No. of frames put
+	uint32_t drops;				//! No. of frames discarded by the drop policy
+	uint32_t coalesced;			//! No. of queued state frames replaced by a newer one
+	uint16_t highWater;			//! Most frames ever queued at once
+} FrameQueue_Stats;
+
+/**
+ * \struct FrameQueue
+ * \brief Queue state
+ */
+typedef struct
+{
+	BtStack_Frame* slots;		//! Storage for queued frames
+	uint16_t depth;				//! No. of slots
+	uint16_t head;				//! Slot of the oldest frame
+	uint16_t count;				//! No. of queued frames
+	FrameQueue_Policy policy;	//! Behaviour when full
+	Semaphore_Handle items;		//! Counts queued frames for getters
+	Semaphore_Handle space;		//! Counts free slots for putters, FRAMEQUEUE_BLOCK only
+	const uint32_t* stateIds;	//! IDs whose frames are coalesced
+	uint8_t stateCount;			//! No. of entries in stateIds
+	const uint32_t* keptIds;	//! IDs whose frames are not dropped
+	uint8_t keptCount;			//! No. of entries in keptIds
+	FrameQueue_Stats stats;		//! Counters
+} FrameQueue;
+
+/**
+ * \brief Creates an empty queue
+ *
+ * \param queue Queue to create
+ * \param slots Storage for depth frames
+ * \param depth No. of slots
+ * \param policy Behaviour when full
+ * \return Returns 0 for success, -1 if a semaphore could not be created
+ */
+int8_t FrameQueue_create(FrameQueue* queue, BtStack_Frame* slots, uint16_t depth, FrameQueue_Policy policy);
+
+/**
+ * \brief Sets the IDs of state frames, before the queue is used
+ *
+ * \param queue Queue to configure
+ * \param ids IDs compared as BtStack_Id.b32, must stay valid while the queue exists
+ * \param count No. of entries in ids
+ */
+void FrameQueue_setStateIds(FrameQueue* queue, const uint32_t* ids, uint8_t count);
+
+/**
+ * \brief Sets the IDs of frames the drop policy spares, before the queue is used
+ *
+ * \param queue Queue to configure
+ * \param ids IDs compared as BtStack_Id.b32, must stay valid while the queue exists
+ * \param count No. of entries in ids
+ */
+void FrameQueue_setKeptIds(FrameQueue* queue, const uint32_t* ids, uint8_t count);
+
+/**
+ * \brief Deletes a queue, nothing may be waiting on it
+ */
+void FrameQueue_delete(FrameQueue* queue);
+
+/**
+ * \brief Copies a frame to the back of the queue
+ *
+ * \param queue Queue to put to
+ * \param frame Frame to copy
+ * \return Returns 0 if the frame was queued or replaced a queued frame, -1 if it was discarded
+ */
+int8_t FrameQueue_put(FrameQueue* queue, const BtStack_Frame* frame);
+
+/**
+ * \brief Takes the frame at the front of the queue
+ *
+ * \param queue Queue to take from
+ * \param frame Filled with the frame
+ * \param timeout Ticks to wait for a frame
+ * \return Returns TRUE if a frame was taken, FALSE on timeout
+ */
+Bool FrameQueue_get(FrameQueue* queue, BtStack_Frame* frame, UInt timeout);
+
+/**
+ * \brief Reads queue counters
+ *
+ * \param queue Queue to read
+ * \param stats Filled with the counters
+ */
+void FrameQueue_getStats(FrameQueue* queue, FrameQueue_Stats* stats);
+
+
+#endif
@@ -0,0 +1,88 @@
+/**
+ * \file FrameRouter.h
+ * \brief Declares ID keyed KFP frame routing table
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-01-05
+ *
+ * Routes are added while the table is being set up, then built into a
+ * flat table. Exact IDs are found through a small open addressing hash
+ * in constant time, masked routes are checked in turn afterwards. Routing
+ * a frame never allocates and only reads the table, so several tasks may
+ * route at once.
+ */
+
+#ifndef FRAME_ROUTER
+#define FRAME_ROUTER
+
+#include <stdint.h>
+#include "Kfp.h"
+
+#define FRAMEROUTER_MAX_ROUTES 32			//! Most routes a table can hold
+#define FRAMEROUTER_HASH_SIZE 64			//! Hash slots, power of two and at least twice the no. of routes
+#define FRAMEROUTER_EXACT 0xFFFFFFFF		//! Mask which matches a single ID
+
+/**
+ * \typedef FrameRouter_Fxn
+ * \brief Handler called with each frame routed to it
+ */
+typedef void (*FrameRouter_Fxn)(const BtStack_Frame*);
+
+/**
+ * \struct FrameRouter_Route
+ * \brief Sends frames whose ID matches id under mask to fxn
+ */
+typedef struct
+{
+	uint32_t id;				//! ID to match, already masked
+	uint32_t mask;				//! Bits of the ID which must match
+	FrameRouter_Fxn fxn;		//! Handler
+} FrameRouter_Route;
+
+/**
+ * \struct FrameRouter
+ * \brief Routing table
+ */
+typedef struct
+{
+	FrameRouter_Route routes[FRAMEROUTER_MAX_ROUTES];	//! Exact routes sorted by ID, then masked routes
+	uint8_t count;										//! No. of routes
+	uint8_t exactCount;									//! No. of exact routes at the front of routes
+	uint8_t hash[FRAMEROUTER_HASH_SIZE];				//! Index plus one of the first exact route of an ID, 0 if empty
+	uint8_t built;										//! Table has been built
+} FrameRouter;
+
+/**
+ * \brief Empties a routing table
+ */
+void FrameRouter_init(FrameRouter* router);
+
+/**
+ * \brief Adds a route, the table must be built again before routing
+ *
+ * Must not be called while frames are being routed.
+ *
+ * \param router Table to add to
+ * \param id ID to match, compared as BtStack_Id.b32
+ * \param mask Bits of the ID which must match, FRAMEROUTER_EXACT for a single ID
+ * \param fxn Handler to call with matching frames
+ * \return Returns 0 for success, -1 if the table is full
+ */
+int8_t FrameRouter_add(FrameRouter* router, uint32_t id, uint32_t mask, FrameRouter_Fxn fxn);
+
+/**
+ * \brief Builds the lookup structures from the routes added so far
+ */
+void FrameRouter_build(FrameRouter* router);
+
+/**
+ * \brief Calls every handler whose route matches the frame ID
+ *
+ * \param router Built table
+ * \param frame Frame to route
+ * \return No. of handlers called
+ */
+uint8_t FrameRouter_route(const FrameRouter* router, const BtStack_Frame* frame);
+
+
+#endif
@@ -0,0 +1,244 @@
+/**
+ * \file InterBus.h
+ * \brief Declares inter board bus service functions
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-01-12
+ *
+ * Owns Board_INTER. Services talking to Shunt, Bash or the power board
+ * register a slave and queue transactions for it. One transaction is on the
+ * bus at a time, the next is taken from the highest priority with work and
+ * round-robin between slaves of that priority.
+ *
+ * Failed transactions are retried with backoff, when they keep failing the
+ * bus is cleared and the driver reopened without stopping the service.
+ * If the driver still fails to reopen after RECOVERY_ATTEMPTS tries, the bus
+ * is lost: queued transactions complete with -2 and new ones are refused
+ * until the service is restarted.
+ */
+
+#ifndef INTER_BUS
+#define INTER_BUS
+
+#include <xdc/std.h>
+#include <stdint.h>
+
+#define INTERBUS_MAX_SLAVES 4		//! Most slaves registered at once
+#define INTERBUS_POOL_SIZE 16		//! Most transactions queued across all slaves
+#define INTERBUS_SLAVE_DEPTH 8		//! Most transactions queued for one slave
+#define INTERBUS_MAX_WRITE 16		//! Most bytes written by one transaction
+#define INTERBUS_MAX_READ 32		//! Most bytes read by one transaction
+
+/**
+ * \enum InterBus_Priority
+ * \brief Queue a transaction waits in, commands always go before telemetry
+ */
+typedef enum
+{
+	INTERBUS_PRIORITY_COMMAND,		//! Drive, weapon and other actuation
+	INTERBUS_PRIORITY_TELEMETRY,	//! Background polls
+	INTERBUS_PRIORITY_COUNT
+} InterBus_Priority;
+
+/**
+ * \typedef InterBus_Token
+ * \brief Identifies a queued transaction, 1 to INT32_MAX and reused after wrapping
+ */
+typedef uint32_t InterBus_Token;
+
+/**
+ * \typedef InterBus_DoneFxn
+ * \brief Called from the I2C driver's interrupt context when a queued transaction completes
+ *
+ * \param token Token returned when the transaction was queued
+ * \param status 0 for success, -2 for transaction error after every retry or cancelled by InterBus_urgent
+ * \param read Bytes read, only valid during the call
+ * \param arg Argument given when the transaction was queued
+ */
+typedef void (*InterBus_DoneFxn)(InterBus_Token token, int8_t status, const uint8_t* read, void* arg);
+
+/**
+ * \struct InterBus_SlaveStats
+ * \brief Counters of one slave since it was registered
+ */
+typedef struct
+{
+	uint32_t submitted;			//! No. of transactions queued
+	uint32_t completed;			//! No. of transactions completed successfully
+	uint32_t errors;			//! No. of transactions which failed
+	uint32_t queueFull;			//! No. of transactions refused because the queue was full
+	uint32_t bytes;				//! No. of bytes written and read by completed transactions
+	uint8_t highWater;			//! Most transactions queued at once
+	uint32_t meanLatencyUs;		//! Mean time from queueing until the transaction starts
+	uint32_t maxLatencyUs;		//! Longest time from queueing until the transaction starts
+} InterBus_SlaveStats;
+
+/**
+ * \struct InterBus_BusStats
+ * \brief Fault and recovery counters since the service was started
+ */
+typedef struct
+{
+	uint32_t retries;			//! No. of retries of failed transactions
+	uint32_t failures;			//! No. of transactions failed after every retry
+	uint32_t recoveries;		//! No. of times the driver was reopened
+	uint32_t recoveryFailures;	//! No. of times the driver failed to reopen
+	uint32_t stuckBus;			//! No. of recoveries where a slave still held SDA low
+	uint32_t maxRecoveryUs;		//! Longest time to clear the bus and reopen the driver
+	uint32_t outages;			//! No. of runs of failures, each ends with a successful transaction
+	uint32_t lastOutageUs;		//! Time from the first failure of the last outage until the next success
+	uint32_t maxOutageUs;		//! Longest outage
+	uint32_t urgent;			//! No. of urgent transactions put on the bus
+	uint32_t cancelled;			//! No. of queued commands dropped by urgent transactions
+	uint32_t lastUrgentUs;		//! Time from the origin of the last urgent transaction until it was put on the bus
+	uint32_t maxUrgentUs;		//! Longest time from the origin of an urgent transaction until it was put on the bus
+} InterBus_BusStats;
+
+/**
+ * \brief Starts inter board bus service
+ *
+ * Opens the inter board I2C bus in callback mode, which stays open until
+ * InterBus_stop is called. Must be called after Board_initI2C.
+ *
+ * \return Returns 0 for success, -1 if service already started and -2 if the bus or the recovery task failed to start
+ */
+int8_t InterBus_start(void);
+
+/**
+ * \brief Stops inter board bus service once queued transactions finish
+ *
+ * Waits up to a second for queued transactions and any bus recovery. If
+ * either is still going then, the service keeps running and accepts
+ * transactions again.
+ *
+ * \return Returns 0 for success, -1 if service was not started and -2 if queued transactions or recovery did not finish
+ */
+int8_t InterBus_stop(void);
+
+/**
+ * \brief Returns whether service has started
+ *
+ * \return Flag indicating whether service has started
+ */
+Bool InterBus_hasStarted(void);
+
+/**
+ * \brief Registers a slave
+ *
+ * \param address 7 bit slave address
+ * \return Index of the slave, -1 if the table is full
+ */
+int8_t InterBus_addSlave(uint8_t address);
+
+/**
+ * \brief Unregisters a slave
+ *
+ * \param slave Index returned by InterBus_addSlave
+ * \return Returns 0 for success, -1 if transactions are still queued for it and -2 if slave is not registered
+ */
+int8_t InterBus_removeSlave(int8_t slave);
+
+/**
+ * \brief Queues a transaction, returns without waiting for the bus
+ *
+ * \param slave Index returned by InterBus_addSlave
+ * \param priority Queue to wait in
+ * \param write Bytes to write, copied before returning
+ * \param writeCount No. of bytes in write, up to INTERBUS_MAX_WRITE
+ * \param readCount No. of bytes to read after a repeated start, up to INTERBUS_MAX_READ
+ * \param doneFxn Called when the transaction completes, may be NULL
+ * \param arg Passed to doneFxn
+ * \return Token of the transaction, -1 if service not started, -2 if the queue is full or the bus was lost
+ * and -3 if a count or priority is out of range, both counts are 0 or slave is not registered
+ */
+int32_t InterBus_submit(int8_t slave, InterBus_Priority priority, const uint8_t* write,
+		uint8_t writeCount, uint8_t readCount, InterBus_DoneFxn doneFxn, void* arg);
+
+/**
+ * \brief Queues a command priority write which an urgent write to the same slave cancels
+ *
+ * For writes a later urgent write makes obsolete, such as drive setpoints.
+ *
+ * \param slave Index returned by InterBus_addSlave
+ * \param write Bytes to write, copied before returning
+ * \param writeCount No. of bytes in write, up to INTERBUS_MAX_WRITE
+ * \param doneFxn Called when the write completes or is cancelled, may be NULL
+ * \param arg Passed to doneFxn
+ * \return Token of the transaction, -1 if service not started, -2 if the queue is full or the bus was lost
+ * and -3 if writeCount is 0 or out of range or slave is not registered
+ */
+int32_t InterBus_supersedable(int8_t slave, const uint8_t* write, uint8_t writeCount,
+		InterBus_DoneFxn doneFxn, void* arg);
+
+/**
+ * \brief Puts a write on the bus ahead of every queued transaction, may be called from Hwi context
+ *
+ * Starts at once if the bus is free, otherwise as soon as the transaction on
+ * it completes. Writes still queued for the slave with InterBus_supersedable
+ * are cancelled, they would undo the urgent write. Other transactions stay
+ * queued behind it.
+ *
+ * \param slave Index returned by InterBus_addSlave
+ * \param write Bytes to write, copied before returning
+ * \param writeCount No. of bytes in write, up to INTERBUS_MAX_WRITE
+ * \param since Timestamp the need for the write arose at, its latency is measured from here
+ * \return Token of the transaction, -1 if service not started, -2 if an urgent transaction is
+ * already waiting or the bus was lost and -3 if writeCount is 0 or out of range or slave is not registered
+ */
+int32_t InterBus_urgent(int8_t slave, const uint8_t* write, uint8_t writeCount, uint32_t since);
+
+/**
+ * \brief Queues a transaction and waits for it to complete, call from task context only
+ *
+ * \param slave Index returned by InterBus_addSlave
+ * \param priority Queue to wait in
+ * \param write Bytes to write
+ * \param writeCount No. of bytes in write, up to INTERBUS_MAX_WRITE
+ * \param read Filled with the bytes read, may be NULL if readCount is 0
+ * \param readCount No. of bytes to read after a repeated start, up to INTERBUS_MAX_READ
+ * \return Returns 0 for success, -1 if service not started, -2 if transaction error or queue full
+ * and -3 if a count or priority is out of range, both counts are 0 or slave is not registered
+ */
+int8_t InterBus_transfer(int8_t slave, InterBus_Priority priority, const uint8_t* write,
+		uint8_t writeCount, uint8_t* read, uint8_t readCount);
+
+/**
+ * \brief Returns whether a queued transaction has completed
+ *
+ * \param token Token returned when the transaction was queued
+ * \return Flag indicating whether the transaction has completed
+ */
+Bool InterBus_isDone(InterBus_Token token);
+
+/**
+ * \brief Returns the no. of transactions queued or in progress for a slave
+ *
+ * \param slave Index returned by InterBus_addSlave
+ * \return No. of transactions, 0 if slave is not registered
+ */
+uint8_t InterBus_pending(int8_t slave);
+
+/**
+ * \brief Returns whether no transaction is queued or in progress
+ *
+ * \return Flag indicating whether the bus is idle
+ */
+Bool InterBus_isIdle(void);
+
+/**
+ * \brief Reads fault and recovery counters
+ *
+ * \param stats Filled with the counters
+ */
+void InterBus_getBusStats(InterBus_BusStats* stats);
+
+/**
+ * \brief Reads counters of a slave
+ *
+ * \param slave Index returned by InterBus_addSlave
+ * \param stats Filled with the counters, zeroed if slave is not registered
+ */
+void InterBus_getSlaveStats(int8_t slave, InterBus_SlaveStats* stats);
+
+
+#endif
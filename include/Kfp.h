@@ -0,0 +1,69 @@
+/**
+ * \file Kfp.h
+ * \brief Declares Killalot frame protocol types
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-01-03
+ *
+ * Kept free of TI-RTOS so frames can be handled by modules below btStack.
+ */
+
+#ifndef KFP
+#define KFP
+
+#include <stdint.h>
+
+#define KFP_FRAME_SIZE 14	//! No. of data bytes in Killalot frame protocol
+#define KFP_WORST_SIZE 26	//! Maximum frame size if escape characters are used
+#define KFP_WORST_CRC_SIZE 30	//! Maximum frame size with CRC-16 trailer if escape characters are used
+
+#define KFP_LINK_MARKER 0xFF		//! First byte of every link frame, KFP frames must not start with it
+#define KFP_LINK_REL_DATA 0x01	//! Link frame, sequenced KFP frame of the reliable channel
+#define KFP_LINK_REL_ACK 0x02	//! Link frame, acknowledgement of the reliable channel
+#define KFP_LINK_FRAG 0x03		//! Link frame, variable length frame or fragment of a long message
+#define KFP_LINK_BAUD 0x04		//! Link frame, baud rate negotiation
+#define KFP_LINK_FLOW 0x05		//! Link frame, asks the peer to pause or resume sending
+
+#define KFP_ESTOP_ID 0x00505453	//! Reserved frame ID of the emergency stop, "STP" bytewise
+
+typedef enum {KFPPRINTFORMAT_ASCII, KFPPRINTFORMAT_HEX} KfpPrintFormat;
+
+/**
+ * \struct BtStack_Id
+ * \brief Allows ID field of KFP to be accessed bytewise or wordwise of Thumb or ARM
+ */
+typedef union
+{
+	uint8_t b8[4];			//! bytewise
+	uint16_t b16[2];		//! thumb wordwise
+	uint32_t b32;			//! ARM wordwise
+} BtStack_Id;
+
+/**
+ * \struct BtStack_Data
+ * \brief Allows payload field of KFP to be accessed bytewise or wordwise of Thumb or ARM
+ */
+typedef union
+{
+	uint8_t b8[8];			//! bytewise
+	uint16_t b16[4];		//! thumb wordwise
+	uint32_t b32[2];		//! ARM wordwise
+} BtStack_Data;
+
+/**
+ * \struct BtStack_Frame
+ * \brief Represents KFP, allows access as structure or bytestream
+ */
+typedef union
+{
+	struct
+	{
+		BtStack_Id id;				//! 4 bytes ID
+		BtStack_Data payload;		//! 8 bytes payload
+	};
+	uint8_t b8[KFP_FRAME_SIZE-2];		//! bytestream access
+	uint32_t b32[(KFP_FRAME_SIZE-2)/4];	//! ARM wordwise access
+} BtStack_Frame;
+
+
+#endif
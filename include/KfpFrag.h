@@ -0,0 +1,107 @@
+/**
+ * \file KfpFrag.h
+ * \brief Declares variable length KFP frames and fragmentation of long messages
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-01-24
+ *
+ * A message is an ID and up to KFPFRAG_MAX_MESSAGE bytes. It is sent as one or
+ * more KFP_LINK_FRAG link frames of at most the MTU, each carrying its length,
+ * its place in the message and the ID. A message which fits in one frame is
+ * simply a variable length KFP frame. Receivers reassemble messages in a few
+ * preallocated slots, a slot whose message stops arriving is reused once it
+ * times out.
+ */
+
+#ifndef KFP_FRAG
+#define KFP_FRAG
+
+#include <xdc/std.h>
+#include <stdint.h>
+#include "BtStack.h"
+
+#define KFPFRAG_HEADER_SIZE 11		//! No. of bytes in front of the data of each fragment
+#define KFPFRAG_MAX_MESSAGE 2048	//! Largest message which can be reassembled
+#define KFPFRAG_MAX_FRAGMENTS 128	//! Most fragments of one message
+#define KFPFRAG_SLOTS 2				//! No. of messages which can be reassembled at once
+
+/**
+ * \typedef KfpFrag_Fxn
+ * \brief Called in the reception task with each complete message, only valid during the call
+ *
+ * \param id ID of the message, as BtStack_Id.b32
+ * \param data Bytes of the message
+ * \param len No. of bytes in data
+ */
+typedef void (*KfpFrag_Fxn)(uint32_t id, const uint8_t* data, uint16_t len);
+
+/**
+ * \struct KfpFrag_Stats
+ * \brief Fragmentation counters since the layer was started
+ */
+typedef struct
+{
+	uint32_t messagesSent;		//! No. of messages sent
+	uint32_t fragmentsSent;		//! No. of link frames sent
+	uint32_t bytesSent;			//! No. of message bytes sent
+	uint32_t messagesReceived;	//! No. of messages reassembled and delivered
+	uint32_t fragmentsReceived;	//! No. of link frames received
+	uint32_t timeouts;			//! No. of partly received messages abandoned
+	uint32_t dropped;			//! No. of fragments dropped, malformed or no free slot
+} KfpFrag_Stats;
+
+/**
+ * \brief Sets the largest link frame sent, only while the layer is stopped
+ *
+ * \param mtu Bytes per link frame, KFPFRAG_HEADER_SIZE+1 to BTSTACK_MAX_RAW
+ * \return Returns 0 for success, -1 if already started, -2 if out of range
+ */
+int8_t KfpFrag_setMtu(uint8_t mtu);
+
+/**
+ * \brief Sets how long a partly received message is kept, only while the layer is stopped
+ *
+ * \param ms Milliseconds since its last fragment arrived
+ * \return Returns 0 for success, -1 if already started
+ */
+int8_t KfpFrag_setTimeout(uint16_t ms);
+
+/**
+ * \brief Starts the layer, must be called before BtStack_start
+ *
+ * \param fxn Called with each complete message received
+ * \return Returns 0 for success, -1 if already started or btStack started, -3 if fxn was NULL
+ */
+int8_t KfpFrag_start(KfpFrag_Fxn fxn);
+
+/**
+ * \brief Stops the layer, partly received messages are discarded
+ *
+ * \return Returns 0 for success, -1 if not started
+ */
+int8_t KfpFrag_stop(void);
+
+/**
+ * \brief Sends a message, in as many fragments as the MTU requires
+ *
+ * Call from task context, waits for room in the lane between fragments.
+ *
+ * \param id ID of the message, as BtStack_Id.b32
+ * \param data Bytes of the message
+ * \param len No. of bytes, up to KFPFRAG_MAX_MESSAGE
+ * \param lane Lane the fragments are queued in
+ * \param timeout Clock ticks to wait for room for each fragment, at most one second
+ * \return Returns 0 for success, -1 if not started, -2 if the lane stayed full, -3 if len is out of range
+ * and -4 if a fragment could not be queued, too large for the lane or btStack stopped
+ */
+int8_t KfpFrag_send(uint32_t id, const uint8_t* data, uint16_t len, BtStack_Lane lane, UInt timeout);
+
+/**
+ * \brief Reads fragmentation counters
+ *
+ * \param stats Filled with the counters
+ */
+void KfpFrag_getStats(KfpFrag_Stats* stats);
+
+
+#endif
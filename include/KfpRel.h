@@ -0,0 +1,96 @@
+/**
+ * \file KfpRel.h
+ * \brief Declares reliable KFP channel functions
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-01-20
+ *
+ * Frames sent through the channel carry a sequence number in a
+ * KFP_LINK_REL_DATA link frame. The receiver acknowledges with the next
+ * sequence number it expects plus a bitmap of the frames after it which
+ * already arrived, so only missing frames are sent again. Up to a window of
+ * frames may be unacknowledged at once.
+ *
+ * Frames carry the session of the end which started them, so an end which
+ * restarts is noticed by its peer and both sides number from 0 again. Frames
+ * in flight across a restart may be delivered twice.
+ */
+
+#ifndef KFP_REL
+#define KFP_REL
+
+#include <xdc/std.h>
+#include <stdint.h>
+#include "Kfp.h"
+
+#define KFPREL_MAX_WINDOW 8		//! Most frames unacknowledged at once, divides 256
+
+/**
+ * \struct KfpRel_Stats
+ * \brief Channel counters since the channel was started
+ */
+typedef struct
+{
+	uint32_t sent;				//! No. of frames sent for the first time
+	uint32_t retransmits;		//! No. of frames sent again after the timeout
+	uint32_t acked;				//! No. of sent frames acknowledged
+	uint32_t delivered;			//! No. of received frames handed to subscribers in order
+	uint32_t duplicates;		//! No. of received frames which had already arrived
+	uint32_t outOfOrder;		//! No. of received frames held until the frames before them arrived
+	uint32_t resyncs;			//! No. of times the peer was found restarted
+} KfpRel_Stats;
+
+/**
+ * \brief Sets how many frames may be unacknowledged, only while the channel is stopped
+ *
+ * \param size No. of frames, 1 to KFPREL_MAX_WINDOW
+ * \return Returns 0 for success, -1 if already started, -2 if out of range
+ */
+int8_t KfpRel_setWindow(uint8_t size);
+
+/**
+ * \brief Sets how long a frame waits for acknowledgement before it is sent again
+ *
+ * \param ms Retransmission timeout in milliseconds
+ * \return Returns 0 for success, -1 if already started, -2 if 0
+ */
+int8_t KfpRel_setTimeout(uint16_t ms);
+
+/**
+ * \brief Starts the channel, must be called before BtStack_start
+ *
+ * Both ends start a new session from sequence number 0. Frames received
+ * through the channel are dispatched to the btStack subscribers like any other frame.
+ *
+ * \return Returns 0 for success, -1 if already started or btStack started, -2 if resources failed to create
+ */
+int8_t KfpRel_start(void);
+
+/**
+ * \brief Stops the channel, unacknowledged frames are forgotten
+ *
+ * \return Returns 0 for success, -1 if not started
+ */
+int8_t KfpRel_stop(void);
+
+/**
+ * \brief Sends a frame which is repeated until acknowledged
+ *
+ * Waits while the window is full.
+ *
+ * \param frame Frame to send, copied before returning
+ * \param timeout Clock ticks to wait for room in the window, at most one second
+ * \return Returns 0 for success, -1 if not started, -2 if the window stayed full and -3 if
+ * the lane refused the frame, it stays in the window and is sent again after the timeout
+ */
+int8_t KfpRel_send(const BtStack_Frame* frame, UInt timeout);
+
+/**
+ * \brief Reads channel counters
+ *
+ * \param stats Filled with the counters
+ */
+void KfpRel_getStats(KfpRel_Stats* stats);
+
+
+#endif
@@ -9,32 +9,263 @@
 #ifndef PWR_MGMT
 #define PWR_MGMT
 
+#include <xdc/std.h>
 #include <stdint.h>
+#include "InterBus.h"
+
+#define PWRMGMT_MAX_BATCH 4		//! Most commands carried by one bus write
+
+#define PWRMGMT_REG_BATTERY 0		//! Register of the percentage of battery remaining
+#define PWRMGMT_REG_FAULTS 1		//! Register of the PwrMgmt_Fault flags
+#define PWRMGMT_REG_CURRENT 2		//! First of the left then right motor currents, mA, 16 bit little endian
+#define PWRMGMT_REG_TEMPERATURE 6	//! Board then motor driver temperatures, degrees C, signed
+#define PWRMGMT_TELEMETRY_SIZE 8	//! No. of registers read by a telemetry snapshot
 
 typedef enum {WEAPON_1 = 121, WEAPON_2 = 122} PwrMgmt_Weapon;
 
+typedef enum
+{
+	PWRMGMT_FAULT_UNDERVOLT = 0x01,		//! Battery below cut-off
+	PWRMGMT_FAULT_OVERCURRENT = 0x02,	//! A motor exceeded its current limit
+	PWRMGMT_FAULT_OVERTEMP = 0x04,		//! Board or motor driver too hot
+	PWRMGMT_FAULT_WATCHDOG = 0x08		//! Drive commands stopped arriving
+} PwrMgmt_Fault;
+
+/**
+ * \struct PwrMgmt_Telemetry
+ * \brief Snapshot of the power board telemetry registers
+ */
+typedef struct
+{
+	uint8_t battery;			//! Percentage of battery remaining
+	uint8_t faults;				//! PwrMgmt_Fault flags
+	int16_t current[2];			//! Left and right motor currents, mA
+	int8_t temperature[2];		//! Board and motor driver temperatures, degrees C
+} PwrMgmt_Telemetry;
+
+/**
+ * \struct PwrMgmt_Command
+ * \brief One component and magnitude pair as understood by the power board
+ */
+typedef struct
+{
+	uint8_t component;			//! Component code
+	int8_t magnitude;			//! Value applied to the component
+} PwrMgmt_Command;
+
+/**
+ * \typedef PwrMgmt_Token
+ * \brief Identifies a queued transaction
+ */
+typedef InterBus_Token PwrMgmt_Token;
+
+/**
+ * \typedef PwrMgmt_DoneFxn
+ * \brief Called from the I2C driver's interrupt context when a queued transaction completes
+ */
+typedef InterBus_DoneFxn PwrMgmt_DoneFxn;
+
+/**
+ * \typedef PwrMgmt_Stats
+ * \brief Transaction counters of the power board
+ */
+typedef InterBus_SlaveStats PwrMgmt_Stats;
+
+/**
+ * \struct PwrMgmt_Battery
+ * \brief Latest battery reading of the background poller
+ */
+typedef struct
+{
+	int8_t percent;				//! Percentage of battery remaining, -1 before the first reading
+	uint32_t ageMs;				//! Time since the reading was taken
+	uint32_t polls;				//! No. of polls completed successfully
+	uint32_t failures;			//! No. of polls which failed or could not be queued
+	uint32_t deferred;			//! No. of polls skipped because the bus was busy
+} PwrMgmt_Battery;
+
+/**
+ * \brief Starts power management service
+ *
+ * Registers the power board with the inter board bus service, which must have started.
+ *
+ * \return Returns 0 for success, -1 if service already started, -2 if the battery poller failed to start
+ * and -3 if the inter board bus is not started or has no free slave
+ */
+int8_t PwrMgmt_start(void);
+
+/**
+ * \brief Stops power management service
+ *
+ * Waits up to a second for queued transactions to finish, then unregisters
+ * the power board. If transactions are still queued then, the service keeps running.
+ *
+ * \return Returns 0 for success, -1 if service was not started and -2 if queued transactions did not finish
+ */
+int8_t PwrMgmt_stop(void);
+
+/**
+ * \brief Returns whether service has started
+ *
+ * \return Flag indicating whether service has started
+ */
+Bool PwrMgmt_hasStarted(void);
+
 /**
  * \brief Commands power board to drive vehicle
  *
+ * Power and yaw are sent in one bus write so both are applied together.
+ *
  * \param power Forward power
  * \param yaw Yaw rate
- * \return Returns 0 for success, -1 if socket failed to open, -2 if transaction error
+ * \return Returns 0 for success, -1 if service not started, -2 if transaction error or queue full
  */
 int8_t PwrMgmt_drive(int8_t power, int8_t yaw);
 
+/**
+ * \brief Sends several commands in one bus write
+ *
+ * Pairs are written back to back, the power board applies them in order
+ * once the write is complete.
+ *
+ * \param commands Commands to send
+ * \param count No. of commands, 1 to PWRMGMT_MAX_BATCH
+ * \return Returns 0 for success, -1 if service not started, -2 if transaction error or queue full, -3 if count is out of range
+ */
+int8_t PwrMgmt_batch(const PwrMgmt_Command* commands, uint8_t count);
+
 /**
  * \brief Commands power board to actuate or retract a weapon
  *
  * \param weapon ID of the weapon to actuate
  * \param state Index of the weapon state
- * \return Returns 0 for success, -1 if socket failed to open, -2 if transaction error
+ * \return Returns 0 for success, -1 if service not started, -2 if transaction error or queue full
  */
 int8_t PwrMgmt_weapon(PwrMgmt_Weapon weapon, uint8_t state);
 
+/**
+ * \brief Queues several commands in one bus write, returns without waiting for the bus
+ *
+ * \param commands Commands to send, copied before returning
+ * \param count No. of commands, 1 to PWRMGMT_MAX_BATCH
+ * \param doneFxn Called when the write completes, may be NULL
+ * \param arg Passed to doneFxn
+ * \return Token of the transaction, -1 if service not started, -2 if the queue is full, -3 if count is out of range
+ */
+int32_t PwrMgmt_batchAsync(const PwrMgmt_Command* commands, uint8_t count,
+		PwrMgmt_DoneFxn doneFxn, void* arg);
+
+/**
+ * \brief Queues a drive command, returns without waiting for the bus, may be called with interrupts disabled
+ *
+ * Dropped by PwrMgmt_stopNow while it waits for the bus.
+ *
+ * \param power Forward power
+ * \param yaw Yaw rate
+ * \param doneFxn Called when the write completes, may be NULL
+ * \param arg Passed to doneFxn
+ * \return Token of the transaction, -1 if service not started, -2 if the queue is full
+ */
+int32_t PwrMgmt_driveAsync(int8_t power, int8_t yaw, PwrMgmt_DoneFxn doneFxn, void* arg);
+
+/**
+ * \brief Queues a request for the remaining power, returns without waiting for the bus
+ *
+ * \param doneFxn Called with the percentage of battery remaining in read[0], may be NULL
+ * \param arg Passed to doneFxn
+ * \return Token of the transaction, -1 if service not started, -2 if the queue is full
+ */
+int32_t PwrMgmt_batteryAsync(PwrMgmt_DoneFxn doneFxn, void* arg);
+
+/**
+ * \brief Stops both motors ahead of everything queued for the bus, may be called from Hwi context
+ *
+ * Drive commands queued with PwrMgmt_driveAsync and still waiting for the bus
+ * are dropped, other commands are sent after the stop.
+ *
+ * \param since Timestamp the stop was requested at, see InterBus_getBusStats
+ * \return Token of the transaction, -1 if service not started, -2 if a stop is already waiting
+ */
+int32_t PwrMgmt_stopNow(uint32_t since);
+
+/**
+ * \brief Returns whether a queued transaction has completed
+ *
+ * \param token Token returned when the transaction was queued
+ * \return Flag indicating whether the transaction has completed
+ */
+Bool PwrMgmt_isDone(PwrMgmt_Token token);
+
+/**
+ * \brief Sets how often the battery is polled in the background, only while the service is stopped
+ *
+ * \param ms Milliseconds between polls, 0 to disable polling
+ * \return Returns 0 for success, -1 if service already started
+ */
+int8_t PwrMgmt_setBatteryInterval(uint16_t ms);
+
+/**
+ * \brief Reads the cached battery reading, never waits for the bus
+ *
+ * Call from task context only. The reading is refreshed by a background poll
+ * whenever the bus is idle at the end of an interval.
+ *
+ * \param battery Filled with the reading and poll counters
+ * \return Returns 0 for success, -1 if no reading has been taken yet
+ */
+int8_t PwrMgmt_getBattery(PwrMgmt_Battery* battery);
+
+/**
+ * \brief Reads transaction counters of the power board
+ *
+ * \param stats Filled with the counters
+ */
+void PwrMgmt_getStats(PwrMgmt_Stats* stats);
+
+/**
+ * \brief Reads a contiguous block of power board registers in one transaction
+ *
+ * The start register is written, then the block is read after a repeated start.
+ *
+ * \param start First register
+ * \param buf Filled with the register values
+ * \param count No. of registers, 1 to INTERBUS_MAX_READ
+ * \return Returns 0 for success, -1 if service not started, -2 if transaction error or queue full
+ * and -3 if count is out of range
+ */
+int8_t PwrMgmt_readRegisters(uint8_t start, uint8_t* buf, uint8_t count);
+
+/**
+ * \brief Reads every telemetry register in one transaction
+ *
+ * \param telemetry Filled with the snapshot
+ * \return Returns 0 for success, -1 if service not started, -2 if transaction error or queue full
+ */
+int8_t PwrMgmt_telemetry(PwrMgmt_Telemetry* telemetry);
+
+/**
+ * \brief Queues a read of every telemetry register, returns without waiting for the bus
+ *
+ * \param doneFxn Called with the PWRMGMT_TELEMETRY_SIZE registers in read, see PwrMgmt_decodeTelemetry
+ * \param arg Passed to doneFxn
+ * \return Token of the transaction, -1 if service not started, -2 if the queue is full
+ */
+int32_t PwrMgmt_telemetryAsync(PwrMgmt_DoneFxn doneFxn, void* arg);
+
+/**
+ * \brief Unpacks the telemetry registers into a snapshot
+ *
+ * \param regs PWRMGMT_TELEMETRY_SIZE registers from PWRMGMT_REG_BATTERY on
+ * \param telemetry Filled with the snapshot
+ */
+void PwrMgmt_decodeTelemetry(const uint8_t* regs, PwrMgmt_Telemetry* telemetry);
+
 /**
  * \brief Request power boarxd to return the estimated remaining power
  *
- * \return Percentage of battery remaining, -1 if socket failed to open, -2 if transaction error
+ * Waits for the bus, PwrMgmt_getBattery returns the cached reading immediately.
+ *
+ * \return Percentage of battery remaining, -1 if service not started, -2 if transaction error or queue full
  */
 int8_t PwrMgmt_batteryRemaining(void);
 
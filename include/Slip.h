@@ -0,0 +1,86 @@
+/**
+ * \file Slip.h
+ * \brief Declares SLIP stream encoder and decoder
+ * \author George Xian
+ * \version 0.1
+ * \date 2014-12-14
+ *
+ * The decoder has no dependency on TI-RTOS. It accepts bytes in arbitrary
+ * sized chunks, keeps its state between chunks (including a pending ESC)
+ * and hands every complete frame to a callback.
+ */
+
+#ifndef SLIP_CODEC
+#define SLIP_CODEC
+
+#include <stdint.h>
+
+#define SLIP_END 0xC0		//! SLIP END character
+#define SLIP_ESC 0xDB		//! SLIP ESC character
+#define SLIP_ESC_END 0xDC	//! Used to send 0xC0 when preceded by ESC character
+#define SLIP_ESC_ESC 0xDD	//! Used to send 0xDB when preceded by ESC character
+
+#define SLIP_MAX_FRAME 128	//! Largest decoded frame which can be buffered, the link MTU
+
+#define SLIP_WORST_SIZE(size) (2*(size) + 2)	//! Encoded size of a frame made only of special characters
+
+/**
+ * \typedef Slip_FrameFxn
+ * \brief Called with each complete decoded frame, the frame is only valid during the call
+ */
+typedef void (*Slip_FrameFxn)(const uint8_t* frame, uint16_t size, void* arg);
+
+/**
+ * \struct Slip_Decoder
+ * \brief State of a SLIP decoder, persists across calls to Slip_decode
+ */
+typedef struct
+{
+	uint8_t state;						//! Current decoder state
+	uint16_t size;						//! No. of bytes in the frame being decoded
+	union
+	{
+		uint32_t b32[(SLIP_MAX_FRAME+3)/4];	//! forces word alignment for frame overlays
+		uint8_t b8[SLIP_MAX_FRAME];		//! bytewise
+	} buf;								//! Frame being decoded
+	Slip_FrameFxn frameFxn;				//! Called on complete frame
+	void* arg;							//! Passed to frameFxn
+
+	uint32_t frames;					//! No. of frames emitted
+	uint32_t escErrors;					//! No. of frames dropped for invalid escape sequences
+	uint32_t overruns;					//! No. of frames dropped for exceeding SLIP_MAX_FRAME
+} Slip_Decoder;
+
+/**
+ * \brief Initialises a decoder, it hunts for the first END character before buffering
+ *
+ * \param dec Decoder to initialise
+ * \param frameFxn Function called on each complete frame
+ * \param arg Argument passed to frameFxn
+ */
+void Slip_decoderInit(Slip_Decoder* dec, Slip_FrameFxn frameFxn, void* arg);
+
+/**
+ * \brief Feeds a chunk of the SLIP stream to the decoder
+ *
+ * \param dec Decoder to feed
+ * \param data Bytes received
+ * \param len No. of bytes in data
+ */
+void Slip_decode(Slip_Decoder* dec, const uint8_t* data, uint16_t len);
+
+/**
+ * \brief Encodes a frame, including the leading and trailing END characters
+ *
+ * Frame is scanned a word at a time, words without END or ESC bytes are
+ * copied whole. Output may be written straight into a transmission buffer.
+ *
+ * \param out Destination, at least SLIP_WORST_SIZE(size) bytes
+ * \param frame Frame to encode
+ * \param size No. of bytes in frame
+ * \return No. of bytes written to out
+ */
+uint16_t Slip_encode(uint8_t* out, const uint8_t* frame, uint16_t size);
+
+
+#endif
@@ -46,6 +46,11 @@
 
 /* Killalot Framework header files */
 #include "BtStack.h"
+#include "InterBus.h"
+#include "PwrMgmt.h"
+#include "DriveCtrl.h"
+#include "BtBaud.h"
+#include "EStop.h"
 
 /*
  *  ======== main ========
@@ -56,7 +61,7 @@ Int main(Void)
     Board_initGeneral();
     Board_initGPIO();
     // Board_initDMA();
-    // Board_initI2C();
+    Board_initI2C();
     // Board_initSPI();
     Board_initUART();
     // Board_initUSB(Board_USBDEVICE);
@@ -64,7 +69,15 @@ Int main(Void)
     // Board_initWiFi();
 
     /* Start services */
+    DriveCtrl_init(DRIVECTRL_DEFAULT_ID);
+    EStop_init(KFP_ESTOP_ID);
+    BtBaud_start();
     BtStack_start();
+    InterBus_start();
+    PwrMgmt_start();
+
+    /* Start applications */
+    DriveCtrl_start();
 
     System_printf("Matilda... All systems are go\n");
     /* SysMin will only print to the console when you call flush or exit */
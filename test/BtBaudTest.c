@@ -0,0 +1,553 @@
+/**
+ * \file BtBaudTest.c
+ * \brief Tests baud rate negotiation on the host against a scripted module and peer
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ *
+ * btStack and the negotiation service run on the bluetooth UART stand-in.
+ * The test plays the bluetooth module and the far end of the link: the
+ * module carries bytes across only while the UART and the module run at
+ * the same rate, switches rate on its AT command unless the rate is past
+ * its limit, and the peer answers proposals up to its own limit, answers
+ * probes and keeps the link busy with KFP frames. The saved rate lives in
+ * the EEPROM stand-in, which keeps it across starts of the services.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ti/sysbios/BIOS.h>
+#include <ti/sysbios/hal/Hwi.h>
+#include <ti/sysbios/knl/Task.h>
+#include <driverlib/eeprom.h>
+
+#include "Check.h"
+#include "FakeBios.h"
+#include "FakeBtUart.h"
+#include "FakeEeprom.h"
+#include "BtStack.h"
+#include "BtBaud.h"
+
+#define INTERVAL_MS 100				//! Fallback interval the tests run the service with
+#define ERROR_PERCENT 5				//! Corrupt frames per hundred which trigger a step down
+#define NOISE_ONE_IN 4				//! One in this many peer frames is corrupt at the noisy rate
+#define DATA_PERIOD 2				//! Ticks between KFP frames from the peer
+#define INBOX_SIZE 16				//! Most link frames waiting for the peer
+#define COMMAND_TEXT 32				//! Most characters of a module command kept
+#define SETTLE_WAIT 3000			//! Most ticks a negotiation is waited for
+#define LINK_SIZE 6					//! No. of bytes in a baud link frame, as BtBaud.c
+#define EEPROM_MAGIC 0x42415544		//! First word of a saved rate record, as BtBaud.c
+
+#define OP_PROPOSE 1				//! Link operations, as BtBaud.c
+#define OP_ACCEPT 2
+#define OP_REJECT 3
+#define OP_PROBE 4
+#define OP_PROBE_ACK 5
+
+/**
+ * \struct LinkOp
+ * \brief A baud link frame the module carried to the peer
+ */
+typedef struct
+{
+	uint8_t op;
+	uint32_t baud;
+} LinkOp;
+
+static volatile uint32_t moduleBaud;		//! Rate the module's UART side runs at
+static uint32_t moduleMax;					//! Fastest rate the module takes on command
+static uint32_t commands;					//! No. of AT commands the module understood
+static char lastCommand[COMMAND_TEXT];		//! Text of the last one
+static Slip_Decoder toPeer;					//! Decodes what the module carries to the peer
+
+static uint32_t peerMax;					//! Fastest rate the peer accepts
+static volatile uint32_t noisyBaud;			//! Rate at which the peer's frames get corrupted, 0 for none
+static volatile Bool peerSilent;			//! Peer sends no KFP frames
+static volatile Bool peerRunning;			//! Peer task keeps going
+static LinkOp inbox[INBOX_SIZE];			//! Link frames waiting for the peer
+static uint8_t inboxHead;
+static uint8_t inboxCount;
+static volatile uint8_t lastAnswerOp;		//! Last answer the service sent the peer
+static volatile uint32_t lastAnswerBaud;
+
+/**
+ * \brief Runs in the module with each frame decoded from the UART
+ */
+static void toPeerFxn(const uint8_t* frame, uint16_t size, void* arg)
+{
+	if ((size != LINK_SIZE + 1) || (frame[0] != KFP_LINK_MARKER) || (frame[1] != KFP_LINK_BAUD))
+	{
+		return;
+	}
+
+	if (inboxCount < INBOX_SIZE)
+	{
+		LinkOp* op = &inbox[(inboxHead + inboxCount) % INBOX_SIZE];
+		op->op = frame[2];
+		op->baud = frame[3] | ((uint32_t)frame[4] << 8) | ((uint32_t)frame[5] << 16) | ((uint32_t)frame[6] << 24);
+		inboxCount++;
+	}
+}
+
+/**
+ * \brief Plays the module's side of the wire, runs with Hwi disabled for every write
+ *
+ * Bytes at a rate other than the module's are lost. The module takes
+ * "AT+UART=<rate>" up to its limit, everything else goes to the peer.
+ */
+static void moduleFxn(const uint8_t* data, uint16_t len, uint32_t baud)
+{
+	if (baud != moduleBaud)
+	{
+		return;
+	}
+
+	if ((len > 8) && (memcmp(data, "AT+UART=", 8) == 0))
+	{
+		uint16_t n = (len < COMMAND_TEXT - 1) ? len : COMMAND_TEXT - 1;
+		memcpy(lastCommand, data, n);
+		lastCommand[n] = '\0';
+		commands++;
+
+		uint32_t rate = strtoul(&lastCommand[8], NULL, 10);
+		if (rate <= moduleMax)
+		{
+			moduleBaud = rate;
+		}
+		return;
+	}
+
+	Slip_decode(&toPeer, data, len);
+}
+
+/**
+ * \brief Sends bytes from the peer, lost unless the module and the UART run at the same rate
+ */
+static void peerSend(const uint8_t* data, uint16_t size)
+{
+	uint8_t encoded[SLIP_WORST_SIZE(SLIP_MAX_FRAME)];
+	uint16_t len = Slip_encode(encoded, data, size);
+
+	UInt key = Hwi_disable();
+	if (FakeBtUart_baud() == moduleBaud)
+	{
+		FakeBtUart_receive(encoded, len);
+	}
+	Hwi_restore(key);
+}
+
+/**
+ * \brief Sends a baud link frame from the peer
+ */
+static void peerSendOp(uint8_t op, uint32_t baud)
+{
+	uint8_t frame[LINK_SIZE + 1] = {KFP_LINK_MARKER, KFP_LINK_BAUD, op,
+			baud & 0xFF, (baud >> 8) & 0xFF, (baud >> 16) & 0xFF, baud >> 24};
+	peerSend(frame, sizeof(frame));
+}
+
+/**
+ * \brief Plays the far end: answers the service's link frames and sends KFP frames
+ */
+static void peerFxn(UArg unused0, UArg unused1)
+{
+	uint32_t ticks = 0;
+	while (peerRunning)
+	{
+		Task_sleep(1);
+		ticks++;
+
+		while (TRUE)
+		{
+			UInt key = Hwi_disable();
+			if (inboxCount == 0)
+			{
+				Hwi_restore(key);
+				break;
+			}
+			LinkOp op = inbox[inboxHead];
+			inboxHead = (inboxHead + 1) % INBOX_SIZE;
+			inboxCount--;
+			Hwi_restore(key);
+
+			switch (op.op)
+			{
+			case OP_PROPOSE:
+				peerSendOp((op.baud <= peerMax) ? OP_ACCEPT : OP_REJECT, op.baud);
+				break;
+
+			case OP_PROBE:
+				peerSendOp(OP_PROBE_ACK, op.baud);
+				break;
+
+			default:
+				lastAnswerBaud = op.baud;
+				lastAnswerOp = op.op;
+				break;
+			}
+		}
+
+		if (peerSilent || (ticks % DATA_PERIOD))
+		{
+			continue;
+		}
+
+		// a frame missing a byte is counted corrupt by the service
+		BtStack_Frame frame;
+		memset(&frame, 0, sizeof(frame));
+		frame.b8[0] = 0x01;
+		frame.b32[1] = ticks;
+		Bool corrupt = (moduleBaud == noisyBaud) && (Check_below(NOISE_ONE_IN) == 0);
+		peerSend(frame.b8, corrupt ? KFP_FRAME_SIZE-3 : KFP_FRAME_SIZE-2);
+	}
+}
+
+static Bool switchesAtLeast(void* arg)
+{
+	BtBaud_Stats stats;
+	BtBaud_getStats(&stats);
+	return stats.switches >= *(uint32_t*)arg;
+}
+
+static Bool silentFallbacksAtLeast(void* arg)
+{
+	BtBaud_Stats stats;
+	BtBaud_getStats(&stats);
+	return stats.silentFallbacks >= *(uint32_t*)arg;
+}
+
+static Bool uartBaudIs(void* arg)
+{
+	return FakeBtUart_baud() == *(uint32_t*)arg;
+}
+
+static Bool answerIs(void* arg)
+{
+	return lastAnswerOp == *(uint8_t*)arg;
+}
+
+static Bool framesAtLeast(void* arg)
+{
+	BtStack_RxStats rx;
+	BtStack_getRxStats(&rx);
+	return rx.frames >= *(uint32_t*)arg;
+}
+
+/**
+ * \brief Powers up the module at a rate and starts both services, the UART opening at 115200 unless a rate is saved
+ */
+static void startLink(uint32_t module, uint32_t moduleLimit, uint32_t peerLimit, uint32_t mcuLimit)
+{
+	UInt key = Hwi_disable();
+	moduleBaud = module;
+	moduleMax = moduleLimit;
+	commands = 0;
+	lastCommand[0] = '\0';
+	Slip_decoderInit(&toPeer, toPeerFxn, NULL);
+	peerMax = peerLimit;
+	noisyBaud = 0;
+	peerSilent = FALSE;
+	inboxHead = 0;
+	inboxCount = 0;
+	lastAnswerOp = 0;
+	Hwi_restore(key);
+
+	FakeBtUart_reset();
+	FakeBtUart_onWrite(moduleFxn);
+
+	CHECK(BtStack_setBaud(115200, NULL, 0) == 0);
+	CHECK(BtBaud_setMaxBaud(mcuLimit) == 0);
+	CHECK(BtBaud_setFallback(INTERVAL_MS, ERROR_PERCENT) == 0);
+	CHECK(BtBaud_start() == 0);
+	CHECK(BtStack_start() == 0);
+}
+
+static void stopLink(void)
+{
+	CHECK(BtBaud_stop() == 0);
+	CHECK(BtStack_stop() == 0);
+}
+
+static void testConfig(void)
+{
+	CHECK(BtBaud_setMaxBaud(12345) == -2);
+	CHECK(BtBaud_setCommand("AT+A-VERY-LONG-UART-COMMAND=", ",0,0\r\n", 50) == -2);
+	CHECK(BtBaud_setFallback(0, ERROR_PERCENT) == -2);
+	CHECK(BtBaud_setFallback(INTERVAL_MS, 101) == -2);
+	CHECK(BtBaud_negotiate(230400) == -1);
+	CHECK(BtBaud_raise() == 0);
+	CHECK(BtBaud_stop() == -1);
+
+	// btStack must not be running yet
+	FakeBtUart_reset();
+	CHECK(BtStack_start() == 0);
+	CHECK(BtBaud_start() == -1);
+	CHECK(BtStack_stop() == 0);
+
+	FakeEeprom_erase();
+	startLink(115200, 921600, 921600, 460800);
+	CHECK(BtBaud_start() == -1);
+	CHECK(BtBaud_setMaxBaud(921600) == -1);
+	CHECK(BtBaud_setCommand("AT+UART=", ",0,0\r\n", 50) == -1);
+	CHECK(BtBaud_setFallback(INTERVAL_MS, ERROR_PERCENT) == -1);
+	CHECK(BtBaud_negotiate(921600) == -2);
+	CHECK(BtBaud_negotiate(12345) == -2);
+
+	uint32_t want = 1;
+	CHECK(FakeBios_waitFor(switchesAtLeast, &want, SETTLE_WAIT));
+	stopLink();
+}
+
+/**
+ * \brief Raises to the fastest rate, saves it and opens at it on the next start
+ */
+static void testRaise(void)
+{
+	FakeEeprom_erase();
+	startLink(115200, 921600, 921600, 921600);
+
+	uint32_t want = 1;
+	CHECK(FakeBios_waitFor(switchesAtLeast, &want, SETTLE_WAIT));
+	BtBaud_Stats stats;
+	BtBaud_getStats(&stats);
+	CHECK(stats.baud == 921600);
+	CHECK(stats.proposals == 1);
+	CHECK(stats.rejected == 0);
+	CHECK(stats.probeFailures == 0);
+	CHECK(FakeBtUart_baud() == 921600);
+	CHECK(moduleBaud == 921600);
+	CHECK(commands == 1);
+	CHECK(strcmp(lastCommand, "AT+UART=921600,0,0\r\n") == 0);
+	CHECK(FakeEeprom_programs() == 1);
+	stopLink();
+
+	// the module kept its rate, so did the EEPROM
+	UInt key = Hwi_disable();
+	moduleBaud = 921600;
+	Hwi_restore(key);
+	FakeBtUart_reset();
+	FakeBtUart_onWrite(moduleFxn);
+	CHECK(BtStack_setBaud(115200, NULL, 0) == 0);
+	CHECK(BtBaud_start() == 0);
+	CHECK(BtStack_getBaud() == 921600);
+	CHECK(BtStack_start() == 0);
+	CHECK(FakeBtUart_baud() == 921600);
+
+	// nothing faster to raise to, frames flow straight away
+	Task_sleep(3 * INTERVAL_MS);
+	want = 50;
+	CHECK(FakeBios_waitFor(framesAtLeast, &want, SETTLE_WAIT));
+	BtBaud_getStats(&stats);
+	CHECK(stats.proposals == 0);
+	CHECK(stats.silentFallbacks == 0);
+	CHECK(FakeEeprom_programs() == 1);
+	BtStack_RxStats rx;
+	BtStack_getRxStats(&rx);
+	CHECK(rx.corruptFrames == 0);
+	stopLink();
+}
+
+/**
+ * \brief Rates the peer rejects are passed over on the way down
+ */
+static void testPeerLimit(void)
+{
+	FakeEeprom_erase();
+	startLink(115200, 921600, 230400, 921600);
+
+	uint32_t want = 1;
+	CHECK(FakeBios_waitFor(switchesAtLeast, &want, SETTLE_WAIT));
+	BtBaud_Stats stats;
+	BtBaud_getStats(&stats);
+	CHECK(stats.baud == 230400);
+	CHECK(stats.proposals == 3);
+	CHECK(stats.rejected == 2);
+	CHECK(stats.probeFailures == 0);
+	CHECK(moduleBaud == 230400);
+	CHECK(commands == 1);
+	CHECK(FakeEeprom_programs() == 1);
+	stopLink();
+}
+
+/**
+ * \brief A rate the module refuses loses the probe and the old rate is restored
+ */
+static void testModuleLimit(void)
+{
+	FakeEeprom_erase();
+	startLink(115200, 460800, 921600, 921600);
+
+	uint32_t want = 1;
+	CHECK(FakeBios_waitFor(switchesAtLeast, &want, SETTLE_WAIT));
+	BtBaud_Stats stats;
+	BtBaud_getStats(&stats);
+	CHECK(stats.baud == 460800);
+	CHECK(stats.proposals == 2);
+	CHECK(stats.rejected == 0);
+	CHECK(stats.probeFailures == 1);
+	CHECK(moduleBaud == 460800);
+
+	// the way back to 115200 was written at 921600, which the module never heard
+	CHECK(commands == 2);
+	CHECK(strcmp(lastCommand, "AT+UART=460800,0,0\r\n") == 0);
+	CHECK(FakeEeprom_programs() == 1);
+	stopLink();
+}
+
+/**
+ * \brief Corrupt frames at the fastest rate step the link down one rate
+ */
+static void testStepDown(void)
+{
+	FakeEeprom_erase();
+	startLink(115200, 921600, 921600, 921600);
+	noisyBaud = 921600;
+
+	uint32_t want = 2;
+	CHECK(FakeBios_waitFor(switchesAtLeast, &want, SETTLE_WAIT));
+	BtBaud_Stats stats;
+	BtBaud_getStats(&stats);
+	CHECK(stats.baud == 460800);
+	CHECK(stats.fallbacks == 1);
+	CHECK(stats.proposals == 2);
+	CHECK(moduleBaud == 460800);
+	CHECK(FakeEeprom_programs() == 2);
+
+	// clean at 460800, the link stays there
+	Task_sleep(5 * INTERVAL_MS);
+	BtBaud_getStats(&stats);
+	CHECK(stats.baud == 460800);
+	CHECK(stats.fallbacks == 1);
+	CHECK(stats.switches == 2);
+	stopLink();
+}
+
+/**
+ * \brief A module reset to the default rate is found by the silence fallback, then raised again
+ */
+static void testSilence(void)
+{
+	FakeEeprom_erase();
+	startLink(115200, 921600, 921600, 921600);
+
+	uint32_t want = 1;
+	CHECK(FakeBios_waitFor(switchesAtLeast, &want, SETTLE_WAIT));
+	CHECK(FakeBtUart_baud() == 921600);
+
+	UInt key = Hwi_disable();
+	moduleBaud = 115200;
+	Slip_decoderInit(&toPeer, toPeerFxn, NULL);
+	Hwi_restore(key);
+
+	CHECK(FakeBios_waitFor(silentFallbacksAtLeast, &want, SETTLE_WAIT));
+	want = 2;
+	CHECK(FakeBios_waitFor(switchesAtLeast, &want, SETTLE_WAIT));
+	BtBaud_Stats stats;
+	BtBaud_getStats(&stats);
+	CHECK(stats.silentFallbacks == 1);
+	CHECK(stats.fallbacks == 0);
+	CHECK(stats.baud == 921600);
+	CHECK(moduleBaud == 921600);
+
+	// 921600, the default rate once the probe there answered, 921600 again
+	CHECK(FakeEeprom_programs() == 3);
+	stopLink();
+}
+
+/**
+ * \brief The peer steps the link down, this end switches and answers its probe
+ */
+static void testPeerProposes(void)
+{
+	// saved at this end's limit, nothing to raise to
+	FakeEeprom_erase();
+	uint32_t record[2] = {EEPROM_MAGIC, 230400};
+	CHECK(EEPROMProgram(record, 0, sizeof(record)) == 0);
+	startLink(230400, 921600, 921600, 230400);
+	CHECK(FakeBtUart_baud() == 230400);
+
+	uint8_t op = OP_REJECT;
+	peerSendOp(OP_PROPOSE, 460800);
+	CHECK(FakeBios_waitFor(answerIs, &op, SETTLE_WAIT));
+	CHECK(lastAnswerBaud == 460800);
+
+	op = OP_ACCEPT;
+	peerSendOp(OP_PROPOSE, 115200);
+	CHECK(FakeBios_waitFor(answerIs, &op, SETTLE_WAIT));
+	CHECK(lastAnswerBaud == 115200);
+
+	uint32_t want = 115200;
+	CHECK(FakeBios_waitFor(uartBaudIs, &want, SETTLE_WAIT));
+	CHECK(moduleBaud == 115200);
+	op = OP_PROBE_ACK;
+	peerSendOp(OP_PROBE, 115200);
+	CHECK(FakeBios_waitFor(answerIs, &op, SETTLE_WAIT));
+
+	want = 1;
+	CHECK(FakeBios_waitFor(switchesAtLeast, &want, SETTLE_WAIT));
+	BtBaud_Stats stats;
+	BtBaud_getStats(&stats);
+	CHECK(stats.baud == 115200);
+	CHECK(stats.proposals == 0);
+	CHECK(stats.probeFailures == 0);
+	CHECK(FakeEeprom_programs() == 2);
+	stopLink();
+}
+
+/**
+ * \brief A record which is not a negotiable rate, or an unusable EEPROM, leaves the default rate
+ */
+static void testEeprom(void)
+{
+	FakeEeprom_erase();
+	uint32_t record[2] = {EEPROM_MAGIC, 12345};
+	CHECK(EEPROMProgram(record, 0, sizeof(record)) == 0);
+	FakeBtUart_reset();
+	CHECK(BtStack_setBaud(115200, NULL, 0) == 0);
+	CHECK(BtBaud_start() == 0);
+	CHECK(BtStack_getBaud() == 115200);
+	CHECK(BtBaud_stop() == 0);
+
+	// a saved rate past this end's limit is not used either
+	record[1] = 921600;
+	CHECK(EEPROMProgram(record, 0, sizeof(record)) == 0);
+	CHECK(BtBaud_setMaxBaud(460800) == 0);
+	CHECK(BtBaud_start() == 0);
+	CHECK(BtStack_getBaud() == 115200);
+	CHECK(BtBaud_stop() == 0);
+
+	FakeEeprom_erase();
+	FakeEeprom_failInit(TRUE);
+	startLink(115200, 921600, 921600, 921600);
+	uint32_t want = 1;
+	CHECK(FakeBios_waitFor(switchesAtLeast, &want, SETTLE_WAIT));
+	CHECK(BtStack_getBaud() == 921600);
+	CHECK(FakeEeprom_programs() == 0);
+	stopLink();
+	FakeEeprom_failInit(FALSE);
+}
+
+int main(void)
+{
+	peerRunning = TRUE;
+	Task_Params params;
+	Task_Params_init(&params);
+	Task_Handle peer = Task_create(peerFxn, &params, NULL);
+	CHECK(peer != NULL);
+
+	testConfig();
+	testRaise();
+	testPeerLimit();
+	testModuleLimit();
+	testStepDown();
+	testSilence();
+	testPeerProposes();
+	testEeprom();
+
+	peerRunning = FALSE;
+	Task_sleep(10);
+	Task_delete(&peer);
+	return CHECK_RESULT();
+}
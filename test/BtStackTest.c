@@ -0,0 +1,859 @@
+/**
+ * \file BtStackTest.c
+ * \brief Tests the btStack service on the host
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ *
+ * The service runs on the bluetooth UART stand-in and the test plays the
+ * module: it encodes frames into the reception ring as the UART interrupt
+ * would and decodes every byte written back into frames. Sustained
+ * reception is measured at the wire rate and as fast as RTS allows, and
+ * batched transmission against a write per frame on a wire timed UART.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <ti/sysbios/BIOS.h>
+#include <ti/sysbios/hal/Hwi.h>
+#include <ti/sysbios/knl/Task.h>
+
+#include "Check.h"
+#include "FakeBios.h"
+#include "FakeBtUart.h"
+#include "BtStack.h"
+#include "BtUart.h"
+
+#define FRAME_ID 0x00000042		//! ID of the frames exchanged
+#define FRAMES 200				//! Frames sent each way by the session test
+#define MAX_RECEIVED 4096		//! Most received frames recorded
+#define MAX_WRITTEN 1024		//! Most written frames decoded
+#define BURST_FRAMES 8			//! Frames the flooding module sends between looks at RTS
+#define FLOOD_FRAMES 2000		//! Frames sent by the flooding module
+#define RX_RING_SIZE 512		//! Reception ring of the service, as BtStack.c
+#define RX_FLOW_HIGH 384		//! Fill level at which the service pauses the module, as BtStack.c
+#define CONTROL_DEPTH 8			//! Default no. of frames waiting in the control lane, as BtStack.c
+#define BENCH_FRAMES 100000		//! Frames pushed by the transmission benchmark
+#define BULK_SIZE 100			//! Size of the raw frames the bulk feeder pushes
+#define CONTROL_FRAMES 100		//! Control frames pushed under saturation
+#define RX_TICKS 1000			//! Ticks the module sends for at the wire rate
+#define WIRE_FRAMES 1000		//! Frames sent down each path of the wire timed transmission benchmark
+#define RX_FLOOD_FRAMES 100000	//! Frames sent as fast as RTS allows by the reception benchmark, a multiple of BURST_FRAMES
+
+/**
+ * \struct WrittenFrame
+ * \brief A frame the service wrote, decoded from the UART
+ */
+typedef struct
+{
+	uint8_t data[SLIP_MAX_FRAME];
+	uint16_t size;
+} WrittenFrame;
+
+static uint32_t received[MAX_RECEIVED];		//! First payload word of each frame dispatched
+static volatile uint32_t receivedCount = 0;
+
+static WrittenFrame written[MAX_WRITTEN];
+static uint16_t writtenCount = 0;
+
+static volatile Bool feeding = FALSE;		//! Bulk feeder keeps the bulk lane full
+static uint32_t wireOwedUs = 0;				//! Wire time not yet slept, less than a tick
+
+static BtStack_Frame makeFrame(uint32_t seq)
+{
+	BtStack_Frame frame;
+	memset(&frame, 0, sizeof(frame));
+	frame.id.b32 = FRAME_ID;
+	frame.payload.b32[0] = seq;
+	return frame;
+}
+
+static void receivedFxn(const BtStack_Frame* frame)
+{
+	UInt key = Hwi_disable();
+	if (receivedCount < MAX_RECEIVED)
+	{
+		received[receivedCount] = frame->payload.b32[0];
+	}
+	receivedCount++;
+	Hwi_restore(key);
+}
+
+static Bool receivedAtLeast(void* arg)
+{
+	return receivedCount >= *(uint32_t*)arg;
+}
+
+static void writtenFxn(const uint8_t* frame, uint16_t size, void* arg)
+{
+	if (writtenCount < MAX_WRITTEN)
+	{
+		memcpy(written[writtenCount].data, frame, size);
+		written[writtenCount].size = size;
+	}
+	writtenCount++;
+}
+
+/**
+ * \brief Decodes every byte written since a point into written
+ *
+ * \return No. of bytes written so far, where the next decode may start
+ */
+static uint32_t decodeWritten(uint32_t from)
+{
+	static uint8_t sent[FAKEBTUART_SENT_SIZE];
+	uint32_t count = FakeBtUart_sent(sent);
+	CHECK(count <= FAKEBTUART_SENT_SIZE);
+
+	Slip_Decoder decoder;
+	Slip_decoderInit(&decoder, writtenFxn, NULL);
+	writtenCount = 0;
+	Slip_decode(&decoder, &sent[from], count - from);
+	return count;
+}
+
+/**
+ * \brief Sends a frame from the module, split into pieces of at most chunk bytes
+ *
+ * Callers send about a frame a tick, 115200 baud carries one 14 byte frame a
+ * millisecond, so the reception task is not asked to outrun the UART.
+ */
+static void receiveFrame(const BtStack_Frame* frame, uint16_t chunk)
+{
+	uint8_t encoded[SLIP_WORST_SIZE(KFP_FRAME_SIZE)];
+	uint16_t len = Slip_encode(encoded, frame->b8, KFP_FRAME_SIZE-2);
+	uint16_t offset;
+	for (offset = 0; offset < len; offset += chunk)
+	{
+		uint16_t piece = (len - offset < chunk) ? len - offset : chunk;
+		CHECK(FakeBtUart_receive(&encoded[offset], piece));
+	}
+}
+
+/**
+ * \brief Encodes consecutive frames back to back
+ *
+ * \return No. of bytes encoded
+ */
+static uint16_t encodeFrames(uint8_t* out, uint32_t first, uint16_t count)
+{
+	uint16_t len = 0;
+	uint16_t n;
+	for (n = 0; n < count; n++)
+	{
+		BtStack_Frame frame = makeFrame(first + n);
+		len += Slip_encode(&out[len], frame.b8, KFP_FRAME_SIZE-2);
+	}
+	return len;
+}
+
+/**
+ * \brief Sends frames as fast as a module honouring RTS may, a burst at a time
+ *
+ * \return No. of frames sent before the module gave up waiting for RTS
+ */
+static uint32_t flood(uint32_t count)
+{
+	uint8_t burst[BURST_FRAMES * SLIP_WORST_SIZE(KFP_FRAME_SIZE)];
+	uint32_t seq = 0;
+	uint32_t waited = 0;
+	while (seq < count)
+	{
+		if (!FakeBtUart_rtsReady())
+		{
+			if (waited++ >= 5000)
+			{
+				break;
+			}
+			Task_sleep(1);
+			continue;
+		}
+
+		uint16_t n = (count - seq < BURST_FRAMES) ? count - seq : BURST_FRAMES;
+		FakeBtUart_receive(burst, encodeFrames(burst, seq, n));
+		seq += n;
+	}
+	return seq;
+}
+
+/**
+ * \brief Sends a flow link frame from the module
+ */
+static void receiveFlow(uint8_t state)
+{
+	uint8_t raw[3] = {KFP_LINK_MARKER, KFP_LINK_FLOW, state};
+	uint8_t encoded[SLIP_WORST_SIZE(3)];
+	CHECK(FakeBtUart_receive(encoded, Slip_encode(encoded, raw, sizeof(raw))));
+}
+
+static Bool sentAtLeast(void* arg)
+{
+	return FakeBtUart_sent(NULL) >= *(uint32_t*)arg;
+}
+
+static Bool writing(void* arg)
+{
+	return FakeBtUart_writing() > 0;
+}
+
+static Bool rtsReady(void* arg)
+{
+	return FakeBtUart_rtsReady();
+}
+
+static Bool rxFramesAtLeast(void* arg)
+{
+	BtStack_RxStats stats;
+	BtStack_getRxStats(&stats);
+	return stats.frames >= *(uint32_t*)arg;
+}
+
+/**
+ * \brief Pushes a frame, waiting while the lane is full
+ */
+static void pushWaiting(const BtStack_Frame* frame, BtStack_Lane lane)
+{
+	int8_t status;
+	uint16_t tries = 0;
+	while (((status = BtStack_pushLane(frame, lane)) == -2) && (tries++ < 1000))
+	{
+		Task_sleep(1);
+	}
+	CHECK(status > 0);
+}
+
+/**
+ * \brief Checks frames decoded from the UART carry consecutive sequence numbers
+ */
+static void expectWritten(uint16_t from, uint32_t firstSeq, uint16_t count)
+{
+	CHECK(writtenCount >= from + count);
+	uint16_t wrong = 0;
+	uint16_t i;
+	for (i = 0; (i < count) && (from + i < writtenCount); i++)
+	{
+		BtStack_Frame out;
+		memcpy(out.b8, written[from + i].data, KFP_FRAME_SIZE-2);
+		wrong += (written[from + i].size != KFP_FRAME_SIZE-2) || (out.payload.b32[0] != firstSeq + i);
+	}
+	CHECK(wrong == 0);
+}
+
+static double seconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/**
+ * \brief Starts the service on a fresh UART with no subscribers but FRAME_ID
+ */
+static void startService(void)
+{
+	receivedCount = 0;
+	CHECK(BtStack_clearSubscriptions() == 0);
+	CHECK(BtStack_subscribe(FRAME_ID, FRAMEROUTER_EXACT, receivedFxn) == 0);
+	CHECK(BtStack_start() == 0);
+}
+
+static void testSession(void)
+{
+	// a UART which will not open leaves nothing running
+	FakeBtUart_reset();
+	FakeBtUart_failOpens(1);
+	CHECK(BtStack_clearSubscriptions() == 0);
+	CHECK(BtStack_subscribe(FRAME_ID, FRAMEROUTER_EXACT, receivedFxn) == 0);
+	CHECK(BtStack_start() == -3);
+	CHECK(!BtStack_hasStarted());
+	BtStack_Frame frame = makeFrame(0);
+	CHECK(BtStack_push(&frame) == -1);
+
+	startService();
+	CHECK(BtStack_hasStarted());
+	CHECK(BtStack_start() == -1);
+	CHECK(FakeBtUart_isOpen());
+	CHECK(FakeBtUart_baud() == 115200);
+
+	// frames arrive a byte at a time or in pieces of any size
+	uint32_t seq;
+	for (seq = 0; seq < FRAMES; seq++)
+	{
+		frame = makeFrame(seq);
+		receiveFrame(&frame, (seq % 3 == 0) ? 1 : 5 + seq % 20);
+		Task_sleep(1);
+	}
+	uint32_t want = FRAMES;
+	CHECK(FakeBios_waitFor(receivedAtLeast, &want, 2000));
+	CHECK(receivedCount == FRAMES);
+	uint32_t wrong = 0;
+	for (seq = 0; seq < FRAMES; seq++)
+	{
+		wrong += (received[seq] != seq);
+	}
+	CHECK(wrong == 0);
+
+	BtStack_RxStats rxStats;
+	BtStack_getRxStats(&rxStats);
+	CHECK(rxStats.frames == FRAMES);
+	CHECK((rxStats.corruptFrames == 0) && (rxStats.ringOverruns == 0));
+
+	// and go out the same UART, however many there are
+	for (seq = 0; seq < FRAMES; seq++)
+	{
+		frame = makeFrame(seq);
+		pushWaiting(&frame, BTSTACK_LANE_CONTROL);
+	}
+	Task_sleep(20);
+	decodeWritten(0);
+	CHECK(writtenCount == FRAMES);
+	wrong = 0;
+	for (seq = 0; seq < FRAMES; seq++)
+	{
+		BtStack_Frame out;
+		memcpy(out.b8, written[seq].data, KFP_FRAME_SIZE-2);
+		wrong += (written[seq].size != KFP_FRAME_SIZE-2) || (out.id.b32 != FRAME_ID) || (out.payload.b32[0] != seq);
+	}
+	CHECK(wrong == 0);
+	CHECK(FakeBtUart_opens() == 1);
+
+	CHECK(BtStack_stop() == 0);
+	CHECK(!FakeBtUart_isOpen());
+	CHECK(!FakeBtUart_receive(frame.b8, 1));
+	CHECK(BtStack_stop() == -1);
+}
+
+static void testFlowNone(void)
+{
+	// without flow control a burst larger than the ring loses bytes
+	FakeBtUart_reset();
+	CHECK(BtStack_setFlow(BTSTACK_FLOW_INBAND + 1) == -2);
+	CHECK(BtStack_setFlow(BTSTACK_FLOW_NONE) == 0);
+	startService();
+	CHECK(BtStack_setFlow(BTSTACK_FLOW_RTSCTS) == -1);
+
+	static uint8_t burst[RX_RING_SIZE + 2 * SLIP_WORST_SIZE(KFP_FRAME_SIZE)];
+	uint16_t frames = 0;
+	uint16_t len = 0;
+	while (len <= RX_RING_SIZE)
+	{
+		len += encodeFrames(&burst[len], frames++, 1);
+	}
+	CHECK(FakeBtUart_receive(burst, len));
+	Task_sleep(20);
+
+	BtStack_RxStats rxStats;
+	BtStack_getRxStats(&rxStats);
+	CHECK(rxStats.ringOverruns > 0);
+	BtStack_FlowStats flowStats;
+	BtStack_getFlowStats(&flowStats);
+	CHECK(flowStats.rxThrottles == 0);
+	CHECK(FakeBtUart_sent(NULL) == 0);
+	CHECK(BtStack_stop() == 0);
+}
+
+static void testRtsCts(void)
+{
+	FakeBtUart_reset();
+	CHECK(BtStack_setFlow(BTSTACK_FLOW_RTSCTS) == 0);
+	startService();
+	CHECK(FakeBtUart_rtsReady());
+
+	// RTS drops as the ring passes its high mark and returns once it has drained
+	static uint8_t burst[RX_FLOW_HIGH + 2 * SLIP_WORST_SIZE(KFP_FRAME_SIZE)];
+	uint16_t frames = 0;
+	uint16_t len = 0;
+	while (len < RX_FLOW_HIGH)
+	{
+		len += encodeFrames(&burst[len], frames++, 1);
+	}
+	CHECK(FakeBtUart_receive(burst, len));
+	CHECK(FakeBtUart_rtsHolds() == 1);
+	CHECK(FakeBios_waitFor(rtsReady, NULL, 100));
+	uint32_t want = frames;
+	CHECK(FakeBios_waitFor(rxFramesAtLeast, &want, 100));
+
+	BtStack_FlowStats flowStats;
+	BtStack_getFlowStats(&flowStats);
+	CHECK(flowStats.rxThrottles == 1);
+	CHECK((flowStats.rxThrottledUs > 0) && (flowStats.rxThrottledUs <= 100 * FAKEBIOS_TICK_US));
+
+	// a module which honours RTS never overruns the ring, however fast it sends
+	CHECK(flood(FLOOD_FRAMES) == (uint32_t) FLOOD_FRAMES);
+	want = frames + FLOOD_FRAMES;
+	CHECK(FakeBios_waitFor(rxFramesAtLeast, &want, 1000));
+	BtStack_RxStats rxStats;
+	BtStack_getRxStats(&rxStats);
+	CHECK(rxStats.frames == want);
+	CHECK((rxStats.ringOverruns == 0) && (rxStats.corruptFrames == 0));
+	CHECK(FakeBtUart_rtsReady());
+
+	// the pin replaces flow frames
+	CHECK(FakeBtUart_sent(NULL) == 0);
+	CHECK(BtStack_stop() == 0);
+}
+
+static void testInBand(void)
+{
+	FakeBtUart_reset();
+	CHECK(BtStack_setFlow(BTSTACK_FLOW_INBAND) == 0);
+	startService();
+
+	// the module is left resumed, a pause still waiting to go out when the ring drains is replaced
+	static uint8_t burst[RX_FLOW_HIGH + 2 * SLIP_WORST_SIZE(KFP_FRAME_SIZE)];
+	uint16_t frames = 0;
+	uint16_t len = 0;
+	while (len < RX_FLOW_HIGH)
+	{
+		len += encodeFrames(&burst[len], frames++, 1);
+	}
+	CHECK(FakeBtUart_receive(burst, len));
+	uint32_t want = frames;
+	CHECK(FakeBios_waitFor(rxFramesAtLeast, &want, 100));
+	Task_sleep(10);
+	decodeWritten(0);
+	CHECK((writtenCount == 1) || (writtenCount == 2));
+	uint16_t i;
+	for (i = 0; i < writtenCount; i++)
+	{
+		CHECK((written[i].size == 3) && (written[i].data[0] == KFP_LINK_MARKER) && (written[i].data[1] == KFP_LINK_FLOW));
+		CHECK(written[i].data[2] == ((i + 1 == writtenCount) ? 1 : 0));
+	}
+	CHECK(FakeBtUart_rtsHolds() == 0);
+
+	// the module pauses this end until it resumes
+	uint32_t before = FakeBtUart_sent(NULL);
+	receiveFlow(0);
+	Task_sleep(5);
+	BtStack_Frame frame = makeFrame(7);
+	CHECK(BtStack_push(&frame) > 0);
+	Task_sleep(50);
+	CHECK(FakeBtUart_sent(NULL) == before);
+	receiveFlow(1);
+	want = before + 1;
+	CHECK(FakeBios_waitFor(sentAtLeast, &want, 100));
+
+	// a pause never resumed ends by itself
+	before = FakeBtUart_sent(NULL);
+	receiveFlow(0);
+	Task_sleep(5);
+	CHECK(BtStack_push(&frame) > 0);
+	Task_sleep(100);
+	CHECK(FakeBtUart_sent(NULL) == before);
+	want = before + 1;
+	CHECK(FakeBios_waitFor(sentAtLeast, &want, 400));
+
+	BtStack_FlowStats flowStats;
+	BtStack_getFlowStats(&flowStats);
+	CHECK(flowStats.rxThrottles == 1);
+	CHECK(flowStats.txPauses == 2);
+	CHECK(flowStats.pauseTimeouts == 1);
+	CHECK(flowStats.txPausedUs >= 150000);
+	CHECK(BtStack_stop() == 0);
+	CHECK(BtStack_setFlow(BTSTACK_FLOW_NONE) == 0);
+}
+
+static void benchRx(void)
+{
+	// a module sending back to back frames at the wire rate, no flow control needed
+	FakeBtUart_reset();
+	CHECK(BtStack_setFlow(BTSTACK_FLOW_NONE) == 0);
+	startService();
+	uint32_t bytesPerS = BtStack_getBaud() / 10;
+	uint8_t encoded[SLIP_WORST_SIZE(KFP_FRAME_SIZE)];
+	uint32_t bytes = 0;
+	uint32_t sent = 0;
+	uint32_t tick;
+	for (tick = 1; tick <= RX_TICKS; tick++)
+	{
+		while ((uint64_t) bytes * 1000 < (uint64_t) tick * bytesPerS)
+		{
+			uint16_t len = encodeFrames(encoded, sent++, 1);
+			FakeBtUart_receive(encoded, len);
+			bytes += len;
+		}
+		Task_sleep(1);
+	}
+	CHECK(FakeBios_waitFor(receivedAtLeast, &sent, 1000));
+	BtStack_RxStats stats;
+	BtStack_getRxStats(&stats);
+	CHECK(stats.frames == sent);
+	CHECK((stats.corruptFrames == 0) && (stats.ringOverruns == 0));
+	CHECK(FakeBtUart_opens() == 1);
+	CHECK(BtStack_stop() == 0);
+	printf("rx: %u frames/s at %u baud for %u ms, %u bytes lost, %u opens of the UART\n",
+			(unsigned)(sent * 1000 / RX_TICKS), (unsigned) BtStack_getBaud(), RX_TICKS,
+			(unsigned) stats.ringOverruns, (unsigned) FakeBtUart_opens());
+
+	// as fast as the reception task drains the ring, what the service could take from a faster UART
+	FakeBtUart_reset();
+	CHECK(BtStack_setFlow(BTSTACK_FLOW_RTSCTS) == 0);
+	startService();
+	uint8_t burst[BURST_FRAMES * SLIP_WORST_SIZE(KFP_FRAME_SIZE)];
+	double start = seconds();
+	sent = 0;
+	while (sent < RX_FLOOD_FRAMES)
+	{
+		if (!FakeBtUart_rtsReady())
+		{
+			Task_yield();
+			continue;
+		}
+		FakeBtUart_receive(burst, encodeFrames(burst, sent, BURST_FRAMES));
+		sent += BURST_FRAMES;
+	}
+	CHECK(FakeBios_waitFor(rxFramesAtLeast, &sent, 5000));
+	double elapsed = seconds() - start;
+	BtStack_getRxStats(&stats);
+	CHECK(stats.frames == sent);
+	CHECK((stats.corruptFrames == 0) && (stats.ringOverruns == 0));
+	CHECK(BtStack_stop() == 0);
+	CHECK(BtStack_setFlow(BTSTACK_FLOW_NONE) == 0);
+
+	// frames beyond what the dispatch queue holds are shed before the subscribers
+	printf("rx: %.0f frames/s decoded as fast as RTS allows, %u dispatched, %u pauses\n", sent / elapsed,
+			(unsigned) receivedCount, (unsigned) FakeBtUart_rtsHolds());
+}
+
+static void testBatching(void)
+{
+	// the first frame goes straight out and holds the UART
+	FakeBtUart_reset();
+	startService();
+	FakeBtUart_holdWrites(TRUE);
+	BtStack_Frame frame = makeFrame(0);
+	CHECK(BtStack_push(&frame) > 0);
+	CHECK(FakeBios_waitFor(writing, NULL, 100));
+
+	// pushes return at once while it is busy, until the lane is full
+	uint32_t seq;
+	for (seq = 1; seq < CONTROL_DEPTH; seq++)
+	{
+		frame = makeFrame(seq);
+		CHECK(BtStack_push(&frame) > 0);
+	}
+	frame = makeFrame(seq);
+	CHECK(BtStack_push(&frame) == -2);
+	CHECK(FakeBtUart_writes() == 1);
+
+	// everything which waited goes out in one write
+	CHECK(FakeBtUart_finishWrite());
+	CHECK(FakeBios_waitFor(writing, NULL, 100));
+	CHECK(FakeBtUart_writes() == 2);
+	CHECK(FakeBtUart_finishWrite());
+	Task_sleep(5);
+	CHECK(FakeBtUart_writes() == 2);
+
+	uint32_t bytes = decodeWritten(0);
+	CHECK(writtenCount == CONTROL_DEPTH);
+	expectWritten(0, 0, CONTROL_DEPTH);
+
+	BtStack_TxStats stats;
+	BtStack_getTxStats(&stats);
+	CHECK(stats.frames == CONTROL_DEPTH);
+	CHECK(stats.writes == 2);
+	CHECK(stats.bytes == bytes);
+	CHECK(stats.queueFull == 1);
+
+	FakeBtUart_holdWrites(FALSE);
+	CHECK(BtStack_stop() == 0);
+}
+
+static void benchTx(void)
+{
+	// frames pushed as fast as the service takes them, the stand-in takes every write at once
+	FakeBtUart_reset();
+	startService();
+	uint32_t full = 0;
+	uint32_t seq = 0;
+	double start = seconds();
+	while (seq < BENCH_FRAMES)
+	{
+		BtStack_Frame frame = makeFrame(seq);
+		if (BtStack_push(&frame) > 0)
+		{
+			seq++;
+		}
+		else
+		{
+			full++;
+			Task_yield();
+		}
+	}
+	Task_sleep(20);
+	double elapsed = seconds() - start;
+
+	BtStack_TxStats stats;
+	BtStack_getTxStats(&stats);
+	CHECK(stats.frames == BENCH_FRAMES);
+	CHECK(stats.bytes == FakeBtUart_sent(NULL));
+	CHECK(BtStack_stop() == 0);
+	printf("tx: %.0f frames/s through the host service, %.2f frames per write, %u pushes found the lane full\n",
+			BENCH_FRAMES / elapsed, (double) stats.frames / stats.writes, full);
+}
+
+/**
+ * \brief Sleeps for the time bytes spend on the wire, carrying parts of a tick to the next call
+ */
+static void wireSleep(uint16_t len, uint32_t baud)
+{
+	// ten bits a byte
+	wireOwedUs += ((uint32_t)len * 10 * 1000000) / baud;
+	Task_sleep(wireOwedUs / FAKEBIOS_TICK_US);
+	wireOwedUs %= FAKEBIOS_TICK_US;
+}
+
+/**
+ * \brief Takes held writes off the UART after the time they spend on the wire
+ */
+static void sinkFxn(UArg unused0, UArg unused1)
+{
+	double finished = 0;
+	while (TRUE)
+	{
+		uint16_t len = FakeBtUart_writing();
+		if (len > 0)
+		{
+			wireSleep(len, BtStack_getBaud());
+			FakeBtUart_finishWrite();
+			finished = seconds();
+		}
+		else if (seconds() - finished < FAKEBIOS_TICK_US * 1e-6)
+		{
+			// the transmission task starts its next write as soon as it runs, the wire would not idle a tick
+			Task_yield();
+		}
+		else
+		{
+			Task_sleep(1);
+		}
+	}
+}
+
+/**
+ * \brief Keeps the bulk lane full of raw frames while feeding is set
+ */
+static void feederFxn(UArg unused0, UArg unused1)
+{
+	uint8_t raw[BULK_SIZE];
+	memset(raw, 0x11, sizeof(raw));
+	while (TRUE)
+	{
+		if (!feeding || (BtStack_pushRaw(raw, sizeof(raw), BTSTACK_LANE_BULK) < 0))
+		{
+			Task_sleep(1);
+		}
+	}
+}
+
+/**
+ * \brief Sends frames the way BtStack_push did before the transmission task
+ *
+ * Each frame opens the UART, waits for a blocking write to leave the wire
+ * and closes the UART again.
+ *
+ * \return Seconds taken, all of them spent blocked in the caller
+ */
+static double perFrameWrites(uint32_t baud)
+{
+	BtUart_Params params;
+	memset(&params, 0, sizeof(params));
+	params.baud = baud;
+	double start = seconds();
+	uint32_t seq;
+	for (seq = 0; seq < WIRE_FRAMES; seq++)
+	{
+		BtStack_Frame frame = makeFrame(seq);
+		uint8_t encoded[SLIP_WORST_SIZE(KFP_FRAME_SIZE)];
+		uint16_t len = Slip_encode(encoded, frame.b8, KFP_FRAME_SIZE-2);
+		CHECK(BtUart_open(&params) == 0);
+		CHECK(BtUart_write(encoded, len) == len);
+		wireSleep(len, baud);
+		CHECK(BtUart_close() == 0);
+	}
+	return seconds() - start;
+}
+
+static Bool wireDrained(void* arg)
+{
+	BtStack_TxStats stats;
+	BtStack_getTxStats(&stats);
+	return (stats.frames == *(uint32_t*)arg) && (stats.bytes == FakeBtUart_sent(NULL)) &&
+			(FakeBtUart_writing() == 0);
+}
+
+static void benchWire(void)
+{
+	// the caller pushes as fast as the queue takes frames, a sink plays a 115200 baud wire
+	FakeBtUart_reset();
+	startService();
+	uint32_t baud = BtStack_getBaud();
+	FakeBtUart_holdWrites(TRUE);
+	Task_Params params;
+	Task_Params_init(&params);
+	Task_Handle sink = Task_create(sinkFxn, &params, NULL);
+	CHECK(sink != NULL);
+
+	wireOwedUs = 0;
+	double blocked = 0;
+	double start = seconds();
+	uint32_t seq = 0;
+	while (seq < WIRE_FRAMES)
+	{
+		BtStack_Frame frame = makeFrame(seq);
+		double before = seconds();
+		int8_t status = BtStack_push(&frame);
+		blocked += seconds() - before;
+		if (status > 0)
+		{
+			seq++;
+		}
+		else
+		{
+			Task_sleep(1);
+		}
+	}
+	uint32_t want = WIRE_FRAMES;
+	CHECK(FakeBios_waitFor(wireDrained, &want, 5000));
+	double batched = seconds() - start;
+
+	BtStack_TxStats stats;
+	BtStack_getTxStats(&stats);
+	Task_delete(&sink);
+	FakeBtUart_holdWrites(FALSE);
+	CHECK(BtStack_stop() == 0);
+
+	FakeBtUart_reset();
+	wireOwedUs = 0;
+	double perFrame = perFrameWrites(baud);
+	CHECK(FakeBtUart_opens() == WIRE_FRAMES);
+
+	printf("tx: at %u baud, batched %.0f frames/s in %u writes, caller blocked %.1f us a frame; "
+			"open/write/close %.0f frames/s, caller blocked %.1f us a frame\n", (unsigned) baud,
+			WIRE_FRAMES / batched, (unsigned) stats.writes, blocked * 1e6 / WIRE_FRAMES,
+			WIRE_FRAMES / perFrame, perFrame * 1e6 / WIRE_FRAMES);
+	CHECK(stats.writes < WIRE_FRAMES);
+	CHECK(blocked * 10 < perFrame);
+}
+
+static void testLanes(void)
+{
+	CHECK(BtStack_setLaneDepth(BTSTACK_LANE_BULK, 0) == -2);
+	CHECK(BtStack_setLaneDepth(BTSTACK_LANE_COUNT, 4) == -2);
+	CHECK(BtStack_setLaneDepth(BTSTACK_LANE_CONTROL, 17) == -2);
+
+	FakeBtUart_reset();
+	startService();
+	CHECK(BtStack_setLaneDepth(BTSTACK_LANE_BULK, 16) == -1);
+	BtStack_Frame frame = makeFrame(1000);
+	CHECK(BtStack_pushLane(&frame, BTSTACK_LANE_COUNT) == -3);
+	CHECK(BtStack_pushRaw(frame.b8, 4, BTSTACK_LANE_COUNT) == -3);
+
+	// a control frame holds the UART while bulk frames and another control frame queue
+	FakeBtUart_holdWrites(TRUE);
+	CHECK(BtStack_pushLane(&frame, BTSTACK_LANE_CONTROL) > 0);
+	CHECK(FakeBios_waitFor(writing, NULL, 100));
+	uint32_t seq;
+	for (seq = 0; seq < 10; seq++)
+	{
+		frame = makeFrame(seq);
+		CHECK(BtStack_pushLane(&frame, BTSTACK_LANE_BULK) > 0);
+	}
+	frame = makeFrame(1001);
+	CHECK(BtStack_pushLane(&frame, BTSTACK_LANE_CONTROL) > 0);
+
+	// the control frame overtakes, bulk frames go in quanta of whole frames
+	CHECK(FakeBtUart_finishWrite());
+	CHECK(FakeBios_waitFor(writing, NULL, 100));
+	CHECK(FakeBtUart_finishWrite());
+	CHECK(FakeBios_waitFor(writing, NULL, 100));
+
+	// a control frame pushed during a bulk write only waits for that write
+	frame = makeFrame(1002);
+	CHECK(BtStack_pushLane(&frame, BTSTACK_LANE_CONTROL) > 0);
+	uint8_t finished = 0;
+	while (FakeBios_waitFor(writing, NULL, 20))
+	{
+		CHECK(FakeBtUart_finishWrite());
+		finished++;
+	}
+	CHECK(finished == 4);
+	CHECK(FakeBtUart_writes() == 6);
+
+	decodeWritten(0);
+	CHECK(writtenCount == 13);
+	expectWritten(0, 1000, 2);
+	expectWritten(2, 0, 4);
+	expectWritten(6, 1002, 1);
+	expectWritten(7, 4, 6);
+
+	BtStack_LaneStats control;
+	BtStack_LaneStats bulk;
+	BtStack_getLaneStats(BTSTACK_LANE_CONTROL, &control);
+	BtStack_getLaneStats(BTSTACK_LANE_BULK, &bulk);
+	CHECK((control.frames == 3) && (control.sent == 3) && (control.queueFull == 0));
+	CHECK((bulk.frames == 10) && (bulk.sent == 10) && (bulk.queueFull == 0));
+	FakeBtUart_holdWrites(FALSE);
+	CHECK(BtStack_stop() == 0);
+}
+
+static void benchLanes(void)
+{
+	// a sink taking writes at 115200 baud, saturated by bulk frames
+	FakeBtUart_reset();
+	startService();
+	FakeBtUart_holdWrites(TRUE);
+	Task_Params params;
+	Task_Params_init(&params);
+	Task_Handle sink = Task_create(sinkFxn, &params, NULL);
+	Task_Handle feeder = Task_create(feederFxn, &params, NULL);
+	CHECK((sink != NULL) && (feeder != NULL));
+	feeding = TRUE;
+	Task_sleep(50);
+
+	uint32_t seq;
+	uint32_t refused = 0;
+	for (seq = 0; seq < CONTROL_FRAMES; seq++)
+	{
+		BtStack_Frame frame = makeFrame(seq);
+		refused += (BtStack_pushLane(&frame, BTSTACK_LANE_CONTROL) <= 0);
+		Task_sleep(7);
+	}
+	feeding = FALSE;
+	Task_sleep(100);
+	CHECK(refused == 0);
+
+	BtStack_LaneStats control;
+	BtStack_LaneStats bulk;
+	BtStack_getLaneStats(BTSTACK_LANE_CONTROL, &control);
+	BtStack_getLaneStats(BTSTACK_LANE_BULK, &bulk);
+	Task_delete(&feeder);
+	Task_delete(&sink);
+	FakeBtUart_holdWrites(FALSE);
+	CHECK(BtStack_stop() == 0);
+
+	printf("lanes: control %u frames, mean %u us, max %u us; bulk %u frames, mean %u us, max %u us\n",
+			control.sent, control.meanLatencyUs, control.maxLatencyUs,
+			bulk.sent, bulk.meanLatencyUs, bulk.maxLatencyUs);
+	CHECK(control.sent == CONTROL_FRAMES);
+	CHECK(bulk.sent > 0);
+	CHECK(control.meanLatencyUs * 2 < bulk.meanLatencyUs);
+}
+
+int main(void)
+{
+	testSession();
+	testFlowNone();
+	testRtsCts();
+	testInBand();
+	benchRx();
+	testBatching();
+	benchTx();
+	benchWire();
+	testLanes();
+	benchLanes();
+
+	return CHECK_RESULT();
+}
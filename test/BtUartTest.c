@@ -0,0 +1,424 @@
+/**
+ * \file BtUartTest.c
+ * \brief Tests the bluetooth UART transport in uDMA mode on the host
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ *
+ * The transport runs on the UART1 and uDMA stand-in. The test plays the
+ * module on the wire: it delivers bytes in pieces of random size with idle
+ * gaps between some of them, and checks that every byte reaches the ring
+ * once, in order, a block per interrupt rather than a byte. Writes gather
+ * buffers of random size, the test frees FIFO space a few bytes at a time
+ * and checks the wire carries them in order and completes once. The clock is
+ * held so the transport's poll only runs when the test ticks it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <ti/sysbios/hal/Hwi.h>
+#include <inc/hw_ints.h>
+
+#include "Check.h"
+#include "FakeBios.h"
+#include "FakeUartDma.h"
+#include "BtUart.h"
+
+#define RING_SIZE 1024			//! Reception ring of the test, power of two
+#define STREAM_BYTES 50000		//! Bytes the random source delivers
+#define MAX_PIECE 200			//! Most bytes delivered at once
+#define IDLE_ONE_IN 4			//! One in this many pieces is followed by a receive timeout
+#define TICK_ONE_IN 8			//! One in this many pieces is followed by a tick
+#define WRITES 2000				//! Asynchronous writes of the transmission test
+#define MAX_SPAN 300			//! Most bytes in one buffer of a write
+#define MAX_STEP 48				//! Most bytes the wire takes between looks
+#define POOL_SIZE 4096			//! Bytes the buffers are taken from
+
+static ByteRing ring;
+static uint8_t ringBuf[RING_SIZE];
+
+static uint8_t stream[STREAM_BYTES];		//! Bytes the module sends
+static uint8_t got[STREAM_BYTES];			//! Bytes read back from the ring
+static uint32_t gotCount;
+static uint8_t scanned[STREAM_BYTES];		//! Bytes the scan function saw
+static uint32_t scannedCount;
+static uint32_t rxCalls;
+static uint32_t rxOrderErrors;				//! Calls whose before did not match the ring
+
+static uint8_t pool[POOL_SIZE];				//! Buffers of the writes are slices of it
+static uint8_t expected[BTUART_MAX_SPANS * MAX_SPAN];
+static uint8_t wire[FAKEUARTDMA_SENT_SIZE];
+static uint32_t txDoneCalls;
+static uint16_t txDoneLen;
+
+static void rxFxn(uint16_t before, uint16_t added)
+{
+	rxCalls++;
+	if (before + added != ByteRing_count(&ring))
+	{
+		rxOrderErrors++;
+	}
+}
+
+static void scanFxn(const uint8_t* data, uint16_t len)
+{
+	if (scannedCount + len <= STREAM_BYTES)
+	{
+		memcpy(&scanned[scannedCount], data, len);
+	}
+	scannedCount += len;
+}
+
+static void txDoneFxn(uint16_t len)
+{
+	txDoneCalls++;
+	txDoneLen = len;
+}
+
+/**
+ * \brief Reads everything waiting in the ring into got
+ */
+static void drain(void)
+{
+	UInt key = Hwi_disable();
+	const uint8_t* data;
+	uint16_t len;
+	while ((len = ByteRing_peek(&ring, &data)) > 0)
+	{
+		if (gotCount + len <= STREAM_BYTES)
+		{
+			memcpy(&got[gotCount], data, len);
+		}
+		gotCount += len;
+		ByteRing_consume(&ring, len);
+	}
+	Hwi_restore(key);
+}
+
+/**
+ * \brief Opens the transport in uDMA mode on a fresh UART1
+ */
+static void openDma(void)
+{
+	FakeUartDma_reset();
+	ByteRing_init(&ring, ringBuf, RING_SIZE);
+	gotCount = 0;
+	scannedCount = 0;
+	rxCalls = 0;
+	rxOrderErrors = 0;
+	txDoneCalls = 0;
+
+	BtUart_Params params;
+	memset(&params, 0, sizeof(params));
+	params.baud = 115200;
+	params.useDma = TRUE;
+	params.rxRing = &ring;
+	params.rxFxn = rxFxn;
+	params.scanFxn = scanFxn;
+	params.txDoneFxn = txDoneFxn;
+	CHECK(BtUart_open(&params) == 0);
+}
+
+static void testOpen(void)
+{
+	// the host has no UART driver to fall back on
+	BtUart_Params params;
+	memset(&params, 0, sizeof(params));
+	params.baud = 115200;
+	params.rxRing = &ring;
+	params.rxFxn = rxFxn;
+	params.txDoneFxn = txDoneFxn;
+	CHECK(BtUart_open(&params) == -2);
+
+	openDma();
+	CHECK(FakeUartDma_baud() == 115200);
+	CHECK(FakeUartDma_faults() == 0);
+	CHECK(BtUart_open(&params) == -1);
+	CHECK(FakeBios_interrupt(INT_UART1));
+
+	CHECK(BtUart_setBaud(460800) == 0);
+	CHECK(FakeUartDma_baud() == 460800);
+
+	CHECK(BtUart_close() == 0);
+	CHECK(!FakeBios_interrupt(INT_UART1));
+	CHECK(BtUart_close() == -1);
+	CHECK(BtUart_setBaud(115200) == -1);
+	CHECK(FakeUartDma_faults() == 0);
+}
+
+/**
+ * \brief Bytes below the burst level wait for the receive timeout, behind those the uDMA moved
+ */
+static void testTail(void)
+{
+	uint16_t i;
+	for (i = 0; i < 18; i++)
+	{
+		stream[i] = i;
+	}
+
+	openDma();
+	FakeUartDma_receive(stream, 5);
+	CHECK(FakeUartDma_interrupts() == 0);
+	CHECK(ByteRing_count(&ring) == 0);
+	FakeUartDma_idle();
+	CHECK(FakeUartDma_interrupts() == 1);
+	CHECK(ByteRing_count(&ring) == 5);
+
+	// 8 go to the block, 5 stay in the FIFO
+	FakeUartDma_receive(&stream[5], 13);
+	CHECK(FakeUartDma_interrupts() == 1);
+	FakeUartDma_idle();
+	CHECK(FakeUartDma_interrupts() == 2);
+	drain();
+	CHECK(gotCount == 18);
+	CHECK(memcmp(got, stream, 18) == 0);
+	CHECK(rxOrderErrors == 0);
+	CHECK(FakeUartDma_faults() == 0);
+	CHECK(BtUart_close() == 0);
+}
+
+/**
+ * \brief Bursts which empty the FIFO leave nothing for the receive timeout, the next tick hands them over
+ */
+static void testBoundary(void)
+{
+	uint16_t i;
+	for (i = 0; i < 24; i++)
+	{
+		stream[i] = 0xA0 + i;
+	}
+
+	openDma();
+	FakeUartDma_receive(stream, 24);
+	FakeUartDma_idle();
+	CHECK(FakeUartDma_interrupts() == 0);
+	CHECK(ByteRing_count(&ring) == 0);
+
+	FakeBios_tick();
+	drain();
+	CHECK(gotCount == 24);
+	CHECK(memcmp(got, stream, 24) == 0);
+
+	// nothing new, nothing handed twice
+	FakeBios_tick();
+	CHECK(ByteRing_count(&ring) == 0);
+	CHECK(FakeUartDma_interrupts() == 0);
+	CHECK(rxOrderErrors == 0);
+	CHECK(BtUart_close() == 0);
+}
+
+/**
+ * \brief A source delivering pieces of random size, with random gaps, reaches the ring intact
+ */
+static void testRandom(void)
+{
+	uint32_t i;
+	for (i = 0; i < STREAM_BYTES; i++)
+	{
+		stream[i] = Check_random();
+	}
+
+	openDma();
+	uint32_t offset = 0;
+	uint32_t idles = 0;
+	while (offset < STREAM_BYTES)
+	{
+		uint32_t piece = 1 + Check_below(MAX_PIECE);
+		if (piece > STREAM_BYTES - offset)
+		{
+			piece = STREAM_BYTES - offset;
+		}
+		FakeUartDma_receive(&stream[offset], piece);
+		offset += piece;
+
+		if (Check_below(IDLE_ONE_IN) == 0)
+		{
+			FakeUartDma_idle();
+			idles++;
+		}
+		if (Check_below(TICK_ONE_IN) == 0)
+		{
+			FakeBios_tick();
+		}
+		drain();
+	}
+	FakeUartDma_idle();
+	idles++;
+	FakeBios_tick();
+	drain();
+
+	CHECK(gotCount == STREAM_BYTES);
+	CHECK(memcmp(got, stream, STREAM_BYTES) == 0);
+	CHECK(scannedCount == STREAM_BYTES);
+	CHECK(memcmp(scanned, stream, STREAM_BYTES) == 0);
+	CHECK(rxOrderErrors == 0);
+	CHECK(FakeUartDma_lost() == 0);
+	CHECK(FakeUartDma_faults() == 0);
+
+	// one interrupt per filled block or timeout, never per byte
+	uint32_t interrupts = FakeUartDma_interrupts();
+	CHECK(interrupts <= STREAM_BYTES / BTUART_DMA_BLOCK + idles);
+	BtUart_Stats stats;
+	BtUart_getStats(&stats);
+	CHECK(stats.hwOverruns == 0);
+	CHECK(stats.rxBlocks >= STREAM_BYTES / BTUART_DMA_BLOCK);
+	printf("uDMA reception: %u bytes in %u interrupts (%u timeouts), %.1f bytes per interrupt, "
+			"%u handoffs to the ring\n", STREAM_BYTES, interrupts, idles,
+			(double)STREAM_BYTES / interrupts, stats.rxBlocks);
+	CHECK(BtUart_close() == 0);
+}
+
+/**
+ * \brief Both blocks and the FIFO filling while interrupts are held overruns, then reception carries on in order
+ */
+static void testOverrun(void)
+{
+	const uint16_t kept = 2 * BTUART_DMA_BLOCK + FAKEUARTDMA_FIFO;
+	uint16_t i;
+	for (i = 0; i < kept + 110; i++)
+	{
+		stream[i] = i * 7;
+	}
+
+	openDma();
+	FakeUartDma_holdInterrupts(TRUE);
+	FakeUartDma_receive(stream, kept + 10);
+	CHECK(ByteRing_count(&ring) == 0);
+	CHECK(FakeUartDma_lost() == 10);
+
+	// the interrupt takes both blocks in the order they filled and restarts the stopped channel
+	FakeUartDma_holdInterrupts(FALSE);
+	CHECK(FakeUartDma_interrupts() == 1);
+	CHECK(ByteRing_count(&ring) == 2 * BTUART_DMA_BLOCK);
+	FakeBios_tick();
+	drain();
+	CHECK(gotCount == kept);
+	CHECK(memcmp(got, stream, kept) == 0);
+
+	BtUart_Stats stats;
+	BtUart_getStats(&stats);
+	CHECK(stats.hwOverruns == 1);
+
+	// bytes after the lost ones follow on
+	FakeUartDma_receive(&stream[kept + 10], 100);
+	FakeUartDma_idle();
+	drain();
+	CHECK(gotCount == kept + 100);
+	CHECK(memcmp(&got[kept], &stream[kept + 10], 100) == 0);
+	CHECK(rxOrderErrors == 0);
+	CHECK(FakeUartDma_faults() == 0);
+	CHECK(BtUart_close() == 0);
+}
+
+/**
+ * \brief Writes of up to BTUART_MAX_SPANS buffers reach the wire in order and complete once, after the last byte
+ */
+static void testGather(void)
+{
+	uint32_t i;
+	for (i = 0; i < POOL_SIZE; i++)
+	{
+		pool[i] = Check_random();
+	}
+
+	openDma();
+	BtUart_Span spans[BTUART_MAX_SPANS + 1];
+	CHECK(BtUart_writeSpans(spans, 0) == -2);
+	CHECK(BtUart_writeSpans(spans, BTUART_MAX_SPANS + 1) == -2);
+
+	uint32_t wireCount = 0;
+	uint32_t mismatches = 0;
+	uint32_t early = 0;
+	uint32_t rxOffset = 0;
+	uint32_t n;
+	for (n = 0; n < WRITES; n++)
+	{
+		uint8_t count = 1 + Check_below(BTUART_MAX_SPANS);
+		uint16_t total = 0;
+		for (i = 0; i < count; i++)
+		{
+			spans[i].len = 1 + Check_below(MAX_SPAN);
+			spans[i].data = &pool[Check_below(POOL_SIZE - spans[i].len)];
+			memcpy(&expected[total], spans[i].data, spans[i].len);
+			total += spans[i].len;
+		}
+
+		uint32_t before = txDoneCalls;
+		uint32_t interrupts = FakeUartDma_interrupts();
+		CHECK(BtUart_writeSpans(spans, count) == 0);
+		CHECK(BtUart_writeSpans(spans, 1) == -1);
+		CHECK(BtUart_setBaud(230400) == -1);
+
+		// the wire takes a few bytes at a time, reception goes on meanwhile
+		uint16_t moved = 0;
+		while (moved < total)
+		{
+			early += (txDoneCalls != before);
+			uint16_t step = FakeUartDma_transmit(1 + Check_below(MAX_STEP));
+			if (step == 0)
+			{
+				// the channel stopped short of the last byte
+				break;
+			}
+			moved += step;
+			if (Check_below(4) == 0)
+			{
+				FakeUartDma_receive(&stream[rxOffset], BTUART_DMA_BLOCK);
+				rxOffset = (rxOffset + BTUART_DMA_BLOCK) % (STREAM_BYTES - BTUART_DMA_BLOCK);
+				drain();
+			}
+		}
+		CHECK(moved == total);
+		CHECK(FakeUartDma_transmit(MAX_STEP) == 0);
+		CHECK(txDoneCalls == before + 1);
+		CHECK(txDoneLen == total);
+
+		FakeUartDma_sent(wire);
+		if ((wireCount + total > FAKEUARTDMA_SENT_SIZE) || (memcmp(&wire[wireCount], expected, total) != 0))
+		{
+			mismatches++;
+		}
+		wireCount += total;
+		if (wireCount + BTUART_MAX_SPANS * MAX_SPAN > FAKEUARTDMA_SENT_SIZE)
+		{
+			// the next write is checked from the start of a fresh wire
+			CHECK(BtUart_close() == 0);
+			openDma();
+			wireCount = 0;
+		}
+		else
+		{
+			CHECK(FakeUartDma_interrupts() >= interrupts + 1);
+		}
+	}
+	CHECK(mismatches == 0);
+	CHECK(early == 0);
+
+	// the rate and blocking writes are free again once a write completes
+	CHECK(BtUart_setBaud(921600) == 0);
+	CHECK(FakeUartDma_baud() == 921600);
+	uint32_t sent = FakeUartDma_sent(NULL);
+	CHECK(BtUart_write((const uint8_t*) "AT", 2) == 2);
+	CHECK(FakeUartDma_sent(wire) == sent + 2);
+	CHECK(memcmp(&wire[sent], "AT", 2) == 0);
+	CHECK(FakeUartDma_faults() == 0);
+	CHECK(rxOrderErrors == 0);
+	printf("uDMA transmission: %u writes of 1 to %u buffers, each completed once after its last byte\n",
+			WRITES, BTUART_MAX_SPANS);
+	CHECK(BtUart_close() == 0);
+}
+
+int main(void)
+{
+	FakeBios_holdClock(TRUE);
+	testOpen();
+	testTail();
+	testBoundary();
+	testRandom();
+	testOverrun();
+	testGather();
+	FakeBios_holdClock(FALSE);
+	return CHECK_RESULT();
+}
@@ -0,0 +1,249 @@
+/**
+ * \file ByteRingTest.c
+ * \brief Tests the lock-free byte ring on the host
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ *
+ * Checks wrapping, overrun accounting and the zero copy calls from one
+ * thread, then streams a counting sequence from a producer thread to a
+ * consumer thread the way the UART Hwi feeds the reception task.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+#include "Check.h"
+#include "ByteRing.h"
+
+#define RING_SIZE 256				//! Size of the ring under test
+#define STRESS_BYTES (8u << 20)	//! No. of bytes streamed between the threads
+
+static uint8_t storage[RING_SIZE];
+static ByteRing ring;
+
+static void testEmpty(void)
+{
+	ByteRing_init(&ring, storage, RING_SIZE);
+
+	const uint8_t* data;
+	CHECK(ByteRing_count(&ring) == 0);
+	CHECK(ByteRing_space(&ring) == RING_SIZE);
+	CHECK(ByteRing_peek(&ring, &data) == 0);
+	CHECK(ByteRing_peekAt(&ring, 5, &data) == 0);
+}
+
+static void testWrap(void)
+{
+	ByteRing_init(&ring, storage, RING_SIZE);
+
+	// walk the free running indices past 65535 with writes which straddle the end of storage
+	uint8_t in[100];
+	uint8_t next = 0;
+	uint8_t expect = 0;
+	uint32_t round;
+	for (round = 0; round < 2000; round++)
+	{
+		uint16_t len = 1 + (round * 37) % sizeof(in);
+		uint16_t i;
+		for (i = 0; i < len; i++)
+		{
+			in[i] = next++;
+		}
+		CHECK(ByteRing_write(&ring, in, len) == len);
+		CHECK(ByteRing_count(&ring) == len);
+
+		// at most two blocks, the second from the start of storage
+		uint16_t got = 0;
+		while (got < len)
+		{
+			const uint8_t* data;
+			uint16_t n = ByteRing_peek(&ring, &data);
+			CHECK(n > 0);
+			if (n == 0)
+			{
+				return;
+			}
+			for (i = 0; i < n; i++)
+			{
+				CHECK(data[i] == expect);
+				expect++;
+			}
+			ByteRing_consume(&ring, n);
+			got += n;
+		}
+		CHECK(got == len);
+	}
+	CHECK(ring.overruns == 0);
+}
+
+static void testOverrun(void)
+{
+	ByteRing_init(&ring, storage, RING_SIZE);
+
+	uint8_t in[RING_SIZE + 10];
+	memset(in, 0x5A, sizeof(in));
+	CHECK(ByteRing_write(&ring, in, sizeof(in)) == RING_SIZE);
+	CHECK(ring.overruns == 10);
+	CHECK(ByteRing_space(&ring) == 0);
+	CHECK(ByteRing_put(&ring, 1) == -1);
+	CHECK(ring.overruns == 11);
+
+	ByteRing_consume(&ring, 1);
+	CHECK(ByteRing_put(&ring, 1) == 0);
+	CHECK(ByteRing_count(&ring) == RING_SIZE);
+}
+
+static void testReserve(void)
+{
+	ByteRing_init(&ring, storage, RING_SIZE);
+
+	// move the indices close to the end of storage
+	uint8_t in[RING_SIZE - 4];
+	memset(in, 0, sizeof(in));
+	ByteRing_write(&ring, in, sizeof(in));
+	ByteRing_consume(&ring, sizeof(in));
+
+	// only the space up to the end of storage is contiguous
+	uint8_t* free;
+	CHECK(ByteRing_reserve(&ring, &free) == 4);
+	memcpy(free, "abcd", 4);
+	ByteRing_commit(&ring, 4);
+	CHECK(ByteRing_reserve(&ring, &free) == RING_SIZE - 4);
+	memcpy(free, "efgh", 4);
+	ByteRing_commit(&ring, 4);
+	CHECK(ByteRing_count(&ring) == 8);
+
+	// peekAt skips unread bytes, across the wrap too
+	const uint8_t* data;
+	CHECK(ByteRing_peekAt(&ring, 0, &data) == 4);
+	CHECK(memcmp(data, "abcd", 4) == 0);
+	CHECK(ByteRing_peekAt(&ring, 2, &data) == 2);
+	CHECK(memcmp(data, "cd", 2) == 0);
+	CHECK(ByteRing_peekAt(&ring, 4, &data) == 4);
+	CHECK(memcmp(data, "efgh", 4) == 0);
+	CHECK(ByteRing_peekAt(&ring, 6, &data) == 2);
+	CHECK(memcmp(data, "gh", 2) == 0);
+	CHECK(ByteRing_peekAt(&ring, 8, &data) == 0);
+	CHECK(ByteRing_peekAt(&ring, 9, &data) == 0);
+}
+
+/**
+ * \brief Writes the counting sequence with every producer call, never more than fits
+ */
+static void* producerFxn(void* arg)
+{
+	uint32_t seed = 0x9E3779B9;
+	uint32_t sent = 0;
+	uint8_t value = 0;
+	while (sent < STRESS_BYTES)
+	{
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+
+		uint16_t space = ByteRing_space(&ring);
+		if (space == 0)
+		{
+			// the build host may have a single core
+			sched_yield();
+			continue;
+		}
+
+		uint16_t len = 1 + seed % 64;
+		if (len > space)
+		{
+			len = space;
+		}
+		if (len > STRESS_BYTES - sent)
+		{
+			len = STRESS_BYTES - sent;
+		}
+
+		uint16_t i;
+		switch (seed >> 30)
+		{
+		case 0:
+			ByteRing_put(&ring, value++);
+			len = 1;
+			break;
+
+		case 1:
+		{
+			uint8_t* free;
+			uint16_t contiguous = ByteRing_reserve(&ring, &free);
+			if (len > contiguous)
+			{
+				len = contiguous;
+			}
+			for (i = 0; i < len; i++)
+			{
+				free[i] = value++;
+			}
+			ByteRing_commit(&ring, len);
+			break;
+		}
+
+		default:
+		{
+			uint8_t in[64];
+			for (i = 0; i < len; i++)
+			{
+				in[i] = value++;
+			}
+			ByteRing_write(&ring, in, len);
+			break;
+		}
+		}
+		sent += len;
+	}
+
+	return NULL;
+}
+
+static void testStress(void)
+{
+	ByteRing_init(&ring, storage, RING_SIZE);
+
+	pthread_t producer;
+	CHECK(pthread_create(&producer, NULL, producerFxn, NULL) == 0);
+
+	uint32_t received = 0;
+	uint32_t wrong = 0;
+	uint8_t expect = 0;
+	while (received < STRESS_BYTES)
+	{
+		const uint8_t* data;
+		uint16_t n = ByteRing_peek(&ring, &data);
+		if (n == 0)
+		{
+			sched_yield();
+			continue;
+		}
+		uint16_t i;
+		for (i = 0; i < n; i++)
+		{
+			wrong += (data[i] != expect);
+			expect++;
+		}
+		ByteRing_consume(&ring, n);
+		received += n;
+	}
+
+	pthread_join(producer, NULL);
+	CHECK(wrong == 0);
+	CHECK(ring.overruns == 0);
+	CHECK(ByteRing_count(&ring) == 0);
+}
+
+int main(void)
+{
+	testEmpty();
+	testWrap();
+	testOverrun();
+	testReserve();
+	testStress();
+
+	return CHECK_RESULT();
+}
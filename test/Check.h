@@ -0,0 +1,60 @@
+/**
+ * \file Check.h
+ * \brief Declares assertion and random helpers shared by the host tests
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ *
+ * Each test is one executable. Failed checks are printed and counted,
+ * CHECK_RESULT is returned from main so ctest sees the failure.
+ */
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+static int checkFailures = 0;		//! No. of failed checks in this test
+
+/**
+ * \brief Prints and counts a failed condition, the test carries on
+ */
+#define CHECK(cond) \
+	do \
+	{ \
+		if (!(cond)) \
+		{ \
+			fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+			checkFailures++; \
+		} \
+	} while (0)
+
+/**
+ * \brief Exit status of the test
+ */
+#define CHECK_RESULT() ((checkFailures == 0) ? 0 : 1)
+
+static uint32_t checkSeed = 0x2545F491;	//! State of the random generator, fixed so runs repeat
+
+/**
+ * \brief Returns the next xorshift32 random number
+ */
+static inline uint32_t Check_random(void)
+{
+	checkSeed ^= checkSeed << 13;
+	checkSeed ^= checkSeed >> 17;
+	checkSeed ^= checkSeed << 5;
+	return checkSeed;
+}
+
+/**
+ * \brief Returns a random number from 0 to range-1
+ */
+static inline uint32_t Check_below(uint32_t range)
+{
+	return Check_random() % range;
+}
+
+
+#endif
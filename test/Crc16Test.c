@@ -0,0 +1,304 @@
+/**
+ * \file Crc16Test.c
+ * \brief Tests the slice-by-4 CRC-16/CCITT against a bitwise reference on the host
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ *
+ * Corrupts KFP frames with their trailer, every short burst exhaustively
+ * and random bit flips by the million, and reports the share detected.
+ * Also times the CRC per frame and per MB against the reference.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "Check.h"
+#include "Crc16.h"
+
+#define BUFFERS 100000			//! No. of random buffers compared with the reference
+#define MAX_LEN 300				//! Longest random buffer
+#define BENCH_BYTES (64u << 20)	//! No. of bytes checked by the benchmark
+#define INJECTIONS 1000000		//! No. of corrupted frames at each no. of flipped bits
+#define BENCH_FRAMES 10000000	//! No. of frames checked by the per frame benchmark
+#define KFP_BYTES 12			//! Bytes of a KFP frame before its trailer
+
+/**
+ * \brief Computes the CRC a bit at a time, straight from the polynomial
+ */
+static uint16_t referenceCrc(uint16_t crc, const uint8_t* data, uint32_t len)
+{
+	uint32_t i;
+	for (i = 0; i < len; i++)
+	{
+		crc ^= (uint16_t)data[i] << 8;
+		uint8_t bit;
+		for (bit = 0; bit < 8; bit++)
+		{
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+		}
+	}
+	return crc;
+}
+
+static void testCheckValue(void)
+{
+	// the catalogued check value of CRC-16/CCITT-FALSE
+	CHECK(Crc16_compute((const uint8_t*) "123456789", 9) == 0x29B1);
+	CHECK(referenceCrc(CRC16_INIT, (const uint8_t*) "123456789", 9) == 0x29B1);
+	CHECK(Crc16_compute(NULL, 0) == CRC16_INIT);
+}
+
+static void testRandom(void)
+{
+	static uint8_t buf[MAX_LEN + 3];
+	uint32_t mismatches = 0;
+
+	uint32_t n;
+	for (n = 0; n < BUFFERS; n++)
+	{
+		uint16_t len = Check_below(MAX_LEN + 1);
+		uint8_t offset = Check_below(4);
+		uint16_t i;
+		for (i = 0; i < len; i++)
+		{
+			buf[offset + i] = (uint8_t) Check_random();
+		}
+		const uint8_t* data = buf + offset;
+		uint16_t expect = referenceCrc(CRC16_INIT, data, len);
+
+		// whole, and continued across a random split
+		uint16_t split = (len > 0) ? Check_below(len + 1) : 0;
+		uint16_t whole = Crc16_compute(data, len);
+		uint16_t parts = Crc16_update(Crc16_update(CRC16_INIT, data, split), data + split, len - split);
+		mismatches += (whole != expect) + (parts != expect);
+	}
+
+	CHECK(mismatches == 0);
+}
+
+static void testTrailer(void)
+{
+	// the CRC appended most significant byte first makes the whole frame check to 0
+	uint8_t frame[12 + CRC16_SIZE];
+	uint32_t failures = 0;
+	uint32_t n;
+	for (n = 0; n < 1000; n++)
+	{
+		uint8_t i;
+		for (i = 0; i < 12; i++)
+		{
+			frame[i] = (uint8_t) Check_random();
+		}
+		uint16_t crc = Crc16_compute(frame, 12);
+		frame[12] = crc >> 8;
+		frame[13] = crc & 0xFF;
+		failures += (Crc16_compute(frame, sizeof(frame)) != 0);
+	}
+	CHECK(failures == 0);
+}
+
+static void testCorruption(void)
+{
+	// every single bit error and every burst of up to 16 bits in a KFP frame with its trailer
+	uint8_t frame[12 + CRC16_SIZE];
+	uint8_t i;
+	for (i = 0; i < 12; i++)
+	{
+		frame[i] = (uint8_t) Check_random();
+	}
+	uint16_t crc = Crc16_compute(frame, 12);
+	frame[12] = crc >> 8;
+	frame[13] = crc & 0xFF;
+
+	uint32_t missed = 0;
+	uint32_t tried = 0;
+	uint16_t start;
+	for (start = 0; start < 8 * sizeof(frame); start++)
+	{
+		uint8_t length;
+		for (length = 1; (length <= 16) && (start + length <= 8 * sizeof(frame)); length++)
+		{
+			// bursts start and end with a flipped bit, any pattern between
+			uint32_t pattern = (length == 1) ? 1 : ((1u << (length - 1)) | 1u | (Check_random() & ((1u << (length - 1)) - 1)));
+			uint8_t bad[sizeof(frame)];
+			memcpy(bad, frame, sizeof(frame));
+			uint8_t b;
+			for (b = 0; b < length; b++)
+			{
+				if (pattern & (1u << b))
+				{
+					uint16_t bit = start + b;
+					bad[bit / 8] ^= 0x80 >> (bit % 8);
+				}
+			}
+			missed += (Crc16_compute(bad, sizeof(bad)) == 0);
+			tried++;
+		}
+	}
+	CHECK(missed == 0);
+	printf("crc: %u bursts of up to 16 bits, %u missed\n", tried, missed);
+}
+
+/**
+ * \brief Fills a random KFP frame and appends its CRC
+ */
+static void randomFrame(uint8_t* frame)
+{
+	uint8_t i;
+	for (i = 0; i < KFP_BYTES; i++)
+	{
+		frame[i] = (uint8_t) Check_random();
+	}
+	uint16_t crc = Crc16_compute(frame, KFP_BYTES);
+	frame[KFP_BYTES] = crc >> 8;
+	frame[KFP_BYTES + 1] = crc & 0xFF;
+}
+
+static void testInjection(void)
+{
+	// flips distinct random bits anywhere in the frame and its trailer, 0 replaces the frame with noise
+	static const uint8_t flips[] = {2, 3, 4, 8, 0};
+	uint8_t n;
+	for (n = 0; n < sizeof(flips); n++)
+	{
+		uint32_t missed = 0;
+		uint32_t i;
+		for (i = 0; i < INJECTIONS; i++)
+		{
+			uint8_t frame[KFP_BYTES + CRC16_SIZE];
+			uint8_t bad[sizeof(frame)];
+			randomFrame(frame);
+			memcpy(bad, frame, sizeof(frame));
+			if (flips[n] == 0)
+			{
+				uint8_t b;
+				for (b = 0; b < sizeof(bad); b++)
+				{
+					bad[b] = (uint8_t) Check_random();
+				}
+			}
+			else
+			{
+				uint8_t done = 0;
+				while (done < flips[n])
+				{
+					uint8_t bit = Check_below(8 * sizeof(bad));
+					if (((bad[bit / 8] ^ frame[bit / 8]) & (0x80 >> (bit % 8))) == 0)
+					{
+						bad[bit / 8] ^= 0x80 >> (bit % 8);
+						done++;
+					}
+				}
+			}
+			missed += (memcmp(bad, frame, sizeof(frame)) != 0) && (Crc16_compute(bad, sizeof(bad)) == 0);
+		}
+
+		if (flips[n] == 0)
+		{
+			// chance alone passes one in 65536
+			CHECK(missed < 4 * INJECTIONS / 65536);
+			printf("crc: random frames, %u of %u missed, %.4f%% detected\n", missed, INJECTIONS,
+					100.0 - 100.0 * missed / INJECTIONS);
+		}
+		else
+		{
+			// distance 4 at this length, so up to 3 flips are always caught
+			if (flips[n] <= 3)
+			{
+				CHECK(missed == 0);
+			}
+			printf("crc: %u bit flips, %u of %u missed, %.4f%% detected\n", flips[n], missed, INJECTIONS,
+					100.0 - 100.0 * missed / INJECTIONS);
+		}
+	}
+}
+
+static double seconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void bench(void)
+{
+	static uint8_t buf[4096];
+	uint16_t i;
+	for (i = 0; i < sizeof(buf); i++)
+	{
+		buf[i] = (uint8_t) Check_random();
+	}
+
+	uint32_t passes = BENCH_BYTES / sizeof(buf);
+	uint16_t reference = CRC16_INIT;
+	uint16_t sliced = CRC16_INIT;
+	uint32_t p;
+
+	double start = seconds();
+	for (p = 0; p < passes; p++)
+	{
+		reference = referenceCrc(reference, buf, sizeof(buf));
+	}
+	double bitwise = seconds() - start;
+
+	start = seconds();
+	for (p = 0; p < passes; p++)
+	{
+		sliced = Crc16_update(sliced, buf, sizeof(buf));
+	}
+	double slice = seconds() - start;
+
+	CHECK(reference == sliced);
+	double mb = (double)BENCH_BYTES / 1e6;
+	printf("crc: bitwise %.1f MB/s, slice-by-4 %.1f MB/s\n", mb / bitwise, mb / slice);
+}
+
+static void benchFrame(void)
+{
+	// a frame's worth at a time, as the decoder and BtStack_push use it
+	static uint8_t frames[256][KFP_BYTES];
+	uint16_t i;
+	for (i = 0; i < 256; i++)
+	{
+		uint8_t b;
+		for (b = 0; b < KFP_BYTES; b++)
+		{
+			frames[i][b] = (uint8_t) Check_random();
+		}
+	}
+
+	uint16_t reference = 0;
+	uint16_t sliced = 0;
+	uint32_t f;
+	double start = seconds();
+	for (f = 0; f < BENCH_FRAMES; f++)
+	{
+		reference ^= referenceCrc(CRC16_INIT, frames[f & 0xFF], KFP_BYTES);
+	}
+	double bitwise = seconds() - start;
+
+	start = seconds();
+	for (f = 0; f < BENCH_FRAMES; f++)
+	{
+		sliced ^= Crc16_compute(frames[f & 0xFF], KFP_BYTES);
+	}
+	double slice = seconds() - start;
+
+	CHECK(reference == sliced);
+	printf("crc: %u byte frame, bitwise %.1f ns, slice-by-4 %.1f ns\n", KFP_BYTES,
+			bitwise * 1e9 / BENCH_FRAMES, slice * 1e9 / BENCH_FRAMES);
+}
+
+int main(void)
+{
+	testCheckValue();
+	testRandom();
+	testTrailer();
+	testCorruption();
+	testInjection();
+	bench();
+	benchFrame();
+
+	return CHECK_RESULT();
+}
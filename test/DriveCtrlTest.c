@@ -0,0 +1,396 @@
+/**
+ * \file DriveCtrlTest.c
+ * \brief Tests the drive control application on the host
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ *
+ * The control loop runs on the power management and inter board bus
+ * services over the I2C driver stand-in, and takes drive frames from btStack
+ * over the bluetooth UART stand-in. Most tests hold the SYS/BIOS clock and
+ * tick it themselves, so each update the power board sees can be checked
+ * against the slew limit and the timing measured is exact. The benchmark
+ * runs in real time with drive frames arriving in irregular bursts.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <ti/sysbios/BIOS.h>
+#include <ti/sysbios/knl/Task.h>
+
+#include "Check.h"
+#include "FakeBios.h"
+#include "FakeBtUart.h"
+#include "FakeI2C.h"
+#include "BtStack.h"
+#include "DriveCtrl.h"
+#include "PwrMgmt.h"
+
+#define PWRBOARD_ADDR 0x02		//! Address of the power board, as PwrMgmt.c
+#define DRV_PWR 101				//! Drive power component, as PwrMgmt.c
+#define DRV_YAW 102				//! Drive yaw component, as PwrMgmt.c
+#define RATE 100				//! Control loop rate of the stepped tests
+#define SLEW 400				//! Slew limit of the stepped tests
+#define STEP (SLEW / RATE)		//! Largest change of each update
+#define PERIOD_TICKS (1000000 / (RATE * FAKEBIOS_TICK_US))	//! Clock ticks between updates
+#define OVERRUN_PERIODS 3		//! Periods an update is held on the bus for
+#define BURST_FRAMES 10			//! Drive frames received between two ticks
+#define BENCH_RATE 200			//! Control loop rate of the benchmark
+#define BENCH_MS 1000			//! Length of the benchmark
+#define BENCH_BURST 20			//! Most drive frames in one burst of the benchmark
+#define BENCH_GAP_MS 40			//! Longest gap between bursts of the benchmark
+
+static volatile Bool autoComplete = FALSE;	//! Power board answers every transfer at once
+static volatile Bool feeding = FALSE;		//! Feeder keeps sending drive frames
+static volatile uint32_t framesFed = 0;		//! Drive frames sent by the feeder
+static volatile int8_t deliveredPower = 0;	//! Power of the last drive frame dispatched
+
+static Bool busBusy(void* arg)
+{
+	return FakeI2C_busy();
+}
+
+static Bool ticksAtLeast(void* arg)
+{
+	DriveCtrl_Stats stats;
+	DriveCtrl_getStats(&stats);
+	return stats.ticks >= *(uint32_t*)arg;
+}
+
+/**
+ * \brief Sees every frame dispatched, routed after the exact route of drive control
+ */
+static void deliveredFxn(const BtStack_Frame* frame)
+{
+	deliveredPower = (int8_t) frame->payload.b8[0];
+}
+
+static Bool deliveredPowerIs(void* arg)
+{
+	return deliveredPower == *(int8_t*)arg;
+}
+
+/**
+ * \brief Returns the transfer logged last, the one on the bus while it is busy
+ */
+static FakeI2C_Transfer lastTransfer(void)
+{
+	FakeI2C_Transfer log[FAKEI2C_LOG_SIZE];
+	uint16_t count = FakeI2C_log(log);
+	CHECK(count > 0);
+	if (count == 0)
+	{
+		memset(&log[0], 0, sizeof(log[0]));
+		return log[0];
+	}
+	return log[count - 1];
+}
+
+/**
+ * \brief Answers transfers while autoComplete is set, as the power board would
+ */
+static void completerFxn(UArg unused0, UArg unused1)
+{
+	while (TRUE)
+	{
+		if (autoComplete && FakeI2C_busy())
+		{
+			FakeI2C_complete(TRUE, NULL);
+		}
+		Task_sleep(1);
+	}
+}
+
+/**
+ * \brief Sends a drive frame from the module
+ */
+static void receiveDrive(int8_t power, int8_t yaw)
+{
+	BtStack_Frame frame;
+	memset(&frame, 0, sizeof(frame));
+	frame.id.b32 = DRIVECTRL_DEFAULT_ID;
+	frame.payload.b8[0] = (uint8_t) power;
+	frame.payload.b8[1] = (uint8_t) yaw;
+
+	uint8_t encoded[SLIP_WORST_SIZE(KFP_FRAME_SIZE)];
+	CHECK(FakeBtUart_receive(encoded, Slip_encode(encoded, frame.b8, KFP_FRAME_SIZE-2)));
+}
+
+/**
+ * \brief Sends bursts of drive frames at irregular times while feeding is set
+ */
+static void feederFxn(UArg unused0, UArg unused1)
+{
+	while (feeding)
+	{
+		uint8_t burst = 1 + Check_below(BENCH_BURST);
+		uint8_t i;
+		for (i = 0; i < burst; i++)
+		{
+			receiveDrive(Check_below(100), Check_below(100) - 50);
+			framesFed++;
+		}
+		Task_sleep(Check_below(BENCH_GAP_MS + 1));
+	}
+}
+
+/**
+ * \brief Advances the held clock by control periods
+ */
+static void runPeriods(uint8_t periods)
+{
+	uint16_t i;
+	for (i = 0; i < periods * PERIOD_TICKS; i++)
+	{
+		FakeBios_tick();
+	}
+}
+
+/**
+ * \brief Lets the clock run for a control period, then answers the update it sends
+ */
+static void expectUpdate(int8_t power, int8_t yaw)
+{
+	DriveCtrl_Stats stats;
+	DriveCtrl_getStats(&stats);
+	uint32_t want = stats.ticks + 1;
+
+	runPeriods(1);
+	CHECK(FakeBios_waitFor(busBusy, NULL, 1000));
+
+	// one write carries both, as PwrMgmt_drive
+	FakeI2C_Transfer t = lastTransfer();
+	uint8_t bytes[4] = {DRV_PWR, (uint8_t) power, DRV_YAW, (uint8_t) yaw};
+	CHECK((t.address == PWRBOARD_ADDR) && (t.writeCount == 4));
+	CHECK(memcmp(t.write, bytes, 4) == 0);
+	CHECK(FakeI2C_complete(TRUE, NULL));
+	CHECK(FakeBios_waitFor(ticksAtLeast, &want, 1000));
+}
+
+/**
+ * \brief Moves value towards goal by at most STEP, as the control loop should
+ */
+static int8_t towards(int8_t value, int8_t goal)
+{
+	if (goal - value > STEP)
+	{
+		return value + STEP;
+	}
+	if (value - goal > STEP)
+	{
+		return value - STEP;
+	}
+	return goal;
+}
+
+/**
+ * \brief Starts every service on a held clock, the control loop at rate and slew
+ */
+static void startServices(uint16_t hz, uint16_t perSecond)
+{
+	FakeI2C_reset();
+	FakeBtUart_reset();
+	autoComplete = FALSE;
+	CHECK(BtStack_clearSubscriptions() == 0);
+	CHECK(DriveCtrl_init(DRIVECTRL_DEFAULT_ID) == 0);
+	CHECK(BtStack_subscribe(0, 0, deliveredFxn) == 0);
+	deliveredPower = 0;
+	CHECK(BtStack_start() == 0);
+	CHECK(InterBus_start() == 0);
+	CHECK(PwrMgmt_setBatteryInterval(0) == 0);
+	CHECK(PwrMgmt_start() == 0);
+	CHECK(DriveCtrl_setRate(hz) == 0);
+	CHECK(DriveCtrl_setSlew(perSecond) == 0);
+	FakeBios_holdClock(TRUE);
+	CHECK(DriveCtrl_start() == 0);
+}
+
+static void stopServices(void)
+{
+	// the services sleep while they stop
+	FakeBios_holdClock(FALSE);
+	autoComplete = TRUE;
+	CHECK(DriveCtrl_stop() == 0);
+	CHECK(PwrMgmt_stop() == 0);
+	CHECK(InterBus_stop() == 0);
+	CHECK(BtStack_stop() == 0);
+	autoComplete = FALSE;
+}
+
+static void testConfig(void)
+{
+	CHECK(DriveCtrl_setRate(9) == -2);
+	CHECK(DriveCtrl_setRate(501) == -2);
+	CHECK(DriveCtrl_setRate(RATE) == 0);
+	CHECK(DriveCtrl_setSlew(SLEW) == 0);
+	CHECK(DriveCtrl_stop() == -1);
+
+	// without the power management service each tick counts as an error
+	FakeBios_holdClock(TRUE);
+	CHECK(DriveCtrl_start() == 0);
+	CHECK(DriveCtrl_start() == -1);
+	CHECK(DriveCtrl_setRate(RATE) == -1);
+	CHECK(DriveCtrl_setSlew(SLEW) == -1);
+	uint32_t want;
+	for (want = 1; want <= 2; want++)
+	{
+		runPeriods(1);
+		CHECK(FakeBios_waitFor(ticksAtLeast, &want, 1000));
+	}
+	DriveCtrl_Stats stats;
+	DriveCtrl_getStats(&stats);
+	CHECK((stats.ticks == 2) && (stats.errors == 2) && (stats.overruns == 0));
+	FakeBios_holdClock(FALSE);
+	CHECK(DriveCtrl_stop() == 0);
+	CHECK(DriveCtrl_stop() == -1);
+
+	// subscribing is only possible before btStack starts
+	FakeBtUart_reset();
+	CHECK(BtStack_start() == 0);
+	CHECK(DriveCtrl_init(DRIVECTRL_DEFAULT_ID) == -1);
+	CHECK(BtStack_stop() == 0);
+}
+
+static void testSlew(void)
+{
+	startServices(RATE, SLEW);
+
+	// the output ramps one step per update, in both directions
+	int8_t power = 0;
+	int8_t yaw = 0;
+	int8_t goals[3][2] = {{100, -50}, {-20, 50}, {0, 0}};
+	uint32_t updates = 0;
+	uint8_t g;
+	for (g = 0; g < 3; g++)
+	{
+		DriveCtrl_command(goals[g][0], goals[g][1]);
+		do
+		{
+			power = towards(power, goals[g][0]);
+			yaw = towards(yaw, goals[g][1]);
+			expectUpdate(power, yaw);
+			updates++;
+		} while ((power != goals[g][0]) || (yaw != goals[g][1]));
+	}
+
+	// the target is held once reached, still one update per tick
+	expectUpdate(0, 0);
+	updates++;
+	CHECK(FakeI2C_log(NULL) == updates);
+
+	// on the virtual clock every period is exact
+	DriveCtrl_Stats stats;
+	DriveCtrl_getStats(&stats);
+	CHECK((stats.ticks == updates) && (stats.overruns == 0) && (stats.errors == 0));
+	CHECK((stats.maxJitterUs == 0) && (stats.meanJitterUs == 0));
+
+	// ticks while an update is still on the bus are skipped and counted
+	DriveCtrl_command(STEP, 0);
+	runPeriods(1);
+	CHECK(FakeBios_waitFor(busBusy, NULL, 1000));
+	runPeriods(OVERRUN_PERIODS);
+	CHECK(FakeI2C_complete(TRUE, NULL));
+	uint32_t want = updates + 1;
+	CHECK(FakeBios_waitFor(ticksAtLeast, &want, 1000));
+	expectUpdate(STEP, 0);
+	DriveCtrl_getStats(&stats);
+	CHECK((stats.ticks == updates + 2) && (stats.overruns == OVERRUN_PERIODS));
+	CHECK(stats.maxJitterUs == OVERRUN_PERIODS * PERIOD_TICKS * FAKEBIOS_TICK_US);
+
+	// no limit moves straight to the target
+	stopServices();
+	startServices(RATE, 0);
+	DriveCtrl_command(-100, 100);
+	expectUpdate(-100, 100);
+	stopServices();
+}
+
+static void testHalt(void)
+{
+	startServices(RATE, SLEW);
+	DriveCtrl_command(100, 100);
+	expectUpdate(STEP, STEP);
+	expectUpdate(2 * STEP, 2 * STEP);
+
+	// a halt drops the output without ramping down, commands are ignored until released
+	DriveCtrl_halt();
+	expectUpdate(0, 0);
+	DriveCtrl_command(50, 50);
+	expectUpdate(0, 0);
+	DriveCtrl_Stats stats;
+	DriveCtrl_getStats(&stats);
+	CHECK(stats.ignored == 1);
+
+	DriveCtrl_release();
+	DriveCtrl_command(50, 50);
+	expectUpdate(STEP, STEP);
+	stopServices();
+}
+
+static void testFrames(void)
+{
+	// a burst of drive frames between two ticks makes one update, with the latest
+	startServices(RATE, 0);
+	int8_t n;
+	for (n = 1; n <= BURST_FRAMES; n++)
+	{
+		receiveDrive(n, -n);
+	}
+	int8_t latest = BURST_FRAMES;
+	CHECK(FakeBios_waitFor(deliveredPowerIs, &latest, 1000));
+	expectUpdate(BURST_FRAMES, -BURST_FRAMES);
+
+	// no frame, the command stays
+	expectUpdate(BURST_FRAMES, -BURST_FRAMES);
+	CHECK(FakeI2C_log(NULL) == 2);
+	stopServices();
+}
+
+static void benchLoop(void)
+{
+	// the bus sees the loop rate however the frames arrive
+	startServices(BENCH_RATE, 0);
+	FakeBios_holdClock(FALSE);
+	autoComplete = TRUE;
+	framesFed = 0;
+	feeding = TRUE;
+	Task_Params params;
+	Task_Params_init(&params);
+	Task_Handle feeder = Task_create(feederFxn, &params, NULL);
+	CHECK(feeder != NULL);
+
+	Task_sleep(BENCH_MS);
+	DriveCtrl_Stats stats;
+	DriveCtrl_getStats(&stats);
+	uint16_t updates = FakeI2C_log(NULL);
+	feeding = FALSE;
+	Task_delete(&feeder);
+	stopServices();
+
+	uint32_t expected = BENCH_MS * BENCH_RATE / 1000;
+	printf("drive: %u frames in %u ms, %u updates at %u Hz, %u overruns, jitter mean %u us, max %u us\n",
+			(unsigned) framesFed, BENCH_MS, (unsigned) stats.ticks, BENCH_RATE, (unsigned) stats.overruns,
+			(unsigned) stats.meanJitterUs, (unsigned) stats.maxJitterUs);
+	CHECK((stats.ticks + stats.overruns >= expected * 9 / 10) && (stats.ticks + stats.overruns <= expected + 1));
+	CHECK((updates >= stats.ticks) && (updates <= stats.ticks + 1));
+	CHECK(stats.errors == 0);
+	CHECK(stats.meanJitterUs < 1000000 / BENCH_RATE);
+}
+
+int main(void)
+{
+	Task_Params params;
+	Task_Params_init(&params);
+	Task_Handle completer = Task_create(completerFxn, &params, NULL);
+	CHECK(completer != NULL);
+
+	testConfig();
+	testSlew();
+	testHalt();
+	testFrames();
+	benchLoop();
+
+	Task_delete(&completer);
+	return CHECK_RESULT();
+}
@@ -0,0 +1,466 @@
+/**
+ * \file EStopTest.c
+ * \brief Tests the emergency stop fast path on the host
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ *
+ * Stop frames are received over the bluetooth UART stand-in and the stop
+ * write is seen on the I2C driver stand-in, with drive control, power
+ * management and the inter board bus in between. The stepped test holds
+ * the SYS/BIOS clock so the latency of a stop behind a transfer already on
+ * the bus is exact. The simulation runs in real time on a busy bus and
+ * compares the fast path with a stop handled by a subscriber task, as
+ * before.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <xdc/runtime/Timestamp.h>
+#include <ti/sysbios/BIOS.h>
+#include <ti/sysbios/knl/Task.h>
+
+#include "Check.h"
+#include "FakeBios.h"
+#include "FakeBtUart.h"
+#include "FakeI2C.h"
+#include "BtStack.h"
+#include "DriveCtrl.h"
+#include "EStop.h"
+#include "PwrMgmt.h"
+
+#define DRV_PWR 101				//! Drive power component, as PwrMgmt.c
+#define DRV_YAW 102				//! Drive yaw component, as PwrMgmt.c
+#define RATE 100				//! Control loop rate
+#define PERIOD_TICKS (1000000 / (RATE * FAKEBIOS_TICK_US))	//! Clock ticks between updates
+#define HOLD_TICKS 3			//! Ticks a transfer stays on the bus after a stop arrives
+#define MAX_DONE 16				//! Most completions recorded
+#define TASK_STOP_ID 0x00000053	//! Stop frames handled by a subscriber task, as before the fast path
+#define STOPS 20				//! Stops sent down each path by the simulation
+#define GAP_MIN_MS 10			//! Shortest gap between stops of the simulation
+#define GAP_MAX_MS 30			//! Longest gap between stops of the simulation
+#define BATTERY_MS 10			//! Battery poll interval of the simulation
+#define LOAD_MS 3				//! Interval of weapon commands and telemetry snapshots of the simulation
+
+static int8_t doneStatus[MAX_DONE];
+static volatile uint8_t doneCount = 0;
+
+static volatile Bool autoComplete = FALSE;	//! Power board answers every transfer at once
+static volatile Bool loading = FALSE;		//! Loader keeps telemetry on the bus
+static volatile uint32_t delivered = 0;		//! Frames dispatched since btStack started
+static volatile uint32_t taskRetries = 0;	//! Stops the subscriber task found the bus queue full for
+
+static void doneFxn(PwrMgmt_Token token, int8_t status, const uint8_t* read, void* arg)
+{
+	if (doneCount < MAX_DONE)
+	{
+		doneStatus[doneCount++] = status;
+	}
+}
+
+/**
+ * \brief Stops the motors from the dispatch task, as stop frames were handled before the fast path
+ */
+static void taskStopFxn(const BtStack_Frame* frame)
+{
+	// a full bus queue refuses the write, a lost stop would never show on the bus
+	while (PwrMgmt_drive(0, 0) == -2)
+	{
+		taskRetries++;
+		Task_sleep(1);
+	}
+}
+
+static Bool busBusy(void* arg)
+{
+	return FakeI2C_busy();
+}
+
+static Bool ticksAtLeast(void* arg)
+{
+	DriveCtrl_Stats stats;
+	DriveCtrl_getStats(&stats);
+	return stats.ticks >= *(uint32_t*)arg;
+}
+
+/**
+ * \brief Counts every frame dispatched, routed after the exact routes of the applications
+ */
+static void deliveredFxn(const BtStack_Frame* frame)
+{
+	delivered++;
+}
+
+static Bool deliveredAtLeast(void* arg)
+{
+	return delivered >= *(uint32_t*)arg;
+}
+
+/**
+ * \brief Returns whether a transfer is the write which stops the motors
+ */
+static Bool isStop(const FakeI2C_Transfer* t)
+{
+	static const uint8_t stopBytes[4] = {DRV_PWR, 0, DRV_YAW, 0};
+	return (t->writeCount == 4) && (memcmp(t->write, stopBytes, 4) == 0);
+}
+
+/**
+ * \brief Returns the transfer logged last, the one on the bus while it is busy
+ */
+static FakeI2C_Transfer lastTransfer(void)
+{
+	static FakeI2C_Transfer log[FAKEI2C_LOG_SIZE];
+	UInt key = Task_disable();
+	uint16_t count = FakeI2C_log(log);
+	FakeI2C_Transfer t = log[(count > 0) ? count - 1 : 0];
+	Task_restore(key);
+	CHECK(count > 0);
+	return t;
+}
+
+/**
+ * \brief Answers transfers while autoComplete is set, as the power board would
+ */
+static void completerFxn(UArg unused0, UArg unused1)
+{
+	while (TRUE)
+	{
+		if (autoComplete && FakeI2C_busy())
+		{
+			uint8_t read[INTERBUS_MAX_READ];
+			memset(read, 0, sizeof(read));
+			FakeI2C_complete(TRUE, read);
+		}
+		Task_sleep(1);
+	}
+}
+
+/**
+ * \brief Keeps weapon commands and telemetry snapshots queued for the bus while loading is set
+ */
+static void loaderFxn(UArg unused0, UArg unused1)
+{
+	PwrMgmt_Command weapon = {WEAPON_1, 0};
+	while (loading)
+	{
+		weapon.magnitude ^= 1;
+		PwrMgmt_batchAsync(&weapon, 1, NULL, NULL);
+		PwrMgmt_telemetryAsync(NULL, NULL);
+		Task_sleep(LOAD_MS);
+	}
+}
+
+/**
+ * \brief Encodes a frame with power and yaw in its payload
+ *
+ * \return No. of bytes encoded
+ */
+static uint16_t encodeFrame(uint8_t* out, uint32_t id, int8_t power, int8_t yaw)
+{
+	BtStack_Frame frame;
+	memset(&frame, 0, sizeof(frame));
+	frame.id.b32 = id;
+	frame.payload.b8[0] = (uint8_t) power;
+	frame.payload.b8[1] = (uint8_t) yaw;
+	return Slip_encode(out, frame.b8, KFP_FRAME_SIZE-2);
+}
+
+/**
+ * \brief Sends a frame from the module with power and yaw in its payload
+ *
+ * \return Timestamp of the END byte
+ */
+static uint32_t receiveFrame(uint32_t id, int8_t power, int8_t yaw)
+{
+	uint8_t encoded[SLIP_WORST_SIZE(KFP_FRAME_SIZE)];
+	uint16_t len = encodeFrame(encoded, id, power, yaw);
+	uint32_t stamp = Timestamp_get32();
+	CHECK(FakeBtUart_receive(encoded, len));
+	return stamp;
+}
+
+/**
+ * \brief Advances the held clock by ticks
+ */
+static void runTicks(uint16_t ticks)
+{
+	uint16_t i;
+	for (i = 0; i < ticks; i++)
+	{
+		FakeBios_tick();
+	}
+}
+
+/**
+ * \brief Lets the held clock run for a control period and checks the update it sends
+ */
+static void expectUpdate(int8_t power, int8_t yaw, Bool complete)
+{
+	DriveCtrl_Stats stats;
+	DriveCtrl_getStats(&stats);
+	uint32_t want = stats.ticks + 1;
+
+	runTicks(PERIOD_TICKS);
+	CHECK(FakeBios_waitFor(busBusy, NULL, 1000));
+	FakeI2C_Transfer t = lastTransfer();
+	uint8_t bytes[4] = {DRV_PWR, (uint8_t) power, DRV_YAW, (uint8_t) yaw};
+	CHECK((t.writeCount == 4) && (memcmp(t.write, bytes, 4) == 0));
+	if (complete)
+	{
+		CHECK(FakeI2C_complete(TRUE, NULL));
+		CHECK(FakeBios_waitFor(ticksAtLeast, &want, 1000));
+	}
+}
+
+/**
+ * \brief Starts every service with stop frames on the fast path, the clock held if asked
+ */
+static void startServices(uint16_t batteryMs, Bool hold)
+{
+	FakeI2C_reset();
+	FakeBtUart_reset();
+	autoComplete = FALSE;
+	doneCount = 0;
+	CHECK(BtStack_clearSubscriptions() == 0);
+	CHECK(DriveCtrl_init(DRIVECTRL_DEFAULT_ID) == 0);
+	CHECK(EStop_init(KFP_ESTOP_ID) == 0);
+	CHECK(BtStack_subscribe(TASK_STOP_ID, FRAMEROUTER_EXACT, taskStopFxn) == 0);
+	CHECK(BtStack_subscribe(0, 0, deliveredFxn) == 0);
+	delivered = 0;
+	CHECK(BtStack_start() == 0);
+	CHECK(InterBus_start() == 0);
+	CHECK(PwrMgmt_setBatteryInterval(batteryMs) == 0);
+	CHECK(PwrMgmt_start() == 0);
+	CHECK(DriveCtrl_setRate(RATE) == 0);
+	CHECK(DriveCtrl_setSlew(0) == 0);
+	FakeBios_holdClock(hold);
+	CHECK(DriveCtrl_start() == 0);
+}
+
+static void stopServices(void)
+{
+	// the services sleep while they stop
+	FakeBios_holdClock(FALSE);
+	autoComplete = TRUE;
+	CHECK(DriveCtrl_stop() == 0);
+	CHECK(PwrMgmt_stop() == 0);
+	CHECK(InterBus_stop() == 0);
+	CHECK(BtStack_stop() == 0);
+	autoComplete = FALSE;
+}
+
+static void testInit(void)
+{
+	// the fast path is set up before btStack starts
+	FakeBtUart_reset();
+	CHECK(BtStack_start() == 0);
+	CHECK(EStop_init(KFP_ESTOP_ID) == -1);
+	CHECK(BtStack_stop() == 0);
+
+	// a stop without the power management service is counted as refused
+	FakeI2C_reset();
+	CHECK(BtStack_clearSubscriptions() == 0);
+	CHECK(EStop_init(KFP_ESTOP_ID) == 0);
+	CHECK(BtStack_subscribe(0, 0, deliveredFxn) == 0);
+	delivered = 0;
+	CHECK(BtStack_start() == 0);
+	receiveFrame(KFP_ESTOP_ID, 0, 0);
+	EStop_Stats stats;
+	EStop_getStats(&stats);
+	CHECK((stats.triggers == 1) && (stats.refused == 1));
+	CHECK(FakeI2C_log(NULL) == 0);
+	uint32_t want = 1;
+	CHECK(FakeBios_waitFor(deliveredAtLeast, &want, 1000));
+	CHECK(BtStack_stop() == 0);
+}
+
+static void testPreempt(void)
+{
+	startServices(0, TRUE);
+
+	// a drive update on the bus, with more waiting behind it
+	DriveCtrl_command(50, 50);
+	expectUpdate(50, 50, FALSE);
+	PwrMgmt_Command weapon = {WEAPON_1, 1};
+	CHECK(PwrMgmt_driveAsync(60, 60, doneFxn, NULL) > 0);
+	CHECK(PwrMgmt_batchAsync(&weapon, 1, doneFxn, NULL) > 0);
+	CHECK(PwrMgmt_batteryAsync(doneFxn, NULL) > 0);
+
+	// a drive frame then two stops in one block, handled before any task runs
+	uint8_t block[3 * SLIP_WORST_SIZE(KFP_FRAME_SIZE)];
+	uint16_t len = encodeFrame(block, DRIVECTRL_DEFAULT_ID, 70, 70);
+	len += encodeFrame(&block[len], KFP_ESTOP_ID, 0, 0);
+	len += encodeFrame(&block[len], KFP_ESTOP_ID, 0, 0);
+	CHECK(FakeBtUart_receive(block, len));
+	EStop_Stats stats;
+	EStop_getStats(&stats);
+	CHECK((stats.triggers == 2) && (stats.refused == 0));
+
+	// the waiting drive command is cancelled, the one on the bus is not cut short
+	CHECK((doneCount == 1) && (doneStatus[0] == -2));
+	CHECK(FakeI2C_log(NULL) == 1);
+
+	// the stop is the next write, as soon as the bus is free
+	runTicks(HOLD_TICKS);
+	CHECK(FakeI2C_complete(TRUE, NULL));
+	FakeI2C_Transfer t = lastTransfer();
+	CHECK(isStop(&t));
+	EStop_getStats(&stats);
+	CHECK(stats.lastLatencyUs == HOLD_TICKS * FAKEBIOS_TICK_US);
+	CHECK(stats.maxLatencyUs == HOLD_TICKS * FAKEBIOS_TICK_US);
+
+	// then the rest of the queue, once
+	CHECK(FakeI2C_complete(TRUE, NULL));
+	CHECK(FakeI2C_complete(TRUE, NULL));
+	CHECK(FakeI2C_complete(TRUE, NULL));
+	CHECK(!FakeI2C_busy());
+	FakeI2C_Transfer log[FAKEI2C_LOG_SIZE];
+	CHECK(FakeI2C_log(log) == 4);
+	CHECK((log[2].write[0] != DRV_PWR) && (log[3].write[0] != DRV_PWR));
+
+	// the drive frame received ahead of the stop is ignored, the output drops at once
+	uint32_t dispatched = 3;
+	CHECK(FakeBios_waitFor(deliveredAtLeast, &dispatched, 1000));
+	expectUpdate(0, 0, TRUE);
+	DriveCtrl_Stats driveStats;
+	DriveCtrl_getStats(&driveStats);
+	CHECK(driveStats.ignored == 1);
+
+	// a drive frame after the stop moves the vehicle again
+	receiveFrame(DRIVECTRL_DEFAULT_ID, 30, 30);
+	dispatched = 4;
+	CHECK(FakeBios_waitFor(deliveredAtLeast, &dispatched, 1000));
+	expectUpdate(30, 30, TRUE);
+
+	// on an idle bus the stop is written from the reception interrupt itself
+	receiveFrame(KFP_ESTOP_ID, 0, 0);
+	CHECK(FakeI2C_busy());
+	t = lastTransfer();
+	CHECK(isStop(&t));
+	EStop_getStats(&stats);
+	CHECK((stats.triggers == 3) && (stats.lastLatencyUs == 0));
+	CHECK(FakeI2C_complete(TRUE, NULL));
+
+	InterBus_BusStats busStats;
+	InterBus_getBusStats(&busStats);
+	CHECK((busStats.urgent == 2) && (busStats.cancelled == 1));
+	stopServices();
+}
+
+/**
+ * \brief Sends a stop at a random gap after a drive frame which keeps the vehicle moving
+ *
+ * \return Time from the END byte until the stop was put on the bus, UINT32_MAX if it never was
+ */
+static uint32_t sendStop(uint32_t id)
+{
+	receiveFrame(DRIVECTRL_DEFAULT_ID, 1 + Check_below(99), 0);
+	Task_sleep(GAP_MIN_MS + Check_below(GAP_MAX_MS - GAP_MIN_MS + 1));
+
+	// the busy bus would fill the log over a whole run
+	FakeI2C_clearLog();
+	uint32_t sent = receiveFrame(id, 0, 0);
+	uint16_t waited;
+	for (waited = 0; waited < 1000; waited++)
+	{
+		static FakeI2C_Transfer log[FAKEI2C_LOG_SIZE];
+		uint16_t count = FakeI2C_log(log);
+		uint16_t i;
+		for (i = 0; i < count; i++)
+		{
+			if (isStop(&log[i]))
+			{
+				return log[i].stamp - sent;
+			}
+		}
+		Task_sleep(1);
+	}
+	return UINT32_MAX;
+}
+
+static int compareLatency(const void* a, const void* b)
+{
+	uint32_t x = *(const uint32_t*) a;
+	uint32_t y = *(const uint32_t*) b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * \brief Sorts latencies and finds their mean, median and max
+ */
+static void summarise(uint32_t* latency, uint32_t* mean, uint32_t* median, uint32_t* max)
+{
+	qsort(latency, STOPS, sizeof(uint32_t), compareLatency);
+	uint64_t total = 0;
+	uint8_t n;
+	for (n = 0; n < STOPS; n++)
+	{
+		total += latency[n];
+	}
+	*mean = total / STOPS;
+	*median = latency[STOPS / 2];
+	*max = latency[STOPS - 1];
+}
+
+static void benchStop(void)
+{
+	// drive updates, battery polls, weapon commands and telemetry snapshots keep the bus busy
+	startServices(BATTERY_MS, FALSE);
+	autoComplete = TRUE;
+	loading = TRUE;
+	taskRetries = 0;
+	Task_Params params;
+	Task_Params_init(&params);
+	Task_Handle loader = Task_create(loaderFxn, &params, NULL);
+	CHECK(loader != NULL);
+
+	// the paths take turns, so both see the same load from the rest of the host
+	uint32_t taskLatency[STOPS];
+	uint32_t fastLatency[STOPS];
+	uint8_t n;
+	for (n = 0; n < STOPS; n++)
+	{
+		taskLatency[n] = sendStop(TASK_STOP_ID);
+		CHECK(taskLatency[n] != UINT32_MAX);
+		fastLatency[n] = sendStop(KFP_ESTOP_ID);
+		CHECK(fastLatency[n] != UINT32_MAX);
+	}
+
+	loading = FALSE;
+	Task_delete(&loader);
+	EStop_Stats stats;
+	EStop_getStats(&stats);
+	stopServices();
+
+	uint32_t taskMean, taskMedian, taskMax, fastMean, fastMedian, fastMax;
+	summarise(taskLatency, &taskMean, &taskMedian, &taskMax);
+	summarise(fastLatency, &fastMean, &fastMedian, &fastMax);
+	printf("estop: END byte to stop write, fast path mean %u us, median %u us, max %u us, "
+			"subscriber task mean %u us, median %u us, max %u us, %u retries on a full queue\n",
+			(unsigned) fastMean, (unsigned) fastMedian, (unsigned) fastMax,
+			(unsigned) taskMean, (unsigned) taskMedian, (unsigned) taskMax, (unsigned) taskRetries);
+	CHECK((stats.triggers == STOPS) && (stats.refused == 0));
+	CHECK(stats.maxLatencyUs <= fastMax);
+
+	// most stops find the bus free or wait less than the tick of the transfer already on it,
+	// host scheduling is as coarse as the gap to the task path so that is only reported
+	CHECK(fastMedian < FAKEBIOS_TICK_US);
+}
+
+int main(void)
+{
+	Task_Params params;
+	Task_Params_init(&params);
+	Task_Handle completer = Task_create(completerFxn, &params, NULL);
+	CHECK(completer != NULL);
+
+	testInit();
+	testPreempt();
+	benchStop();
+
+	Task_delete(&completer);
+	return CHECK_RESULT();
+}
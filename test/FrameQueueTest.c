@@ -0,0 +1,399 @@
+/**
+ * \file FrameQueueTest.c
+ * \brief Tests the bounded KFP frame queue on the host
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ *
+ * Covers ordering, each drop policy, coalescing of state frames, sparing
+ * of kept frames and get timeouts, then runs a producer task against several dispatch-like
+ * worker tasks.
+ */
+
+#include <string.h>
+
+#include <ti/sysbios/BIOS.h>
+#include <ti/sysbios/hal/Hwi.h>
+#include <ti/sysbios/knl/Clock.h>
+#include <ti/sysbios/knl/Task.h>
+
+#include "Check.h"
+#include "FakeBios.h"
+#include "FrameQueue.h"
+
+#define DEPTH 8					//! Slots of the queues under test
+#define WORKERS 4				//! Worker tasks taking from the shared queue
+#define WORKER_FRAMES 20000		//! Frames put for the workers
+
+static BtStack_Frame slots[DEPTH];
+static FrameQueue queue;
+
+/**
+ * \brief Makes a frame carrying an ID and a sequence number
+ */
+static BtStack_Frame makeFrame(uint32_t id, uint32_t seq)
+{
+	BtStack_Frame frame;
+	memset(&frame, 0, sizeof(frame));
+	frame.id.b32 = id;
+	frame.payload.b32[0] = seq;
+	return frame;
+}
+
+static void testOrder(void)
+{
+	CHECK(FrameQueue_create(&queue, slots, DEPTH, FRAMEQUEUE_DROP_OLDEST) == 0);
+
+	// several laps of the slots
+	uint32_t seq;
+	for (seq = 0; seq < 5 * DEPTH; seq += 3)
+	{
+		uint32_t i;
+		for (i = 0; i < 3; i++)
+		{
+			BtStack_Frame frame = makeFrame(1, seq + i);
+			CHECK(FrameQueue_put(&queue, &frame) == 0);
+		}
+		for (i = 0; i < 3; i++)
+		{
+			BtStack_Frame frame;
+			CHECK(FrameQueue_get(&queue, &frame, BIOS_NO_WAIT));
+			CHECK(frame.payload.b32[0] == seq + i);
+		}
+	}
+
+	FrameQueue_Stats stats;
+	FrameQueue_getStats(&queue, &stats);
+	CHECK(stats.drops == 0);
+	CHECK(stats.highWater == 3);
+	FrameQueue_delete(&queue);
+}
+
+static void testDropOldest(void)
+{
+	CHECK(FrameQueue_create(&queue, slots, DEPTH, FRAMEQUEUE_DROP_OLDEST) == 0);
+
+	uint32_t seq;
+	for (seq = 0; seq < DEPTH + 3; seq++)
+	{
+		BtStack_Frame frame = makeFrame(1, seq);
+		CHECK(FrameQueue_put(&queue, &frame) == 0);
+	}
+
+	// the three oldest made way
+	for (seq = 3; seq < DEPTH + 3; seq++)
+	{
+		BtStack_Frame frame;
+		CHECK(FrameQueue_get(&queue, &frame, BIOS_NO_WAIT));
+		CHECK(frame.payload.b32[0] == seq);
+	}
+	BtStack_Frame frame;
+	CHECK(!FrameQueue_get(&queue, &frame, BIOS_NO_WAIT));
+
+	FrameQueue_Stats stats;
+	FrameQueue_getStats(&queue, &stats);
+	CHECK(stats.puts == DEPTH + 3);
+	CHECK(stats.drops == 3);
+	CHECK(stats.highWater == DEPTH);
+	FrameQueue_delete(&queue);
+}
+
+static void testDropNewest(void)
+{
+	CHECK(FrameQueue_create(&queue, slots, DEPTH, FRAMEQUEUE_DROP_NEWEST) == 0);
+
+	uint32_t seq;
+	for (seq = 0; seq < DEPTH + 3; seq++)
+	{
+		BtStack_Frame frame = makeFrame(1, seq);
+		CHECK(FrameQueue_put(&queue, &frame) == ((seq < DEPTH) ? 0 : -1));
+	}
+
+	for (seq = 0; seq < DEPTH; seq++)
+	{
+		BtStack_Frame frame;
+		CHECK(FrameQueue_get(&queue, &frame, BIOS_NO_WAIT));
+		CHECK(frame.payload.b32[0] == seq);
+	}
+
+	FrameQueue_Stats stats;
+	FrameQueue_getStats(&queue, &stats);
+	CHECK(stats.drops == 3);
+	FrameQueue_delete(&queue);
+}
+
+/**
+ * \brief Takes every queued frame and checks their IDs and sequence numbers
+ */
+static void expectQueued(const uint32_t* ids, const uint32_t* seqs, uint8_t count)
+{
+	uint8_t i;
+	for (i = 0; i < count; i++)
+	{
+		BtStack_Frame frame;
+		CHECK(FrameQueue_get(&queue, &frame, BIOS_NO_WAIT));
+		CHECK(frame.id.b32 == ids[i]);
+		CHECK(frame.payload.b32[0] == seqs[i]);
+	}
+	BtStack_Frame frame;
+	CHECK(!FrameQueue_get(&queue, &frame, BIOS_NO_WAIT));
+}
+
+static void testCoalesce(void)
+{
+	static const uint32_t stateIds[2] = {10, 20};
+	CHECK(FrameQueue_create(&queue, slots, DEPTH, FRAMEQUEUE_DROP_OLDEST) == 0);
+	FrameQueue_setStateIds(&queue, stateIds, 2);
+
+	// a newer state frame takes the older one's place, events always queue
+	static const uint32_t putIds[7] = {10, 1, 10, 20, 1, 10, 20};
+	uint32_t seq;
+	for (seq = 0; seq < 7; seq++)
+	{
+		BtStack_Frame frame = makeFrame(putIds[seq], seq);
+		CHECK(FrameQueue_put(&queue, &frame) == 0);
+	}
+
+	FrameQueue_Stats stats;
+	FrameQueue_getStats(&queue, &stats);
+	CHECK(stats.puts == 7);
+	CHECK(stats.coalesced == 3);
+	CHECK(stats.highWater == 4);
+
+	static const uint32_t ids[4] = {10, 1, 20, 1};
+	static const uint32_t seqs[4] = {5, 1, 6, 4};
+	expectQueued(ids, seqs, 4);
+
+	// taken state frames are not coalesced with
+	BtStack_Frame frame = makeFrame(10, 7);
+	CHECK(FrameQueue_put(&queue, &frame) == 0);
+	static const uint32_t againIds[1] = {10};
+	static const uint32_t againSeqs[1] = {7};
+	expectQueued(againIds, againSeqs, 1);
+	FrameQueue_delete(&queue);
+}
+
+static void testCoalesceFull(void)
+{
+	// a full queue drops nothing for a state frame it already holds, whatever the policy
+	static const uint32_t stateIds[1] = {10};
+	static const FrameQueue_Policy policies[3] = {FRAMEQUEUE_DROP_OLDEST, FRAMEQUEUE_DROP_NEWEST, FRAMEQUEUE_BLOCK};
+
+	uint8_t p;
+	for (p = 0; p < 3; p++)
+	{
+		CHECK(FrameQueue_create(&queue, slots, DEPTH, policies[p]) == 0);
+		FrameQueue_setStateIds(&queue, stateIds, 1);
+
+		uint32_t ids[DEPTH];
+		uint32_t seqs[DEPTH];
+		uint32_t seq;
+		for (seq = 0; seq < DEPTH; seq++)
+		{
+			ids[seq] = (seq == 2) ? 10 : 1;
+			seqs[seq] = seq;
+			BtStack_Frame frame = makeFrame(ids[seq], seq);
+			CHECK(FrameQueue_put(&queue, &frame) == 0);
+		}
+
+		// would block or drop if it needed a slot
+		BtStack_Frame frame = makeFrame(10, 100);
+		CHECK(FrameQueue_put(&queue, &frame) == 0);
+		seqs[2] = 100;
+
+		FrameQueue_Stats stats;
+		FrameQueue_getStats(&queue, &stats);
+		CHECK(stats.drops == 0);
+		CHECK(stats.coalesced == 1);
+		expectQueued(ids, seqs, DEPTH);
+		FrameQueue_delete(&queue);
+	}
+}
+
+static void testKept(void)
+{
+	static const uint32_t keptIds[1] = {50};
+
+	// the oldest frame which is not kept makes way, the rest keep their order
+	CHECK(FrameQueue_create(&queue, slots, DEPTH, FRAMEQUEUE_DROP_OLDEST) == 0);
+	FrameQueue_setKeptIds(&queue, keptIds, 1);
+
+	uint32_t ids[DEPTH];
+	uint32_t seqs[DEPTH];
+	uint32_t seq;
+	for (seq = 0; seq < DEPTH; seq++)
+	{
+		uint32_t id = ((seq == 0) || (seq == 2)) ? 50 : 1;
+		BtStack_Frame frame = makeFrame(id, seq);
+		CHECK(FrameQueue_put(&queue, &frame) == 0);
+	}
+	BtStack_Frame frame = makeFrame(1, 100);
+	CHECK(FrameQueue_put(&queue, &frame) == 0);
+
+	uint8_t n = 0;
+	for (seq = 0; seq < DEPTH; seq++)
+	{
+		if (seq != 1)
+		{
+			ids[n] = ((seq == 0) || (seq == 2)) ? 50 : 1;
+			seqs[n++] = seq;
+		}
+	}
+	ids[n] = 1;
+	seqs[n++] = 100;
+	expectQueued(ids, seqs, n);
+
+	FrameQueue_Stats stats;
+	FrameQueue_getStats(&queue, &stats);
+	CHECK(stats.drops == 1);
+	FrameQueue_delete(&queue);
+
+	// dropping the newest still queues a kept frame, the oldest other frame makes way
+	CHECK(FrameQueue_create(&queue, slots, DEPTH, FRAMEQUEUE_DROP_NEWEST) == 0);
+	FrameQueue_setKeptIds(&queue, keptIds, 1);
+	for (seq = 0; seq < DEPTH; seq++)
+	{
+		frame = makeFrame(1, seq);
+		CHECK(FrameQueue_put(&queue, &frame) == 0);
+	}
+	frame = makeFrame(50, 100);
+	CHECK(FrameQueue_put(&queue, &frame) == 0);
+	frame = makeFrame(1, 101);
+	CHECK(FrameQueue_put(&queue, &frame) == -1);
+
+	for (seq = 1; seq < DEPTH; seq++)
+	{
+		ids[seq - 1] = 1;
+		seqs[seq - 1] = seq;
+	}
+	ids[DEPTH - 1] = 50;
+	seqs[DEPTH - 1] = 100;
+	expectQueued(ids, seqs, DEPTH);
+	FrameQueue_delete(&queue);
+
+	// nothing makes way once only kept frames are queued
+	CHECK(FrameQueue_create(&queue, slots, DEPTH, FRAMEQUEUE_DROP_OLDEST) == 0);
+	FrameQueue_setKeptIds(&queue, keptIds, 1);
+	for (seq = 0; seq < DEPTH; seq++)
+	{
+		ids[seq] = 50;
+		seqs[seq] = seq;
+		frame = makeFrame(50, seq);
+		CHECK(FrameQueue_put(&queue, &frame) == 0);
+	}
+	frame = makeFrame(50, 100);
+	CHECK(FrameQueue_put(&queue, &frame) == -1);
+	frame = makeFrame(1, 101);
+	CHECK(FrameQueue_put(&queue, &frame) == -1);
+
+	FrameQueue_getStats(&queue, &stats);
+	CHECK(stats.drops == 2);
+	expectQueued(ids, seqs, DEPTH);
+	FrameQueue_delete(&queue);
+}
+
+static void testTimeout(void)
+{
+	CHECK(FrameQueue_create(&queue, slots, DEPTH, FRAMEQUEUE_DROP_OLDEST) == 0);
+
+	BtStack_Frame frame;
+	UInt32 start = Clock_getTicks();
+	CHECK(!FrameQueue_get(&queue, &frame, 20));
+	CHECK(Clock_getTicks() - start >= 20);
+	FrameQueue_delete(&queue);
+}
+
+static volatile uint32_t taken[WORKERS];		//! Frames taken by each worker
+static volatile uint32_t seen[WORKER_FRAMES];	//! Times each sequence number was taken
+static volatile Bool workersStop;
+
+static void workerFxn(UArg index, UArg unused)
+{
+	BtStack_Frame frame;
+	while (!workersStop)
+	{
+		if (FrameQueue_get(&queue, &frame, 5))
+		{
+			UInt key = Hwi_disable();
+			seen[frame.payload.b32[0]]++;
+			taken[index]++;
+			Hwi_restore(key);
+		}
+	}
+
+	// parks until deleted, as dispatch tasks do
+	while (TRUE)
+	{
+		Task_sleep(1000);
+	}
+}
+
+static Bool allTaken(void* arg)
+{
+	uint32_t total = 0;
+	uint8_t i;
+	for (i = 0; i < WORKERS; i++)
+	{
+		total += taken[i];
+	}
+	return total == WORKER_FRAMES;
+}
+
+static void testWorkers(void)
+{
+	// a blocking queue loses nothing, every frame reaches exactly one worker
+	CHECK(FrameQueue_create(&queue, slots, DEPTH, FRAMEQUEUE_BLOCK) == 0);
+	workersStop = FALSE;
+
+	Task_Handle workers[WORKERS];
+	Task_Params params;
+	Task_Params_init(&params);
+	uint8_t i;
+	for (i = 0; i < WORKERS; i++)
+	{
+		params.arg0 = i;
+		workers[i] = Task_create(workerFxn, &params, NULL);
+		CHECK(workers[i] != NULL);
+	}
+
+	uint32_t seq;
+	for (seq = 0; seq < WORKER_FRAMES; seq++)
+	{
+		BtStack_Frame frame = makeFrame(1, seq);
+		CHECK(FrameQueue_put(&queue, &frame) == 0);
+	}
+
+	CHECK(FakeBios_waitFor(allTaken, NULL, 10000));
+	workersStop = TRUE;
+	for (i = 0; i < WORKERS; i++)
+	{
+		Task_delete(&workers[i]);
+	}
+
+	uint32_t wrong = 0;
+	for (seq = 0; seq < WORKER_FRAMES; seq++)
+	{
+		wrong += (seen[seq] != 1);
+	}
+	CHECK(wrong == 0);
+
+	FrameQueue_Stats stats;
+	FrameQueue_getStats(&queue, &stats);
+	CHECK(stats.drops == 0);
+	CHECK(stats.highWater <= DEPTH);
+	FrameQueue_delete(&queue);
+}
+
+int main(void)
+{
+	testOrder();
+	testDropOldest();
+	testDropNewest();
+	testCoalesce();
+	testCoalesceFull();
+	testKept();
+	testTimeout();
+	testWorkers();
+
+	return CHECK_RESULT();
+}
@@ -0,0 +1,304 @@
+/**
+ * \file FrameRouterTest.c
+ * \brief Tests the ID keyed routing table on the host
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ *
+ * Random tables of exact and masked routes, with repeated IDs and IDs
+ * chosen to collide in the hash, must call the same handlers as a linear
+ * scan of the routes. Also times routing against the no. of routes.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "Check.h"
+#include "FrameRouter.h"
+
+#define TABLES 2000				//! No. of random tables built
+#define FRAMES_PER_TABLE 200	//! No. of frames routed through each table
+#define BENCH_IDS 4096			//! No. of frame IDs cycled through by the benchmark, power of two
+#define BENCH_FRAMES (1u << 22)	//! No. of frames routed at each table size, a multiple of BENCH_IDS
+
+static uint32_t calls[FRAMEROUTER_MAX_ROUTES];		//! Calls of each handler
+static uint8_t order[2 * FRAMEROUTER_MAX_ROUTES];	//! Handlers in the order they were called
+static uint8_t orderCount;
+
+static void record(uint8_t handler)
+{
+	calls[handler]++;
+	if (orderCount < sizeof(order))
+	{
+		order[orderCount++] = handler;
+	}
+}
+
+#define HANDLER(n) static void handler##n(const BtStack_Frame* frame) { record(n); }
+HANDLER(0) HANDLER(1) HANDLER(2) HANDLER(3) HANDLER(4) HANDLER(5) HANDLER(6) HANDLER(7)
+HANDLER(8) HANDLER(9) HANDLER(10) HANDLER(11) HANDLER(12) HANDLER(13) HANDLER(14) HANDLER(15)
+HANDLER(16) HANDLER(17) HANDLER(18) HANDLER(19) HANDLER(20) HANDLER(21) HANDLER(22) HANDLER(23)
+HANDLER(24) HANDLER(25) HANDLER(26) HANDLER(27) HANDLER(28) HANDLER(29) HANDLER(30) HANDLER(31)
+#undef HANDLER
+
+//! Distinct handler for each route, so calls show which routes matched
+static const FrameRouter_Fxn handlers[FRAMEROUTER_MAX_ROUTES] = {
+	handler0, handler1, handler2, handler3, handler4, handler5, handler6, handler7,
+	handler8, handler9, handler10, handler11, handler12, handler13, handler14, handler15,
+	handler16, handler17, handler18, handler19, handler20, handler21, handler22, handler23,
+	handler24, handler25, handler26, handler27, handler28, handler29, handler30, handler31
+};
+
+/**
+ * \struct Added
+ * \brief Route as it was added, for the linear reference
+ */
+typedef struct
+{
+	uint32_t id;
+	uint32_t mask;
+} Added;
+
+static FrameRouter router;
+static uint32_t collide[4];		//! IDs which share a hash slot
+
+/**
+ * \brief Hash of FrameRouter.c, used only to pick colliding IDs
+ */
+static uint8_t hashId(uint32_t id)
+{
+	return (uint8_t) ((id * 2654435761u) >> 26) & (FRAMEROUTER_HASH_SIZE - 1);
+}
+
+static void findCollisions(void)
+{
+	uint8_t found = 0;
+	uint32_t id;
+	for (id = 1; found < 4; id++)
+	{
+		if (hashId(id) == hashId(1))
+		{
+			collide[found++] = id;
+		}
+	}
+}
+
+static BtStack_Frame makeFrame(uint32_t id)
+{
+	BtStack_Frame frame;
+	memset(&frame, 0, sizeof(frame));
+	frame.id.b32 = id;
+	return frame;
+}
+
+/**
+ * \brief Picks an ID, often one already in the table or one that collides
+ */
+static uint32_t pickId(const Added* added, uint8_t count)
+{
+	switch (Check_below(4))
+	{
+	case 0:
+		return collide[Check_below(4)];
+	case 1:
+		return (count > 0) ? added[Check_below(count)].id : Check_random();
+	case 2:
+		return Check_below(16);
+	default:
+		return Check_random();
+	}
+}
+
+static void testRandomTables(void)
+{
+	Added added[FRAMEROUTER_MAX_ROUTES];
+	uint32_t mismatches = 0;
+
+	uint32_t t;
+	for (t = 0; t < TABLES; t++)
+	{
+		FrameRouter_init(&router);
+		uint8_t count = 1 + Check_below(FRAMEROUTER_MAX_ROUTES);
+		uint8_t i;
+		for (i = 0; i < count; i++)
+		{
+			added[i].id = pickId(added, i);
+			added[i].mask = (Check_below(3) == 0) ? (Check_random() | 0xFF) : FRAMEROUTER_EXACT;
+			CHECK(FrameRouter_add(&router, added[i].id, added[i].mask, handlers[i]) == 0);
+		}
+		FrameRouter_build(&router);
+
+		uint32_t f;
+		for (f = 0; f < FRAMES_PER_TABLE; f++)
+		{
+			BtStack_Frame frame = makeFrame(pickId(added, count));
+			memset(calls, 0, sizeof(calls));
+			orderCount = 0;
+			uint8_t called = FrameRouter_route(&router, &frame);
+
+			uint8_t expected = 0;
+			for (i = 0; i < count; i++)
+			{
+				uint32_t match = ((frame.id.b32 & added[i].mask) == (added[i].id & added[i].mask));
+				expected += match;
+				mismatches += (calls[i] != match);
+			}
+			mismatches += (called != expected);
+		}
+	}
+
+	CHECK(mismatches == 0);
+}
+
+static void testOrder(void)
+{
+	// exact handlers of an ID in the order added, then masked handlers in the order added
+	FrameRouter_init(&router);
+	FrameRouter_add(&router, 0x00000100, 0x0000FF00, handlers[0]);
+	FrameRouter_add(&router, collide[1], FRAMEROUTER_EXACT, handlers[1]);
+	FrameRouter_add(&router, 0x00000123, FRAMEROUTER_EXACT, handlers[2]);
+	FrameRouter_add(&router, 0x00000000, 0x00000000, handlers[3]);
+	FrameRouter_add(&router, 0x00000123, FRAMEROUTER_EXACT, handlers[4]);
+	FrameRouter_add(&router, collide[0], FRAMEROUTER_EXACT, handlers[5]);
+	FrameRouter_build(&router);
+
+	BtStack_Frame frame = makeFrame(0x00000123);
+	orderCount = 0;
+	CHECK(FrameRouter_route(&router, &frame) == 4);
+	CHECK(orderCount == 4);
+	CHECK((order[0] == 2) && (order[1] == 4) && (order[2] == 0) && (order[3] == 3));
+
+	// IDs sharing a hash slot are told apart
+	frame = makeFrame(collide[0]);
+	orderCount = 0;
+	CHECK(FrameRouter_route(&router, &frame) == 2);
+	CHECK((order[0] == 5) && (order[1] == 3));
+
+	frame = makeFrame(collide[2]);
+	orderCount = 0;
+	CHECK(FrameRouter_route(&router, &frame) == 1);
+	CHECK(order[0] == 3);
+}
+
+static void testFull(void)
+{
+	FrameRouter_init(&router);
+	uint8_t i;
+	for (i = 0; i < FRAMEROUTER_MAX_ROUTES; i++)
+	{
+		CHECK(FrameRouter_add(&router, i, FRAMEROUTER_EXACT, handlers[i]) == 0);
+	}
+	CHECK(FrameRouter_add(&router, 99, FRAMEROUTER_EXACT, handlers[0]) == -1);
+
+	// every slot filled still routes every ID
+	FrameRouter_build(&router);
+	for (i = 0; i < FRAMEROUTER_MAX_ROUTES; i++)
+	{
+		BtStack_Frame frame = makeFrame(i);
+		memset(calls, 0, sizeof(calls));
+		CHECK(FrameRouter_route(&router, &frame) == 1);
+		CHECK(calls[i] == 1);
+	}
+}
+
+static volatile uint32_t benchCalls;		//! Handler calls made by the benchmark
+
+static void benchFxn(const BtStack_Frame* frame)
+{
+	benchCalls++;
+}
+
+static double seconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/**
+ * \brief Routes BENCH_FRAMES frames through a built table
+ *
+ * \return Nanoseconds per frame
+ */
+static double benchRoute(const BtStack_Frame* frames)
+{
+	benchCalls = 0;
+	double start = seconds();
+	uint32_t i;
+	for (i = 0; i < BENCH_FRAMES; i++)
+	{
+		FrameRouter_route(&router, &frames[i & (BENCH_IDS - 1)]);
+	}
+	return (seconds() - start) * 1e9 / BENCH_FRAMES;
+}
+
+/**
+ * \brief Times routing with 1 to FRAMEROUTER_MAX_ROUTES exact or masked routes
+ *
+ * Three in four frames carry a routed ID, the rest miss. Masked routes
+ * match on the top 24 bits, as a subsystem prefix would.
+ */
+static void bench(void)
+{
+	static BtStack_Frame frames[BENCH_IDS];
+	uint32_t ids[FRAMEROUTER_MAX_ROUTES];
+	uint8_t count;
+	for (count = 1; count <= FRAMEROUTER_MAX_ROUTES; count *= 2)
+	{
+		uint8_t i;
+		for (i = 0; i < count; i++)
+		{
+			ids[i] = Check_random() & 0xFFFFFF00;
+		}
+
+		// half the routed IDs differ from the route in the bits masked routes ignore
+		uint32_t exactMatches = 0;
+		uint32_t maskedMatches = 0;
+		uint32_t f;
+		for (f = 0; f < BENCH_IDS; f++)
+		{
+			uint32_t id = Check_random();
+			if (Check_below(4) != 0)
+			{
+				id = ids[Check_below(count)] | ((Check_below(2) == 0) ? 0 : (id & 0xFF));
+			}
+			frames[f] = makeFrame(id);
+			for (i = 0; i < count; i++)
+			{
+				exactMatches += (id == ids[i]);
+				maskedMatches += ((id & 0xFFFFFF00) == ids[i]);
+			}
+		}
+
+		FrameRouter_init(&router);
+		for (i = 0; i < count; i++)
+		{
+			FrameRouter_add(&router, ids[i], FRAMEROUTER_EXACT, benchFxn);
+		}
+		FrameRouter_build(&router);
+		double exact = benchRoute(frames);
+		CHECK(benchCalls == exactMatches * (BENCH_FRAMES / BENCH_IDS));
+
+		FrameRouter_init(&router);
+		for (i = 0; i < count; i++)
+		{
+			FrameRouter_add(&router, ids[i], 0xFFFFFF00, benchFxn);
+		}
+		FrameRouter_build(&router);
+		double masked = benchRoute(frames);
+		CHECK(benchCalls == maskedMatches * (BENCH_FRAMES / BENCH_IDS));
+
+		printf("route: %2u routes, exact %.1f ns/frame, masked %.1f ns/frame\n", count, exact, masked);
+	}
+}
+
+int main(void)
+{
+	findCollisions();
+	testRandomTables();
+	testOrder();
+	testFull();
+	bench();
+
+	return CHECK_RESULT();
+}
@@ -0,0 +1,635 @@
+/**
+ * \file InterBusTest.c
+ * \brief Tests the inter board bus scheduler on the host
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ *
+ * The service runs on the I2C driver stand-in, which holds each transfer
+ * until the test completes it. Covers the order the bus is granted in,
+ * tokens, full queues, urgent writes, retries, recovery of the bus, giving
+ * the bus up and stopping with work queued. A real time run with three
+ * slaves asking for more than the bus can carry reports the throughput
+ * and queueing latency of each.
+ */
+
+#include <string.h>
+
+#include <xdc/runtime/Timestamp.h>
+#include <ti/sysbios/BIOS.h>
+#include <ti/sysbios/knl/Clock.h>
+#include <ti/sysbios/knl/Task.h>
+
+#include "Check.h"
+#include "FakeBios.h"
+#include "FakeI2C.h"
+#include "InterBus.h"
+
+#define RECOVERY_ATTEMPTS 20	//! Attempts to reopen the driver before the bus is given up, as InterBus.c
+#define MAX_DONE 64				//! Most completions recorded
+#define LOAD_TICKS 1000			//! Length of the real time run, the completer finishes about one transfer per tick
+
+/**
+ * \struct Done
+ * \brief A completion reported to a doneFxn
+ */
+typedef struct
+{
+	InterBus_Token token;
+	int8_t status;
+	uint8_t tag;				//! arg of the transaction
+	uint8_t read[4];			//! First bytes read
+} Done;
+
+static Done done[MAX_DONE];
+static volatile uint8_t doneCount = 0;
+
+static volatile Bool autoComplete = FALSE;	//! Completer task finishes every transfer at once
+static const uint8_t reply[INTERBUS_MAX_READ] = {0xA1, 0xB2, 0xC3, 0xD4};
+
+static int8_t slaveA;
+static int8_t slaveB;
+static int8_t slaveC;
+
+static void doneFxn(InterBus_Token token, int8_t status, const uint8_t* read, void* arg)
+{
+	if (doneCount < MAX_DONE)
+	{
+		done[doneCount].token = token;
+		done[doneCount].status = status;
+		done[doneCount].tag = (uint8_t)(uintptr_t)arg;
+		memcpy(done[doneCount].read, read, sizeof(done[doneCount].read));
+		doneCount++;
+	}
+}
+
+/**
+ * \brief Completes transfers successfully while autoComplete is set, as a healthy slave would
+ */
+static void completerFxn(UArg unused0, UArg unused1)
+{
+	while (TRUE)
+	{
+		if (autoComplete)
+		{
+			FakeI2C_complete(TRUE, reply);
+		}
+		Task_sleep(1);
+	}
+}
+
+/**
+ * \brief Queues a command or telemetry transaction tagged with its first byte
+ */
+static int32_t submit(int8_t slave, InterBus_Priority priority, uint8_t tag)
+{
+	uint8_t write[2] = {tag, 0};
+	return InterBus_submit(slave, priority, write, sizeof(write), 0, doneFxn, (void*)(uintptr_t)tag);
+}
+
+static Bool transfersLogged(void* arg)
+{
+	return FakeI2C_log(NULL) >= *(uint16_t*)arg;
+}
+
+static Bool notRecovering(void* arg)
+{
+	// the recovery task starts the next transaction once the driver is open
+	return FakeI2C_busy() || InterBus_isIdle();
+}
+
+static Bool isIdle(void* arg)
+{
+	return InterBus_isIdle();
+}
+
+static Bool opensAtLeast(void* arg)
+{
+	return FakeI2C_opens() >= *(uint32_t*)arg;
+}
+
+/**
+ * \brief Fails the transfer on the bus and each of its retries
+ */
+static void failWithRetries(void)
+{
+	uint8_t attempt;
+	for (attempt = 0; attempt < 4; attempt++)
+	{
+		uint16_t want = FakeI2C_log(NULL) + 1;
+		if (attempt > 0)
+		{
+			// the retry goes on the bus after its backoff
+			CHECK(FakeBios_waitFor(transfersLogged, &want, 100));
+		}
+		CHECK(FakeI2C_complete(FALSE, NULL));
+	}
+}
+
+/**
+ * \brief Checks the transfers logged after a point carry the expected tags
+ */
+static void expectTags(uint16_t from, const uint8_t* tags, uint8_t count)
+{
+	FakeI2C_Transfer log[FAKEI2C_LOG_SIZE];
+	uint16_t logged = FakeI2C_log(log);
+	CHECK(logged == from + count);
+	uint8_t i;
+	for (i = 0; (i < count) && (from + i < logged); i++)
+	{
+		if (log[from + i].tag != tags[i])
+		{
+			fprintf(stderr, "transfer %u: tag %u, expected %u\n", (unsigned)(from + i),
+					(unsigned) log[from + i].tag, (unsigned) tags[i]);
+		}
+		CHECK(log[from + i].tag == tags[i]);
+	}
+}
+
+/**
+ * \brief Registers the three slaves, again if they were, so their counters start from 0
+ */
+static void addSlaves(void)
+{
+	InterBus_removeSlave(slaveA);
+	InterBus_removeSlave(slaveB);
+	InterBus_removeSlave(slaveC);
+	slaveA = InterBus_addSlave(0x10);
+	slaveB = InterBus_addSlave(0x20);
+	slaveC = InterBus_addSlave(0x30);
+	CHECK((slaveA == 0) && (slaveB == 1) && (slaveC == 2));
+}
+
+static void startBus(void)
+{
+	addSlaves();
+	FakeI2C_reset();
+	autoComplete = FALSE;
+	doneCount = 0;
+	CHECK(InterBus_start() == 0);
+}
+
+static void stopBus(void)
+{
+	autoComplete = TRUE;
+	CHECK(InterBus_stop() == 0);
+	autoComplete = FALSE;
+}
+
+static void testStartStop(void)
+{
+	FakeI2C_reset();
+	CHECK(InterBus_stop() == -1);
+	CHECK(submit(slaveA, INTERBUS_PRIORITY_COMMAND, 1) == -1);
+
+	FakeI2C_failOpens(1);
+	CHECK(InterBus_start() == -2);
+	CHECK(!InterBus_hasStarted());
+
+	CHECK(InterBus_start() == 0);
+	CHECK(InterBus_hasStarted());
+	CHECK(InterBus_start() == -1);
+	CHECK(FakeI2C_opens() == 1);
+	CHECK(InterBus_stop() == 0);
+	CHECK(FakeI2C_closes() == 1);
+	CHECK(InterBus_stop() == -1);
+}
+
+static void testArguments(void)
+{
+	startBus();
+	uint8_t write[INTERBUS_MAX_WRITE + 1];
+	memset(write, 1, sizeof(write));
+
+	CHECK(InterBus_submit(slaveA, INTERBUS_PRIORITY_COMMAND, write, INTERBUS_MAX_WRITE + 1, 0, NULL, NULL) == -3);
+	CHECK(InterBus_submit(slaveA, INTERBUS_PRIORITY_COMMAND, write, 1, INTERBUS_MAX_READ + 1, NULL, NULL) == -3);
+	CHECK(InterBus_submit(slaveA, INTERBUS_PRIORITY_COMMAND, write, 0, 0, NULL, NULL) == -3);
+	CHECK(InterBus_submit(slaveA, INTERBUS_PRIORITY_COUNT, write, 1, 0, NULL, NULL) == -3);
+	CHECK(InterBus_supersedable(slaveA, write, 0, NULL, NULL) == -3);
+	CHECK(InterBus_urgent(slaveA, write, 0, 0) == -3);
+	CHECK(InterBus_urgent(slaveA, write, INTERBUS_MAX_WRITE + 1, 0) == -3);
+
+	// slaves which were never registered or have been removed
+	int8_t gone = InterBus_addSlave(0x40);
+	CHECK(gone >= 0);
+	CHECK(InterBus_removeSlave(gone) == 0);
+	int8_t bad[4] = {-1, INTERBUS_MAX_SLAVES, 100, gone};
+	uint8_t i;
+	for (i = 0; i < 4; i++)
+	{
+		CHECK(InterBus_submit(bad[i], INTERBUS_PRIORITY_COMMAND, write, 1, 0, NULL, NULL) == -3);
+		CHECK(InterBus_supersedable(bad[i], write, 1, NULL, NULL) == -3);
+		CHECK(InterBus_urgent(bad[i], write, 1, 0) == -3);
+		CHECK(InterBus_removeSlave(bad[i]) == -2);
+		CHECK(InterBus_pending(bad[i]) == 0);
+
+		InterBus_SlaveStats stats;
+		memset(&stats, 0xFF, sizeof(stats));
+		InterBus_getSlaveStats(bad[i], &stats);
+		CHECK((stats.submitted == 0) && (stats.highWater == 0));
+	}
+	CHECK(FakeI2C_log(NULL) == 0);
+
+	// a slave with work queued stays registered
+	CHECK(submit(slaveA, INTERBUS_PRIORITY_COMMAND, 1) > 0);
+	CHECK(InterBus_pending(slaveA) == 1);
+	CHECK(InterBus_removeSlave(slaveA) == -1);
+
+	// the table holds INTERBUS_MAX_SLAVES
+	int8_t extra = InterBus_addSlave(0x50);
+	CHECK(extra >= 0);
+	CHECK(InterBus_addSlave(0x60) == -1);
+	CHECK(InterBus_removeSlave(extra) == 0);
+	stopBus();
+}
+
+static void testPriority(void)
+{
+	startBus();
+
+	// the first goes straight on the bus, the rest wait behind it
+	CHECK(submit(slaveA, INTERBUS_PRIORITY_TELEMETRY, 1) > 0);
+	CHECK(FakeI2C_busy());
+	submit(slaveA, INTERBUS_PRIORITY_TELEMETRY, 2);
+	submit(slaveA, INTERBUS_PRIORITY_TELEMETRY, 3);
+	submit(slaveB, INTERBUS_PRIORITY_TELEMETRY, 4);
+	submit(slaveC, INTERBUS_PRIORITY_COMMAND, 5);
+	submit(slaveA, INTERBUS_PRIORITY_COMMAND, 6);
+	submit(slaveC, INTERBUS_PRIORITY_COMMAND, 7);
+	submit(slaveB, INTERBUS_PRIORITY_COMMAND, 8);
+	CHECK(InterBus_pending(slaveA) == 4);
+	CHECK(FakeI2C_log(NULL) == 1);
+
+	while (FakeI2C_complete(TRUE, NULL))
+	{
+	}
+
+	// commands before telemetry, each round-robin between slaves starting after the last served
+	static const uint8_t order[8] = {1, 6, 8, 5, 7, 4, 2, 3};
+	expectTags(0, order, 8);
+	CHECK(doneCount == 8);
+	uint8_t i;
+	for (i = 0; i < doneCount; i++)
+	{
+		CHECK(done[i].tag == order[i]);
+		CHECK(done[i].status == 0);
+	}
+	CHECK(InterBus_isIdle());
+
+	InterBus_SlaveStats stats;
+	InterBus_getSlaveStats(slaveA, &stats);
+	CHECK(stats.submitted == 4);
+	CHECK(stats.completed == 4);
+	CHECK(stats.highWater == 4);
+	CHECK(stats.bytes == 8);
+	stopBus();
+}
+
+static void testTokens(void)
+{
+	startBus();
+
+	uint8_t write[1] = {9};
+	int32_t first = InterBus_submit(slaveB, INTERBUS_PRIORITY_COMMAND, write, 1, 4, doneFxn, (void*)9);
+	int32_t second = submit(slaveB, INTERBUS_PRIORITY_COMMAND, 10);
+	CHECK(first == 1);
+	CHECK(second == 2);
+	CHECK(!InterBus_isDone(first));
+	CHECK(!InterBus_isDone(second));
+
+	// the bytes read are handed to the doneFxn
+	CHECK(FakeI2C_complete(TRUE, reply));
+	CHECK(InterBus_isDone(first));
+	CHECK(!InterBus_isDone(second));
+	CHECK(doneCount == 1);
+	CHECK(done[0].token == (InterBus_Token) first);
+	CHECK(memcmp(done[0].read, reply, 4) == 0);
+
+	CHECK(FakeI2C_complete(TRUE, NULL));
+	CHECK(InterBus_isDone(second));
+	CHECK(done[1].token == (InterBus_Token) second);
+
+	FakeI2C_Transfer log[FAKEI2C_LOG_SIZE];
+	CHECK(FakeI2C_log(log) == 2);
+	CHECK((log[0].address == 0x20) && (log[0].writeCount == 1) && (log[0].readCount == 4));
+	stopBus();
+}
+
+static void testQueueFull(void)
+{
+	startBus();
+
+	// one slave holds at most INTERBUS_SLAVE_DEPTH
+	uint8_t i;
+	for (i = 0; i < INTERBUS_SLAVE_DEPTH; i++)
+	{
+		CHECK(submit(slaveA, INTERBUS_PRIORITY_TELEMETRY, i + 1) > 0);
+	}
+	CHECK(submit(slaveA, INTERBUS_PRIORITY_COMMAND, 50) == -2);
+
+	// and the pool INTERBUS_POOL_SIZE across slaves
+	for (i = 0; i < INTERBUS_POOL_SIZE - INTERBUS_SLAVE_DEPTH; i++)
+	{
+		CHECK(submit((i % 2) ? slaveB : slaveC, INTERBUS_PRIORITY_TELEMETRY, 100 + i) > 0);
+	}
+	CHECK(submit(slaveB, INTERBUS_PRIORITY_TELEMETRY, 51) == -2);
+
+	InterBus_SlaveStats stats;
+	InterBus_getSlaveStats(slaveA, &stats);
+	CHECK(stats.queueFull == 1);
+	CHECK(stats.highWater == INTERBUS_SLAVE_DEPTH);
+	stopBus();
+	CHECK(doneCount == INTERBUS_POOL_SIZE);
+}
+
+static void testTransfer(void)
+{
+	startBus();
+	autoComplete = TRUE;
+
+	uint8_t write[1] = {7};
+	uint8_t read[4] = {0};
+	CHECK(InterBus_transfer(slaveC, INTERBUS_PRIORITY_COMMAND, write, 1, read, 4) == 0);
+	CHECK(memcmp(read, reply, 4) == 0);
+	CHECK(InterBus_transfer(slaveC, INTERBUS_PRIORITY_COMMAND, write, 0, read, 0) == -3);
+	stopBus();
+}
+
+static void testUrgent(void)
+{
+	startBus();
+
+	CHECK(submit(slaveA, INTERBUS_PRIORITY_TELEMETRY, 1) > 0);
+	uint8_t write[1];
+	write[0] = 2;
+	CHECK(InterBus_supersedable(slaveA, write, 1, doneFxn, (void*)2) > 0);
+	write[0] = 3;
+	CHECK(InterBus_supersedable(slaveA, write, 1, doneFxn, (void*)3) > 0);
+	submit(slaveA, INTERBUS_PRIORITY_COMMAND, 4);
+	write[0] = 5;
+	CHECK(InterBus_supersedable(slaveB, write, 1, doneFxn, (void*)5) > 0);
+
+	// cancels the superseded writes of its slave only, then waits for the bus
+	write[0] = 9;
+	CHECK(InterBus_urgent(slaveA, write, 1, Timestamp_get32()) > 0);
+	CHECK(InterBus_urgent(slaveB, write, 1, Timestamp_get32()) == -2);
+	CHECK(doneCount == 2);
+	CHECK((done[0].tag == 2) && (done[0].status == -2));
+	CHECK((done[1].tag == 3) && (done[1].status == -2));
+	CHECK(InterBus_pending(slaveA) == 3);
+
+	while (FakeI2C_complete(TRUE, NULL))
+	{
+	}
+	static const uint8_t order[4] = {1, 9, 4, 5};
+	expectTags(0, order, 4);
+
+	InterBus_BusStats stats;
+	InterBus_getBusStats(&stats);
+	CHECK(stats.urgent == 1);
+	CHECK(stats.cancelled == 2);
+
+	// the urgent slot is free again
+	CHECK(InterBus_urgent(slaveB, write, 1, Timestamp_get32()) > 0);
+	CHECK(FakeI2C_complete(TRUE, NULL));
+	stopBus();
+}
+
+static void testRetry(void)
+{
+	startBus();
+	CHECK(submit(slaveA, INTERBUS_PRIORITY_COMMAND, 1) > 0);
+	submit(slaveB, INTERBUS_PRIORITY_COMMAND, 2);
+
+	// three retries with backoff, the third gets through
+	uint8_t attempt;
+	for (attempt = 0; attempt < 3; attempt++)
+	{
+		uint16_t want = attempt + 2;
+		CHECK(FakeI2C_complete(FALSE, NULL));
+		CHECK(FakeBios_waitFor(transfersLogged, &want, 100));
+	}
+	CHECK(FakeI2C_complete(TRUE, NULL));
+	CHECK(FakeI2C_complete(TRUE, NULL));
+
+	static const uint8_t order[5] = {1, 1, 1, 1, 2};
+	expectTags(0, order, 5);
+	CHECK((done[0].tag == 1) && (done[0].status == 0));
+
+	InterBus_BusStats stats;
+	InterBus_getBusStats(&stats);
+	CHECK(stats.retries == 3);
+	CHECK(stats.failures == 0);
+	CHECK(stats.outages == 1);
+	CHECK(stats.recoveries == 0);
+	stopBus();
+}
+
+static void testRecovery(void)
+{
+	startBus();
+	CHECK(submit(slaveA, INTERBUS_PRIORITY_COMMAND, 1) > 0);
+	submit(slaveA, INTERBUS_PRIORITY_COMMAND, 2);
+
+	// a slave holding SDA lets go within the clear pulses
+	FakeI2C_holdSda(3);
+	failWithRetries();
+	CHECK(FakeBios_waitFor(notRecovering, NULL, 1000));
+	CHECK((done[0].tag == 1) && (done[0].status == -2));
+
+	// the bus was reopened and the queue carries on
+	CHECK(FakeI2C_busy());
+	CHECK(FakeI2C_complete(TRUE, NULL));
+	CHECK((done[1].tag == 2) && (done[1].status == 0));
+	CHECK(FakeI2C_opens() == 2);
+	CHECK(FakeI2C_closes() == 1);
+
+	// a slave which never lets go is counted, the bus is still reopened
+	FakeI2C_holdSda(0xFF);
+	submit(slaveA, INTERBUS_PRIORITY_COMMAND, 3);
+	submit(slaveA, INTERBUS_PRIORITY_COMMAND, 4);
+	failWithRetries();
+	CHECK(FakeBios_waitFor(notRecovering, NULL, 1000));
+	FakeI2C_holdSda(0);
+
+	// reopening may fail a few times before it works
+	FakeI2C_failOpens(RECOVERY_ATTEMPTS - 1);
+	failWithRetries();
+	uint32_t opens = 4;
+	CHECK(FakeBios_waitFor(opensAtLeast, &opens, 2000));
+	CHECK(InterBus_isIdle());
+	CHECK((done[2].tag == 3) && (done[2].status == -2));
+	CHECK((done[3].tag == 4) && (done[3].status == -2));
+
+	InterBus_BusStats stats;
+	InterBus_getBusStats(&stats);
+	CHECK(stats.failures == 3);
+	CHECK(stats.recoveries == 3);
+	CHECK(stats.stuckBus == 1);
+	CHECK(stats.recoveryFailures == RECOVERY_ATTEMPTS - 1);
+	CHECK(stats.outages == 2);
+
+	// still serving
+	CHECK(submit(slaveA, INTERBUS_PRIORITY_COMMAND, 5) > 0);
+	CHECK(FakeI2C_complete(TRUE, NULL));
+	stopBus();
+}
+
+static void testLost(void)
+{
+	startBus();
+	CHECK(submit(slaveA, INTERBUS_PRIORITY_COMMAND, 1) > 0);
+	submit(slaveA, INTERBUS_PRIORITY_TELEMETRY, 2);
+	submit(slaveB, INTERBUS_PRIORITY_COMMAND, 3);
+
+	// the driver never reopens, everything queued fails and nothing new is taken
+	FakeI2C_failOpens(RECOVERY_ATTEMPTS);
+	failWithRetries();
+	CHECK(FakeBios_waitFor(isIdle, NULL, 2000));
+	CHECK(doneCount == 3);
+	uint8_t i;
+	for (i = 0; i < doneCount; i++)
+	{
+		CHECK(done[i].status == -2);
+	}
+
+	uint8_t write[1] = {4};
+	CHECK(submit(slaveA, INTERBUS_PRIORITY_COMMAND, 4) == -2);
+	CHECK(InterBus_supersedable(slaveA, write, 1, NULL, NULL) == -2);
+	CHECK(InterBus_urgent(slaveA, write, 1, 0) == -2);
+	CHECK(InterBus_transfer(slaveA, INTERBUS_PRIORITY_COMMAND, write, 1, NULL, 0) == -2);
+
+	InterBus_BusStats stats;
+	InterBus_getBusStats(&stats);
+	CHECK(stats.recoveryFailures == RECOVERY_ATTEMPTS);
+	CHECK(stats.failures == 3);
+
+	InterBus_SlaveStats slaveStats;
+	InterBus_getSlaveStats(slaveA, &slaveStats);
+	CHECK(slaveStats.errors == 2);
+
+	// stops without waiting, a restart serves again
+	CHECK(InterBus_stop() == 0);
+	startBus();
+	CHECK(submit(slaveA, INTERBUS_PRIORITY_COMMAND, 5) > 0);
+	CHECK(FakeI2C_complete(TRUE, NULL));
+	stopBus();
+}
+
+static void testStop(void)
+{
+	// queued transactions finish before the bus closes
+	startBus();
+	uint8_t i;
+	for (i = 0; i < 6; i++)
+	{
+		submit((i % 2) ? slaveA : slaveB, INTERBUS_PRIORITY_TELEMETRY, i + 1);
+	}
+	autoComplete = TRUE;
+	CHECK(InterBus_stop() == 0);
+	autoComplete = FALSE;
+	CHECK(doneCount == 6);
+	CHECK(FakeI2C_closes() == 1);
+
+	// a transfer which never completes keeps the service running
+	startBus();
+	submit(slaveA, INTERBUS_PRIORITY_TELEMETRY, 1);
+	CHECK(InterBus_stop() == -2);
+	CHECK(InterBus_hasStarted());
+	CHECK(FakeI2C_closes() == 0);
+	CHECK(submit(slaveA, INTERBUS_PRIORITY_TELEMETRY, 2) > 0);
+	stopBus();
+	CHECK(doneCount == 2);
+}
+
+/**
+ * \brief Queues each slave's work for one tick of the real time run
+ *
+ * The power board gets a drive command every 5 ticks, Shunt a telemetry
+ * poll every tick and Bash a weapon command every 20 plus a poll every 4,
+ * about 1550 transactions a second for a bus which completes about 1000.
+ */
+static void loadTick(uint32_t tick)
+{
+	static const uint8_t command[4] = {101, 0, 102, 0};
+	static const uint8_t poll[1] = {0x40};
+	if (tick % 5 == 0)
+	{
+		InterBus_submit(slaveA, INTERBUS_PRIORITY_COMMAND, command, sizeof(command), 0, NULL, NULL);
+	}
+	InterBus_submit(slaveB, INTERBUS_PRIORITY_TELEMETRY, poll, sizeof(poll), 8, NULL, NULL);
+	if (tick % 20 == 0)
+	{
+		InterBus_submit(slaveC, INTERBUS_PRIORITY_COMMAND, command, 2, 0, NULL, NULL);
+	}
+	if (tick % 4 == 0)
+	{
+		InterBus_submit(slaveC, INTERBUS_PRIORITY_TELEMETRY, poll, sizeof(poll), 8, NULL, NULL);
+	}
+}
+
+static void testLoad(void)
+{
+	startBus();
+	autoComplete = TRUE;
+	UInt32 start = Clock_getTicks();
+	uint32_t tick;
+	for (tick = 0; tick < LOAD_TICKS; tick++)
+	{
+		loadTick(tick);
+		Task_sleep(1);
+	}
+	CHECK(FakeBios_waitFor(isIdle, NULL, 1000));
+	double seconds = (Clock_getTicks() - start) * FAKEBIOS_TICK_US / 1e6;
+
+	static const char* names[3] = {"power board", "shunt", "bash"};
+	const int8_t slaves[3] = {slaveA, slaveB, slaveC};
+	InterBus_SlaveStats stats[3];
+	uint8_t i;
+	for (i = 0; i < 3; i++)
+	{
+		InterBus_getSlaveStats(slaves[i], &stats[i]);
+		CHECK(stats[i].errors == 0);
+		CHECK(stats[i].completed == stats[i].submitted);
+		printf("interBus: %-11s %4.0f transactions/s, %5.0f bytes/s, %u refused, queued mean %u us, max %u us\n",
+				names[i], stats[i].completed / seconds, stats[i].bytes / seconds, (unsigned) stats[i].queueFull,
+				(unsigned) stats[i].meanLatencyUs, (unsigned) stats[i].maxLatencyUs);
+	}
+
+	// drive commands go ahead of the polls which overload the bus, only Shunt's own queue fills
+	CHECK(stats[0].queueFull == 0);
+	CHECK(stats[0].completed >= LOAD_TICKS / 5);
+	CHECK(stats[0].meanLatencyUs < stats[1].meanLatencyUs);
+	CHECK(stats[1].queueFull > 0);
+	CHECK(stats[2].queueFull == 0);
+	stopBus();
+}
+
+int main(void)
+{
+	slaveA = -1;
+	slaveB = -1;
+	slaveC = -1;
+	addSlaves();
+
+	Task_Params params;
+	Task_Params_init(&params);
+	Task_Handle completer = Task_create(completerFxn, &params, NULL);
+	CHECK(completer != NULL);
+
+	testStartStop();
+	testArguments();
+	testPriority();
+	testTokens();
+	testQueueFull();
+	testTransfer();
+	testUrgent();
+	testRetry();
+	testRecovery();
+	testLost();
+	testStop();
+	testLoad();
+
+	Task_delete(&completer);
+	return CHECK_RESULT();
+}
@@ -0,0 +1,469 @@
+/**
+ * \file KfpFragTest.c
+ * \brief Tests variable length frames and fragmentation on the host
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ *
+ * Messages of random lengths are fragmented at several MTUs, their
+ * fragments shuffled and repeated, and handed back to the layer, which must
+ * reassemble each one exactly once. Interleaved and abandoned messages,
+ * malformed fragments and a full lane are checked separately. Payload
+ * efficiency on the wire is reported against fixed 8 byte KFP frames.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include <ti/sysbios/BIOS.h>
+#include <ti/sysbios/knl/Clock.h>
+#include <ti/sysbios/knl/Task.h>
+
+#include "Check.h"
+#include "Crc16.h"
+#include "FakeBios.h"
+#include "FakeBtStack.h"
+#include "KfpFrag.h"
+#include "Slip.h"
+
+#define MESSAGES 2000			//! No. of random messages sent through the layer
+#define BENCH_MESSAGES 20000		//! No. of messages fragmented and reassembled per size by the benchmark
+#define WIRE_BYTES_PER_S 11520	//! Bytes/s of a 115200 baud 8N1 link
+
+/**
+ * \struct Fragment
+ * \brief A pushed link frame
+ */
+typedef struct
+{
+	uint8_t data[BTSTACK_MAX_RAW];
+	uint16_t size;
+} Fragment;
+
+static Fragment fragments[KFPFRAG_MAX_FRAGMENTS];
+static uint16_t fragmentCount = 0;
+static int16_t laneResult = 0;		//! Returned for every push if not 0
+
+static uint8_t received[KFPFRAG_MAX_MESSAGE];	//! Last message reassembled
+static uint16_t receivedLen = 0;
+static uint32_t receivedId = 0;
+static uint32_t receivedCount = 0;
+
+static int16_t captureFxn(const uint8_t* frame, uint16_t size, BtStack_Lane lane)
+{
+	if (laneResult != 0)
+	{
+		return laneResult;
+	}
+
+	CHECK(fragmentCount < KFPFRAG_MAX_FRAGMENTS);
+	if (fragmentCount < KFPFRAG_MAX_FRAGMENTS)
+	{
+		memcpy(fragments[fragmentCount].data, frame, size);
+		fragments[fragmentCount].size = size;
+		fragmentCount++;
+	}
+	return size + 2;
+}
+
+static void messageFxn(uint32_t id, const uint8_t* data, uint16_t len)
+{
+	memcpy(received, data, len);
+	receivedLen = len;
+	receivedId = id;
+	receivedCount++;
+}
+
+static void startLayer(uint8_t mtu, uint16_t ms)
+{
+	FakeBtStack_reset();
+	CHECK(KfpFrag_setMtu(mtu) == 0);
+	CHECK(KfpFrag_setTimeout(ms) == 0);
+	CHECK(KfpFrag_start(messageFxn) == 0);
+	FakeBtStack_onRaw(captureFxn);
+	FakeBtStack_setStarted(TRUE);
+	fragmentCount = 0;
+	laneResult = 0;
+	receivedCount = 0;
+}
+
+static void stopLayer(void)
+{
+	FakeBtStack_setStarted(FALSE);
+	CHECK(KfpFrag_stop() == 0);
+}
+
+static void fillMessage(uint8_t* data, uint16_t len)
+{
+	uint16_t i;
+	for (i = 0; i < len; i++)
+	{
+		data[i] = (uint8_t) Check_random();
+	}
+}
+
+static void testConfig(void)
+{
+	FakeBtStack_reset();
+	CHECK(KfpFrag_setMtu(KFPFRAG_HEADER_SIZE) == -2);
+	CHECK(KfpFrag_setMtu(BTSTACK_MAX_RAW + 1) == -2);
+	CHECK(KfpFrag_start(NULL) == -3);
+	CHECK(KfpFrag_stop() == -1);
+
+	uint8_t data[1] = {0};
+	CHECK(KfpFrag_send(1, data, 1, BTSTACK_LANE_BULK, 0) == -1);
+
+	FakeBtStack_setStarted(TRUE);
+	CHECK(KfpFrag_start(messageFxn) == -1);
+	FakeBtStack_setStarted(FALSE);
+
+	CHECK(KfpFrag_start(messageFxn) == 0);
+	CHECK(KfpFrag_start(messageFxn) == -1);
+	CHECK(KfpFrag_setMtu(40) == -1);
+	CHECK(KfpFrag_setTimeout(10) == -1);
+	CHECK(KfpFrag_stop() == 0);
+
+	// too short, too long, and too many fragments at the smallest MTU
+	startLayer(KFPFRAG_HEADER_SIZE + 1, 500);
+	static uint8_t big[KFPFRAG_MAX_MESSAGE + 1];
+	CHECK(KfpFrag_send(1, big, 0, BTSTACK_LANE_BULK, 0) == -3);
+	CHECK(KfpFrag_send(1, big, KFPFRAG_MAX_FRAGMENTS + 1, BTSTACK_LANE_BULK, 0) == -3);
+	CHECK(KfpFrag_send(1, big, KFPFRAG_MAX_FRAGMENTS, BTSTACK_LANE_BULK, 0) == 0);
+	CHECK(fragmentCount == KFPFRAG_MAX_FRAGMENTS);
+	stopLayer();
+
+	startLayer(BTSTACK_MAX_RAW, 500);
+	CHECK(KfpFrag_send(1, big, KFPFRAG_MAX_MESSAGE + 1, BTSTACK_LANE_BULK, 0) == -3);
+	stopLayer();
+}
+
+static void testRandom(void)
+{
+	static const uint8_t mtus[3] = {KFPFRAG_HEADER_SIZE + 5, 40, BTSTACK_MAX_RAW};
+	static uint8_t sent[KFPFRAG_MAX_MESSAGE];
+	uint32_t wrong = 0;
+	uint32_t sendFailures = 0;
+
+	uint32_t n;
+	for (n = 0; n < MESSAGES; n++)
+	{
+		if (n % (MESSAGES / 3 + 1) == 0)
+		{
+			if (n > 0)
+			{
+				stopLayer();
+			}
+			startLayer(mtus[n / (MESSAGES / 3 + 1)], 500);
+		}
+
+		uint16_t chunk = mtus[n / (MESSAGES / 3 + 1)] - KFPFRAG_HEADER_SIZE;
+		uint16_t most = chunk * KFPFRAG_MAX_FRAGMENTS;
+		if (most > KFPFRAG_MAX_MESSAGE)
+		{
+			most = KFPFRAG_MAX_MESSAGE;
+		}
+		uint16_t len = 1 + Check_below(most);
+		uint32_t id = Check_random();
+		fillMessage(sent, len);
+
+		fragmentCount = 0;
+		receivedCount = 0;
+		sendFailures += (KfpFrag_send(id, sent, len, BTSTACK_LANE_BULK, 10) != 0);
+
+		// shuffled, and some arrive twice
+		uint16_t i;
+		for (i = fragmentCount; i > 1; i--)
+		{
+			uint16_t j = Check_below(i);
+			Fragment swap = fragments[i - 1];
+			fragments[i - 1] = fragments[j];
+			fragments[j] = swap;
+		}
+		for (i = 0; i < fragmentCount; i++)
+		{
+			FakeBtStack_receive(fragments[i].data, fragments[i].size);
+			if ((i + 1 < fragmentCount) && (Check_below(10) == 0))
+			{
+				FakeBtStack_receive(fragments[i].data, fragments[i].size);
+			}
+		}
+
+		wrong += (receivedCount != 1) || (receivedId != id) || (receivedLen != len) ||
+				(memcmp(received, sent, len) != 0);
+	}
+	CHECK(sendFailures == 0);
+	CHECK(wrong == 0);
+
+	KfpFrag_Stats stats;
+	KfpFrag_getStats(&stats);
+	CHECK(stats.dropped == 0);
+	CHECK(stats.timeouts == 0);
+	stopLayer();
+}
+
+static void testInterleaved(void)
+{
+	startLayer(40, 500);
+	static uint8_t first[200];
+	static uint8_t second[300];
+	static uint8_t third[100];
+	fillMessage(first, sizeof(first));
+	fillMessage(second, sizeof(second));
+	fillMessage(third, sizeof(third));
+
+	static Fragment a[KFPFRAG_MAX_FRAGMENTS];
+	static Fragment b[KFPFRAG_MAX_FRAGMENTS];
+	CHECK(KfpFrag_send(1, first, sizeof(first), BTSTACK_LANE_BULK, 0) == 0);
+	uint16_t aCount = fragmentCount;
+	memcpy(a, fragments, sizeof(Fragment) * aCount);
+	fragmentCount = 0;
+	CHECK(KfpFrag_send(2, second, sizeof(second), BTSTACK_LANE_BULK, 0) == 0);
+	uint16_t bCount = fragmentCount;
+	memcpy(b, fragments, sizeof(Fragment) * bCount);
+	fragmentCount = 0;
+	CHECK(KfpFrag_send(3, third, sizeof(third), BTSTACK_LANE_BULK, 0) == 0);
+
+	// both slots in use, the third message has nowhere to go
+	FakeBtStack_receive(a[0].data, a[0].size);
+	FakeBtStack_receive(b[0].data, b[0].size);
+	FakeBtStack_receive(fragments[0].data, fragments[0].size);
+
+	uint16_t i;
+	for (i = 1; (i < aCount) || (i < bCount); i++)
+	{
+		if (i < bCount)
+		{
+			FakeBtStack_receive(b[i].data, b[i].size);
+		}
+		if (i < aCount)
+		{
+			FakeBtStack_receive(a[i].data, a[i].size);
+		}
+	}
+	CHECK(receivedCount == 2);
+	CHECK(receivedId == 2);
+	CHECK((receivedLen == sizeof(second)) && (memcmp(received, second, sizeof(second)) == 0));
+
+	KfpFrag_Stats stats;
+	KfpFrag_getStats(&stats);
+	CHECK(stats.messagesReceived == 2);
+	CHECK(stats.dropped == 1);
+
+	// slots are free again once messages complete
+	for (i = 0; i < fragmentCount; i++)
+	{
+		FakeBtStack_receive(fragments[i].data, fragments[i].size);
+	}
+	CHECK(receivedCount == 3);
+	CHECK((receivedId == 3) && (memcmp(received, third, sizeof(third)) == 0));
+	stopLayer();
+}
+
+static void testTimeout(void)
+{
+	startLayer(40, 20);
+	static uint8_t data[300];
+	fillMessage(data, sizeof(data));
+
+	// two messages stop arriving, holding both slots
+	CHECK(KfpFrag_send(1, data, sizeof(data), BTSTACK_LANE_BULK, 0) == 0);
+	CHECK(KfpFrag_send(2, data, sizeof(data), BTSTACK_LANE_BULK, 0) == 0);
+	uint16_t perMessage = fragmentCount / 2;
+	FakeBtStack_receive(fragments[0].data, fragments[0].size);
+	FakeBtStack_receive(fragments[perMessage].data, fragments[perMessage].size);
+
+	fragmentCount = 0;
+	CHECK(KfpFrag_send(3, data, sizeof(data), BTSTACK_LANE_BULK, 0) == 0);
+	FakeBtStack_receive(fragments[0].data, fragments[0].size);
+
+	KfpFrag_Stats stats;
+	KfpFrag_getStats(&stats);
+	CHECK(stats.dropped == 1);
+	CHECK(stats.timeouts == 0);
+
+	// abandoned once the timeout passes
+	Task_sleep(30);
+	uint16_t i;
+	for (i = 0; i < fragmentCount; i++)
+	{
+		FakeBtStack_receive(fragments[i].data, fragments[i].size);
+	}
+	CHECK(receivedCount == 1);
+	CHECK(receivedId == 3);
+
+	KfpFrag_getStats(&stats);
+	CHECK(stats.timeouts == 2);
+	stopLayer();
+}
+
+static void testMalformed(void)
+{
+	startLayer(40, 500);
+	uint8_t data[20];
+	fillMessage(data, sizeof(data));
+	CHECK(KfpFrag_send(7, data, sizeof(data), BTSTACK_LANE_BULK, 0) == 0);
+	CHECK(fragmentCount == 1);
+
+	// a message in one frame is delivered straight away
+	FakeBtStack_receive(fragments[0].data, fragments[0].size);
+	CHECK(receivedCount == 1);
+	CHECK((receivedId == 7) && (receivedLen == sizeof(data)) && (memcmp(received, data, sizeof(data)) == 0));
+
+	uint8_t frame[BTSTACK_MAX_RAW];
+	memcpy(frame, fragments[0].data, fragments[0].size);
+	uint16_t size = fragments[0].size;
+
+	// short header
+	FakeBtStack_receive(frame, KFPFRAG_HEADER_SIZE - 1);
+	// length disagrees with the frame
+	FakeBtStack_receive(frame, size - 1);
+	// no fragments
+	frame[4] = 0;
+	FakeBtStack_receive(frame, size);
+	// index past the count
+	frame[3] = 2;
+	frame[4] = 2;
+	FakeBtStack_receive(frame, size);
+	// data past the end of the largest message
+	frame[3] = 0;
+	frame[5] = (KFPFRAG_MAX_MESSAGE - 10) & 0xFF;
+	frame[6] = (KFPFRAG_MAX_MESSAGE - 10) >> 8;
+	FakeBtStack_receive(frame, size);
+
+	CHECK(receivedCount == 1);
+	KfpFrag_Stats stats;
+	KfpFrag_getStats(&stats);
+	CHECK(stats.dropped == 5);
+	CHECK(stats.fragmentsReceived == 6);
+	stopLayer();
+}
+
+static void testLane(void)
+{
+	startLayer(40, 500);
+	uint8_t data[100];
+	fillMessage(data, sizeof(data));
+
+	// a lane which stays full gives up after the timeout
+	laneResult = -2;
+	UInt32 start = Clock_getTicks();
+	CHECK(KfpFrag_send(1, data, sizeof(data), BTSTACK_LANE_BULK, 10) == -2);
+	CHECK(Clock_getTicks() - start >= 10);
+
+	// a fragment the lane can never take
+	laneResult = -4;
+	CHECK(KfpFrag_send(1, data, sizeof(data), BTSTACK_LANE_BULK, 10) == -4);
+
+	laneResult = 0;
+	CHECK(KfpFrag_send(1, data, sizeof(data), BTSTACK_LANE_BULK, 10) == 0);
+	KfpFrag_Stats stats;
+	KfpFrag_getStats(&stats);
+	CHECK(stats.messagesSent == 1);
+	CHECK(stats.bytesSent == sizeof(data));
+	stopLayer();
+}
+
+/**
+ * \brief Bytes a frame takes on the wire, with its CRC trailer and SLIP encoded
+ *
+ * \param link Frame is a link frame, sent after KFP_LINK_MARKER
+ */
+static uint16_t wireSize(const uint8_t* frame, uint16_t size, Bool link)
+{
+	uint8_t buf[SLIP_MAX_FRAME];
+	uint8_t out[SLIP_WORST_SIZE(SLIP_MAX_FRAME)];
+	uint16_t n = 0;
+	if (link)
+	{
+		buf[n++] = KFP_LINK_MARKER;
+	}
+	memcpy(&buf[n], frame, size);
+	n += size;
+	uint16_t crc = Crc16_compute(buf, n);
+	buf[n++] = crc >> 8;
+	buf[n++] = crc & 0xFF;
+	return Slip_encode(out, buf, n);
+}
+
+static double seconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void benchEfficiency(void)
+{
+	// fixed frames carry 8 bytes of the message after a 4 byte ID
+	static const uint16_t lens[4] = {8, 64, 512, KFPFRAG_MAX_MESSAGE};
+	static const uint8_t mtus[2] = {40, BTSTACK_MAX_RAW};
+	static uint8_t data[KFPFRAG_MAX_MESSAGE];
+	fillMessage(data, sizeof(data));
+
+	uint8_t l;
+	for (l = 0; l < 4; l++)
+	{
+		uint16_t len = lens[l];
+		uint32_t fixedWire = 0;
+		uint16_t off;
+		for (off = 0; off < len; off += 8)
+		{
+			uint8_t frame[KFP_FRAME_SIZE-2] = {0x10, 0x00, 0x00, 0x01};
+			memcpy(&frame[4], &data[off], (len - off < 8) ? len - off : 8);
+			fixedWire += wireSize(frame, sizeof(frame), FALSE);
+		}
+		double fixed = (double)len / fixedWire;
+		printf("kfpFrag: %4u byte message, fixed frames %.0f%% payload, %.0f bytes/s", len, 100.0 * fixed,
+				fixed * WIRE_BYTES_PER_S);
+
+		uint8_t m;
+		for (m = 0; m < 2; m++)
+		{
+			startLayer(mtus[m], 500);
+			CHECK(KfpFrag_send(0x10000001, data, len, BTSTACK_LANE_BULK, 0) == 0);
+			uint32_t fragWire = 0;
+			uint16_t i;
+			for (i = 0; i < fragmentCount; i++)
+			{
+				fragWire += wireSize(fragments[i].data, fragments[i].size, TRUE);
+			}
+
+			// the layer itself, fragmenting into and reassembling from memory
+			double start = seconds();
+			uint32_t n;
+			for (n = 0; n < BENCH_MESSAGES; n++)
+			{
+				fragmentCount = 0;
+				KfpFrag_send(n, data, len, BTSTACK_LANE_BULK, 0);
+				for (i = 0; i < fragmentCount; i++)
+				{
+					FakeBtStack_receive(fragments[i].data, fragments[i].size);
+				}
+			}
+			double host = seconds() - start;
+			CHECK(receivedCount == BENCH_MESSAGES);
+			CHECK((receivedLen == len) && (memcmp(received, data, len) == 0));
+			stopLayer();
+
+			double frag = (double)len / fragWire;
+			// a header costs more than fixed frames only for the shortest messages
+			CHECK((len < 64) || (frag > fixed));
+			printf(", MTU %u %.0f%% payload, %.0f bytes/s (%.0f MB/s on the host)", mtus[m], 100.0 * frag,
+					frag * WIRE_BYTES_PER_S, (double)len * BENCH_MESSAGES / host / 1e6);
+		}
+		printf("\n");
+	}
+}
+
+int main(void)
+{
+	testConfig();
+	testRandom();
+	testInterleaved();
+	testTimeout();
+	testMalformed();
+	testLane();
+	benchEfficiency();
+
+	return CHECK_RESULT();
+}
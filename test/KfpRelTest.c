@@ -0,0 +1,563 @@
+/**
+ * \file KfpRelTest.c
+ * \brief Tests the reliable KFP channel on the host
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ *
+ * The channel runs on the btStack stand-in with its link frames looped back
+ * through a wire which loses, delays, reorders and repeats them, so one
+ * channel is both ends of the link. Acknowledgement bitmaps and restarted
+ * peers are checked against frames written by the test. Goodput is
+ * reported against window size over a lossy wire with a round trip delay.
+ */
+
+#include <string.h>
+
+#include <ti/sysbios/BIOS.h>
+#include <ti/sysbios/hal/Hwi.h>
+#include <ti/sysbios/knl/Clock.h>
+#include <ti/sysbios/knl/Task.h>
+
+#include "Check.h"
+#include "FakeBios.h"
+#include "FakeBtStack.h"
+#include "KfpRel.h"
+
+#define WIRE_DEPTH 64			//! Most link frames on the wire at once
+#define WIRE_SIZE 20			//! Largest link frame the wire carries
+#define LOSSY_FRAMES 1000		//! Frames sent over the lossy wire
+#define CAPTURE_DEPTH 64		//! Most pushed link frames captured
+#define GOODPUT_FRAMES 200		//! Frames sent at each window size
+#define GOODPUT_DELAY 5			//! Ticks a link frame spends on the wire in the goodput test
+
+/**
+ * \struct WireFrame
+ * \brief A link frame on its way back to the channel
+ */
+typedef struct
+{
+	uint8_t data[WIRE_SIZE];
+	uint16_t size;
+	UInt32 due;			//! Tick the frame reaches the far end
+} WireFrame;
+
+static WireFrame wire[WIRE_DEPTH];
+static volatile uint8_t wireCount = 0;
+static volatile Bool pumpBusy = FALSE;		//! Pump is handing a frame to the channel
+static uint8_t lossPercent = 0;				//! Chance a frame is lost
+static uint8_t reorderPercent = 0;			//! Chance a frame overtakes the one before it
+static uint8_t repeatPercent = 0;			//! Chance a frame arrives twice
+static UInt32 delayTicks = 0;				//! Ticks each frame spends on the wire
+static Bool refuseData = FALSE;				//! Data frames are refused as if the lane were full
+
+static WireFrame captured[CAPTURE_DEPTH];
+static volatile uint8_t capturedCount = 0;
+
+static uint32_t delivered[LOSSY_FRAMES];	//! Sequence numbers in the order delivered
+static volatile uint32_t deliveredCount = 0;
+
+static BtStack_Frame makeFrame(uint32_t seq)
+{
+	BtStack_Frame frame;
+	memset(&frame, 0, sizeof(frame));
+	frame.id.b32 = 0x00000042;
+	frame.payload.b32[0] = seq;
+	return frame;
+}
+
+/**
+ * \brief Puts a pushed link frame on the wire, or loses it
+ */
+static int16_t wireFxn(const uint8_t* frame, uint16_t size, BtStack_Lane lane)
+{
+	UInt key = Hwi_disable();
+	if (refuseData && (frame[0] == KFP_LINK_REL_DATA))
+	{
+		Hwi_restore(key);
+		return -2;
+	}
+
+	if (wireCount >= WIRE_DEPTH - 1)
+	{
+		Hwi_restore(key);
+		return -2;
+	}
+
+	if (Check_below(100) >= lossPercent)
+	{
+		uint8_t copies = (Check_below(100) < repeatPercent) ? 2 : 1;
+		while (copies-- > 0)
+		{
+			memcpy(wire[wireCount].data, frame, size);
+			wire[wireCount].size = size;
+			wire[wireCount].due = Clock_getTicks() + delayTicks;
+			wireCount++;
+		}
+
+		if ((wireCount >= 2) && (Check_below(100) < reorderPercent))
+		{
+			WireFrame last = wire[wireCount - 1];
+			wire[wireCount - 1] = wire[wireCount - 2];
+			wire[wireCount - 2] = last;
+		}
+	}
+	Hwi_restore(key);
+
+	return size + 2;
+}
+
+/**
+ * \brief Keeps pushed link frames for the test to read
+ */
+static int16_t captureFxn(const uint8_t* frame, uint16_t size, BtStack_Lane lane)
+{
+	UInt key = Hwi_disable();
+	if (capturedCount < CAPTURE_DEPTH)
+	{
+		memcpy(captured[capturedCount].data, frame, size);
+		captured[capturedCount].size = size;
+		capturedCount++;
+	}
+	Hwi_restore(key);
+	return size + 2;
+}
+
+static void deliverFxn(const BtStack_Frame* frame)
+{
+	if (deliveredCount < LOSSY_FRAMES)
+	{
+		delivered[deliveredCount] = frame->payload.b32[0];
+	}
+	deliveredCount++;
+}
+
+/**
+ * \brief Hands frames on the wire back to the channel in order once due, as the reception task would
+ */
+static void pumpFxn(UArg unused0, UArg unused1)
+{
+	while (TRUE)
+	{
+		WireFrame frame;
+		UInt key = Hwi_disable();
+		Bool got = (wireCount > 0) && ((Int32)(Clock_getTicks() - wire[0].due) >= 0);
+		if (got)
+		{
+			frame = wire[0];
+			memmove(&wire[0], &wire[1], (wireCount - 1) * sizeof(WireFrame));
+			wireCount--;
+			pumpBusy = TRUE;
+		}
+		Hwi_restore(key);
+
+		if (!got)
+		{
+			Task_sleep(1);
+			continue;
+		}
+
+		FakeBtStack_receive(frame.data, frame.size);
+		pumpBusy = FALSE;
+	}
+}
+
+static Bool wireIdle(void* arg)
+{
+	return (wireCount == 0) && !pumpBusy;
+}
+
+static Bool allDelivered(void* arg)
+{
+	KfpRel_Stats stats;
+	KfpRel_getStats(&stats);
+	return (deliveredCount >= *(uint32_t*)arg) && (stats.acked >= *(uint32_t*)arg);
+}
+
+static Bool capturedAtLeast(void* arg)
+{
+	return capturedCount >= *(uint8_t*)arg;
+}
+
+/**
+ * \brief Starts the channel on a clean loopback wire
+ */
+static void startChannel(uint8_t size, uint16_t ms)
+{
+	FakeBtStack_reset();
+	UInt key = Hwi_disable();
+	wireCount = 0;
+	capturedCount = 0;
+	lossPercent = 0;
+	reorderPercent = 0;
+	repeatPercent = 0;
+	delayTicks = 0;
+	refuseData = FALSE;
+	deliveredCount = 0;
+	Hwi_restore(key);
+
+	CHECK(KfpRel_setWindow(size) == 0);
+	CHECK(KfpRel_setTimeout(ms) == 0);
+	CHECK(KfpRel_start() == 0);
+	FakeBtStack_onRaw(wireFxn);
+	FakeBtStack_onDeliver(deliverFxn);
+	FakeBtStack_setStarted(TRUE);
+}
+
+/**
+ * \brief Empties the wire, then stops the channel
+ */
+static void stopChannel(void)
+{
+	UInt key = Hwi_disable();
+	lossPercent = 100;
+	Hwi_restore(key);
+	CHECK(FakeBios_waitFor(wireIdle, NULL, 1000));
+	Task_sleep(20);
+	CHECK(FakeBios_waitFor(wireIdle, NULL, 1000));
+
+	FakeBtStack_setStarted(FALSE);
+	CHECK(KfpRel_stop() == 0);
+}
+
+/**
+ * \brief Checks each sequence number was delivered exactly once, in order
+ */
+static void expectInOrder(uint32_t count)
+{
+	CHECK(deliveredCount == count);
+	uint32_t wrong = 0;
+	uint32_t i;
+	for (i = 0; (i < count) && (i < deliveredCount); i++)
+	{
+		wrong += (delivered[i] != i);
+	}
+	CHECK(wrong == 0);
+}
+
+static void testConfig(void)
+{
+	FakeBtStack_reset();
+	CHECK(KfpRel_setWindow(0) == -2);
+	CHECK(KfpRel_setWindow(KFPREL_MAX_WINDOW + 1) == -2);
+	CHECK(KfpRel_setTimeout(0) == -2);
+	CHECK(KfpRel_stop() == -1);
+
+	BtStack_Frame frame = makeFrame(0);
+	CHECK(KfpRel_send(&frame, 0) == -1);
+
+	// links can only be made before btStack starts
+	FakeBtStack_setStarted(TRUE);
+	CHECK(KfpRel_start() == -1);
+	FakeBtStack_setStarted(FALSE);
+
+	CHECK(KfpRel_start() == 0);
+	CHECK(KfpRel_start() == -1);
+	CHECK(KfpRel_setWindow(2) == -1);
+	CHECK(KfpRel_setTimeout(10) == -1);
+	CHECK(KfpRel_stop() == 0);
+}
+
+static void testLoopback(void)
+{
+	// a timeout no scheduling stall on the host reaches, so any retransmit is a fault
+	startChannel(4, 1000);
+
+	uint32_t seq;
+	for (seq = 0; seq < 100; seq++)
+	{
+		BtStack_Frame frame = makeFrame(seq);
+		CHECK(KfpRel_send(&frame, BIOS_WAIT_FOREVER) == 0);
+	}
+
+	uint32_t count = 100;
+	CHECK(FakeBios_waitFor(allDelivered, &count, 5000));
+	expectInOrder(100);
+
+	KfpRel_Stats stats;
+	KfpRel_getStats(&stats);
+	CHECK(stats.sent == 100);
+	CHECK(stats.acked == 100);
+	CHECK(stats.delivered == 100);
+	CHECK(stats.retransmits == 0);
+	CHECK(stats.duplicates == 0);
+	stopChannel();
+}
+
+static void testLossy(void)
+{
+	startChannel(KFPREL_MAX_WINDOW, 10);
+	UInt key = Hwi_disable();
+	lossPercent = 15;
+	reorderPercent = 10;
+	repeatPercent = 5;
+	Hwi_restore(key);
+
+	uint32_t failed = 0;
+	uint32_t seq;
+	for (seq = 0; seq < LOSSY_FRAMES; seq++)
+	{
+		BtStack_Frame frame = makeFrame(seq);
+		failed += (KfpRel_send(&frame, BIOS_WAIT_FOREVER) != 0);
+	}
+	CHECK(failed == 0);
+
+	uint32_t count = LOSSY_FRAMES;
+	CHECK(FakeBios_waitFor(allDelivered, &count, 30000));
+	expectInOrder(LOSSY_FRAMES);
+
+	KfpRel_Stats stats;
+	KfpRel_getStats(&stats);
+	CHECK(stats.sent == LOSSY_FRAMES);
+	CHECK(stats.acked == LOSSY_FRAMES);
+	CHECK(stats.delivered == LOSSY_FRAMES);
+	CHECK(stats.retransmits > 0);
+	CHECK(stats.duplicates > 0);
+	CHECK(stats.outOfOrder > 0);
+	printf("kfpRel: %u frames, %u retransmits, %u duplicates, %u out of order\n",
+			(unsigned) stats.sent, (unsigned) stats.retransmits, (unsigned) stats.duplicates, (unsigned) stats.outOfOrder);
+	stopChannel();
+}
+
+static void testGoodput(void)
+{
+	// a round trip of 2 * GOODPUT_DELAY ticks, so a window of 1 is stop-and-wait
+	double goodput[KFPREL_MAX_WINDOW + 1];
+	uint8_t size;
+	for (size = 1; size <= KFPREL_MAX_WINDOW; size *= 2)
+	{
+		startChannel(size, 4 * GOODPUT_DELAY);
+		UInt key = Hwi_disable();
+		lossPercent = 5;
+		delayTicks = GOODPUT_DELAY;
+		Hwi_restore(key);
+
+		UInt32 start = Clock_getTicks();
+		uint32_t seq;
+		for (seq = 0; seq < GOODPUT_FRAMES; seq++)
+		{
+			BtStack_Frame frame = makeFrame(seq);
+			CHECK(KfpRel_send(&frame, BIOS_WAIT_FOREVER) == 0);
+		}
+		uint32_t count = GOODPUT_FRAMES;
+		CHECK(FakeBios_waitFor(allDelivered, &count, 30000));
+		UInt32 ticks = Clock_getTicks() - start;
+		expectInOrder(GOODPUT_FRAMES);
+
+		KfpRel_Stats stats;
+		KfpRel_getStats(&stats);
+		goodput[size] = GOODPUT_FRAMES * 1000.0 / ticks;
+		printf("kfpRel: window %u, %.0f frames/s (%.0f payload bytes/s), %u retransmits, %u ms round trip, 5%% loss\n",
+				size, goodput[size], goodput[size] * sizeof(((BtStack_Frame*)0)->payload),
+				(unsigned) stats.retransmits, 2 * GOODPUT_DELAY);
+		stopChannel();
+	}
+
+	// frames in flight cover the round trip, stop-and-wait idles through it
+	CHECK(goodput[KFPREL_MAX_WINDOW] > 2 * goodput[1]);
+}
+
+static void testWindowFull(void)
+{
+	startChannel(4, 10);
+	UInt key = Hwi_disable();
+	lossPercent = 100;
+	Hwi_restore(key);
+
+	uint32_t seq;
+	for (seq = 0; seq < 4; seq++)
+	{
+		BtStack_Frame frame = makeFrame(seq);
+		CHECK(KfpRel_send(&frame, BIOS_NO_WAIT) == 0);
+	}
+	BtStack_Frame frame = makeFrame(4);
+	CHECK(KfpRel_send(&frame, 20) == -2);
+
+	// the unacknowledged frames go again until they get through
+	key = Hwi_disable();
+	lossPercent = 0;
+	Hwi_restore(key);
+	uint32_t count = 4;
+	CHECK(FakeBios_waitFor(allDelivered, &count, 2000));
+	CHECK(KfpRel_send(&frame, 100) == 0);
+	count = 5;
+	CHECK(FakeBios_waitFor(allDelivered, &count, 2000));
+	expectInOrder(5);
+
+	KfpRel_Stats stats;
+	KfpRel_getStats(&stats);
+	CHECK(stats.retransmits >= 4);
+	stopChannel();
+}
+
+static void testRefused(void)
+{
+	startChannel(4, 10);
+	UInt key = Hwi_disable();
+	refuseData = TRUE;
+	Hwi_restore(key);
+
+	// a refused frame stays in the window
+	BtStack_Frame frame = makeFrame(0);
+	CHECK(KfpRel_send(&frame, BIOS_NO_WAIT) == -3);
+	Task_sleep(30);
+	CHECK(deliveredCount == 0);
+
+	key = Hwi_disable();
+	refuseData = FALSE;
+	Hwi_restore(key);
+	uint32_t count = 1;
+	CHECK(FakeBios_waitFor(allDelivered, &count, 2000));
+	expectInOrder(1);
+	stopChannel();
+}
+
+/**
+ * \brief Writes a data link frame as the peer would
+ */
+static void receiveData(uint16_t session, uint8_t seq)
+{
+	BtStack_Frame frame = makeFrame(seq);
+	uint8_t data[4 + KFP_FRAME_SIZE-2] = {KFP_LINK_REL_DATA, session & 0xFF, session >> 8, seq};
+	memcpy(&data[4], frame.b8, KFP_FRAME_SIZE-2);
+	CHECK(FakeBtStack_receive(data, sizeof(data)));
+}
+
+/**
+ * \brief Writes an ack link frame as the peer would
+ */
+static void receiveAck(uint16_t peer, uint16_t acked, uint8_t next, uint8_t bitmap)
+{
+	uint8_t ack[7] = {KFP_LINK_REL_ACK, peer & 0xFF, peer >> 8, acked & 0xFF, acked >> 8, next, bitmap};
+	CHECK(FakeBtStack_receive(ack, sizeof(ack)));
+}
+
+/**
+ * \brief Checks the last captured frame is an ack of a session
+ */
+static void expectAck(uint16_t acked, uint8_t next, uint8_t bitmap)
+{
+	CHECK(capturedCount > 0);
+	if (capturedCount == 0)
+	{
+		return;
+	}
+	const WireFrame* ack = &captured[capturedCount - 1];
+	CHECK(ack->size == 7);
+	CHECK(ack->data[0] == KFP_LINK_REL_ACK);
+	CHECK((ack->data[3] | (ack->data[4] << 8)) == acked);
+	CHECK(ack->data[5] == next);
+	CHECK(ack->data[6] == bitmap);
+}
+
+static void testReceiver(void)
+{
+	startChannel(4, 60);
+	FakeBtStack_onRaw(captureFxn);
+
+	// a gap is held back and reported in the bitmap
+	receiveData(0x1234, 1);
+	CHECK(deliveredCount == 0);
+	expectAck(0x1234, 0, 0x01);
+
+	receiveData(0x1234, 0);
+	expectInOrder(2);
+	expectAck(0x1234, 2, 0x00);
+
+	receiveData(0x1234, 0);
+	CHECK(deliveredCount == 2);
+	expectAck(0x1234, 2, 0x00);
+
+	// a restarted peer numbers from 0 again
+	receiveData(0x5678, 0);
+	CHECK(deliveredCount == 3);
+	CHECK(delivered[2] == 0);
+	expectAck(0x5678, 1, 0x00);
+
+	KfpRel_Stats stats;
+	KfpRel_getStats(&stats);
+	CHECK(stats.delivered == 3);
+	CHECK(stats.duplicates == 1);
+	CHECK(stats.outOfOrder == 1);
+	CHECK(stats.resyncs == 1);
+	stopChannel();
+}
+
+static void testSender(void)
+{
+	startChannel(4, 1000);
+	FakeBtStack_onRaw(captureFxn);
+
+	uint32_t seq;
+	for (seq = 0; seq < 3; seq++)
+	{
+		BtStack_Frame frame = makeFrame(seq);
+		CHECK(KfpRel_send(&frame, BIOS_NO_WAIT) == 0);
+	}
+	CHECK(capturedCount == 3);
+	uint16_t session = captured[0].data[1] | (captured[0].data[2] << 8);
+	CHECK(session != 0);
+	for (seq = 0; seq < 3; seq++)
+	{
+		CHECK(captured[seq].data[0] == KFP_LINK_REL_DATA);
+		CHECK(captured[seq].data[3] == seq);
+	}
+
+	// frame 0 by the cumulative number, frame 2 by the bitmap
+	receiveAck(0x1111, session, 1, 0x01);
+	KfpRel_Stats stats;
+	KfpRel_getStats(&stats);
+	CHECK(stats.acked == 2);
+
+	// acks of another session of this end are ignored
+	receiveAck(0x1111, session ^ 0x0101, 3, 0x00);
+	KfpRel_getStats(&stats);
+	CHECK(stats.acked == 2);
+
+	// the peer restarted, frames 1 and 2 go again at once as 0 and 1
+	capturedCount = 0;
+	receiveAck(0x2222, session, 0, 0x00);
+	uint8_t want = 2;
+	CHECK(FakeBios_waitFor(capturedAtLeast, &want, 100));
+	KfpRel_getStats(&stats);
+	CHECK(stats.resyncs == 1);
+
+	Bool found[2] = {FALSE, FALSE};
+	uint8_t i;
+	for (i = 0; i < capturedCount; i++)
+	{
+		const uint8_t* data = captured[i].data;
+		BtStack_Frame frame;
+		memcpy(frame.b8, &data[4], KFP_FRAME_SIZE-2);
+		if ((data[0] == KFP_LINK_REL_DATA) && (data[3] < 2) && (frame.payload.b32[0] == data[3] + 1u))
+		{
+			found[data[3]] = TRUE;
+		}
+	}
+	CHECK(found[0] && found[1]);
+
+	receiveAck(0x2222, session, 2, 0x00);
+	KfpRel_getStats(&stats);
+	CHECK(stats.acked == 4);
+	stopChannel();
+}
+
+int main(void)
+{
+	Task_Params params;
+	Task_Params_init(&params);
+	Task_Handle pump = Task_create(pumpFxn, &params, NULL);
+	CHECK(pump != NULL);
+
+	testConfig();
+	testLoopback();
+	testLossy();
+	testGoodput();
+	testWindowFull();
+	testRefused();
+	testReceiver();
+	testSender();
+
+	Task_delete(&pump);
+	return CHECK_RESULT();
+}
@@ -0,0 +1,637 @@
+/**
+ * \file PwrMgmtTest.c
+ * \brief Tests the power management service on the host
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ *
+ * The service runs on the inter board bus service, itself on the I2C driver
+ * stand-in, so the test sees the writes the power board would. A simulated
+ * power board decodes them and answers reads. Covers the queued and blocking
+ * commands on one bus handle, the telemetry snapshot, the background battery
+ * poll and stopping with work queued. Times blocking calls end to end on a
+ * board which answers at once, and models the bus time of commands.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <ti/sysbios/BIOS.h>
+#include <ti/sysbios/knl/Task.h>
+
+#include "Check.h"
+#include "FakeBios.h"
+#include "FakeI2C.h"
+#include "PwrMgmt.h"
+
+#define PWRBOARD_ADDR 0x02		//! Address of the power board, as PwrMgmt.c
+#define DRV_PWR 101				//! Drive power component, as PwrMgmt.c
+#define DRV_YAW 102				//! Drive yaw component, as PwrMgmt.c
+#define BATTERY_REQUEST_CODE 131	//! Battery request, as PwrMgmt.c
+#define REGISTER_READ_CODE 132	//! Register block read, as PwrMgmt.c
+#define BOARD_REGISTERS 16		//! No. of registers of the simulated board, reads past them answer 0
+#define MAX_DONE 16				//! Most completions recorded
+#define HANDLE_ROUNDS 50		//! No. of rounds of blocking commands sent on one handle
+#define BENCH_DRIVES 100		//! No. of drive commands timed by the benchmark
+#define BENCH_CALLS 2000		//! No. of each blocking call timed by the call benchmark
+#define BUS_KHZ 400				//! Bus clock the benchmark models
+
+/**
+ * \struct Done
+ * \brief A completion reported to a doneFxn
+ */
+typedef struct
+{
+	PwrMgmt_Token token;
+	int8_t status;
+	uint8_t read;				//! First byte read
+} Done;
+
+static Done done[MAX_DONE];
+static volatile uint8_t doneCount = 0;
+
+/**
+ * \struct PowerBoard
+ * \brief State of the simulated power board
+ */
+typedef struct
+{
+	int8_t power;				//! Last drive power applied
+	int8_t yaw;					//! Last drive yaw applied
+	uint8_t weapon[2];			//! Last state of each weapon
+	uint32_t commands;			//! No. of component and magnitude pairs applied
+	uint32_t unknown;			//! No. of writes it could not decode
+	uint8_t battery;			//! Percentage of battery remaining it reports
+	uint8_t regs[BOARD_REGISTERS];	//! Register map
+} PowerBoard;
+
+static PowerBoard board;
+static volatile Bool autoComplete = FALSE;	//! Power board answers every transfer at once
+static volatile Bool answerNow = FALSE;		//! Power board answers without waiting for the next tick
+
+static void doneFxn(PwrMgmt_Token token, int8_t status, const uint8_t* read, void* arg)
+{
+	if (doneCount < MAX_DONE)
+	{
+		done[doneCount].token = token;
+		done[doneCount].status = status;
+		done[doneCount].read = read[0];
+		doneCount++;
+	}
+}
+
+/**
+ * \brief Returns the transfer logged last, the one on the bus while it is busy
+ */
+static FakeI2C_Transfer lastTransfer(void)
+{
+	FakeI2C_Transfer log[FAKEI2C_LOG_SIZE];
+	uint16_t count = FakeI2C_log(log);
+	CHECK(count > 0);
+	if (count == 0)
+	{
+		memset(&log[0], 0, sizeof(log[0]));
+		return log[0];
+	}
+	return log[count - 1];
+}
+
+static Bool transfersLogged(void* arg)
+{
+	return FakeI2C_log(NULL) >= *(uint16_t*)arg;
+}
+
+static Bool idle(void* arg)
+{
+	return InterBus_isIdle();
+}
+
+static Bool notRecovering(void* arg)
+{
+	// the recovery task starts the next transaction once the driver is open
+	return FakeI2C_busy() || InterBus_isIdle();
+}
+
+static Bool deferredAtLeast(void* arg)
+{
+	PwrMgmt_Battery battery;
+	PwrMgmt_getBattery(&battery);
+	return battery.deferred >= *(uint32_t*)arg;
+}
+
+/**
+ * \brief Fails the transfer on the bus and each of its retries
+ */
+static void failWithRetries(void)
+{
+	uint8_t attempt;
+	for (attempt = 0; attempt < 4; attempt++)
+	{
+		uint16_t want = FakeI2C_log(NULL) + 1;
+		if (attempt > 0)
+		{
+			CHECK(FakeBios_waitFor(transfersLogged, &want, 100));
+		}
+		CHECK(FakeI2C_complete(FALSE, NULL));
+	}
+}
+
+/**
+ * \brief Decodes a write as the power board does and builds its answer
+ */
+static void boardFxn(const FakeI2C_Transfer* t, uint8_t* read)
+{
+	if ((t->writeCount == 1) && (t->write[0] == BATTERY_REQUEST_CODE))
+	{
+		read[0] = board.battery;
+		return;
+	}
+
+	// a block of registers from the start register
+	if ((t->writeCount == 2) && (t->write[0] == REGISTER_READ_CODE) && (t->readCount > 0))
+	{
+		uint8_t i;
+		for (i = 0; i < t->readCount; i++)
+		{
+			uint16_t reg = t->write[1] + i;
+			read[i] = (reg < BOARD_REGISTERS) ? board.regs[reg] : 0;
+		}
+		return;
+	}
+
+	// otherwise component and magnitude pairs, back to back
+	if ((t->writeCount == 0) || (t->writeCount % 2) || (t->readCount > 0))
+	{
+		board.unknown++;
+		return;
+	}
+	uint8_t i;
+	for (i = 0; i < t->writeCount; i += 2)
+	{
+		uint8_t magnitude = t->write[i+1];
+		switch (t->write[i])
+		{
+			case DRV_PWR: board.power = (int8_t) magnitude; break;
+			case DRV_YAW: board.yaw = (int8_t) magnitude; break;
+			case WEAPON_1: board.weapon[0] = magnitude; break;
+			case WEAPON_2: board.weapon[1] = magnitude; break;
+			default: board.unknown++; continue;
+		}
+		board.commands++;
+	}
+}
+
+/**
+ * \brief Answers transfers while autoComplete is set, as the power board would
+ */
+static void completerFxn(UArg unused0, UArg unused1)
+{
+	while (TRUE)
+	{
+		if (autoComplete && FakeI2C_busy())
+		{
+			uint8_t read[INTERBUS_MAX_READ];
+			FakeI2C_Transfer t = lastTransfer();
+			memset(read, 0, sizeof(read));
+			boardFxn(&t, read);
+			FakeI2C_complete(TRUE, read);
+		}
+		if (answerNow)
+		{
+			Task_yield();
+		}
+		else
+		{
+			Task_sleep(1);
+		}
+	}
+}
+
+/**
+ * \brief Returns the bits a transfer puts on the bus, start, address, data with acks and stop
+ */
+static uint32_t busBits(uint8_t writeCount, uint8_t readCount)
+{
+	uint32_t bits = 1 + 9 * (1 + writeCount) + 1;
+	if (readCount > 0)
+	{
+		// repeated start and the address again
+		bits += 1 + 9 * (1 + readCount);
+	}
+	return bits;
+}
+
+static void startService(uint16_t batteryMs)
+{
+	FakeI2C_reset();
+	autoComplete = FALSE;
+	doneCount = 0;
+	memset(&board, 0, sizeof(board));
+	CHECK(InterBus_start() == 0);
+	CHECK(PwrMgmt_setBatteryInterval(batteryMs) == 0);
+	CHECK(PwrMgmt_start() == 0);
+}
+
+static void stopService(void)
+{
+	autoComplete = TRUE;
+	CHECK(PwrMgmt_stop() == 0);
+	CHECK(InterBus_stop() == 0);
+	autoComplete = FALSE;
+}
+
+static void testStart(void)
+{
+	// the bus service must be running with a free slave
+	FakeI2C_reset();
+	CHECK(PwrMgmt_start() == -3);
+	CHECK(PwrMgmt_stop() == -1);
+	CHECK(InterBus_start() == 0);
+
+	int8_t others[INTERBUS_MAX_SLAVES];
+	uint8_t i;
+	for (i = 0; i < INTERBUS_MAX_SLAVES; i++)
+	{
+		others[i] = InterBus_addSlave(0x10 + i);
+	}
+	CHECK(PwrMgmt_start() == -3);
+	for (i = 0; i < INTERBUS_MAX_SLAVES; i++)
+	{
+		InterBus_removeSlave(others[i]);
+	}
+
+	CHECK(PwrMgmt_setBatteryInterval(0) == 0);
+	CHECK(PwrMgmt_start() == 0);
+	CHECK(PwrMgmt_hasStarted());
+	CHECK(PwrMgmt_start() == -1);
+	CHECK(PwrMgmt_setBatteryInterval(100) == -1);
+	CHECK(PwrMgmt_stop() == 0);
+	CHECK(!PwrMgmt_hasStarted());
+	CHECK(PwrMgmt_stop() == -1);
+	CHECK(InterBus_stop() == 0);
+
+	// nothing is sent while stopped
+	PwrMgmt_Command command = {WEAPON_1, 1};
+	PwrMgmt_Telemetry telemetry;
+	uint8_t regs[1];
+	CHECK(PwrMgmt_drive(1, 1) == -1);
+	CHECK(PwrMgmt_batch(&command, 1) == -1);
+	CHECK(PwrMgmt_weapon(WEAPON_1, 1) == -1);
+	CHECK(PwrMgmt_batteryRemaining() == -1);
+	CHECK(PwrMgmt_batchAsync(&command, 1, NULL, NULL) == -1);
+	CHECK(PwrMgmt_driveAsync(1, 1, NULL, NULL) == -1);
+	CHECK(PwrMgmt_batteryAsync(NULL, NULL) == -1);
+	CHECK(PwrMgmt_stopNow(0) == -1);
+	CHECK(PwrMgmt_readRegisters(0, regs, 1) == -1);
+	CHECK(PwrMgmt_telemetry(&telemetry) == -1);
+	CHECK(PwrMgmt_telemetryAsync(NULL, NULL) == -1);
+	CHECK(FakeI2C_log(NULL) == 0);
+}
+
+static void testAsync(void)
+{
+	startService(0);
+
+	// each call returns at once, the bus works through them behind the caller's back
+	PwrMgmt_Command commands[3] = {{WEAPON_1, 1}, {WEAPON_2, 0}, {WEAPON_1, 2}};
+	int32_t batch = PwrMgmt_batchAsync(commands, 3, doneFxn, NULL);
+	int32_t drive = PwrMgmt_driveAsync(40, -40, doneFxn, NULL);
+	int32_t poll = PwrMgmt_batteryAsync(doneFxn, NULL);
+	CHECK((batch > 0) && (drive > 0) && (poll > 0));
+	CHECK(FakeI2C_busy());
+	CHECK(!PwrMgmt_isDone(batch) && !PwrMgmt_isDone(drive) && !PwrMgmt_isDone(poll));
+
+	CHECK(PwrMgmt_batchAsync(commands, 0, doneFxn, NULL) == -3);
+	CHECK(PwrMgmt_batchAsync(commands, PWRMGMT_MAX_BATCH + 1, doneFxn, NULL) == -3);
+
+	// one write carries the whole batch
+	FakeI2C_Transfer t = lastTransfer();
+	static const uint8_t batchBytes[6] = {WEAPON_1, 1, WEAPON_2, 0, WEAPON_1, 2};
+	CHECK(t.address == PWRBOARD_ADDR);
+	CHECK((t.writeCount == 6) && (t.readCount == 0));
+	CHECK(memcmp(t.write, batchBytes, 6) == 0);
+	CHECK(FakeI2C_complete(TRUE, NULL));
+
+	t = lastTransfer();
+	CHECK(t.writeCount == 4);
+	CHECK(FakeI2C_complete(TRUE, NULL));
+
+	// the poll reads one byte after the request code
+	t = lastTransfer();
+	CHECK((t.writeCount == 1) && (t.write[0] == 131) && (t.readCount == 1));
+	uint8_t percent = 64;
+	CHECK(FakeI2C_complete(TRUE, &percent));
+
+	CHECK(PwrMgmt_isDone(batch) && PwrMgmt_isDone(drive) && PwrMgmt_isDone(poll));
+	CHECK(doneCount == 3);
+	CHECK((done[0].token == (PwrMgmt_Token) batch) && (done[0].status == 0));
+	CHECK((done[1].token == (PwrMgmt_Token) drive) && (done[1].status == 0));
+	CHECK((done[2].token == (PwrMgmt_Token) poll) && (done[2].read == 64));
+
+	PwrMgmt_Stats stats;
+	PwrMgmt_getStats(&stats);
+	CHECK(stats.submitted == 3);
+	CHECK(stats.completed == 3);
+	stopService();
+}
+
+static void testStop(void)
+{
+	// a write the power board never finishes keeps the service running
+	startService(0);
+	CHECK(PwrMgmt_driveAsync(10, 10, NULL, NULL) > 0);
+	CHECK(PwrMgmt_stop() == -2);
+	CHECK(PwrMgmt_hasStarted());
+	CHECK(PwrMgmt_driveAsync(20, 20, NULL, NULL) > 0);
+
+	// stops once the queue drains
+	autoComplete = TRUE;
+	CHECK(PwrMgmt_stop() == 0);
+	CHECK(FakeI2C_log(NULL) == 2);
+	CHECK(InterBus_stop() == 0);
+	autoComplete = FALSE;
+}
+
+static void testBattery(void)
+{
+	// the first poll goes out at once, nothing is cached until it completes
+	startService(50);
+	uint16_t want = 1;
+	CHECK(FakeBios_waitFor(transfersLogged, &want, 100));
+	PwrMgmt_Battery battery;
+	CHECK(PwrMgmt_getBattery(&battery) == -1);
+	CHECK((battery.percent == -1) && (battery.polls == 0));
+
+	FakeI2C_Transfer t = lastTransfer();
+	CHECK((t.address == PWRBOARD_ADDR) && (t.writeCount == 1) && (t.write[0] == 131) && (t.readCount == 1));
+	uint8_t percent = 87;
+	CHECK(FakeI2C_complete(TRUE, &percent));
+	CHECK(PwrMgmt_getBattery(&battery) == 0);
+	CHECK((battery.percent == 87) && (battery.polls == 1) && (battery.failures == 0));
+	CHECK(battery.ageMs < 50);
+
+	// the reading ages between polls
+	Task_sleep(20);
+	CHECK(PwrMgmt_getBattery(&battery) == 0);
+	CHECK(battery.ageMs >= 20);
+
+	// polls wait while commands hold the bus
+	CHECK(PwrMgmt_driveAsync(30, 0, NULL, NULL) > 0);
+	uint32_t deferred = 2;
+	CHECK(FakeBios_waitFor(deferredAtLeast, &deferred, 500));
+	CHECK(FakeI2C_log(NULL) == 2);
+	CHECK(FakeI2C_complete(TRUE, NULL));
+
+	// a failed poll is counted and the last reading kept
+	want = 3;
+	CHECK(FakeBios_waitFor(transfersLogged, &want, 200));
+	t = lastTransfer();
+	CHECK(t.write[0] == 131);
+	failWithRetries();
+	CHECK(FakeBios_waitFor(notRecovering, NULL, 1000));
+	CHECK(PwrMgmt_getBattery(&battery) == 0);
+	CHECK((battery.percent == 87) && (battery.polls == 1) && (battery.failures == 1));
+
+	// nothing is polled once stopped, though the bus carries on
+	autoComplete = TRUE;
+	CHECK(PwrMgmt_stop() == 0);
+	uint16_t logged = FakeI2C_log(NULL);
+	PwrMgmt_Battery stopped;
+	PwrMgmt_getBattery(&stopped);
+	Task_sleep(200);
+	CHECK(FakeI2C_log(NULL) == logged);
+	PwrMgmt_getBattery(&battery);
+	CHECK((battery.polls == stopped.polls) && (battery.failures == stopped.failures) && (battery.deferred == stopped.deferred));
+	CHECK(InterBus_stop() == 0);
+	autoComplete = FALSE;
+}
+
+static void testCommands(void)
+{
+	// power and yaw arrive together in one write
+	startService(0);
+	autoComplete = TRUE;
+	CHECK(PwrMgmt_drive(50, -20) == 0);
+	FakeI2C_Transfer t = lastTransfer();
+	static const uint8_t driveBytes[4] = {DRV_PWR, 50, DRV_YAW, (uint8_t) -20};
+	CHECK((t.address == PWRBOARD_ADDR) && (t.writeCount == 4) && (t.readCount == 0));
+	CHECK(memcmp(t.write, driveBytes, 4) == 0);
+	CHECK((board.power == 50) && (board.yaw == -20) && (board.commands == 2));
+
+	CHECK(PwrMgmt_weapon(WEAPON_2, 1) == 0);
+	t = lastTransfer();
+	CHECK((t.writeCount == 2) && (t.write[0] == WEAPON_2) && (t.write[1] == 1));
+
+	PwrMgmt_Command commands[PWRMGMT_MAX_BATCH] = {{WEAPON_1, 3}, {DRV_PWR, 10}, {DRV_YAW, 11}, {WEAPON_2, 0}};
+	CHECK(PwrMgmt_batch(commands, PWRMGMT_MAX_BATCH) == 0);
+	CHECK(PwrMgmt_batch(commands, PWRMGMT_MAX_BATCH + 1) == -3);
+	CHECK(PwrMgmt_batch(commands, 0) == -3);
+	CHECK((board.weapon[0] == 3) && (board.weapon[1] == 0) && (board.power == 10) && (board.yaw == 11));
+	CHECK(FakeI2C_log(NULL) == 3);
+
+	// the emergency stop goes out as one write too
+	CHECK(PwrMgmt_drive(60, 60) == 0);
+	CHECK(PwrMgmt_stopNow(0) > 0);
+	uint16_t want = 5;
+	CHECK(FakeBios_waitFor(transfersLogged, &want, 100));
+	CHECK(FakeBios_waitFor(idle, NULL, 100));
+	CHECK((board.power == 0) && (board.yaw == 0));
+	CHECK(board.unknown == 0);
+	stopService();
+}
+
+static void testHandle(void)
+{
+	// every command runs on the one bus handle, however many follow each other
+	startService(0);
+	autoComplete = TRUE;
+	board.battery = 55;
+	uint8_t i;
+	for (i = 0; i < HANDLE_ROUNDS; i++)
+	{
+		CHECK(PwrMgmt_drive(i, -i) == 0);
+		CHECK(PwrMgmt_weapon(WEAPON_1, i) == 0);
+		CHECK(PwrMgmt_batteryRemaining() == 55);
+	}
+	CHECK((board.power == HANDLE_ROUNDS - 1) && (board.weapon[0] == HANDLE_ROUNDS - 1));
+	CHECK(FakeI2C_log(NULL) == 3 * HANDLE_ROUNDS);
+
+	// restarting the service keeps the handle, only the bus service closes it
+	CHECK(PwrMgmt_stop() == 0);
+	CHECK(PwrMgmt_start() == 0);
+	CHECK(PwrMgmt_drive(1, 1) == 0);
+	CHECK(FakeI2C_opens() == 1);
+	CHECK(FakeI2C_closes() == 0);
+	stopService();
+	CHECK(FakeI2C_closes() == 1);
+}
+
+static double seconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void benchCalls(void)
+{
+	// the cost of the call path itself, queue, bus service and driver callback, on the one handle
+	startService(0);
+	autoComplete = TRUE;
+	answerNow = TRUE;
+	board.battery = 55;
+	static const char* names[3] = {"drive", "weapon", "battery"};
+	uint8_t c;
+	for (c = 0; c < 3; c++)
+	{
+		double total = 0;
+		double most = 0;
+		uint16_t failed = 0;
+		uint16_t i;
+		for (i = 0; i < BENCH_CALLS; i++)
+		{
+			// the board answers the transfer logged last, the bus is idle between blocking calls
+			FakeI2C_clearLog();
+			double start = seconds();
+			switch (c)
+			{
+			case 0:
+				failed += (PwrMgmt_drive(i & 0x7F, 0) != 0);
+				break;
+			case 1:
+				failed += (PwrMgmt_weapon(WEAPON_1, i & 1) != 0);
+				break;
+			default:
+				failed += (PwrMgmt_batteryRemaining() != 55);
+				break;
+			}
+			double taken = seconds() - start;
+			total += taken;
+			most = (taken > most) ? taken : most;
+		}
+		CHECK(failed == 0);
+		printf("calls: %-7s mean %.1f us, max %.1f us on the host\n", names[c],
+				total * 1e6 / BENCH_CALLS, most * 1e6);
+	}
+	answerNow = FALSE;
+	CHECK(FakeI2C_opens() == 1);
+	stopService();
+}
+
+static void benchDrive(void)
+{
+	// bus time of a drive command as one write, against the two writes it used to take
+	startService(0);
+	autoComplete = TRUE;
+	uint16_t from = FakeI2C_log(NULL);
+	uint8_t i;
+	for (i = 0; i < BENCH_DRIVES; i++)
+	{
+		CHECK(PwrMgmt_drive(i, -i) == 0);
+	}
+
+	FakeI2C_Transfer log[FAKEI2C_LOG_SIZE];
+	uint16_t logged = FakeI2C_log(log);
+	CHECK(logged == from + BENCH_DRIVES);
+	uint32_t bits = 0;
+	uint16_t n;
+	for (n = from; n < logged; n++)
+	{
+		bits += busBits(log[n].writeCount, log[n].readCount);
+	}
+	CHECK((board.power == BENCH_DRIVES - 1) && (board.commands == 2 * BENCH_DRIVES));
+	stopService();
+
+	uint32_t separate = BENCH_DRIVES * 2 * busBits(2, 0);
+	printf("drive: %.1f us of bus per command in one write, %.1f us in two, at %u kHz\n",
+			(double) bits * 1000 / BUS_KHZ / BENCH_DRIVES,
+			(double) separate * 1000 / BUS_KHZ / BENCH_DRIVES, BUS_KHZ);
+	CHECK(bits < separate);
+}
+
+static void testTelemetry(void)
+{
+	// 80%, undervolt and watchdog, 4660 and -1 mA, 246 reads back as -10 degrees
+	static const uint8_t regs[PWRMGMT_TELEMETRY_SIZE] = {80, 0x09, 0x34, 0x12, 0xFF, 0xFF, 0xF6, 45};
+	PwrMgmt_Telemetry telemetry;
+	PwrMgmt_decodeTelemetry(regs, &telemetry);
+	CHECK((telemetry.battery == 80) && (telemetry.faults == (PWRMGMT_FAULT_UNDERVOLT | PWRMGMT_FAULT_WATCHDOG)));
+	CHECK((telemetry.current[0] == 0x1234) && (telemetry.current[1] == -1));
+	CHECK((telemetry.temperature[0] == -10) && (telemetry.temperature[1] == 45));
+
+	// the whole snapshot is one repeated start read
+	startService(0);
+	memcpy(board.regs, regs, sizeof(regs));
+	board.regs[PWRMGMT_TELEMETRY_SIZE] = 0xAA;
+	autoComplete = TRUE;
+	memset(&telemetry, 0, sizeof(telemetry));
+	CHECK(PwrMgmt_telemetry(&telemetry) == 0);
+	FakeI2C_Transfer t = lastTransfer();
+	CHECK((t.address == PWRBOARD_ADDR) && (t.writeCount == 2) && (t.readCount == PWRMGMT_TELEMETRY_SIZE));
+	CHECK((t.write[0] == REGISTER_READ_CODE) && (t.write[1] == PWRMGMT_REG_BATTERY));
+	CHECK((telemetry.battery == 80) && (telemetry.current[0] == 0x1234) && (telemetry.temperature[0] == -10));
+	CHECK(FakeI2C_log(NULL) == 1);
+
+	// any block within a read
+	uint8_t buf[INTERBUS_MAX_READ + 1];
+	memset(buf, 0x55, sizeof(buf));
+	CHECK(PwrMgmt_readRegisters(PWRMGMT_REG_CURRENT, buf, 4) == 0);
+	CHECK((buf[0] == 0x34) && (buf[3] == 0xFF) && (buf[4] == 0x55));
+	CHECK(PwrMgmt_readRegisters(0, buf, INTERBUS_MAX_READ) == 0);
+	CHECK((buf[PWRMGMT_TELEMETRY_SIZE] == 0xAA) && (buf[INTERBUS_MAX_READ - 1] == 0));
+	CHECK(PwrMgmt_readRegisters(0, buf, 0) == -3);
+	CHECK(PwrMgmt_readRegisters(0, buf, INTERBUS_MAX_READ + 1) == -3);
+	CHECK(FakeI2C_log(NULL) == 3);
+
+	// queued, the registers come to the doneFxn
+	int32_t token = PwrMgmt_telemetryAsync(doneFxn, NULL);
+	CHECK(token > 0);
+	uint16_t want = 4;
+	CHECK(FakeBios_waitFor(transfersLogged, &want, 100));
+	CHECK(FakeBios_waitFor(idle, NULL, 100));
+	t = lastTransfer();
+	CHECK((t.writeCount == 2) && (t.readCount == PWRMGMT_TELEMETRY_SIZE));
+	CHECK((doneCount == 1) && (done[0].token == (PwrMgmt_Token) token) && (done[0].status == 0) && (done[0].read == 80));
+	stopService();
+}
+
+static void benchTelemetry(void)
+{
+	// values a second from snapshots, against reading each register on its own
+	startService(0);
+	autoComplete = TRUE;
+	PwrMgmt_Telemetry telemetry;
+	CHECK(PwrMgmt_telemetry(&telemetry) == 0);
+	FakeI2C_Transfer t = lastTransfer();
+	stopService();
+
+	uint32_t snapshot = busBits(t.writeCount, t.readCount);
+	uint32_t single = PWRMGMT_TELEMETRY_SIZE * busBits(2, 1);
+	printf("telemetry: %.0f values/s from snapshots, %.0f values/s one register at a time, at %u kHz\n",
+			(double) PWRMGMT_TELEMETRY_SIZE * BUS_KHZ * 1000 / snapshot,
+			(double) PWRMGMT_TELEMETRY_SIZE * BUS_KHZ * 1000 / single, BUS_KHZ);
+	CHECK(snapshot < single);
+}
+
+int main(void)
+{
+	Task_Params params;
+	Task_Params_init(&params);
+	Task_Handle completer = Task_create(completerFxn, &params, NULL);
+	CHECK(completer != NULL);
+
+	testStart();
+	testAsync();
+	testStop();
+	testBattery();
+	testCommands();
+	testHandle();
+	benchCalls();
+	benchDrive();
+	testTelemetry();
+	benchTelemetry();
+
+	Task_delete(&completer);
+	return CHECK_RESULT();
+}
@@ -0,0 +1,483 @@
+/**
+ * \file SlipTest.c
+ * \brief Tests the SLIP encoder and decoder against bytewise references on the host
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ *
+ * Random frames rich in END and ESC bytes are encoded back to back and fed
+ * to the decoder in random sized chunks, so every escape and delimiter
+ * lands on a chunk boundary somewhere. The word at a time encoder must match
+ * the bytewise reference at every size and alignment. Also times both
+ * against the references, decoding clean, escape heavy and corrupt streams.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "Check.h"
+#include "Slip.h"
+
+#define ROUND_TRIPS 100000		//! No. of random frames in the round trip test
+#define MAX_CHUNK 64			//! Largest chunk fed to the decoder at once
+#define BENCH_BYTES (16u << 20)	//! No. of encoded bytes decoded by the benchmark
+
+/**
+ * \struct Sink
+ * \brief Frames emitted by the decoder, compared as they arrive
+ */
+typedef struct
+{
+	const uint8_t (*frames)[SLIP_MAX_FRAME];	//! Frames expected, in order
+	const uint16_t* sizes;						//! Size of each expected frame
+	uint32_t count;								//! No. of expected frames
+	uint32_t next;								//! Index of the next expected frame
+	uint32_t mismatches;						//! No. of emitted frames which differed
+} Sink;
+
+static uint8_t frames[ROUND_TRIPS][SLIP_MAX_FRAME];
+static uint16_t sizes[ROUND_TRIPS];
+static uint8_t stream[ROUND_TRIPS * SLIP_WORST_SIZE(SLIP_MAX_FRAME)];
+static volatile uint32_t referenceSum;		//! Sum of the last byte of every reference decoded frame
+
+/**
+ * \brief Encodes a byte at a time, the reference Slip_encode must agree with
+ */
+static uint16_t referenceEncode(uint8_t* out, const uint8_t* frame, uint16_t size)
+{
+	uint16_t n = 0;
+	out[n++] = SLIP_END;
+	uint16_t i;
+	for (i = 0; i < size; i++)
+	{
+		if (frame[i] == SLIP_END)
+		{
+			out[n++] = SLIP_ESC;
+			out[n++] = SLIP_ESC_END;
+		}
+		else if (frame[i] == SLIP_ESC)
+		{
+			out[n++] = SLIP_ESC;
+			out[n++] = SLIP_ESC_ESC;
+		}
+		else
+		{
+			out[n++] = frame[i];
+		}
+	}
+	out[n++] = SLIP_END;
+	return n;
+}
+
+/**
+ * \brief Fills a frame with bytes, a quarter of them special characters
+ */
+static void randomFrame(uint8_t* frame, uint16_t size)
+{
+	static const uint8_t special[4] = {SLIP_END, SLIP_ESC, SLIP_ESC_END, SLIP_ESC_ESC};
+	uint16_t i;
+	for (i = 0; i < size; i++)
+	{
+		frame[i] = (Check_below(4) == 0) ? special[Check_below(4)] : (uint8_t)Check_random();
+	}
+}
+
+static void sinkFxn(const uint8_t* frame, uint16_t size, void* arg)
+{
+	Sink* sink = (Sink*) arg;
+	if ((sink->next >= sink->count) || (size != sink->sizes[sink->next]) ||
+			(memcmp(frame, sink->frames[sink->next], size) != 0))
+	{
+		sink->mismatches++;
+	}
+	sink->next++;
+}
+
+static void countFxn(const uint8_t* frame, uint16_t size, void* arg)
+{
+	(*(uint32_t*) arg)++;
+}
+
+/**
+ * \brief Feeds a stream to the decoder in random chunks of 1 to MAX_CHUNK bytes
+ */
+static void feedChunked(Slip_Decoder* dec, const uint8_t* data, uint32_t len)
+{
+	uint32_t done = 0;
+	while (done < len)
+	{
+		uint32_t chunk = 1 + Check_below(MAX_CHUNK);
+		if (chunk > len - done)
+		{
+			chunk = len - done;
+		}
+		Slip_decode(dec, data + done, chunk);
+		done += chunk;
+	}
+}
+
+static void testRoundTrip(void)
+{
+	uint32_t len = 0;
+	uint32_t i;
+	for (i = 0; i < ROUND_TRIPS; i++)
+	{
+		sizes[i] = 1 + Check_below(SLIP_MAX_FRAME);
+		randomFrame(frames[i], sizes[i]);
+		len += referenceEncode(&stream[len], frames[i], sizes[i]);
+	}
+
+	Sink sink = {frames, sizes, ROUND_TRIPS, 0, 0};
+	Slip_Decoder dec;
+	Slip_decoderInit(&dec, sinkFxn, &sink);
+	feedChunked(&dec, stream, len);
+
+	CHECK(sink.next == ROUND_TRIPS);
+	CHECK(sink.mismatches == 0);
+	CHECK(dec.frames == ROUND_TRIPS);
+	CHECK(dec.escErrors == 0);
+	CHECK(dec.overruns == 0);
+}
+
+static void testEncode(void)
+{
+	// every size, from every alignment of the source
+	static uint8_t source[SLIP_MAX_FRAME + 3];
+	uint8_t out[SLIP_WORST_SIZE(SLIP_MAX_FRAME)];
+	uint8_t expect[SLIP_WORST_SIZE(SLIP_MAX_FRAME)];
+
+	uint32_t i;
+	for (i = 0; i < ROUND_TRIPS; i++)
+	{
+		uint16_t size = i % (SLIP_MAX_FRAME + 1);
+		uint8_t offset = (i / (SLIP_MAX_FRAME + 1)) % 4;
+		randomFrame(source + offset, size);
+
+		uint16_t len = Slip_encode(out, source + offset, size);
+		uint16_t expectLen = referenceEncode(expect, source + offset, size);
+		CHECK(len == expectLen);
+		CHECK(memcmp(out, expect, expectLen) == 0);
+		CHECK(len <= SLIP_WORST_SIZE(size));
+		if ((len != expectLen) || (memcmp(out, expect, expectLen) != 0))
+		{
+			break;
+		}
+	}
+
+	// all special, the worst case size
+	memset(source, SLIP_END, SLIP_MAX_FRAME);
+	CHECK(Slip_encode(out, source, SLIP_MAX_FRAME) == SLIP_WORST_SIZE(SLIP_MAX_FRAME));
+}
+
+static void testEncodeDecode(void)
+{
+	uint32_t len = 0;
+	uint32_t i;
+	for (i = 0; i < ROUND_TRIPS; i++)
+	{
+		sizes[i] = 1 + Check_below(SLIP_MAX_FRAME);
+		randomFrame(frames[i], sizes[i]);
+		len += Slip_encode(&stream[len], frames[i], sizes[i]);
+	}
+
+	Sink sink = {frames, sizes, ROUND_TRIPS, 0, 0};
+	Slip_Decoder dec;
+	Slip_decoderInit(&dec, sinkFxn, &sink);
+	feedChunked(&dec, stream, len);
+
+	CHECK(sink.next == ROUND_TRIPS);
+	CHECK(sink.mismatches == 0);
+}
+
+static void testHunt(void)
+{
+	// bytes before the first END are not a frame
+	static const uint8_t data[] = {'a', 'b', SLIP_ESC, 'c', SLIP_END, 'x', 'y', SLIP_END};
+	static const uint8_t expect[1][SLIP_MAX_FRAME] = {{'x', 'y'}};
+	static const uint16_t expectSize[1] = {2};
+
+	Sink sink = {expect, expectSize, 1, 0, 0};
+	Slip_Decoder dec;
+	Slip_decoderInit(&dec, sinkFxn, &sink);
+	Slip_decode(&dec, data, sizeof(data));
+
+	CHECK(sink.next == 1);
+	CHECK(sink.mismatches == 0);
+	CHECK(dec.escErrors == 0);
+}
+
+static void testEmptyFrames(void)
+{
+	static const uint8_t data[] = {SLIP_END, SLIP_END, SLIP_END, 'z', SLIP_END, SLIP_END};
+	uint32_t count = 0;
+	Slip_Decoder dec;
+	Slip_decoderInit(&dec, countFxn, &count);
+	Slip_decode(&dec, data, sizeof(data));
+
+	CHECK(count == 1);
+	CHECK(dec.frames == 1);
+}
+
+static void testEscapeError(void)
+{
+	// ESC followed by a literal drops that frame, the next one survives
+	static const uint8_t data[] = {SLIP_END, 'a', SLIP_ESC, 'b', 'c', SLIP_END, 'd', SLIP_END,
+			SLIP_END, 'e', SLIP_ESC, SLIP_END, 'f', SLIP_END};
+	static const uint8_t expect[2][SLIP_MAX_FRAME] = {{'d'}, {'f'}};
+	static const uint16_t expectSize[2] = {1, 1};
+
+	uint16_t chunk;
+	for (chunk = 1; chunk <= sizeof(data); chunk++)
+	{
+		Sink sink = {expect, expectSize, 2, 0, 0};
+		Slip_Decoder dec;
+		Slip_decoderInit(&dec, sinkFxn, &sink);
+
+		uint16_t done;
+		for (done = 0; done < sizeof(data); done += chunk)
+		{
+			uint16_t n = (sizeof(data) - done < chunk) ? sizeof(data) - done : chunk;
+			Slip_decode(&dec, data + done, n);
+		}
+
+		CHECK(sink.next == 2);
+		CHECK(sink.mismatches == 0);
+		CHECK(dec.escErrors == 2);
+	}
+}
+
+static void testOverrun(void)
+{
+	// one byte over the limit, once as a literal run and once as an escaped byte
+	static uint8_t frame[SLIP_MAX_FRAME + 1];
+	static uint8_t data[3 * SLIP_WORST_SIZE(SLIP_MAX_FRAME + 1)];
+	static const uint8_t expect[1][SLIP_MAX_FRAME] = {{'k'}};
+	static const uint16_t expectSize[1] = {1};
+
+	memset(frame, 'a', sizeof(frame));
+	uint16_t len = referenceEncode(data, frame, sizeof(frame));
+	frame[SLIP_MAX_FRAME] = SLIP_END;
+	len += referenceEncode(&data[len], frame, sizeof(frame));
+	len += referenceEncode(&data[len], (const uint8_t*) "k", 1);
+
+	Sink sink = {expect, expectSize, 1, 0, 0};
+	Slip_Decoder dec;
+	Slip_decoderInit(&dec, sinkFxn, &sink);
+	Slip_decode(&dec, data, len);
+
+	CHECK(sink.next == 1);
+	CHECK(sink.mismatches == 0);
+	CHECK(dec.overruns == 2);
+
+	// exactly the limit still fits
+	memset(frame, SLIP_ESC, SLIP_MAX_FRAME);
+	len = referenceEncode(data, frame, SLIP_MAX_FRAME);
+	uint32_t count = 0;
+	Slip_decoderInit(&dec, countFxn, &count);
+	Slip_decode(&dec, data, len);
+	CHECK(count == 1);
+	CHECK(dec.overruns == 0);
+}
+
+/**
+ * \brief Decodes a byte at a time through a switch, what the table driven decoder replaced
+ *
+ * Drops frames with invalid escapes or more than SLIP_MAX_FRAME bytes, as
+ * Slip_decode does, so both count the same frames in a corrupt stream.
+ */
+static uint32_t referenceDecode(const uint8_t* data, uint32_t len)
+{
+	uint8_t buf[SLIP_MAX_FRAME];
+	uint32_t count = 0;
+	uint16_t size = 0;
+	int escaped = 0;
+	int bad = 0;
+	uint32_t i;
+	for (i = 0; i < len; i++)
+	{
+		uint8_t value = data[i];
+		if (value == SLIP_END)
+		{
+			if ((size > 0) && !bad && !escaped)
+			{
+				// keeps the stores from being optimised away
+				referenceSum += buf[size-1];
+				count++;
+			}
+			size = 0;
+			escaped = 0;
+			bad = 0;
+			continue;
+		}
+		if (escaped)
+		{
+			switch (value)
+			{
+			case SLIP_ESC_END:
+				value = SLIP_END;
+				break;
+			case SLIP_ESC_ESC:
+				value = SLIP_ESC;
+				break;
+			default:
+				bad = 1;
+				break;
+			}
+			escaped = 0;
+		}
+		else if (value == SLIP_ESC)
+		{
+			escaped = 1;
+			continue;
+		}
+		if (size < SLIP_MAX_FRAME)
+		{
+			buf[size++] = value;
+		}
+		else
+		{
+			bad = 1;
+		}
+	}
+	return count;
+}
+
+static double seconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/**
+ * \brief Times both decoders on a stream of random frames
+ *
+ * \param name Printed with the results
+ * \param special One in special frame bytes is END or ESC, 0 for none
+ * \param corrupt One in corrupt frames gets an invalid escape, 0 for none
+ */
+static void benchDecode(const char* name, uint32_t special, uint32_t corrupt)
+{
+	uint32_t len = 0;
+	uint32_t expected = 0;
+	while (len + SLIP_WORST_SIZE(SLIP_MAX_FRAME) <= sizeof(stream))
+	{
+		uint8_t frame[SLIP_MAX_FRAME];
+		uint16_t size = 12 + Check_below(SLIP_MAX_FRAME - 12);
+		uint16_t i;
+		for (i = 0; i < size; i++)
+		{
+			if ((special != 0) && (Check_below(special) == 0))
+			{
+				frame[i] = (Check_below(2) == 0) ? SLIP_END : SLIP_ESC;
+			}
+			else
+			{
+				do
+				{
+					frame[i] = (uint8_t)Check_random();
+				} while ((frame[i] == SLIP_END) || (frame[i] == SLIP_ESC));
+			}
+		}
+		uint16_t n = referenceEncode(&stream[len], frame, size);
+		if ((corrupt != 0) && (Check_below(corrupt) == 0))
+		{
+			// an escape of a literal, never forms an END so only this frame is lost
+			uint16_t at = 1 + Check_below(n - 3);
+			stream[len + at] = SLIP_ESC;
+			stream[len + at + 1] = 0x01;
+		}
+		else
+		{
+			expected++;
+		}
+		len += n;
+	}
+
+	uint32_t passes = (BENCH_BYTES + len - 1) / len;
+	uint32_t count = 0;
+	uint32_t p;
+	double start = seconds();
+	for (p = 0; p < passes; p++)
+	{
+		count += referenceDecode(stream, len);
+	}
+	double reference = seconds() - start;
+	CHECK(count == expected * passes);
+
+	Slip_Decoder dec;
+	count = 0;
+	Slip_decoderInit(&dec, countFxn, &count);
+	start = seconds();
+	for (p = 0; p < passes; p++)
+	{
+		uint32_t done = 0;
+		while (done < len)
+		{
+			// chunks the size of a uDMA ping-pong half
+			uint32_t chunk = (len - done < MAX_CHUNK) ? len - done : MAX_CHUNK;
+			Slip_decode(&dec, stream + done, chunk);
+			done += chunk;
+		}
+	}
+	double table = seconds() - start;
+	CHECK(count == expected * passes);
+
+	double mb = (double)len * passes / 1e6;
+	double frames = (double)expected * passes;
+	printf("decode %s: bytewise %.1f MB/s %.0f frames/s, table driven %.1f MB/s %.0f frames/s\n", name,
+			mb / reference, frames / reference, mb / table, frames / table);
+}
+
+static void benchEncode(void)
+{
+	// telemetry-like frames, mostly literals with the odd special byte
+	uint32_t i;
+	for (i = 0; i < ROUND_TRIPS; i++)
+	{
+		sizes[i] = 12 + Check_below(SLIP_MAX_FRAME - 12);
+		uint16_t j;
+		for (j = 0; j < sizes[i]; j++)
+		{
+			frames[i][j] = (Check_below(64) == 0) ? SLIP_ESC : (uint8_t)Check_random();
+		}
+	}
+
+	uint32_t len = 0;
+	double start = seconds();
+	for (i = 0; i < ROUND_TRIPS; i++)
+	{
+		len += referenceEncode(&stream[len], frames[i], sizes[i]);
+	}
+	double reference = seconds() - start;
+	uint32_t referenceLen = len;
+
+	len = 0;
+	start = seconds();
+	for (i = 0; i < ROUND_TRIPS; i++)
+	{
+		len += Slip_encode(&stream[len], frames[i], sizes[i]);
+	}
+	double word = seconds() - start;
+	CHECK(len == referenceLen);
+
+	double mb = (double)len / 1e6;
+	printf("encode: bytewise %.1f MB/s, word at a time %.1f MB/s\n", mb / reference, mb / word);
+}
+
+int main(void)
+{
+	testRoundTrip();
+	testEncode();
+	testEncodeDecode();
+	testHunt();
+	testEmptyFrames();
+	testEscapeError();
+	testOverrun();
+	benchDecode("clean", 0, 0);
+	benchDecode("escape heavy", 4, 0);
+	benchDecode("corrupt", 64, 8);
+	benchEncode();
+
+	return CHECK_RESULT();
+}
@@ -0,0 +1,605 @@
+/**
+ * \file FakeBios.c
+ * \brief Implements the host stand-ins for the SYS/BIOS kernel used by the tests
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ *
+ * Tasks are threads. Semaphores, sleeps and the tick counter share one
+ * kernel lock and condition, which is broadcast on every post and tick.
+ * Hwi_disable takes a separate recursive lock which the tick thread also
+ * holds while it runs Clock functions. The Hwi lock is always taken before
+ * the kernel lock, and nothing pends with Hwi disabled.
+ *
+ * Holding the clock swaps the real time tick for a virtual one: ticks and
+ * timestamps only move when the test calls FakeBios_tick.
+ */
+
+#include "FakeBios.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <xdc/runtime/Error.h>
+#include <xdc/runtime/System.h>
+#include <xdc/runtime/Timestamp.h>
+#include <ti/sysbios/BIOS.h>
+#include <ti/sysbios/hal/Hwi.h>
+#include <ti/sysbios/knl/Clock.h>
+#include <ti/sysbios/knl/Semaphore.h>
+#include <ti/sysbios/knl/Task.h>
+
+#define MAX_CLOCKS 32			//! Most Clock instances alive at once
+#define MAX_HWIS 8				//! Most Hwi instances alive at once
+
+struct Task_Object
+{
+	pthread_t thread;			//! Thread running the task
+	Task_FuncPtr fxn;			//! Task function
+	UArg arg0;					//! First argument of fxn
+	UArg arg1;					//! Second argument of fxn
+};
+
+struct Clock_Object
+{
+	Clock_FuncPtr fxn;			//! Called when the timeout expires
+	UArg arg;					//! Passed to fxn
+	UInt timeout;				//! Ticks from start to the first call
+	UInt period;				//! Ticks between later calls, 0 for one shot
+	UInt32 expiry;				//! Tick of the next call
+	Bool active;				//! Started and not yet expired
+};
+
+struct Hwi_Object
+{
+	Int intNum;					//! Interrupt served
+	Hwi_FuncPtr fxn;			//! Called when the interrupt is raised
+	UArg arg;					//! Passed to fxn
+};
+
+const UInt32 Clock_tickPeriod = FAKEBIOS_TICK_US;
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t hwiLock;
+static pthread_mutex_t kernelLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t kernelCond = PTHREAD_COND_INITIALIZER;
+static volatile UInt32 ticks = 0;
+static Clock_Handle clocks[MAX_CLOCKS];
+static struct Hwi_Object hwis[MAX_HWIS];		//! Created Hwis, fxn NULL when free
+static __thread Task_Handle self = NULL;
+static volatile Bool held = FALSE;		//! Ticks only advance through FakeBios_tick
+static UInt32 stampOffset = 0;			//! Added to the monotonic clock by Timestamp_get32
+static UInt32 heldStamp = 0;			//! Timestamp_get32 while the clock is held, moves with each tick
+
+/**
+ * \brief Advances the tick counter and runs due Clock functions
+ *
+ * \param manual Called by FakeBios_tick, the tick only happens if this matches held
+ */
+static void advance(Bool manual)
+{
+	pthread_mutex_lock(&hwiLock);
+	if (held != manual)
+	{
+		pthread_mutex_unlock(&hwiLock);
+		return;
+	}
+
+	pthread_mutex_lock(&kernelLock);
+	UInt32 now = ++ticks;
+	if (held)
+	{
+		heldStamp += FAKEBIOS_TICK_US;
+	}
+	pthread_mutex_unlock(&kernelLock);
+
+	int i;
+	for (i = 0; i < MAX_CLOCKS; i++)
+	{
+		Clock_Handle clock = clocks[i];
+		if ((clock != NULL) && clock->active && ((Int32)(now - clock->expiry) >= 0))
+		{
+			if (clock->period > 0)
+			{
+				clock->expiry += clock->period;
+			}
+			else
+			{
+				clock->active = FALSE;
+			}
+			clock->fxn(clock->arg);
+		}
+	}
+	pthread_mutex_unlock(&hwiLock);
+
+	pthread_mutex_lock(&kernelLock);
+	pthread_cond_broadcast(&kernelCond);
+	pthread_mutex_unlock(&kernelLock);
+}
+
+/**
+ * \brief Ticks in real time while the clock is not held, forever
+ */
+static void* tickFxn(void* arg)
+{
+	struct timespec next;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	while (1)
+	{
+		next.tv_nsec += FAKEBIOS_TICK_US * 1000;
+		if (next.tv_nsec >= 1000000000)
+		{
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		advance(FALSE);
+	}
+
+	return NULL;
+}
+
+static void init(void)
+{
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&hwiLock, &attr);
+
+	pthread_t tick;
+	pthread_create(&tick, NULL, tickFxn, NULL);
+	pthread_detach(tick);
+}
+
+static void ensureInit(void)
+{
+	pthread_once(&once, init);
+}
+
+static void unlockKernel(void* arg)
+{
+	pthread_mutex_unlock(&kernelLock);
+}
+
+/**
+ * \brief Waits on the kernel condition until done returns true or the tick deadline passes
+ *
+ * \return Value of done when the wait ended
+ */
+static Bool kernelWait(Bool (*done)(void*), void* arg, UInt timeout)
+{
+	ensureInit();
+
+	Bool result;
+	pthread_mutex_lock(&kernelLock);
+	pthread_cleanup_push(unlockKernel, NULL);
+	UInt32 deadline = ticks + timeout;
+	while (!(result = done(arg)))
+	{
+		if ((timeout != BIOS_WAIT_FOREVER) && ((Int32)(ticks - deadline) >= 0))
+		{
+			break;
+		}
+		pthread_cond_wait(&kernelCond, &kernelLock);
+	}
+	pthread_cleanup_pop(1);
+	return result;
+}
+
+void Error_init(Error_Block* eb)
+{
+	eb->raised = FALSE;
+}
+
+Bool Error_check(Error_Block* eb)
+{
+	return eb->raised;
+}
+
+/**
+ * \brief Returns the monotonic clock in microseconds
+ */
+static UInt32 monotonicUs(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (UInt32)((uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000);
+}
+
+UInt32 Timestamp_get32(void)
+{
+	pthread_mutex_lock(&kernelLock);
+	UInt32 stamp = held ? heldStamp : monotonicUs() + stampOffset;
+	pthread_mutex_unlock(&kernelLock);
+	return stamp;
+}
+
+void Timestamp_getFreq(Types_FreqHz* freq)
+{
+	freq->hi = 0;
+	freq->lo = 1000000;
+}
+
+Int System_printf(const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	Int n = vprintf(format, args);
+	va_end(args);
+	return n;
+}
+
+void System_flush(void)
+{
+	fflush(stdout);
+}
+
+UInt Hwi_disable(void)
+{
+	ensureInit();
+	pthread_mutex_lock(&hwiLock);
+	return 0;
+}
+
+void Hwi_restore(UInt key)
+{
+	pthread_mutex_unlock(&hwiLock);
+}
+
+void Hwi_Params_init(Hwi_Params* params)
+{
+	params->arg = 0;
+	params->priority = -1;
+}
+
+Hwi_Handle Hwi_create(Int intNum, Hwi_FuncPtr fxn, const Hwi_Params* params, Error_Block* eb)
+{
+	UInt key = Hwi_disable();
+	UInt i;
+	for (i = 0; i < MAX_HWIS; i++)
+	{
+		if (hwis[i].fxn == NULL)
+		{
+			hwis[i].intNum = intNum;
+			hwis[i].fxn = fxn;
+			hwis[i].arg = (params != NULL) ? params->arg : 0;
+			Hwi_restore(key);
+			return &hwis[i];
+		}
+	}
+	Hwi_restore(key);
+	return NULL;
+}
+
+void Hwi_delete(Hwi_Handle* handle)
+{
+	UInt key = Hwi_disable();
+	(*handle)->fxn = NULL;
+	Hwi_restore(key);
+	*handle = NULL;
+}
+
+Bool FakeBios_interrupt(Int intNum)
+{
+	UInt key = Hwi_disable();
+	UInt i;
+	for (i = 0; i < MAX_HWIS; i++)
+	{
+		if ((hwis[i].fxn != NULL) && (hwis[i].intNum == intNum))
+		{
+			hwis[i].fxn(hwis[i].arg);
+			Hwi_restore(key);
+			return TRUE;
+		}
+	}
+	Hwi_restore(key);
+	return FALSE;
+}
+
+void Semaphore_Params_init(Semaphore_Params* params)
+{
+	params->instance = &params->instanceStorage;
+	params->instanceStorage.name = NULL;
+	params->mode = Semaphore_Mode_COUNTING;
+}
+
+Semaphore_Handle Semaphore_create(Int count, const Semaphore_Params* params, Error_Block* eb)
+{
+	Semaphore_Handle handle = malloc(sizeof(struct Semaphore_Object));
+	if (handle != NULL)
+	{
+		Semaphore_construct(handle, count, params);
+	}
+	return handle;
+}
+
+void Semaphore_delete(Semaphore_Handle* handle)
+{
+	free(*handle);
+	*handle = NULL;
+}
+
+void Semaphore_construct(Semaphore_Struct* obj, Int count, const Semaphore_Params* params)
+{
+	obj->mode = (params != NULL) ? params->mode : Semaphore_Mode_COUNTING;
+	obj->count = ((obj->mode == Semaphore_Mode_BINARY) && (count > 1)) ? 1 : count;
+}
+
+void Semaphore_destruct(Semaphore_Struct* obj)
+{
+}
+
+Semaphore_Handle Semaphore_handle(Semaphore_Struct* obj)
+{
+	return obj;
+}
+
+static Bool semReady(void* arg)
+{
+	Semaphore_Handle handle = (Semaphore_Handle) arg;
+	if (handle->count > 0)
+	{
+		handle->count--;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+Bool Semaphore_pend(Semaphore_Handle handle, UInt timeout)
+{
+	return kernelWait(semReady, handle, timeout);
+}
+
+void Semaphore_post(Semaphore_Handle handle)
+{
+	pthread_mutex_lock(&kernelLock);
+	if ((handle->mode != Semaphore_Mode_BINARY) || (handle->count == 0))
+	{
+		handle->count++;
+	}
+	pthread_cond_broadcast(&kernelCond);
+	pthread_mutex_unlock(&kernelLock);
+}
+
+Int Semaphore_getCount(Semaphore_Handle handle)
+{
+	pthread_mutex_lock(&kernelLock);
+	Int count = handle->count;
+	pthread_mutex_unlock(&kernelLock);
+	return count;
+}
+
+void Semaphore_reset(Semaphore_Handle handle, Int count)
+{
+	pthread_mutex_lock(&kernelLock);
+	handle->count = count;
+	pthread_mutex_unlock(&kernelLock);
+}
+
+void Task_Params_init(Task_Params* params)
+{
+	params->instance = &params->instanceStorage;
+	params->instanceStorage.name = NULL;
+	params->priority = 1;
+	params->stackSize = 0;
+	params->arg0 = 0;
+	params->arg1 = 0;
+}
+
+static void* taskThread(void* arg)
+{
+	Task_Handle task = (Task_Handle) arg;
+	self = task;
+	task->fxn(task->arg0, task->arg1);
+	return NULL;
+}
+
+Task_Handle Task_create(Task_FuncPtr fxn, const Task_Params* params, Error_Block* eb)
+{
+	ensureInit();
+
+	Task_Handle task = malloc(sizeof(struct Task_Object));
+	if (task == NULL)
+	{
+		return NULL;
+	}
+	task->fxn = fxn;
+	task->arg0 = (params != NULL) ? params->arg0 : 0;
+	task->arg1 = (params != NULL) ? params->arg1 : 0;
+	if (pthread_create(&task->thread, NULL, taskThread, task) != 0)
+	{
+		free(task);
+		return NULL;
+	}
+	return task;
+}
+
+void Task_delete(Task_Handle* handle)
+{
+	// the thread stops at its next pend or sleep, or has already returned
+	pthread_cancel((*handle)->thread);
+	pthread_join((*handle)->thread, NULL);
+	free(*handle);
+	*handle = NULL;
+}
+
+Task_Handle Task_self(void)
+{
+	return self;
+}
+
+static Bool never(void* arg)
+{
+	return FALSE;
+}
+
+void Task_sleep(UInt timeout)
+{
+	kernelWait(never, NULL, timeout);
+}
+
+void Task_yield(void)
+{
+	pthread_testcancel();
+	sched_yield();
+}
+
+UInt Task_disable(void)
+{
+	return Hwi_disable();
+}
+
+void Task_restore(UInt key)
+{
+	Hwi_restore(key);
+}
+
+void Clock_Params_init(Clock_Params* params)
+{
+	params->instance = &params->instanceStorage;
+	params->instanceStorage.name = NULL;
+	params->period = 0;
+	params->startFlag = FALSE;
+	params->arg = 0;
+}
+
+Clock_Handle Clock_create(Clock_FuncPtr fxn, UInt timeout, const Clock_Params* params, Error_Block* eb)
+{
+	ensureInit();
+
+	Clock_Handle clock = malloc(sizeof(struct Clock_Object));
+	if (clock == NULL)
+	{
+		return NULL;
+	}
+	clock->fxn = fxn;
+	clock->arg = (params != NULL) ? params->arg : 0;
+	clock->timeout = timeout;
+	clock->period = (params != NULL) ? params->period : 0;
+	clock->active = FALSE;
+
+	UInt key = Hwi_disable();
+	int i;
+	for (i = 0; (i < MAX_CLOCKS) && (clocks[i] != NULL); i++)
+	{
+	}
+	if (i == MAX_CLOCKS)
+	{
+		Hwi_restore(key);
+		free(clock);
+		return NULL;
+	}
+	clocks[i] = clock;
+	Hwi_restore(key);
+
+	if ((params != NULL) && params->startFlag)
+	{
+		Clock_start(clock);
+	}
+	return clock;
+}
+
+void Clock_delete(Clock_Handle* handle)
+{
+	UInt key = Hwi_disable();
+	int i;
+	for (i = 0; i < MAX_CLOCKS; i++)
+	{
+		if (clocks[i] == *handle)
+		{
+			clocks[i] = NULL;
+		}
+	}
+	Hwi_restore(key);
+
+	free(*handle);
+	*handle = NULL;
+}
+
+void Clock_start(Clock_Handle handle)
+{
+	UInt key = Hwi_disable();
+	handle->expiry = ticks + handle->timeout;
+	handle->active = TRUE;
+	Hwi_restore(key);
+}
+
+void Clock_stop(Clock_Handle handle)
+{
+	UInt key = Hwi_disable();
+	handle->active = FALSE;
+	Hwi_restore(key);
+}
+
+void Clock_setTimeout(Clock_Handle handle, UInt timeout)
+{
+	handle->timeout = timeout;
+}
+
+void Clock_setPeriod(Clock_Handle handle, UInt period)
+{
+	handle->period = period;
+}
+
+Bool Clock_isActive(Clock_Handle handle)
+{
+	return handle->active;
+}
+
+UInt32 Clock_getTicks(void)
+{
+	ensureInit();
+	return ticks;
+}
+
+Bool FakeBios_waitFor(Bool (*cond)(void* arg), void* arg, UInt timeout)
+{
+	UInt waited;
+	for (waited = 0; !cond(arg) && (waited < timeout); waited++)
+	{
+		if (held)
+		{
+			// no tick comes, wait as long in real time
+			struct timespec tick = {0, FAKEBIOS_TICK_US * 1000};
+			nanosleep(&tick, NULL);
+		}
+		else
+		{
+			Task_sleep(1);
+		}
+	}
+	return cond(arg);
+}
+
+void FakeBios_holdClock(Bool hold)
+{
+	ensureInit();
+
+	// the tick thread holds the Hwi lock while it ticks
+	pthread_mutex_lock(&hwiLock);
+	pthread_mutex_lock(&kernelLock);
+	if (hold && !held)
+	{
+		heldStamp = monotonicUs() + stampOffset;
+	}
+	else if (!hold && held)
+	{
+		// time carries on from where the virtual clock left it
+		stampOffset = heldStamp - monotonicUs();
+	}
+	held = hold;
+	pthread_mutex_unlock(&kernelLock);
+	pthread_mutex_unlock(&hwiLock);
+}
+
+void FakeBios_tick(void)
+{
+	ensureInit();
+	advance(TRUE);
+}
@@ -0,0 +1,58 @@
+/**
+ * \file FakeBios.h
+ * \brief Declares test helpers of the host SYS/BIOS stand-ins
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ *
+ * The fakes under test/fakes let modules written against SYS/BIOS run on
+ * the host: tasks become threads and the Clock ticks in real time, unless
+ * the test holds it and ticks it itself. Tests call the SYS/BIOS API
+ * directly from main, which acts as a task.
+ */
+
+#ifndef FAKE_BIOS_HELPERS
+#define FAKE_BIOS_HELPERS
+
+#include <xdc/std.h>
+
+#define FAKEBIOS_TICK_US 1000		//! Clock_tickPeriod of the fakes, one tick per millisecond
+
+/**
+ * \brief Sleeps in ticks until a condition holds
+ *
+ * While the clock is held, polls once per tick period of real time instead.
+ *
+ * \param cond Condition to poll once per tick
+ * \param arg Passed to cond
+ * \param timeout Most ticks to wait
+ * \return Value of cond when the wait ended
+ */
+Bool FakeBios_waitFor(Bool (*cond)(void* arg), void* arg, UInt timeout);
+
+/**
+ * \brief Runs the Hwi created for an interrupt with Hwi disabled, as the interrupt would
+ *
+ * \param intNum Interrupt no. the Hwi was created with
+ * \return Flag indicating whether a Hwi was created for it
+ */
+Bool FakeBios_interrupt(Int intNum);
+
+/**
+ * \brief Holds or releases the clock
+ *
+ * While held, the tick counter, Clock functions, sleeps, pend timeouts and
+ * Timestamp_get32 only advance with FakeBios_tick, each tick moving the
+ * timestamp by exactly FAKEBIOS_TICK_US. Once released they carry on in real
+ * time from where the virtual clock stopped.
+ *
+ * \param hold Flag indicating whether the clock is held
+ */
+void FakeBios_holdClock(Bool hold);
+
+/**
+ * \brief Advances a held clock by one tick, running Clock functions due, ignored unless held
+ */
+void FakeBios_tick(void);
+
+#endif
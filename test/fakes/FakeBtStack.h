@@ -0,0 +1,62 @@
+/**
+ * \file FakeBtStack.h
+ * \brief Declares test helpers of the host btStack stand-in
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ *
+ * Link layers run on top of the stand-in instead of the UART. Raw frames
+ * they push go to a function set by the test, which plays the wire, and
+ * the test hands received link frames back to them as the reception task
+ * would. Frames they deliver go to another function set by the test.
+ */
+
+#ifndef FAKE_BTSTACK
+#define FAKE_BTSTACK
+
+#include "BtStack.h"
+
+/**
+ * \typedef FakeBtStack_RawFxn
+ * \brief Takes a link frame pushed by a layer, after the marker
+ *
+ * \return Returned by BtStack_pushRaw
+ */
+typedef int16_t (*FakeBtStack_RawFxn)(const uint8_t* frame, uint16_t size, BtStack_Lane lane);
+
+/**
+ * \typedef FakeBtStack_DeliverFxn
+ * \brief Takes a frame a layer delivered to the subscribers
+ */
+typedef void (*FakeBtStack_DeliverFxn)(const BtStack_Frame* frame);
+
+/**
+ * \brief Stops the service and forgets links and test functions
+ */
+void FakeBtStack_reset(void);
+
+/**
+ * \brief Sets what BtStack_hasStarted returns, pushes and deliveries fail while stopped
+ */
+void FakeBtStack_setStarted(Bool started);
+
+/**
+ * \brief Sets the function taking pushed link frames, NULL accepts and discards them
+ */
+void FakeBtStack_onRaw(FakeBtStack_RawFxn fxn);
+
+/**
+ * \brief Sets the function taking delivered frames, NULL discards them
+ */
+void FakeBtStack_onDeliver(FakeBtStack_DeliverFxn fxn);
+
+/**
+ * \brief Hands a received link frame to the function linked for its type
+ *
+ * \param frame Frame after the marker, frame[0] is its type
+ * \param size No. of bytes in frame
+ * \return Returns TRUE if a function was linked for the type
+ */
+Bool FakeBtStack_receive(const uint8_t* frame, uint16_t size);
+
+#endif
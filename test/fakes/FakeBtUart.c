@@ -0,0 +1,298 @@
+/**
+ * \file FakeBtUart.c
+ * \brief Implements the host stand-in of the bluetooth UART transport
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ */
+
+#include "FakeBtUart.h"
+
+#include <string.h>
+#include <ti/sysbios/hal/Hwi.h>
+#include "BtUart.h"
+
+static BtUart_Params params;				//! Parameters of the last open
+static Bool isOpen = FALSE;
+static Bool rtsReady = TRUE;
+static uint32_t rtsHolds = 0;
+static uint32_t baud = 0;
+static uint8_t openFailures = 0;			//! Opens which still fail
+static uint32_t opens = 0;
+static uint32_t writes = 0;
+static Bool holdWrites = FALSE;
+static Bool txBusy = FALSE;					//! A held write is waiting for FakeBtUart_finishWrite
+static uint16_t txLen = 0;					//! No. of bytes in the held write
+static uint8_t sent[FAKEBTUART_SENT_SIZE];
+static uint32_t sentCount = 0;
+static FakeBtUart_TapFxn tapFxn = NULL;		//! Sees every write, NULL for none
+
+/**
+ * \brief Keeps bytes written, Hwi disabled by the caller
+ */
+static void keep(const uint8_t* data, uint16_t len)
+{
+	uint16_t i;
+	for (i = 0; i < len; i++)
+	{
+		if (sentCount < FAKEBTUART_SENT_SIZE)
+		{
+			sent[sentCount] = data[i];
+		}
+		sentCount++;
+	}
+
+	if (tapFxn != NULL)
+	{
+		tapFxn(data, len, baud);
+	}
+}
+
+void FakeBtUart_reset(void)
+{
+	UInt key = Hwi_disable();
+	memset(&params, 0, sizeof(params));
+	isOpen = FALSE;
+	rtsReady = TRUE;
+	rtsHolds = 0;
+	baud = 0;
+	openFailures = 0;
+	opens = 0;
+	writes = 0;
+	holdWrites = FALSE;
+	txBusy = FALSE;
+	txLen = 0;
+	sentCount = 0;
+	tapFxn = NULL;
+	Hwi_restore(key);
+}
+
+void FakeBtUart_failOpens(uint8_t count)
+{
+	UInt key = Hwi_disable();
+	openFailures = count;
+	Hwi_restore(key);
+}
+
+void FakeBtUart_holdWrites(Bool hold)
+{
+	UInt key = Hwi_disable();
+	holdWrites = hold;
+	Hwi_restore(key);
+}
+
+void FakeBtUart_onWrite(FakeBtUart_TapFxn fxn)
+{
+	UInt key = Hwi_disable();
+	tapFxn = fxn;
+	Hwi_restore(key);
+}
+
+Bool FakeBtUart_finishWrite(void)
+{
+	// the uDMA interrupt calls txDoneFxn
+	UInt key = Hwi_disable();
+	if (!txBusy)
+	{
+		Hwi_restore(key);
+		return FALSE;
+	}
+
+	txBusy = FALSE;
+	params.txDoneFxn(txLen);
+	Hwi_restore(key);
+	return TRUE;
+}
+
+uint16_t FakeBtUart_writing(void)
+{
+	UInt key = Hwi_disable();
+	uint16_t len = txBusy ? txLen : 0;
+	Hwi_restore(key);
+	return len;
+}
+
+Bool FakeBtUart_receive(const uint8_t* data, uint16_t len)
+{
+	UInt key = Hwi_disable();
+	if (!isOpen)
+	{
+		Hwi_restore(key);
+		return FALSE;
+	}
+
+	if (params.scanFxn != NULL)
+	{
+		params.scanFxn(data, len);
+	}
+
+	uint16_t before = ByteRing_count(params.rxRing);
+	ByteRing_write(params.rxRing, data, len);
+	params.rxFxn(before, len);
+	Hwi_restore(key);
+	return TRUE;
+}
+
+uint32_t FakeBtUart_sent(uint8_t* buf)
+{
+	UInt key = Hwi_disable();
+	uint32_t count = sentCount;
+	if (buf != NULL)
+	{
+		memcpy(buf, sent, (count < FAKEBTUART_SENT_SIZE) ? count : FAKEBTUART_SENT_SIZE);
+	}
+	Hwi_restore(key);
+	return count;
+}
+
+Bool FakeBtUart_rtsReady(void)
+{
+	return rtsReady;
+}
+
+uint32_t FakeBtUart_rtsHolds(void)
+{
+	return rtsHolds;
+}
+
+uint32_t FakeBtUart_baud(void)
+{
+	return baud;
+}
+
+uint32_t FakeBtUart_writes(void)
+{
+	return writes;
+}
+
+uint32_t FakeBtUart_opens(void)
+{
+	return opens;
+}
+
+Bool FakeBtUart_isOpen(void)
+{
+	return isOpen;
+}
+
+int8_t BtUart_open(const BtUart_Params* openParams)
+{
+	UInt key = Hwi_disable();
+	if (isOpen)
+	{
+		Hwi_restore(key);
+		return -1;
+	}
+
+	if (openFailures > 0)
+	{
+		openFailures--;
+		Hwi_restore(key);
+		return -2;
+	}
+
+	params = *openParams;
+	baud = params.baud;
+	rtsReady = TRUE;
+	txBusy = FALSE;
+	isOpen = TRUE;
+	opens++;
+	Hwi_restore(key);
+	return 0;
+}
+
+int8_t BtUart_close(void)
+{
+	UInt key = Hwi_disable();
+	if (!isOpen)
+	{
+		Hwi_restore(key);
+		return -1;
+	}
+
+	isOpen = FALSE;
+	txBusy = FALSE;
+	Hwi_restore(key);
+	return 0;
+}
+
+int BtUart_write(const uint8_t* data, uint16_t len)
+{
+	UInt key = Hwi_disable();
+	if (!isOpen)
+	{
+		Hwi_restore(key);
+		return -1;
+	}
+
+	keep(data, len);
+	Hwi_restore(key);
+	return len;
+}
+
+int8_t BtUart_writeSpans(const BtUart_Span* spans, uint8_t count)
+{
+	UInt key = Hwi_disable();
+	if (!isOpen || txBusy)
+	{
+		Hwi_restore(key);
+		return -1;
+	}
+
+	if ((count == 0) || (count > BTUART_MAX_SPANS))
+	{
+		Hwi_restore(key);
+		return -2;
+	}
+
+	uint16_t total = 0;
+	uint8_t i;
+	for (i = 0; i < count; i++)
+	{
+		keep(spans[i].data, spans[i].len);
+		total += spans[i].len;
+	}
+	writes++;
+
+	if (holdWrites)
+	{
+		txBusy = TRUE;
+		txLen = total;
+		Hwi_restore(key);
+		return 0;
+	}
+	Hwi_restore(key);
+
+	// as the UART driver, the buffers are free once the write returns
+	params.txDoneFxn(total);
+	return 0;
+}
+
+int8_t BtUart_setBaud(uint32_t newBaud)
+{
+	UInt key = Hwi_disable();
+	if (!isOpen || txBusy)
+	{
+		Hwi_restore(key);
+		return -1;
+	}
+
+	baud = newBaud;
+	Hwi_restore(key);
+	return 0;
+}
+
+void BtUart_setRts(Bool ready)
+{
+	if (params.flowPins)
+	{
+		rtsHolds += (rtsReady && !ready);
+		rtsReady = ready;
+	}
+}
+
+void BtUart_getStats(BtUart_Stats* stats)
+{
+	stats->hwOverruns = 0;
+	stats->rxBlocks = 0;
+}
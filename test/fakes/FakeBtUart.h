@@ -0,0 +1,118 @@
+/**
+ * \file FakeBtUart.h
+ * \brief Declares test helpers of the host bluetooth UART stand-in
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ *
+ * btStack runs on the stand-in instead of UART1. The test plays the
+ * module: FakeBtUart_receive places bytes in the reception ring with Hwi
+ * disabled, as the UART interrupt would, and every byte written is kept
+ * for the test to decode. Asynchronous writes complete at once, as with
+ * the UART driver, unless the test holds them to play a slow uDMA.
+ */
+
+#ifndef FAKE_BT_UART
+#define FAKE_BT_UART
+
+#include <xdc/std.h>
+#include <stdint.h>
+
+#define FAKEBTUART_SENT_SIZE 16384	//! Most bytes written kept, later ones are counted only
+
+/**
+ * \typedef FakeBtUart_TapFxn
+ * \brief Called with Hwi disabled with the bytes of each write as they are kept
+ *
+ * \param data Bytes written, only valid during the call
+ * \param len No. of bytes
+ * \param baud Rate the UART ran at when they were written
+ */
+typedef void (*FakeBtUart_TapFxn)(const uint8_t* data, uint16_t len, uint32_t baud);
+
+/**
+ * \brief Forgets bytes written, counters and held writes, the UART is left closed
+ */
+void FakeBtUart_reset(void);
+
+/**
+ * \brief Makes the next opens fail
+ *
+ * \param count No. of opens to fail
+ */
+void FakeBtUart_failOpens(uint8_t count);
+
+/**
+ * \brief Holds asynchronous writes until FakeBtUart_finishWrite
+ *
+ * \param hold Flag indicating whether writes are held
+ */
+void FakeBtUart_holdWrites(Bool hold);
+
+/**
+ * \brief Lets the test see writes as they happen, as a module on the wire would
+ *
+ * \param fxn Called with the bytes of every write, NULL to stop
+ */
+void FakeBtUart_onWrite(FakeBtUart_TapFxn fxn);
+
+/**
+ * \brief Completes the held write, calling txDoneFxn with Hwi disabled
+ *
+ * \return Flag indicating whether a write was held
+ */
+Bool FakeBtUart_finishWrite(void);
+
+/**
+ * \brief Returns the no. of bytes in the held write, 0 if none is held
+ */
+uint16_t FakeBtUart_writing(void);
+
+/**
+ * \brief Receives bytes as the UART interrupt would
+ *
+ * \param data Bytes from the module
+ * \param len No. of bytes
+ * \return Flag indicating whether the UART was open to receive them
+ */
+Bool FakeBtUart_receive(const uint8_t* data, uint16_t len);
+
+/**
+ * \brief Copies the bytes written so far
+ *
+ * \param buf Receives up to FAKEBTUART_SENT_SIZE bytes, may be NULL
+ * \return No. of bytes written, including any not kept
+ */
+uint32_t FakeBtUart_sent(uint8_t* buf);
+
+/**
+ * \brief Returns whether RTS tells the module it may send, TRUE without flow control pins
+ */
+Bool FakeBtUart_rtsReady(void);
+
+/**
+ * \brief Returns the no. of times RTS told the module to stop sending
+ */
+uint32_t FakeBtUart_rtsHolds(void);
+
+/**
+ * \brief Returns the baud rate the UART was last opened or set at, 0 if never opened
+ */
+uint32_t FakeBtUart_baud(void);
+
+/**
+ * \brief Returns the no. of asynchronous writes started
+ */
+uint32_t FakeBtUart_writes(void);
+
+/**
+ * \brief Returns the no. of successful opens
+ */
+uint32_t FakeBtUart_opens(void);
+
+/**
+ * \brief Returns whether the UART is open
+ */
+Bool FakeBtUart_isOpen(void);
+
+#endif
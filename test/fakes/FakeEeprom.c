@@ -0,0 +1,59 @@
+/**
+ * \file FakeEeprom.c
+ * \brief Implements the host stand-ins of the TivaWare EEPROM calls
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ */
+
+#include "FakeEeprom.h"
+
+#include <string.h>
+#include <driverlib/eeprom.h>
+
+static uint32_t words[FAKEEEPROM_SIZE / 4] = {[0 ... FAKEEEPROM_SIZE / 4 - 1] = 0xFFFFFFFF};
+static Bool initFails = FALSE;
+static uint32_t programs = 0;
+
+void FakeEeprom_erase(void)
+{
+	memset(words, 0xFF, sizeof(words));
+	initFails = FALSE;
+	programs = 0;
+}
+
+void FakeEeprom_failInit(Bool fail)
+{
+	initFails = fail;
+}
+
+uint32_t FakeEeprom_programs(void)
+{
+	return programs;
+}
+
+uint32_t EEPROMInit(void)
+{
+	return initFails ? EEPROM_INIT_ERROR : EEPROM_INIT_OK;
+}
+
+void EEPROMRead(uint32_t* data, uint32_t address, uint32_t count)
+{
+	// address and count are in bytes, whole words only
+	if ((address % 4) || (count % 4) || (address + count > FAKEEEPROM_SIZE))
+	{
+		return;
+	}
+	memcpy(data, &words[address / 4], count);
+}
+
+uint32_t EEPROMProgram(uint32_t* data, uint32_t address, uint32_t count)
+{
+	if ((address % 4) || (count % 4) || (address + count > FAKEEEPROM_SIZE))
+	{
+		return 1;
+	}
+	memcpy(&words[address / 4], data, count);
+	programs++;
+	return 0;
+}
@@ -0,0 +1,37 @@
+/**
+ * \file FakeEeprom.h
+ * \brief Declares test helpers of the host EEPROM stand-in
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ *
+ * The EEPROM keeps its words across starts of the services under test, as
+ * the real one keeps them across resets, until the test erases it.
+ */
+
+#ifndef FAKE_EEPROM
+#define FAKE_EEPROM
+
+#include <xdc/std.h>
+#include <stdint.h>
+
+#define FAKEEEPROM_SIZE 64			//! No. of bytes of the stand-in, word aligned
+
+/**
+ * \brief Erases every word to 0xFFFFFFFF and forgets counters and scripted faults
+ */
+void FakeEeprom_erase(void);
+
+/**
+ * \brief Makes EEPROMInit report an unusable EEPROM
+ *
+ * \param fail Flag indicating whether EEPROMInit fails
+ */
+void FakeEeprom_failInit(Bool fail);
+
+/**
+ * \brief Returns the no. of successful calls to EEPROMProgram
+ */
+uint32_t FakeEeprom_programs(void);
+
+#endif
@@ -0,0 +1,249 @@
+/**
+ * \file FakeI2C.c
+ * \brief Implements the host stand-ins of the I2C driver and the TivaWare calls the bus recovery uses
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ */
+
+#include "FakeI2C.h"
+
+#include <string.h>
+#include <xdc/runtime/Timestamp.h>
+#include <ti/sysbios/hal/Hwi.h>
+#include <ti/drivers/I2C.h>
+#include <driverlib/gpio.h>
+#include <driverlib/sysctl.h>
+
+#define SCL GPIO_PIN_2			//! SCL of the inter board bus
+#define SDA GPIO_PIN_3			//! SDA of the inter board bus
+
+struct I2C_Config
+{
+	I2C_CallbackFxn callbackFxn;	//! Called when a transfer completes
+	Bool open;						//! Driver is open
+};
+
+static struct I2C_Config config;
+static I2C_Transaction* current = NULL;		//! Transfer on the bus
+static uint8_t openFailures = 0;			//! Opens which still fail
+static uint32_t opens = 0;
+static uint32_t closes = 0;
+static FakeI2C_Transfer transfers[FAKEI2C_LOG_SIZE];
+static uint16_t transferCount = 0;
+static uint8_t sdaPulses = 0;				//! SCL pulses until SDA is released
+static uint8_t pins = SCL | SDA;			//! Levels last written
+
+void FakeI2C_reset(void)
+{
+	UInt key = Hwi_disable();
+	memset(&config, 0, sizeof(config));
+	current = NULL;
+	openFailures = 0;
+	opens = 0;
+	closes = 0;
+	transferCount = 0;
+	sdaPulses = 0;
+	pins = SCL | SDA;
+	Hwi_restore(key);
+}
+
+void FakeI2C_failOpens(uint8_t count)
+{
+	UInt key = Hwi_disable();
+	openFailures = count;
+	Hwi_restore(key);
+}
+
+void FakeI2C_holdSda(uint8_t pulses)
+{
+	UInt key = Hwi_disable();
+	sdaPulses = pulses;
+	Hwi_restore(key);
+}
+
+Bool FakeI2C_busy(void)
+{
+	UInt key = Hwi_disable();
+	Bool busy = (current != NULL);
+	Hwi_restore(key);
+	return busy;
+}
+
+Bool FakeI2C_complete(Bool success, const uint8_t* read)
+{
+	// the driver callback runs in Hwi context
+	UInt key = Hwi_disable();
+	I2C_Transaction* transaction = current;
+	if (transaction == NULL)
+	{
+		Hwi_restore(key);
+		return FALSE;
+	}
+
+	current = NULL;
+	if (success && (read != NULL))
+	{
+		memcpy(transaction->readBuf, read, transaction->readCount);
+	}
+	config.callbackFxn(&config, transaction, success);
+	Hwi_restore(key);
+	return TRUE;
+}
+
+uint16_t FakeI2C_log(FakeI2C_Transfer* log)
+{
+	UInt key = Hwi_disable();
+	uint16_t count = transferCount;
+	if (log != NULL)
+	{
+		memcpy(log, transfers, count * sizeof(FakeI2C_Transfer));
+	}
+	Hwi_restore(key);
+	return count;
+}
+
+void FakeI2C_clearLog(void)
+{
+	UInt key = Hwi_disable();
+	transferCount = 0;
+	Hwi_restore(key);
+}
+
+uint32_t FakeI2C_opens(void)
+{
+	return opens;
+}
+
+uint32_t FakeI2C_closes(void)
+{
+	return closes;
+}
+
+void I2C_Params_init(I2C_Params* params)
+{
+	params->transferMode = I2C_MODE_BLOCKING;
+	params->transferCallbackFxn = NULL;
+	params->bitRate = I2C_100kHz;
+	params->custom = 0;
+}
+
+I2C_Handle I2C_open(UInt index, I2C_Params* params)
+{
+	UInt key = Hwi_disable();
+	if (config.open || (params->transferMode != I2C_MODE_CALLBACK))
+	{
+		Hwi_restore(key);
+		return NULL;
+	}
+
+	if (openFailures > 0)
+	{
+		openFailures--;
+		Hwi_restore(key);
+		return NULL;
+	}
+
+	config.callbackFxn = params->transferCallbackFxn;
+	config.open = TRUE;
+	opens++;
+	Hwi_restore(key);
+	return &config;
+}
+
+void I2C_close(I2C_Handle handle)
+{
+	UInt key = Hwi_disable();
+	handle->open = FALSE;
+	current = NULL;
+	closes++;
+	Hwi_restore(key);
+}
+
+Bool I2C_transfer(I2C_Handle handle, I2C_Transaction* transaction)
+{
+	UInt key = Hwi_disable();
+	if (!handle->open || (current != NULL))
+	{
+		Hwi_restore(key);
+		return FALSE;
+	}
+
+	current = transaction;
+	if (transferCount < FAKEI2C_LOG_SIZE)
+	{
+		FakeI2C_Transfer* t = &transfers[transferCount++];
+		t->address = transaction->slaveAddress;
+		t->tag = (transaction->writeCount > 0) ? ((uint8_t*)transaction->writeBuf)[0] : 0;
+		t->writeCount = transaction->writeCount;
+		t->readCount = transaction->readCount;
+		memcpy(t->write, transaction->writeBuf,
+				(transaction->writeCount < FAKEI2C_MAX_WRITE) ? transaction->writeCount : FAKEI2C_MAX_WRITE);
+		t->stamp = Timestamp_get32();
+	}
+	Hwi_restore(key);
+	return TRUE;
+}
+
+uint32_t SysCtlClockGet(void)
+{
+	return 80000000;
+}
+
+void SysCtlDelay(uint32_t count)
+{
+}
+
+void SysCtlPeripheralEnable(uint32_t peripheral)
+{
+}
+
+void GPIOPinTypeGPIOOutputOD(uint32_t port, uint8_t pinMask)
+{
+}
+
+void GPIOPinTypeI2C(uint32_t port, uint8_t pinMask)
+{
+}
+
+void GPIOPinTypeI2CSCL(uint32_t port, uint8_t pinMask)
+{
+}
+
+void GPIOPinTypeGPIOOutput(uint32_t port, uint8_t pinMask)
+{
+}
+
+void GPIOPinTypeUART(uint32_t port, uint8_t pinMask)
+{
+}
+
+void GPIOPinConfigure(uint32_t pinConfig)
+{
+}
+
+void GPIOPinWrite(uint32_t port, uint8_t pinMask, uint8_t value)
+{
+	UInt key = Hwi_disable();
+	uint8_t old = pins;
+	pins = (pins & ~pinMask) | (value & pinMask);
+
+	// a rising SCL clocks one more bit out of a slave holding SDA
+	if (!(old & SCL) && (pins & SCL) && (sdaPulses > 0) && (sdaPulses != 0xFF))
+	{
+		sdaPulses--;
+	}
+	Hwi_restore(key);
+}
+
+int32_t GPIOPinRead(uint32_t port, uint8_t pinMask)
+{
+	UInt key = Hwi_disable();
+	uint8_t level = pins;
+	if (sdaPulses > 0)
+	{
+		level &= ~SDA;
+	}
+	Hwi_restore(key);
+	return level & pinMask;
+}
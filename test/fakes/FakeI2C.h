@@ -0,0 +1,92 @@
+/**
+ * \file FakeI2C.h
+ * \brief Declares test helpers of the host I2C driver stand-in
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ *
+ * One transfer is on the bus at a time. It stays there until the test
+ * completes it with FakeI2C_complete, which calls the driver callback with
+ * Hwi disabled as the I2C interrupt would. Every transfer started is logged
+ * so the test can check the order the bus was granted in.
+ */
+
+#ifndef FAKE_I2C_HELPERS
+#define FAKE_I2C_HELPERS
+
+#include <xdc/std.h>
+#include <stdint.h>
+
+#define FAKEI2C_LOG_SIZE 1024		//! Most transfers logged
+#define FAKEI2C_MAX_WRITE 16		//! Most bytes written kept in the log
+
+/**
+ * \struct FakeI2C_Transfer
+ * \brief A transfer put on the bus
+ */
+typedef struct
+{
+	uint8_t address;			//! Slave address
+	uint8_t tag;				//! First byte written, 0 if nothing was written
+	uint8_t writeCount;			//! No. of bytes written
+	uint8_t readCount;			//! No. of bytes read
+	uint8_t write[FAKEI2C_MAX_WRITE];	//! Bytes written
+	uint32_t stamp;				//! Timestamp the transfer was put on the bus at
+} FakeI2C_Transfer;
+
+/**
+ * \brief Forgets transfers, counters and scripted faults, the bus is left closed
+ */
+void FakeI2C_reset(void);
+
+/**
+ * \brief Makes the next opens of the driver fail
+ *
+ * \param count No. of opens which fail
+ */
+void FakeI2C_failOpens(uint8_t count);
+
+/**
+ * \brief Holds SDA low until SCL has been pulsed a no. of times
+ *
+ * \param pulses No. of SCL pulses, 0xFF holds it for good
+ */
+void FakeI2C_holdSda(uint8_t pulses);
+
+/**
+ * \brief Returns whether a transfer is on the bus waiting to complete
+ */
+Bool FakeI2C_busy(void);
+
+/**
+ * \brief Completes the transfer on the bus
+ *
+ * \param success Passed to the driver callback
+ * \param read Copied to the read buffer of a successful transfer, may be NULL
+ * \return Returns TRUE if a transfer was on the bus
+ */
+Bool FakeI2C_complete(Bool success, const uint8_t* read);
+
+/**
+ * \brief Returns the no. of transfers logged, and copies them
+ *
+ * \param log Filled with the transfers in the order they were started, may be NULL
+ */
+uint16_t FakeI2C_log(FakeI2C_Transfer* log);
+
+/**
+ * \brief Forgets the transfers logged so far, so a long run does not fill the log
+ */
+void FakeI2C_clearLog(void);
+
+/**
+ * \brief Returns the no. of times the driver was opened
+ */
+uint32_t FakeI2C_opens(void);
+
+/**
+ * \brief Returns the no. of times the driver was closed
+ */
+uint32_t FakeI2C_closes(void);
+
+#endif
@@ -0,0 +1,643 @@
+/**
+ * \file FakeUartDma.c
+ * \brief Implements the host stand-ins of UART1, its uDMA channels and the UART driver
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ */
+
+#include "FakeUartDma.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inc/hw_memmap.h>
+#include <inc/hw_ints.h>
+#include <inc/hw_uart.h>
+#include <driverlib/uart.h>
+#include <driverlib/udma.h>
+#include <ti/sysbios/hal/Hwi.h>
+#include <ti/drivers/UART.h>
+#include "FakeBios.h"
+#include "EK_TM4C123GXL.h"
+
+#define RX_BURST 8					//! Bytes in the FIFO which request a burst, UART_FIFO_RX4_8
+#define MAX_TRANSFER 1024			//! Most items in one uDMA transfer
+#define DR_ADDRESS ((void*) (UART1_BASE + UART_O_DR))
+
+/**
+ * \struct Structure
+ * \brief A reception control structure, primary or alternate
+ */
+typedef struct
+{
+	uint32_t mode;					//! UDMA_MODE_PINGPONG while armed, UDMA_MODE_STOP once filled
+	uint8_t* dst;					//! Start of the block
+	uint32_t size;					//! No. of bytes programmed
+	uint32_t left;					//! No. of bytes still to move
+} Structure;
+
+static Bool uartEnabled = FALSE;
+static uint32_t baud = 0;
+static uint32_t intMask = 0;				//! Interrupts enabled
+static uint32_t intRaw = 0;					//! Interrupts flagged
+static uint32_t dmaRequests = 0;			//! UART_DMA_RX and UART_DMA_TX enabled
+static uint8_t fifo[FAKEUARTDMA_FIFO];
+static uint8_t fifoHead = 0;
+static uint8_t fifoCount = 0;
+
+static Bool rxAssigned = FALSE;
+static Bool rxEnabled = FALSE;
+static uint32_t rxAttr = 0;
+static uint8_t rxAlt = 0;					//! Structure the channel fills next, 1 for alternate
+static Structure rxCtl[2];
+
+static Bool txAssigned = FALSE;
+static Bool txEnabled = FALSE;
+static tDMAControlTable* txTasks = NULL;	//! Task list being walked, in the caller's memory
+static uint32_t txTaskCount = 0;
+static uint32_t txTask = 0;					//! Task being copied
+static uint32_t txDone = 0;					//! Bytes of that task already moved
+
+static Bool held = FALSE;					//! Interrupts wait for release
+static Bool pending = FALSE;				//! An interrupt is waiting to run
+static Bool inIsr = FALSE;					//! The Hwi is running, interrupts it raises wait for it
+static uint32_t interrupts = 0;
+static uint32_t lost = 0;
+static uint32_t faults = 0;
+static uint8_t sent[FAKEUARTDMA_SENT_SIZE];
+static uint32_t sentCount = 0;
+
+/**
+ * \brief Counts and reports a programming fault
+ */
+static void fault(const char* what)
+{
+	fprintf(stderr, "FakeUartDma: %s\n", what);
+	faults++;
+}
+
+/**
+ * \brief Counts a fault unless base is UART1
+ */
+static void checkBase(uint32_t base)
+{
+	if (base != UART1_BASE)
+	{
+		fault("not UART1");
+	}
+}
+
+/**
+ * \brief Flags the UART interrupt and runs its Hwi unless held or already running, Hwi disabled by the caller
+ */
+static void raise(void)
+{
+	pending = TRUE;
+	while (pending && !held && !inIsr)
+	{
+		pending = FALSE;
+		inIsr = TRUE;
+		if (FakeBios_interrupt(INT_UART1))
+		{
+			interrupts++;
+		}
+		inIsr = FALSE;
+	}
+}
+
+/**
+ * \brief Moves bursts from the FIFO while the reception channel asks for them, Hwi disabled by the caller
+ */
+static void rxService(void)
+{
+	while ((dmaRequests & UART_DMA_RX) && rxEnabled && (fifoCount >= RX_BURST))
+	{
+		Structure* s = &rxCtl[rxAlt];
+		if (s->mode != UDMA_MODE_PINGPONG)
+		{
+			rxEnabled = FALSE;
+			break;
+		}
+
+		uint32_t n = (s->left < RX_BURST) ? s->left : RX_BURST;
+		while (n-- > 0)
+		{
+			s->dst[s->size - s->left] = fifo[fifoHead];
+			fifoHead = (fifoHead + 1) % FAKEUARTDMA_FIFO;
+			fifoCount--;
+			s->left--;
+		}
+
+		// a filled block hands over to the other one, a channel with both filled stops
+		if (s->left == 0)
+		{
+			s->mode = UDMA_MODE_STOP;
+			rxAlt ^= 1;
+			if (rxCtl[rxAlt].mode != UDMA_MODE_PINGPONG)
+			{
+				rxEnabled = FALSE;
+			}
+			raise();
+		}
+	}
+}
+
+/**
+ * \brief Puts a byte on the wire
+ */
+static void keep(uint8_t byte)
+{
+	if (sentCount < FAKEUARTDMA_SENT_SIZE)
+	{
+		sent[sentCount] = byte;
+	}
+	sentCount++;
+}
+
+void FakeUartDma_reset(void)
+{
+	UInt key = Hwi_disable();
+	uartEnabled = FALSE;
+	baud = 0;
+	intMask = 0;
+	intRaw = 0;
+	dmaRequests = 0;
+	fifoHead = 0;
+	fifoCount = 0;
+	rxAssigned = FALSE;
+	rxEnabled = FALSE;
+	rxAttr = 0;
+	rxAlt = 0;
+	memset(rxCtl, 0, sizeof(rxCtl));
+	txAssigned = FALSE;
+	txEnabled = FALSE;
+	txTasks = NULL;
+	txTaskCount = 0;
+	held = FALSE;
+	pending = FALSE;
+	interrupts = 0;
+	lost = 0;
+	faults = 0;
+	sentCount = 0;
+	Hwi_restore(key);
+}
+
+void FakeUartDma_receive(const uint8_t* data, uint16_t len)
+{
+	UInt key = Hwi_disable();
+	uint16_t i;
+	for (i = 0; i < len; i++)
+	{
+		if (!uartEnabled)
+		{
+			continue;
+		}
+
+		if (fifoCount == FAKEUARTDMA_FIFO)
+		{
+			lost++;
+			if (!(intRaw & UART_INT_OE))
+			{
+				intRaw |= UART_INT_OE;
+				if (intMask & UART_INT_OE)
+				{
+					raise();
+				}
+			}
+			continue;
+		}
+
+		fifo[(fifoHead + fifoCount) % FAKEUARTDMA_FIFO] = data[i];
+		fifoCount++;
+		rxService();
+	}
+	Hwi_restore(key);
+}
+
+void FakeUartDma_idle(void)
+{
+	UInt key = Hwi_disable();
+	if (uartEnabled && (fifoCount > 0))
+	{
+		intRaw |= UART_INT_RT;
+		if (intMask & UART_INT_RT)
+		{
+			raise();
+		}
+		rxService();
+	}
+	Hwi_restore(key);
+}
+
+uint16_t FakeUartDma_transmit(uint16_t max)
+{
+	UInt key = Hwi_disable();
+	uint16_t moved = 0;
+	while ((moved < max) && txEnabled && (dmaRequests & UART_DMA_TX))
+	{
+		tDMAControlTable* task = &txTasks[txTask];
+		uint32_t control = task->ui32Control;
+		uint32_t count = ((control & UDMA_CHCTL_XFERSIZE_M) >> UDMA_CHCTL_XFERSIZE_S) + 1;
+		uint32_t mode = control & UDMA_MODE_M;
+
+		if (txDone == 0)
+		{
+			uint32_t increments = control & (UDMA_DST_INC_NONE | UDMA_SRC_INC_NONE);
+			if ((task->pvDstEndAddr != DR_ADDRESS) || (increments != (UDMA_DST_INC_NONE | UDMA_SRC_INC_8)) ||
+					((mode != UDMA_MODE_BASIC) && (mode != (UDMA_MODE_PER_SCATTER_GATHER | UDMA_MODE_ALT_SELECT))))
+			{
+				fault("transmission task is not a byte copy to the data register");
+				txEnabled = FALSE;
+				break;
+			}
+		}
+
+		// the end address is the last byte, the uDMA counts back from it
+		const uint8_t* src = (const uint8_t*) task->pvSrcEndAddr - (count - 1);
+		keep(src[txDone]);
+		txDone++;
+		moved++;
+		if (txDone < count)
+		{
+			continue;
+		}
+
+		txDone = 0;
+		if (mode == UDMA_MODE_BASIC)
+		{
+			txEnabled = FALSE;
+			txTasks = NULL;
+			raise();
+			break;
+		}
+
+		txTask++;
+		if (txTask >= txTaskCount)
+		{
+			fault("task list ended without a basic task");
+			txEnabled = FALSE;
+			txTasks = NULL;
+			break;
+		}
+	}
+	Hwi_restore(key);
+	return moved;
+}
+
+uint32_t FakeUartDma_sent(uint8_t* buf)
+{
+	UInt key = Hwi_disable();
+	uint32_t count = sentCount;
+	if (buf != NULL)
+	{
+		memcpy(buf, sent, (count < FAKEUARTDMA_SENT_SIZE) ? count : FAKEUARTDMA_SENT_SIZE);
+	}
+	Hwi_restore(key);
+	return count;
+}
+
+void FakeUartDma_holdInterrupts(Bool hold)
+{
+	UInt key = Hwi_disable();
+	held = hold;
+	if (!held && pending)
+	{
+		raise();
+		rxService();
+	}
+	Hwi_restore(key);
+}
+
+uint32_t FakeUartDma_interrupts(void)
+{
+	return interrupts;
+}
+
+uint32_t FakeUartDma_lost(void)
+{
+	return lost;
+}
+
+uint32_t FakeUartDma_baud(void)
+{
+	return baud;
+}
+
+uint32_t FakeUartDma_faults(void)
+{
+	return faults;
+}
+
+void EK_TM4C123GXL_initDMA(void)
+{
+}
+
+void UARTConfigSetExpClk(uint32_t base, uint32_t clock, uint32_t newBaud, uint32_t config)
+{
+	checkBase(base);
+	UInt key = Hwi_disable();
+	baud = newBaud;
+	Hwi_restore(key);
+}
+
+void UARTFIFOLevelSet(uint32_t base, uint32_t txLevel, uint32_t rxLevel)
+{
+	checkBase(base);
+	if (rxLevel != UART_FIFO_RX4_8)
+	{
+		fault("reception FIFO level other than the burst modelled");
+	}
+}
+
+void UARTFIFOEnable(uint32_t base)
+{
+	checkBase(base);
+}
+
+void UARTEnable(uint32_t base)
+{
+	checkBase(base);
+	UInt key = Hwi_disable();
+	uartEnabled = TRUE;
+	Hwi_restore(key);
+}
+
+void UARTDisable(uint32_t base)
+{
+	checkBase(base);
+	UInt key = Hwi_disable();
+	uartEnabled = FALSE;
+	fifoCount = 0;
+	Hwi_restore(key);
+}
+
+bool UARTBusy(uint32_t base)
+{
+	// bytes leave the FIFO at once on the host
+	checkBase(base);
+	return false;
+}
+
+void UARTFlowControlSet(uint32_t base, uint32_t mode)
+{
+	checkBase(base);
+}
+
+void UARTIntEnable(uint32_t base, uint32_t flags)
+{
+	checkBase(base);
+	UInt key = Hwi_disable();
+	intMask |= flags;
+	Hwi_restore(key);
+}
+
+void UARTIntDisable(uint32_t base, uint32_t flags)
+{
+	checkBase(base);
+	UInt key = Hwi_disable();
+	intMask &= ~flags;
+	Hwi_restore(key);
+}
+
+uint32_t UARTIntStatus(uint32_t base, bool masked)
+{
+	checkBase(base);
+	UInt key = Hwi_disable();
+	uint32_t status = masked ? (intRaw & intMask) : intRaw;
+	Hwi_restore(key);
+	return status;
+}
+
+void UARTIntClear(uint32_t base, uint32_t flags)
+{
+	checkBase(base);
+	UInt key = Hwi_disable();
+	intRaw &= ~flags;
+	Hwi_restore(key);
+}
+
+void UARTDMAEnable(uint32_t base, uint32_t flags)
+{
+	checkBase(base);
+	UInt key = Hwi_disable();
+	dmaRequests |= flags;
+	Hwi_restore(key);
+}
+
+void UARTDMADisable(uint32_t base, uint32_t flags)
+{
+	checkBase(base);
+	UInt key = Hwi_disable();
+	dmaRequests &= ~flags;
+	Hwi_restore(key);
+}
+
+bool UARTCharsAvail(uint32_t base)
+{
+	checkBase(base);
+	return fifoCount > 0;
+}
+
+int32_t UARTCharGetNonBlocking(uint32_t base)
+{
+	checkBase(base);
+	UInt key = Hwi_disable();
+	int32_t byte = -1;
+	if (fifoCount > 0)
+	{
+		byte = fifo[fifoHead];
+		fifoHead = (fifoHead + 1) % FAKEUARTDMA_FIFO;
+		fifoCount--;
+	}
+	Hwi_restore(key);
+	return byte;
+}
+
+void UARTCharPut(uint32_t base, unsigned char data)
+{
+	checkBase(base);
+	UInt key = Hwi_disable();
+	if (txEnabled)
+	{
+		fault("byte written while the transmission channel runs");
+	}
+	keep(data);
+	Hwi_restore(key);
+}
+
+void uDMAChannelAssign(uint32_t mapping)
+{
+	UInt key = Hwi_disable();
+	if (mapping == UDMA_CH22_UART1RX)
+	{
+		rxAssigned = TRUE;
+	}
+	else if (mapping == UDMA_CH23_UART1TX)
+	{
+		txAssigned = TRUE;
+	}
+	else
+	{
+		fault("channel other than UART1 assigned");
+	}
+	Hwi_restore(key);
+}
+
+void uDMAChannelAttributeEnable(uint32_t channel, uint32_t attr)
+{
+	UInt key = Hwi_disable();
+	if ((channel & 0x1F) == UDMA_CHANNEL_UART1RX)
+	{
+		rxAttr |= attr;
+		rxAlt = (attr & UDMA_ATTR_ALTSELECT) ? 1 : rxAlt;
+	}
+	Hwi_restore(key);
+}
+
+void uDMAChannelAttributeDisable(uint32_t channel, uint32_t attr)
+{
+	UInt key = Hwi_disable();
+	if ((channel & 0x1F) == UDMA_CHANNEL_UART1RX)
+	{
+		rxAttr &= ~attr;
+		rxAlt = (attr & UDMA_ATTR_ALTSELECT) ? 0 : rxAlt;
+	}
+	Hwi_restore(key);
+}
+
+void uDMAChannelControlSet(uint32_t channel, uint32_t control)
+{
+	if ((channel & 0x1F) == UDMA_CHANNEL_UART1RX)
+	{
+		uint32_t increments = control & (UDMA_DST_INC_NONE | UDMA_SRC_INC_NONE);
+		if (increments != (UDMA_DST_INC_8 | UDMA_SRC_INC_NONE))
+		{
+			fault("reception does not copy bytes from the data register to a block");
+		}
+	}
+}
+
+void uDMAChannelTransferSet(uint32_t channel, uint32_t mode, void* src, void* dst, uint32_t size)
+{
+	UInt key = Hwi_disable();
+	if (((channel & 0x1F) != UDMA_CHANNEL_UART1RX) || (mode != UDMA_MODE_PINGPONG) || (src != DR_ADDRESS) ||
+			(size == 0) || (size > MAX_TRANSFER) || (size % RX_BURST))
+	{
+		fault("reception block is not a ping-pong transfer from the data register");
+		Hwi_restore(key);
+		return;
+	}
+
+	Structure* s = &rxCtl[(channel & UDMA_ALT_SELECT) ? 1 : 0];
+	s->mode = mode;
+	s->dst = dst;
+	s->size = size;
+	s->left = size;
+	Hwi_restore(key);
+}
+
+void uDMAChannelScatterGatherSet(uint32_t channel, uint32_t taskCount, void* taskList, uint32_t isPeriph)
+{
+	UInt key = Hwi_disable();
+	if (((channel & 0x1F) != UDMA_CHANNEL_UART1TX) || txEnabled || (taskCount == 0) || !isPeriph)
+	{
+		fault("transmission task list set on a busy or wrong channel");
+		Hwi_restore(key);
+		return;
+	}
+
+	txTasks = taskList;
+	txTaskCount = taskCount;
+	txTask = 0;
+	txDone = 0;
+	Hwi_restore(key);
+}
+
+void uDMAChannelEnable(uint32_t channel)
+{
+	UInt key = Hwi_disable();
+	if ((channel & 0x1F) == UDMA_CHANNEL_UART1RX)
+	{
+		if (!rxAssigned || !(rxAttr & UDMA_ATTR_USEBURST))
+		{
+			fault("reception channel enabled unassigned or without bursts");
+		}
+		rxEnabled = TRUE;
+	}
+	else if ((channel & 0x1F) == UDMA_CHANNEL_UART1TX)
+	{
+		if (!txAssigned || (txTasks == NULL))
+		{
+			fault("transmission channel enabled unassigned or without a task list");
+		}
+		else
+		{
+			txEnabled = TRUE;
+		}
+	}
+	Hwi_restore(key);
+}
+
+void uDMAChannelDisable(uint32_t channel)
+{
+	UInt key = Hwi_disable();
+	if ((channel & 0x1F) == UDMA_CHANNEL_UART1RX)
+	{
+		rxEnabled = FALSE;
+	}
+	else if ((channel & 0x1F) == UDMA_CHANNEL_UART1TX)
+	{
+		txEnabled = FALSE;
+		txTasks = NULL;
+	}
+	Hwi_restore(key);
+}
+
+bool uDMAChannelIsEnabled(uint32_t channel)
+{
+	return ((channel & 0x1F) == UDMA_CHANNEL_UART1RX) ? rxEnabled : txEnabled;
+}
+
+uint32_t uDMAChannelModeGet(uint32_t channel)
+{
+	if ((channel & 0x1F) == UDMA_CHANNEL_UART1RX)
+	{
+		return rxCtl[(channel & UDMA_ALT_SELECT) ? 1 : 0].mode;
+	}
+	return txEnabled ? UDMA_MODE_PER_SCATTER_GATHER : UDMA_MODE_STOP;
+}
+
+uint32_t uDMAChannelSizeGet(uint32_t channel)
+{
+	if ((channel & 0x1F) != UDMA_CHANNEL_UART1RX)
+	{
+		return 0;
+	}
+
+	Structure* s = &rxCtl[(channel & UDMA_ALT_SELECT) ? 1 : 0];
+	return (s->mode == UDMA_MODE_STOP) ? 0 : s->left;
+}
+
+void UART_Params_init(UART_Params* params)
+{
+	memset(params, 0, sizeof(*params));
+}
+
+UART_Handle UART_open(unsigned int index, UART_Params* params)
+{
+	return NULL;
+}
+
+void UART_close(UART_Handle handle)
+{
+}
+
+int UART_read(UART_Handle handle, void* buf, size_t size)
+{
+	return -1;
+}
+
+int UART_write(UART_Handle handle, const void* buf, size_t size)
+{
+	return -1;
+}
@@ -0,0 +1,92 @@
+/**
+ * \file FakeUartDma.h
+ * \brief Declares test helpers of the host UART1 and uDMA stand-in
+ * \author George Xian
+ * \version 0.1
+ * \date 2015-02-09
+ *
+ * BtUart runs in uDMA mode on a model of UART1 and its two uDMA channels.
+ * Bytes the test receives fill the 16 byte FIFO, and the reception channel
+ * moves them to its ping-pong blocks 8 at a time, as the burst level asks.
+ * A filled block stops its control structure and raises the UART interrupt.
+ * Bytes below the burst level wait for FakeUartDma_idle, which plays the
+ * receive timeout. A full FIFO drops bytes and flags an overrun.
+ *
+ * The transmission channel walks the scatter-gather task list in memory,
+ * one byte per FIFO slot the test frees with FakeUartDma_transmit, and raises
+ * the interrupt after the last task. Programming the uDMA other than the
+ * hardware expects is counted as a fault. Interrupts run the Hwi BtUart
+ * created, with Hwi disabled, in the thread which caused them.
+ */
+
+#ifndef FAKE_UART_DMA
+#define FAKE_UART_DMA
+
+#include <xdc/std.h>
+#include <stdint.h>
+
+#define FAKEUARTDMA_FIFO 16				//! Depth of the reception FIFO
+#define FAKEUARTDMA_SENT_SIZE 16384		//! Most bytes transmitted kept, later ones are counted only
+
+/**
+ * \brief Forgets bytes, counters and faults, UART1 is left disabled and both channels idle
+ */
+void FakeUartDma_reset(void);
+
+/**
+ * \brief Bytes arrive on the wire, dropped while UART1 is disabled
+ *
+ * \param data Bytes from the module
+ * \param len No. of bytes
+ */
+void FakeUartDma_receive(const uint8_t* data, uint16_t len);
+
+/**
+ * \brief The wire stays idle long enough for the receive timeout, if bytes wait in the FIFO
+ */
+void FakeUartDma_idle(void);
+
+/**
+ * \brief Lets the transmission channel move bytes to the wire
+ *
+ * \param max Most bytes moved
+ * \return No. of bytes moved
+ */
+uint16_t FakeUartDma_transmit(uint16_t max);
+
+/**
+ * \brief Copies the bytes transmitted so far
+ *
+ * \param buf Receives up to FAKEUARTDMA_SENT_SIZE bytes, may be NULL
+ * \return No. of bytes transmitted, including any not kept
+ */
+uint32_t FakeUartDma_sent(uint8_t* buf);
+
+/**
+ * \brief Keeps interrupts pending, as a long section with interrupts disabled would
+ *
+ * \param hold Flag indicating whether interrupts are held, a pending one runs on release
+ */
+void FakeUartDma_holdInterrupts(Bool hold);
+
+/**
+ * \brief Returns the no. of times the UART interrupt ran its Hwi
+ */
+uint32_t FakeUartDma_interrupts(void);
+
+/**
+ * \brief Returns the no. of bytes lost to a full FIFO
+ */
+uint32_t FakeUartDma_lost(void);
+
+/**
+ * \brief Returns the baud rate UART1 was last configured at
+ */
+uint32_t FakeUartDma_baud(void);
+
+/**
+ * \brief Returns the no. of times UART1 or the uDMA was programmed other than the hardware expects
+ */
+uint32_t FakeUartDma_faults(void);
+
+#endif
@@ -0,0 +1,20 @@
+/**
+ * \file eeprom.h
+ * \brief Host stand-in for the TivaWare EEPROM calls
+ *
+ * The EEPROM is an array of words in memory, see FakeEeprom.h.
+ */
+
+#ifndef FAKE_DRIVERLIB_EEPROM
+#define FAKE_DRIVERLIB_EEPROM
+
+#include <stdint.h>
+
+#define EEPROM_INIT_OK 0			//! EEPROMInit found the EEPROM usable
+#define EEPROM_INIT_ERROR 2			//! EEPROMInit found the EEPROM unusable
+
+uint32_t EEPROMInit(void);
+void EEPROMRead(uint32_t* data, uint32_t address, uint32_t count);
+uint32_t EEPROMProgram(uint32_t* data, uint32_t address, uint32_t count);
+
+#endif
@@ -0,0 +1,28 @@
+/**
+ * \file gpio.h
+ * \brief Host stand-in for the TivaWare GPIO calls
+ *
+ * Pins read back what was last written to them, except pins the test holds
+ * low with FakeI2C_holdSda.
+ */
+
+#ifndef FAKE_DRIVERLIB_GPIO
+#define FAKE_DRIVERLIB_GPIO
+
+#include <stdint.h>
+
+#define GPIO_PIN_2 0x00000004
+#define GPIO_PIN_3 0x00000008
+#define GPIO_PIN_4 0x00000010
+#define GPIO_PIN_5 0x00000020
+
+void GPIOPinTypeGPIOOutputOD(uint32_t port, uint8_t pins);
+void GPIOPinTypeI2C(uint32_t port, uint8_t pins);
+void GPIOPinTypeI2CSCL(uint32_t port, uint8_t pins);
+void GPIOPinTypeGPIOOutput(uint32_t port, uint8_t pins);
+void GPIOPinTypeUART(uint32_t port, uint8_t pins);
+void GPIOPinConfigure(uint32_t config);
+void GPIOPinWrite(uint32_t port, uint8_t pins, uint8_t value);
+int32_t GPIOPinRead(uint32_t port, uint8_t pins);
+
+#endif
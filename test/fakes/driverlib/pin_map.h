@@ -0,0 +1,13 @@
+/**
+ * \file pin_map.h
+ * \brief Host stand-in for the TivaWare pin mux values
+ */
+
+#ifndef FAKE_PIN_MAP
+#define FAKE_PIN_MAP
+
+#define GPIO_PB2_I2C0SCL 0x00010803
+#define GPIO_PB3_I2C0SDA 0x00010C03
+#define GPIO_PC5_U1CTS 0x00021408
+
+#endif
@@ -0,0 +1,18 @@
+/**
+ * \file sysctl.h
+ * \brief Host stand-in for the TivaWare system control calls
+ */
+
+#ifndef FAKE_SYSCTL
+#define FAKE_SYSCTL
+
+#include <stdint.h>
+
+#define SYSCTL_PERIPH_EEPROM0 0xF0005800	//! EEPROM module, as TivaWare
+#define SYSCTL_PERIPH_GPIOC 0xF0000802		//! GPIO port C, as TivaWare
+
+uint32_t SysCtlClockGet(void);
+void SysCtlDelay(uint32_t count);
+void SysCtlPeripheralEnable(uint32_t peripheral);
+
+#endif
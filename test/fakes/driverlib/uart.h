@@ -0,0 +1,47 @@
+/**
+ * \file uart.h
+ * \brief Host stand-in for the TivaWare UART calls
+ *
+ * Only UART1 exists, see FakeUartDma.h. Values are those of TivaWare.
+ */
+
+#ifndef FAKE_DRIVERLIB_UART
+#define FAKE_DRIVERLIB_UART
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define UART_INT_OE 0x400			//! Overrun error
+#define UART_INT_RT 0x040			//! Receive timeout
+
+#define UART_DMA_RX 0x00000001		//! Reception requests the uDMA
+#define UART_DMA_TX 0x00000002		//! Transmission requests the uDMA
+
+#define UART_FLOWCONTROL_NONE 0x00000000
+#define UART_FLOWCONTROL_TX 0x00008000	//! CTS holds transmission
+
+#define UART_CONFIG_WLEN_8 0x00000060
+#define UART_CONFIG_STOP_ONE 0x00000000
+#define UART_CONFIG_PAR_NONE 0x00000000
+
+#define UART_FIFO_TX4_8 0x00000002
+#define UART_FIFO_RX4_8 0x00000010	//! Reception requests a burst at 8 of 16 bytes
+
+void UARTConfigSetExpClk(uint32_t base, uint32_t clock, uint32_t baud, uint32_t config);
+void UARTFIFOLevelSet(uint32_t base, uint32_t txLevel, uint32_t rxLevel);
+void UARTFIFOEnable(uint32_t base);
+void UARTEnable(uint32_t base);
+void UARTDisable(uint32_t base);
+bool UARTBusy(uint32_t base);
+void UARTFlowControlSet(uint32_t base, uint32_t mode);
+void UARTIntEnable(uint32_t base, uint32_t flags);
+void UARTIntDisable(uint32_t base, uint32_t flags);
+uint32_t UARTIntStatus(uint32_t base, bool masked);
+void UARTIntClear(uint32_t base, uint32_t flags);
+void UARTDMAEnable(uint32_t base, uint32_t flags);
+void UARTDMADisable(uint32_t base, uint32_t flags);
+bool UARTCharsAvail(uint32_t base);
+int32_t UARTCharGetNonBlocking(uint32_t base);
+void UARTCharPut(uint32_t base, unsigned char data);
+
+#endif
@@ -0,0 +1,88 @@
+/**
+ * \file udma.h
+ * \brief Host stand-in for the TivaWare uDMA calls
+ *
+ * Only the UART1 channels exist, see FakeUartDma.h. Values, the control
+ * table entry and uDMATaskStructEntry are those of TivaWare, so the stand-in
+ * reads a task list as the uDMA would.
+ */
+
+#ifndef FAKE_DRIVERLIB_UDMA
+#define FAKE_DRIVERLIB_UDMA
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * \struct tDMAControlTable
+ * \brief A channel control structure, or a scatter-gather task
+ */
+typedef struct
+{
+	volatile void* pvSrcEndAddr;	//! Last source address
+	volatile void* pvDstEndAddr;	//! Last destination address
+	volatile uint32_t ui32Control;	//! Sizes, increments, transfer count - 1 and mode
+	volatile uint32_t ui32Spare;
+} tDMAControlTable;
+
+#define UDMA_CHANNEL_UART1RX 22
+#define UDMA_CHANNEL_UART1TX 23
+#define UDMA_CH22_UART1RX 0x00000016
+#define UDMA_CH23_UART1TX 0x00000017
+
+#define UDMA_PRI_SELECT 0x00000000
+#define UDMA_ALT_SELECT 0x00000020
+
+#define UDMA_ATTR_USEBURST 0x00000001
+#define UDMA_ATTR_ALTSELECT 0x00000002
+#define UDMA_ATTR_HIGH_PRIORITY 0x00000004
+#define UDMA_ATTR_REQMASK 0x00000008
+#define UDMA_ATTR_ALL 0x0000000F
+
+#define UDMA_MODE_STOP 0x00000000
+#define UDMA_MODE_BASIC 0x00000001
+#define UDMA_MODE_AUTO 0x00000002
+#define UDMA_MODE_PINGPONG 0x00000003
+#define UDMA_MODE_MEM_SCATTER_GATHER 0x00000004
+#define UDMA_MODE_PER_SCATTER_GATHER 0x00000006
+#define UDMA_MODE_ALT_SELECT 0x00000001
+#define UDMA_MODE_M 0x00000007
+
+#define UDMA_DST_INC_8 0x00000000
+#define UDMA_DST_INC_NONE 0xC0000000
+#define UDMA_SRC_INC_8 0x00000000
+#define UDMA_SRC_INC_NONE 0x0C000000
+#define UDMA_SIZE_8 0x00000000
+#define UDMA_ARB_4 0x00008000
+#define UDMA_ARB_8 0x0000C000
+
+#define UDMA_CHCTL_XFERSIZE_M 0x00003FF0
+#define UDMA_CHCTL_XFERSIZE_S 4
+
+/**
+ * \brief Initialiser of a scatter-gather task, from the start addresses of the transfer
+ */
+#define uDMATaskStructEntry(count, itemSize, srcIncrement, srcAddr, dstIncrement, dstAddr, arbSize, mode) \
+	{ \
+		(((srcIncrement) == UDMA_SRC_INC_NONE) ? (void*)(srcAddr) : \
+				((void*)(&((uint8_t*)(srcAddr))[((count) << ((srcIncrement) >> 26)) - 1]))), \
+		(((dstIncrement) == UDMA_DST_INC_NONE) ? (void*)(dstAddr) : \
+				((void*)(&((uint8_t*)(dstAddr))[((count) << ((dstIncrement) >> 30)) - 1]))), \
+		(srcIncrement) | (dstIncrement) | (itemSize) | (arbSize) | (((count) - 1) << 4) | \
+				((((mode) == UDMA_MODE_MEM_SCATTER_GATHER) || ((mode) == UDMA_MODE_PER_SCATTER_GATHER)) ? \
+				(mode) | UDMA_MODE_ALT_SELECT : (mode)), 0 \
+	}
+
+void uDMAChannelAssign(uint32_t mapping);
+void uDMAChannelAttributeEnable(uint32_t channel, uint32_t attr);
+void uDMAChannelAttributeDisable(uint32_t channel, uint32_t attr);
+void uDMAChannelControlSet(uint32_t channel, uint32_t control);
+void uDMAChannelTransferSet(uint32_t channel, uint32_t mode, void* src, void* dst, uint32_t size);
+void uDMAChannelScatterGatherSet(uint32_t channel, uint32_t taskCount, void* taskList, uint32_t isPeriph);
+void uDMAChannelEnable(uint32_t channel);
+void uDMAChannelDisable(uint32_t channel);
+bool uDMAChannelIsEnabled(uint32_t channel);
+uint32_t uDMAChannelModeGet(uint32_t channel);
+uint32_t uDMAChannelSizeGet(uint32_t channel);
+
+#endif
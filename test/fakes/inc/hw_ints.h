@@ -0,0 +1,11 @@
+/**
+ * \file hw_ints.h
+ * \brief Host stand-in for the TivaWare interrupt numbers
+ */
+
+#ifndef FAKE_HW_INTS
+#define FAKE_HW_INTS
+
+#define INT_UART1 22
+
+#endif
@@ -0,0 +1,13 @@
+/**
+ * \file hw_memmap.h
+ * \brief Host stand-in for the TivaWare peripheral base addresses
+ */
+
+#ifndef FAKE_HW_MEMMAP
+#define FAKE_HW_MEMMAP
+
+#define GPIO_PORTB_BASE 0x40005000
+#define GPIO_PORTC_BASE 0x40006000
+#define UART1_BASE 0x4000D000UL		//! Unsigned long so register addresses cast to host pointers
+
+#endif
@@ -0,0 +1,9 @@
+/**
+ * \file hw_types.h
+ * \brief Host stand-in for the TivaWare register access macros, nothing on the host touches registers
+ */
+
+#ifndef FAKE_HW_TYPES
+#define FAKE_HW_TYPES
+
+#endif
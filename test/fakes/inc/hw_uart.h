@@ -0,0 +1,11 @@
+/**
+ * \file hw_uart.h
+ * \brief Host stand-in for the TivaWare UART register offsets
+ */
+
+#ifndef FAKE_HW_UART
+#define FAKE_HW_UART
+
+#define UART_O_DR 0x00000000		//! Data register, the uDMA moves bytes through it
+
+#endif
@@ -0,0 +1,22 @@
+/**
+ * \file GPIO.h
+ * \brief Host stand-in for ti/drivers/GPIO.h
+ *
+ * Only the types the board header names.
+ */
+
+#ifndef FAKE_GPIO
+#define FAKE_GPIO
+
+#include <xdc/std.h>
+
+typedef void (*GPIO_CallbackFxn)(void);
+
+typedef struct
+{
+	UInt32 port;
+	UInt32 intNum;
+	GPIO_CallbackFxn* callbackFxn;
+} GPIO_Callbacks;
+
+#endif
@@ -0,0 +1,54 @@
+/**
+ * \file I2C.h
+ * \brief Host stand-in for ti/drivers/I2C.h
+ *
+ * Transfers in callback mode wait until the test completes them with
+ * FakeI2C_complete, see FakeI2C.h.
+ */
+
+#ifndef FAKE_I2C
+#define FAKE_I2C
+
+#include <xdc/std.h>
+
+typedef struct I2C_Config* I2C_Handle;
+
+typedef struct
+{
+	Void* writeBuf;
+	size_t writeCount;
+	Void* readBuf;
+	size_t readCount;
+	UChar slaveAddress;
+	UArg arg;
+	Void* nextPtr;
+} I2C_Transaction;
+
+typedef void (*I2C_CallbackFxn)(I2C_Handle handle, I2C_Transaction* transaction, Bool success);
+
+typedef enum
+{
+	I2C_MODE_BLOCKING,
+	I2C_MODE_CALLBACK
+} I2C_TransferMode;
+
+typedef enum
+{
+	I2C_100kHz,
+	I2C_400kHz
+} I2C_BitRate;
+
+typedef struct
+{
+	I2C_TransferMode transferMode;
+	I2C_CallbackFxn transferCallbackFxn;
+	I2C_BitRate bitRate;
+	UArg custom;
+} I2C_Params;
+
+void I2C_Params_init(I2C_Params* params);
+I2C_Handle I2C_open(UInt index, I2C_Params* params);
+void I2C_close(I2C_Handle handle);
+Bool I2C_transfer(I2C_Handle handle, I2C_Transaction* transaction);
+
+#endif
@@ -0,0 +1,62 @@
+/**
+ * \file UART.h
+ * \brief Host stand-in for ti/drivers/UART.h
+ *
+ * The host has no UART driver, UART_open always fails. BtUart runs on the
+ * host in uDMA mode only, see FakeUartDma.h.
+ */
+
+#ifndef FAKE_UART
+#define FAKE_UART
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct UART_Config* UART_Handle;
+
+typedef void (*UART_Callback)(UART_Handle handle, void* buf, int count);
+
+typedef enum
+{
+	UART_MODE_BLOCKING,
+	UART_MODE_CALLBACK
+} UART_Mode;
+
+typedef enum
+{
+	UART_DATA_BINARY,
+	UART_DATA_TEXT
+} UART_DataMode;
+
+typedef enum
+{
+	UART_RETURN_FULL,
+	UART_RETURN_NEWLINE
+} UART_ReturnMode;
+
+typedef enum
+{
+	UART_ECHO_OFF,
+	UART_ECHO_ON
+} UART_Echo;
+
+typedef struct
+{
+	UART_Mode readMode;
+	UART_Mode writeMode;
+	UART_Callback readCallback;
+	UART_Callback writeCallback;
+	UART_ReturnMode readReturnMode;
+	UART_DataMode readDataMode;
+	UART_DataMode writeDataMode;
+	UART_Echo readEcho;
+	uint32_t baudRate;
+} UART_Params;
+
+void UART_Params_init(UART_Params* params);
+UART_Handle UART_open(unsigned int index, UART_Params* params);
+void UART_close(UART_Handle handle);
+int UART_read(UART_Handle handle, void* buf, size_t size);
+int UART_write(UART_Handle handle, const void* buf, size_t size);
+
+#endif
@@ -0,0 +1,14 @@
+/**
+ * \file BIOS.h
+ * \brief Host stand-in for ti.sysbios.BIOS
+ */
+
+#ifndef FAKE_BIOS
+#define FAKE_BIOS
+
+#include <xdc/std.h>
+
+#define BIOS_WAIT_FOREVER (~(UInt)0)
+#define BIOS_NO_WAIT ((UInt)0)
+
+#endif
@@ -0,0 +1,32 @@
+/**
+ * \file Hwi.h
+ * \brief Host stand-in for ti.sysbios.hal.Hwi
+ *
+ * Disabling interrupts takes one recursive lock shared with Clock
+ * functions, so a section under Hwi_disable excludes them and other tasks.
+ * Created Hwis run when a peripheral stand-in calls FakeBios_interrupt.
+ */
+
+#ifndef FAKE_HWI
+#define FAKE_HWI
+
+#include <xdc/std.h>
+#include <xdc/runtime/Error.h>
+
+typedef void (*Hwi_FuncPtr)(UArg arg);
+
+typedef struct
+{
+	UArg arg;
+	Int priority;
+} Hwi_Params;
+
+typedef struct Hwi_Object* Hwi_Handle;
+
+void Hwi_Params_init(Hwi_Params* params);
+Hwi_Handle Hwi_create(Int intNum, Hwi_FuncPtr fxn, const Hwi_Params* params, Error_Block* eb);
+void Hwi_delete(Hwi_Handle* handle);
+UInt Hwi_disable(void);
+void Hwi_restore(UInt key);
+
+#endif
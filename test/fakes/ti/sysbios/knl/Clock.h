@@ -0,0 +1,45 @@
+/**
+ * \file Clock.h
+ * \brief Host stand-in for ti.sysbios.knl.Clock
+ *
+ * A thread ticks every Clock_tickPeriod microseconds of real time and runs
+ * due Clock functions with Hwi disabled.
+ */
+
+#ifndef FAKE_CLOCK
+#define FAKE_CLOCK
+
+#include <xdc/std.h>
+#include <xdc/runtime/Error.h>
+
+typedef void (*Clock_FuncPtr)(UArg arg);
+
+typedef struct
+{
+	const char* name;
+} Clock_Instance;
+
+typedef struct
+{
+	Clock_Instance* instance;
+	Clock_Instance instanceStorage;
+	UInt period;
+	Bool startFlag;
+	UArg arg;
+} Clock_Params;
+
+typedef struct Clock_Object* Clock_Handle;
+
+extern const UInt32 Clock_tickPeriod;
+
+void Clock_Params_init(Clock_Params* params);
+Clock_Handle Clock_create(Clock_FuncPtr fxn, UInt timeout, const Clock_Params* params, Error_Block* eb);
+void Clock_delete(Clock_Handle* handle);
+void Clock_start(Clock_Handle handle);
+void Clock_stop(Clock_Handle handle);
+void Clock_setTimeout(Clock_Handle handle, UInt timeout);
+void Clock_setPeriod(Clock_Handle handle, UInt period);
+Bool Clock_isActive(Clock_Handle handle);
+UInt32 Clock_getTicks(void);
+
+#endif
@@ -0,0 +1,49 @@
+/**
+ * \file Semaphore.h
+ * \brief Host stand-in for ti.sysbios.knl.Semaphore
+ */
+
+#ifndef FAKE_SEMAPHORE
+#define FAKE_SEMAPHORE
+
+#include <xdc/std.h>
+#include <xdc/runtime/Error.h>
+
+typedef enum
+{
+	Semaphore_Mode_COUNTING,
+	Semaphore_Mode_BINARY
+} Semaphore_Mode;
+
+typedef struct
+{
+	const char* name;
+} Semaphore_Instance;
+
+typedef struct
+{
+	Semaphore_Instance* instance;
+	Semaphore_Instance instanceStorage;
+	Semaphore_Mode mode;
+} Semaphore_Params;
+
+typedef struct Semaphore_Object
+{
+	Int count;
+	Semaphore_Mode mode;
+} Semaphore_Struct;
+
+typedef struct Semaphore_Object* Semaphore_Handle;
+
+void Semaphore_Params_init(Semaphore_Params* params);
+Semaphore_Handle Semaphore_create(Int count, const Semaphore_Params* params, Error_Block* eb);
+void Semaphore_delete(Semaphore_Handle* handle);
+void Semaphore_construct(Semaphore_Struct* obj, Int count, const Semaphore_Params* params);
+void Semaphore_destruct(Semaphore_Struct* obj);
+Semaphore_Handle Semaphore_handle(Semaphore_Struct* obj);
+Bool Semaphore_pend(Semaphore_Handle handle, UInt timeout);
+void Semaphore_post(Semaphore_Handle handle);
+Int Semaphore_getCount(Semaphore_Handle handle);
+void Semaphore_reset(Semaphore_Handle handle, Int count);
+
+#endif
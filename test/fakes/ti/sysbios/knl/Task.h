@@ -0,0 +1,42 @@
+/**
+ * \file Task.h
+ * \brief Host stand-in for ti.sysbios.knl.Task, each task is a thread
+ *
+ * Priorities are not honoured, tasks run concurrently.
+ */
+
+#ifndef FAKE_TASK
+#define FAKE_TASK
+
+#include <xdc/std.h>
+#include <xdc/runtime/Error.h>
+
+typedef void (*Task_FuncPtr)(UArg arg0, UArg arg1);
+
+typedef struct
+{
+	const char* name;
+} Task_Instance;
+
+typedef struct
+{
+	Task_Instance* instance;
+	Task_Instance instanceStorage;
+	Int priority;
+	size_t stackSize;
+	UArg arg0;
+	UArg arg1;
+} Task_Params;
+
+typedef struct Task_Object* Task_Handle;
+
+void Task_Params_init(Task_Params* params);
+Task_Handle Task_create(Task_FuncPtr fxn, const Task_Params* params, Error_Block* eb);
+void Task_delete(Task_Handle* handle);
+Task_Handle Task_self(void);
+void Task_sleep(UInt ticks);
+void Task_yield(void);
+UInt Task_disable(void);
+void Task_restore(UInt key);
+
+#endif
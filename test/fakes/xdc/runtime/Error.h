@@ -0,0 +1,19 @@
+/**
+ * \file Error.h
+ * \brief Host stand-in for xdc.runtime.Error, creation failures are never raised
+ */
+
+#ifndef FAKE_XDC_ERROR
+#define FAKE_XDC_ERROR
+
+#include <xdc/std.h>
+
+typedef struct
+{
+	Bool raised;
+} Error_Block;
+
+void Error_init(Error_Block* eb);
+Bool Error_check(Error_Block* eb);
+
+#endif
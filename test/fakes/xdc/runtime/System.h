@@ -0,0 +1,14 @@
+/**
+ * \file System.h
+ * \brief Host stand-in for xdc.runtime.System, prints to stdout
+ */
+
+#ifndef FAKE_XDC_SYSTEM
+#define FAKE_XDC_SYSTEM
+
+#include <xdc/std.h>
+
+Int System_printf(const char* format, ...);
+void System_flush(void);
+
+#endif
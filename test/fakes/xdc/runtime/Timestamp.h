@@ -0,0 +1,15 @@
+/**
+ * \file Timestamp.h
+ * \brief Host stand-in for xdc.runtime.Timestamp, counts microseconds of the monotonic clock
+ */
+
+#ifndef FAKE_XDC_TIMESTAMP
+#define FAKE_XDC_TIMESTAMP
+
+#include <xdc/std.h>
+#include <xdc/runtime/Types.h>
+
+UInt32 Timestamp_get32(void);
+void Timestamp_getFreq(Types_FreqHz* freq);
+
+#endif
@@ -0,0 +1,17 @@
+/**
+ * \file Types.h
+ * \brief Host stand-in for xdc.runtime.Types
+ */
+
+#ifndef FAKE_XDC_TYPES
+#define FAKE_XDC_TYPES
+
+#include <xdc/std.h>
+
+typedef struct
+{
+	Int32 hi;
+	UInt32 lo;
+} Types_FreqHz;
+
+#endif
@@ -0,0 +1,32 @@
+/**
+ * \file std.h
+ * \brief Host stand-in for the XDC base types
+ */
+
+#ifndef FAKE_XDC_STD
+#define FAKE_XDC_STD
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef int Bool;
+typedef int Int;
+typedef unsigned int UInt;
+typedef char Char;
+typedef unsigned char UChar;
+typedef unsigned long ULong;
+typedef int32_t Int32;
+typedef uint32_t UInt32;
+typedef uintptr_t UArg;
+
+#define Void void
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#endif